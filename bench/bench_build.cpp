@@ -0,0 +1,94 @@
+// Compara las construcciones STR y Hilbert de RTreeIndex.
+//
+//   c++ -O3 -march=native -std=c++17 -pthread -Isrc bench/bench_build.cpp -o bench_build
+//   ./bench_build [allCountries.txt|cities500.txt|inputs.csv] [maxPoints] [degree]
+//
+// Sin fichero usa un conjunto sintético sesgado (mezcla de gaussianas con
+// tamaños tipo ley de potencias), parecido a la distribución de GeoNames.
+// Las ventanas y los puntos de kNN se centran en puntos del propio conjunto.
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Datasets.hpp"
+#include "RTree.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double buildMs = 0, rangeUs = 0, knnUs = 0;
+    double rangeNodes = 0, rangeLeaves = 0, knnNodes = 0, knnLeaves = 0;
+};
+
+static Result run(RTreeIndex::BuildMode mode, int degree, const std::vector<Geoname>& pts,
+                  const std::vector<Rect>& windows, const std::vector<Geoname>& queries) {
+    Result r;
+    RTreeIndex index(degree, mode);
+    auto t0 = Clock::now();
+    index.build(pts);
+    r.buildMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    // tiempos con el perfilado apagado; los contadores salen de una segunda pasada
+    size_t sink = 0;
+    t0 = Clock::now();
+    for (const auto& w : windows) sink += index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon).size();
+    r.rangeUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / windows.size();
+
+    t0 = Clock::now();
+    for (const auto& q : queries) sink += index.kNN(q, 10).size();
+    r.knnUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / queries.size();
+
+    index.profiler().setEnabled(true);
+    for (const auto& w : windows) index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon);
+    for (const auto& q : queries) index.kNN(q, 10);
+    const auto range = index.profiler().stats(QueryKind::Range);
+    const auto knn = index.profiler().stats(QueryKind::KNN);
+    r.rangeNodes = static_cast<double>(range.totals.nodesVisited()) / range.queries;
+    r.rangeLeaves = static_cast<double>(range.totals.leavesScanned) / range.queries;
+    r.knnNodes = static_cast<double>(knn.totals.nodesVisited()) / knn.queries;
+    r.knnLeaves = static_cast<double>(knn.totals.leavesScanned) / knn.queries;
+    if (sink == 0) std::cerr << "(sin resultados)\n";
+    return r;
+}
+
+int main(int argc, char** argv) {
+    std::mt19937_64 rng(7);
+    const size_t maxPoints = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1'000'000;
+    const int degree = argc > 3 ? std::atoi(argv[3]) : 16;
+
+    std::vector<Geoname> pts;
+    if (argc > 1) pts = loadGeonames(argv[1], maxPoints);
+    const bool real = !pts.empty();
+    if (!real) pts = geonamesLikeDataset(maxPoints, rng);
+
+    std::uniform_int_distribution<size_t> pick(0, pts.size() - 1);
+    std::uniform_real_distribution<double> half(0.05, 0.5);
+    std::vector<Rect> windows(1000);
+    std::vector<Geoname> queries(1000);
+    for (auto& w : windows) {
+        const auto& c = pts[pick(rng)];
+        const double h = half(rng);
+        w = Rect(c.latitude - h, c.longitude - h, c.latitude + h, c.longitude + h);
+    }
+    for (auto& q : queries) q = pts[pick(rng)];
+
+    std::cout << "dataset: " << (real ? argv[1] : "sintetico sesgado") << ", " << pts.size()
+              << " puntos, grado " << degree << "\n\n";
+    std::cout << std::left << std::setw(9) << "modo" << std::right
+              << std::setw(11) << "build ms" << std::setw(12) << "range us" << std::setw(13) << "range nodos"
+              << std::setw(13) << "range hojas" << std::setw(10) << "knn us" << std::setw(12) << "knn nodos"
+              << std::setw(12) << "knn hojas" << "\n";
+    for (auto mode : {RTreeIndex::BuildMode::STR, RTreeIndex::BuildMode::Hilbert}) {
+        const Result r = run(mode, degree, pts, windows, queries);
+        std::cout << std::left << std::setw(9) << (mode == RTreeIndex::BuildMode::STR ? "STR" : "Hilbert")
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(11) << r.buildMs << std::setw(12) << r.rangeUs << std::setw(13) << r.rangeNodes
+                  << std::setw(13) << r.rangeLeaves << std::setw(10) << r.knnUs << std::setw(12) << r.knnNodes
+                  << std::setw(12) << r.knnLeaves << "\n";
+    }
+    return 0;
+}
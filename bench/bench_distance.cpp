@@ -0,0 +1,64 @@
+// Micro-benchmark de evaluaciones de distancia por segundo.
+//
+//   c++ -O3 -march=native -fno-math-errno -std=c++17 -Isrc bench/bench_distance.cpp -o bench_distance
+//   ./bench_distance [n] [reps]
+//
+// Compara el haversine escalar (una llamada por par, como hacían GridIndex::kNN
+// y RTreeIndex::minDistRect) con haversineBatch y con chord2Batch sobre
+// vectores unitarios precalculados, que es lo que usan ahora los kNN.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "utils.hpp"
+
+template <typename F>
+static double evalsPerSecond(size_t n, int reps, F&& body) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) body();
+    const auto t1 = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(t1 - t0).count();
+    return static_cast<double>(n) * reps / secs;
+}
+
+int main(int argc, char** argv) {
+    const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1'000'000;
+    const int reps = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> latD(-90.0, 90.0), lonD(-180.0, 180.0);
+    std::vector<double> lats(n), lons(n), out(n);
+    UnitVecArray units;
+    units.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        lats[i] = latD(rng);
+        lons[i] = lonD(rng);
+        units.push_back(lats[i], lons[i]);
+    }
+    const double qLat = -6.9092, qLon = -78.7987;
+    const UnitVec uq = toUnitVec(qLat, qLon);
+
+    double sink = 0;
+    const double scalar = evalsPerSecond(n, reps, [&] {
+        for (size_t i = 0; i < n; ++i) out[i] = haversine(qLat, qLon, lats[i], lons[i]);
+        sink += out[n / 2];
+    });
+    const double batch = evalsPerSecond(n, reps, [&] {
+        haversineBatch(qLat, qLon, lats.data(), lons.data(), n, out.data());
+        sink += out[n / 2];
+    });
+    const double chord = evalsPerSecond(n, reps, [&] {
+        chord2Batch(uq, units.xs.data(), units.ys.data(), units.zs.data(), n, out.data());
+        sink += out[n / 2];
+    });
+
+    std::cout << "n=" << n << " reps=" << reps << "\n";
+    std::cout << "haversine escalar:   " << scalar / 1e6 << " M evals/s\n";
+    std::cout << "haversineBatch:      " << batch / 1e6 << " M evals/s (x" << batch / scalar << ")\n";
+    std::cout << "chord2Batch (SoA):   " << chord / 1e6 << " M evals/s (x" << chord / scalar << ")\n";
+    std::cout << "(checksum " << sink << ")\n";
+    return 0;
+}
@@ -1,11 +1,52 @@
 #!/usr/bin/env bash
+# Compila con CMake en build-cmake/.
+#
+#   ./build.sh            Release (-O3)
+#   ./build.sh native     Release + -march=native + LTO
+#   ./build.sh pgo        native + LTO + PGO entrenado con spatial_bench
+#   ./build.sh asan       Debug con AddressSanitizer + UBSan
+#   ./build.sh tsan       RelWithDebInfo con ThreadSanitizer (ctest -R test_concurrency)
+#
+# Los módulos de Python quedan en build-cmake/python/{memory,disk}/.
 set -e
 
-echo "[+] Compilando spatialcpp con pybind11, RTree+Grid, KNN, Join..."
-```bash
-c++ -O3 -Wall -shared -std=c++20 -fPIC \
-  $(python3 -m pybind11 --includes) \
-  spatialcpp.cpp -o spatialcpp$(python3-config --extension-suffix)
-```
+MODE=${1:-release}
+BUILD_DIR=${BUILD_DIR:-build-cmake}
+JOBS=$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 4)
 
-echo "[✓] Compilado exitosamente"
+# Cada modo fija todas las opciones, porque la caché de CMake las recuerda.
+configure() {
+    cmake -S . -B "$BUILD_DIR" -DSPATIALCPP_NATIVE=OFF -DSPATIALCPP_LTO=OFF -DSPATIALCPP_PGO=OFF \
+          -DSPATIALCPP_SANITIZE= "$@"
+}
+
+case "$MODE" in
+    release)
+        configure -DCMAKE_BUILD_TYPE=Release
+        ;;
+    native)
+        configure -DCMAKE_BUILD_TYPE=Release -DSPATIALCPP_NATIVE=ON -DSPATIALCPP_LTO=ON
+        ;;
+    pgo)
+        echo "[+] PGO 1/2: build instrumentado y entrenamiento"
+        rm -rf "$BUILD_DIR/pgo-profiles"
+        configure -DCMAKE_BUILD_TYPE=Release -DSPATIALCPP_NATIVE=ON -DSPATIALCPP_LTO=ON -DSPATIALCPP_PGO=GENERATE
+        cmake --build "$BUILD_DIR" -j"$JOBS"
+        cmake --build "$BUILD_DIR" --target pgo-train
+        echo "[+] PGO 2/2: build con los perfiles"
+        configure -DCMAKE_BUILD_TYPE=Release -DSPATIALCPP_NATIVE=ON -DSPATIALCPP_LTO=ON -DSPATIALCPP_PGO=USE
+        ;;
+    asan)
+        configure -DCMAKE_BUILD_TYPE=Debug -DSPATIALCPP_SANITIZE=address,undefined
+        ;;
+    tsan)
+        configure -DCMAKE_BUILD_TYPE=RelWithDebInfo -DSPATIALCPP_SANITIZE=thread
+        ;;
+    *)
+        echo "uso: $0 [release|native|pgo|asan|tsan]"
+        exit 1
+        ;;
+esac
+
+cmake --build "$BUILD_DIR" -j"$JOBS"
+echo "[✓] Compilado en $BUILD_DIR"
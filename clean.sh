@@ -37,6 +37,7 @@ clean_files "*.o" "Archivos objeto (.o)"
 
 echo -e "\n${YELLOW}Limpiando directorios de build...${NC}"
 clean_dirs "build/" "Directorio build"
+clean_dirs "build-cmake/" "Directorio build de CMake"
 clean_dirs "dist/" "Directorio dist"
 clean_dirs "*.egg-info/" "Información de paquete egg"
 clean_dirs "__pycache__/" "Cache de Python"
@@ -63,7 +63,7 @@ else
     echo -e "${BLUE}Archivo de salida: $OUTPUT_FILE${NC}"
     
     # Compilar
-    c++ -O3 -Wall -shared -std=c++20 -fPIC \
+    c++ -O3 -fno-math-errno -Wall -shared -std=c++20 -fPIC \
         $(python3 -m pybind11 --includes) \
         src/spatial_index.cpp \
         -o "$OUTPUT_FILE"
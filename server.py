@@ -1,5 +1,7 @@
 import sys
 import os
+import json
+import threading
 
 # Agregar el directorio actual al path
 sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
@@ -15,16 +17,46 @@ except ImportError as e:
             print(f"  - {f}")
     sys.exit(1)
 
-from flask import Flask, request, jsonify, send_from_directory
+from flask import Flask, Response, request, jsonify, send_from_directory
 from flask_cors import CORS
 
 app = Flask(__name__)
 CORS(app)
 
+# Límites por petición de RANGE: como mucho RANGE_PAGE_LIMIT puntos o
+# RANGE_TIMEOUT_MS de consulta; el resto se pide con el cursor devuelto.
+RANGE_PAGE_LIMIT = 10000
+RANGE_TIMEOUT_MS = 200.0
+# Tamaño de los trozos de /api/stream/range
+STREAM_CHUNK_SIZE = 4096
+# Fichero de teselas que genera /api/generate_tiles y sirve /tiles/z/x/y.bin
+TILE_ARCHIVE_PATH = os.environ.get('SPATIALCPP_TILES', 'tiles.sptiles')
+
 # Estado global
 current_index = None
+current_clusters = None  # pirámide de grupos sobre current_index (/api/clusters)
+tile_archive = spatialcpp.TileArchive(TILE_ARCHIVE_PATH) if os.path.exists(TILE_ARCHIVE_PATH) else None
 data_points = []
 point_id_counter = 1
+# Los insert2D reconstruyen el índice en sitio: se hacen con este candado, y
+# /api/stream/range lo toma para producir cada trozo. current_clusters.insert2D
+# no recalcula la pirámide de grupos; lo hace el siguiente /api/clusters.
+index_lock = threading.Lock()
+
+def point_json(p, distance=None):
+    """Punto 2D de un resultado del índice; su id viaja con él (Point2D.id)."""
+    point_data = {'id': p.id, 'x': p.x, 'y': p.y, 'z': None, 'type': '2D'}
+    if p.name:
+        point_data['name'] = p.name
+    if distance is not None:
+        point_data['distance'] = distance
+    return point_data
+
+def make_point(x, y, point_id, name=''):
+    point = spatialcpp.Point2D(x, y)
+    point.id = point_id
+    point.name = name
+    return point
 
 @app.route('/')
 def index():
@@ -36,16 +68,25 @@ def serve_static(path):
 
 @app.route('/api/create_index', methods=['POST'])
 def create_index():
-    global current_index, data_points, point_id_counter
+    global current_index, current_clusters, data_points, point_id_counter
     try:
         data = request.json
-        index_type = data.get('type', 'rtree')
+        index_type = data.get('type', 'auto')
         
         if index_type.lower() == 'grid':
             print(index_type)
             current_index = spatialcpp.GridIndex()
         elif index_type.lower() == 'rtree':
             current_index = spatialcpp.RTree()
+        elif index_type.lower() == 'auto':
+            # Rejilla, R-tree o barrido según cada consulta (ver EXPLAIN)
+            current_index = spatialcpp.PlannedIndex()
+        else:
+            return jsonify({
+                'success': False,
+                'error': f'Tipo de índice desconocido: {index_type}'
+            })
+        current_clusters = spatialcpp.ClusteredIndex(current_index)
         data_points = []
         point_id_counter = 1
         
@@ -86,7 +127,8 @@ def bulk_insert():
                 try:
                     x = float(p['x'])
                     y = float(p['y'])
-                    point_objs.append(spatialcpp.Point2D(x, y))
+                    name = str(p.get('name', ''))
+                    point_objs.append(make_point(x, y, point_id_counter, name))
                     point_data = {
                         'id': point_id_counter, 
                         'x': x, 
@@ -94,6 +136,8 @@ def bulk_insert():
                         'z': None,
                         'type': '2D'
                     }
+                    if name:
+                        point_data['name'] = name
                     point_id_counter += 1
 
                     data_points.append(point_data)
@@ -110,7 +154,8 @@ def bulk_insert():
                 'error': 'No se pudo cargar ningún punto válido'
             }), 400
 
-        current_index.insert2D(point_objs)
+        with index_lock:
+            current_clusters.insert2D(point_objs)
 
         return jsonify({
             'success': True,
@@ -162,8 +207,9 @@ def execute_query():
             # Insertar en el índice
             if z is not None:
 
-                point = spatialcpp.Point2D(x, y)
-                current_index.insert2D([point])
+                point = make_point(x, y, point_id_counter)
+                with index_lock:
+                    current_clusters.insert2D([point])
                 point_data = {
                     'id': point_id_counter, 
                     'x': x, 
@@ -172,8 +218,9 @@ def execute_query():
                     'type': '2D'
                 }
             else:
-                point = spatialcpp.Point2D(x, y)
-                current_index.insert2D([point])
+                point = make_point(x, y, point_id_counter)
+                with index_lock:
+                    current_clusters.insert2D([point])
                 point_data = {
                     'id': point_id_counter, 
                     'x': x, 
@@ -192,7 +239,7 @@ def execute_query():
             })
         
         elif command == 'RANGE':
-            # RANGE x1 y1 x2 y2
+            # RANGE x1 y1 x2 y2 [cursor]
             if len(parts) < 5:
                 return jsonify({
                     'success': False, 
@@ -200,27 +247,26 @@ def execute_query():
                 })
             
             x1, y1, x2, y2 = map(float, parts[1:5])    
+            cursor = int(parts[5]) if len(parts) > 5 else 0
             
-            # Consulta en el índice
-            results = current_index.rangeQuery2D(x1, y1, x2, y2)
+            # Consulta acotada en el índice
+            options = spatialcpp.QueryOptions(limit=RANGE_PAGE_LIMIT, timeoutMs=RANGE_TIMEOUT_MS, cursor=cursor)
+            page = current_index.rangeQuery2DPage(x1, y1, x2, y2, options)
+            results = page.results
             
             # Convertir resultados a formato JSON
-            found_points = []
-            for p in results:
-                # Buscar el punto en nuestra lista
-                for dp in data_points:
-                    if dp['type'] in ['2D', '3D'] and abs(dp['x'] - p.x) < 0.001 and abs(dp['y'] - p.y) < 0.001:
-                        found_points.append(dp)
-                        break
+            found_points = [point_json(p) for p in results]
             
             return jsonify({
                 'success': True,
                 'results': found_points,
+                'cursor': None if page.done() else page.cursor,
                 'message': f'Encontrados {len(found_points)} puntos en el rango'
+                           + ('' if page.done() else f' (parcial, continuar con RANGE {x1} {y1} {x2} {y2} {page.cursor})')
             })
         
         elif command == 'KNN':
-            # KNN x y k
+            # KNN x y k [prefijo]: con prefijo, solo puntos cuyo nombre empieza así
             if len(parts) < 4:
                 return jsonify({
                     'success': False, 
@@ -233,7 +279,10 @@ def execute_query():
             print(x, y, k)
             
             # Consulta KNN
-            results = current_index.knnQuery2D(query_point, k)
+            if len(parts) > 4:
+                results = current_index.knnQuery2D(query_point, k, ' '.join(parts[4:]))
+            else:
+                results = current_index.knnQuery2D(query_point, k)
 
             print("LISTOO")
 
@@ -242,16 +291,7 @@ def execute_query():
 
             
             # Convertir resultados
-            found_points = []
-            for p in results:
-                dist = spatialcpp.distance2D(query_point, p)
-                # Buscar el punto en nuestra lista
-                for dp in data_points:
-                    if dp['type'] in ['2D', '3D'] and abs(dp['x'] - p.x) < 0.001 and abs(dp['y'] - p.y) < 0.001:
-                        point_with_dist = dp.copy()
-                        point_with_dist['distance'] = dist
-                        found_points.append(point_with_dist)
-                        break
+            found_points = [point_json(p, spatialcpp.distance2D(query_point, p)) for p in results]
             
             return jsonify({
                 'success': True,
@@ -259,6 +299,70 @@ def execute_query():
                 'message': f'Encontrados {len(found_points)} vecinos más cercanos'
             })
         
+        elif command == 'RADIUS':
+            # RADIUS x y metros (x = lat, y = lon)
+            if len(parts) < 4:
+                return jsonify({
+                    'success': False, 
+                    'error': 'RADIUS requiere x, y, metros'
+                })
+            
+            x, y, meters = float(parts[1]), float(parts[2]), float(parts[3])
+            
+            # Consulta por radio, ya ordenada por distancia
+            results = current_index.radiusQuery2DWithDistances(x, y, meters)
+            
+            found_points = [point_json(p, dist) for dist, p in results]
+            
+            return jsonify({
+                'success': True,
+                'results': found_points,
+                'message': f'Encontrados {len(found_points)} puntos a menos de {meters} m'
+            })
+        
+        elif command == 'GET':
+            # GET id
+            if len(parts) < 2:
+                return jsonify({
+                    'success': False,
+                    'error': 'GET requiere un id'
+                })
+            
+            p = current_index.getById(int(parts[1]))
+            return jsonify({
+                'success': True,
+                'results': [] if p is None else [point_json(p)],
+                'message': f'Punto {parts[1]} ' + ('no encontrado' if p is None else 'encontrado')
+            })
+        
+        elif command == 'EXPLAIN':
+            # EXPLAIN x1 y1 x2 y2: plan que seguiría un rango en el índice automático
+            if len(parts) < 5:
+                return jsonify({
+                    'success': False,
+                    'error': 'EXPLAIN requiere 4 coordenadas'
+                })
+            if not isinstance(current_index, spatialcpp.PlannedIndex):
+                return jsonify({
+                    'success': False,
+                    'error': 'EXPLAIN solo está disponible con el índice automático'
+                })
+
+            x1, y1, x2, y2 = map(float, parts[1:5])
+            plan = current_index.plan(x1, y1, x2, y2)
+            return jsonify({
+                'success': True,
+                'results': [],
+                'plan': {
+                    'plan': plan.name,
+                    'estimate': plan.estimate,
+                    'gridCells': plan.gridCells,
+                    'gridCandidates': plan.gridCandidates,
+                    'costs': {'grid': plan.gridCost, 'rtree': plan.treeCost, 'scan': plan.scanCost}
+                },
+                'message': f'Plan {plan.name}: unos {round(plan.estimate)} puntos estimados'
+            })
+        
         elif command == 'POLYGON':
             '''
             # POLYGON x1,y1 x2,y2 x3,y3 ...
@@ -330,6 +434,106 @@ def execute_query():
             'error': f'Error ejecutando consulta: {str(e)}'
         })
 
+@app.route('/api/stream/range', methods=['POST'])
+def stream_range():
+    """Consulta por rango sin límite: el array JSON se envía por trozos a medida que el índice los produce."""
+    if not current_index:
+        return jsonify({
+            'success': False, 
+            'error': 'No hay índice creado'
+        })
+    
+    data = request.json
+    try:
+        x1, y1, x2, y2 = (float(data[k]) for k in ('x1', 'y1', 'x2', 'y2'))
+    except (KeyError, TypeError, ValueError):
+        return jsonify({
+            'success': False, 
+            'error': 'Se requieren x1, y1, x2, y2'
+        })
+    
+    chunks = current_index.rangeQuery2DIter(x1, y1, x2, y2, chunkSize=STREAM_CHUNK_SIZE)
+    
+    def generate():
+        # Corre después de que el handler vuelva: cada trozo se saca con el
+        # candado para no leer el índice mientras un INSERT lo reconstruye.
+        yield '['
+        first = True
+        while True:
+            with index_lock:
+                chunk = next(chunks, None)
+            if chunk is None:
+                break
+            body = ','.join(json.dumps({'id': p.id, 'x': p.x, 'y': p.y}) for p in chunk)
+            yield body if first else ',' + body
+            first = False
+        yield ']'
+    
+    return Response(generate(), mimetype='application/json')
+
+@app.route('/api/clusters', methods=['POST'])
+def clusters():
+    """Vista del mapa: centroides con su número de puntos, o los puntos si el zoom es alto y caben."""
+    if not current_clusters:
+        return jsonify({
+            'success': False, 
+            'error': 'No hay índice creado'
+        })
+    
+    data = request.json
+    try:
+        x1, y1, x2, y2 = (float(data[k]) for k in ('x1', 'y1', 'x2', 'y2'))
+        zoom = int(data['zoom'])
+    except (KeyError, TypeError, ValueError):
+        return jsonify({
+            'success': False, 
+            'error': 'Se requieren x1, y1, x2, y2 y zoom'
+        })
+    
+    # Los INSERT solo marcan la pirámide como pendiente: se calcula aquí, una
+    # vez, y con el candado porque modifica el índice agrupado
+    with index_lock:
+        result = current_clusters.clusterQuery(x1, y1, x2, y2, zoom)
+    return jsonify({
+        'success': True,
+        'zoom': result.zoom,
+        'raw': result.raw,
+        'clusters': [{'x': c.x, 'y': c.y, 'count': c.count} for c in result.clusters],
+        'points': [{'id': p.id, 'x': p.x, 'y': p.y} for p in result.points]
+    })
+
+@app.route('/api/generate_tiles', methods=['POST'])
+def generate_tiles():
+    """Escribe la pirámide de teselas del índice actual; después /tiles/z/x/y.bin no calcula nada."""
+    global tile_archive
+    if not current_index:
+        return jsonify({
+            'success': False, 
+            'error': 'No hay índice creado'
+        })
+    
+    data = request.json or {}
+    options = spatialcpp.TileOptions()
+    options.maxZoom = int(data.get('maxZoom', options.maxZoom))
+    options.featureCap = int(data.get('featureCap', options.featureCap))
+    stats = spatialcpp.writeTileArchive(current_index, TILE_ARCHIVE_PATH, options)
+    tile_archive = spatialcpp.TileArchive(TILE_ARCHIVE_PATH)
+    return jsonify({
+        'success': True,
+        'tiles': stats.tiles,
+        'features': stats.features,
+        'bytes': stats.bytes
+    })
+
+@app.route('/tiles/<int:z>/<int:x>/<int:y>.bin')
+def get_tile(z, x, y):
+    if tile_archive is None:
+        return Response(status=404)
+    data = tile_archive.tile(z, x, y)
+    if not data:
+        return Response(status=204)
+    return Response(data, mimetype='application/octet-stream')
+
 @app.route('/api/get_all_data', methods=['GET'])
 def get_all_data():
     return jsonify({
@@ -20,7 +20,8 @@ ext_modules = [
             pybind11.get_include(),
         ],
         cxx_std=17,
-        extra_compile_args=['-O3', '-Wall'],
+        extra_compile_args=['-O3', '-fno-math-errno', '-Wall', '-pthread'],
+        extra_link_args=['-pthread'],
     ),
 ]
 
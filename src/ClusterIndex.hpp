@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Geoname.hpp"
+#include "Hilbert.hpp"
+#include "Index.hpp"
+#include "WebMercator.hpp"
+
+/// Grupo de puntos de una celda: centroide y número de puntos.
+struct Cluster {
+    double latitude = 0, longitude = 0;
+    size_t count = 0;
+};
+
+/// Respuesta de clusterQuery: grupos del nivel `zoom` o, si raw, los puntos.
+struct ClusterResult {
+    int zoom = 0;
+    bool raw = false;
+    std::vector<Cluster> clusters;
+    std::vector<Geoname> points;
+};
+
+struct ClusterOptions {
+    int maxZoom = 14;            // último nivel precalculado
+    int cellsPerTile = 8;        // celdas por lado de tesela (8 = 32 px en teselas de 256)
+    int rawZoom = 15;            // desde este zoom se devuelven puntos si caben en rawLimit
+    size_t rawLimit = 2'000;
+    size_t maxClusters = 10'000; // si la ventana tiene más celdas se usa un nivel más grueso
+};
+
+/// Agrupamiento por niveles de zoom para mapas. Cada nivel z es una rejilla
+/// Web Mercator de cellsPerTile · 2^z celdas de lado con las celdas no vacías
+/// ordenadas por (fila, columna); el nivel z - 1 se obtiene fundiendo las
+/// celdas de cuatro en cuatro. clusterQuery devuelve los centroides de las
+/// celdas de la ventana, así que la respuesta depende del tamaño de la ventana
+/// en píxeles y no del número de puntos. Los puntos sueltos salen del índice
+/// espacial, que hay que construir a través de build() para que la pirámide
+/// no se quede desfasada.
+class ClusteredIndex {
+public:
+    explicit ClusteredIndex(std::shared_ptr<Index> index, ClusterOptions options = ClusterOptions())
+        : index_(std::move(index)), options_(options) {
+        if (!index_) throw std::invalid_argument("ClusteredIndex: falta el índice");
+        if (options_.maxZoom < 0 || options_.cellsPerTile < 1 ||
+            (static_cast<uint64_t>(options_.cellsPerTile) << options_.maxZoom) > (uint64_t(1) << 31))
+            throw std::invalid_argument("ClusteredIndex: la rejilla de maxZoom no cabe en 32 bits");
+    }
+
+    /// Construye el índice espacial y la pirámide de grupos.
+    void build(const std::vector<Geoname>& points) {
+        index_->rebuild(points);
+        pending_ = {};
+        dirty_ = false;
+        buildLevels(points);
+    }
+
+    /// Construye el índice espacial y deja la pirámide para la siguiente
+    /// clusterQuery (o refresh()): varias inserciones seguidas sin consultas de
+    /// grupos la calculan una sola vez.
+    void insert(const std::vector<Geoname>& points) {
+        index_->rebuild(points);
+        pending_ = points;
+        dirty_ = true;
+    }
+
+    /// Calcula la pirámide pendiente de insert(), si la hay.
+    void refresh() {
+        if (!dirty_) return;
+        buildLevels(pending_);
+        pending_ = {};
+        dirty_ = false;
+    }
+    bool dirty() const { return dirty_; }
+
+    /// Grupos de la ventana en el zoom del mapa. Desde rawZoom, si la ventana
+    /// tiene como mucho rawLimit puntos, devuelve los puntos. Si hay más de
+    /// maxClusters celdas baja de nivel hasta que caben. Si la pirámide está
+    /// pendiente la calcula antes, así que tras un insert() no puede llamarse
+    /// a la vez que otra consulta.
+    ClusterResult clusterQuery(double minLat, double minLon, double maxLat, double maxLon, int zoom) {
+        refresh();
+        return clusters(minLat, minLon, maxLat, maxLon, zoom);
+    }
+
+    Index& index() { return *index_; }
+    const ClusterOptions& options() const { return options_; }
+    /// Celdas no vacías del nivel z.
+    size_t clusterCount(const int z) const { return levels_.at(static_cast<size_t>(z)).size(); }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this) + levels_.capacity() * sizeof(std::vector<Cell>) +
+                       pending_.capacity() * sizeof(Geoname);
+        for (const auto& level : levels_) bytes += level.capacity() * sizeof(Cell);
+        return bytes + index_->memoryUsage();
+    }
+
+private:
+    struct Cell {
+        uint64_t key;          // fila * celdas + columna
+        double sumLat, sumLon; // sumas para el centroide
+        uint32_t count;
+    };
+
+    std::shared_ptr<Index> index_;
+    ClusterOptions options_;
+    std::vector<std::vector<Cell>> levels_; // levels_[z]
+    std::vector<Geoname> pending_;          // puntos del último insert() sin pirámide
+    bool dirty_ = false;
+
+    // Pirámide de grupos de points; el índice ya está construido.
+    void buildLevels(const std::vector<Geoname>& points) {
+        levels_.assign(static_cast<size_t>(options_.maxZoom) + 1, {});
+
+        // Nivel más fino: puntos ordenados por celda y acumulados
+        const uint64_t finest = cellsAt(options_.maxZoom);
+        std::vector<std::pair<uint64_t, uint32_t>> keyed(points.size());
+        for (size_t i = 0; i < points.size(); ++i) {
+            const uint64_t row = mercatorCell(mercatorY(points[i].latitude), finest);
+            const uint64_t col = mercatorCell(mercatorX(points[i].longitude), finest);
+            keyed[i] = {row * finest + col, static_cast<uint32_t>(i)};
+        }
+        parallelRadixSort(keyed);
+        auto& top = levels_.back();
+        for (const auto& [key, i] : keyed) {
+            if (top.empty() || top.back().key != key) top.push_back(Cell{key, 0, 0, 0});
+            top.back().sumLat += points[i].latitude;
+            top.back().sumLon += points[i].longitude;
+            ++top.back().count;
+        }
+        top.shrink_to_fit();
+
+        // Cada nivel funde las celdas 2 × 2 del siguiente
+        for (int z = options_.maxZoom; z > 0; --z) {
+            const uint64_t cells = cellsAt(z), coarse = cellsAt(z - 1);
+            std::vector<Cell> parents;
+            parents.reserve(levels_[z].size());
+            for (const Cell& c : levels_[z]) {
+                const uint64_t row = c.key / cells, col = c.key % cells;
+                parents.push_back(Cell{(row / 2) * coarse + col / 2, c.sumLat, c.sumLon, c.count});
+            }
+            std::sort(parents.begin(), parents.end(), [](const Cell& a, const Cell& b) { return a.key < b.key; });
+            auto& level = levels_[z - 1];
+            for (const Cell& c : parents) {
+                if (level.empty() || level.back().key != c.key) {
+                    level.push_back(c);
+                } else {
+                    level.back().sumLat += c.sumLat;
+                    level.back().sumLon += c.sumLon;
+                    level.back().count += c.count;
+                }
+            }
+            level.shrink_to_fit();
+        }
+    }
+
+    // clusterQuery con la pirámide al día.
+    ClusterResult clusters(double minLat, double minLon, double maxLat, double maxLon, int zoom) const {
+        ClusterResult result;
+        zoom = std::max(zoom, 0);
+        if (minLat > maxLat || minLon > maxLon || levels_.empty()) return result;
+
+        if (zoom >= options_.rawZoom && index_->countQuery(minLat, minLon, maxLat, maxLon) <= options_.rawLimit) {
+            result.zoom = zoom;
+            result.raw = true;
+            result.points = index_->rangeQuery(minLat, minLon, maxLat, maxLon);
+            return result;
+        }
+
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (int z = std::min(zoom, options_.maxZoom); z >= 0; --z) {
+            const size_t found = cellRanges(z, minLat, minLon, maxLat, maxLon, ranges);
+            result.zoom = z;
+            if (found <= options_.maxClusters) break;
+        }
+        const auto& level = levels_[result.zoom];
+        for (const auto& [begin, end] : ranges) {
+            for (size_t i = begin; i < end; ++i) {
+                const Cell& c = level[i];
+                result.clusters.push_back(Cluster{c.sumLat / c.count, c.sumLon / c.count, c.count});
+            }
+        }
+        return result;
+    }
+
+    uint64_t cellsAt(const int z) const { return static_cast<uint64_t>(options_.cellsPerTile) << z; }
+
+    // Tramos de levels_[z] con las celdas de la ventana, uno por fila no vacía:
+    // las filas vacías se saltan con una búsqueda binaria. Devuelve cuántas hay.
+    size_t cellRanges(const int z, const double minLat, const double minLon, const double maxLat,
+                      const double maxLon, std::vector<std::pair<size_t, size_t>>& ranges) const {
+        ranges.clear();
+        const auto& level = levels_[z];
+        const uint64_t cells = cellsAt(z);
+        const uint64_t r0 = mercatorCell(mercatorY(maxLat), cells), r1 = mercatorCell(mercatorY(minLat), cells);
+        const uint64_t c0 = mercatorCell(mercatorX(minLon), cells), c1 = mercatorCell(mercatorX(maxLon), cells);
+        auto from = [&](const size_t pos, const uint64_t key) {
+            return static_cast<size_t>(std::lower_bound(level.begin() + pos, level.end(), key,
+                                                        [](const Cell& c, const uint64_t k) { return c.key < k; })
+                                       - level.begin());
+        };
+
+        size_t found = 0;
+        size_t i = from(0, r0 * cells + c0);
+        while (i < level.size()) {
+            const uint64_t row = level[i].key / cells;
+            if (row > r1) break;
+            if (level[i].key % cells < c0) {
+                i = from(i, row * cells + c0);
+                continue;
+            }
+            const size_t end = from(i, row * cells + c1 + 1);
+            if (end > i) {
+                ranges.emplace_back(i, end);
+                found += end - i;
+            }
+            i = from(end, (row + 1) * cells + c0);
+        }
+        return found;
+    }
+};
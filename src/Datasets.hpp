@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Geoname.hpp"
+#include "GeonamesIO.hpp"
+
+// Conjuntos sintéticos para los benchmarks. Todos son deterministas para una
+// misma semilla y numeran los puntos desde 0.
+
+/// Uniforme en lat [-90, 90] × lon [-180, 180].
+inline std::vector<Geoname> uniformDataset(const size_t n, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+    std::vector<Geoname> pts(n);
+    for (size_t i = 0; i < n; ++i) {
+        pts[i].geonameId = static_cast<long>(i);
+        pts[i].latitude = lat(rng);
+        pts[i].longitude = lon(rng);
+    }
+    return pts;
+}
+
+/// Mezcla de `clusters` gaussianas del mismo peso y sigma entre 0.5 y 5 grados.
+inline std::vector<Geoname> clusteredDataset(const size_t n, std::mt19937_64& rng, const size_t clusters = 64) {
+    std::uniform_real_distribution<double> lat(-70, 70), lon(-180, 180), sigma(0.5, 5.0);
+    std::vector<std::pair<Geoname, double>> centers(std::max<size_t>(1, clusters));
+    for (auto& [c, s] : centers) {
+        c.latitude = lat(rng);
+        c.longitude = lon(rng);
+        s = sigma(rng);
+    }
+    std::uniform_int_distribution<size_t> pick(0, centers.size() - 1);
+    std::normal_distribution<double> unit(0, 1);
+    std::vector<Geoname> pts(n);
+    for (size_t i = 0; i < n; ++i) {
+        const auto& [c, s] = centers[pick(rng)];
+        pts[i].geonameId = static_cast<long>(i);
+        pts[i].latitude = std::clamp(c.latitude + s * unit(rng), -90.0, 90.0);
+        pts[i].longitude = std::clamp(c.longitude + s * unit(rng), -180.0, 180.0);
+    }
+    return pts;
+}
+
+/// Parecido a GeoNames: 200 centros con tamaños tipo ley de potencias (Zipf) y
+/// dispersiones muy distintas, así que hay ciudades densas y zonas casi vacías.
+inline std::vector<Geoname> geonamesLikeDataset(const size_t n, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> lat(-60, 70), lon(-180, 180), u(0, 1);
+    std::vector<std::pair<Geoname, double>> centers(200);
+    for (auto& [c, sigma] : centers) {
+        c.latitude = lat(rng);
+        c.longitude = lon(rng);
+        sigma = 0.05 + 3 * u(rng) * u(rng);
+    }
+    std::vector<Geoname> pts;
+    pts.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        // centro elegido con probabilidad ~ 1/rango (ley de Zipf)
+        const size_t c = std::min(centers.size() - 1, static_cast<size_t>(std::pow(centers.size(), u(rng))) - 1);
+        std::normal_distribution<double> dLat(centers[c].first.latitude, centers[c].second);
+        std::normal_distribution<double> dLon(centers[c].first.longitude, centers[c].second);
+        Geoname g;
+        g.geonameId = static_cast<long>(i);
+        g.latitude = std::clamp(dLat(rng), -90.0, 90.0);
+        g.longitude = std::clamp(dLon(rng), -180.0, 180.0);
+        pts.push_back(g);
+    }
+    return pts;
+}
+
+/// "uniform", "clustered" o "geonames". Para "geonames" usa `path` (volcado de
+/// GeoNames o CSV) si se da y si no, geonamesLikeDataset. Vacío si el nombre no existe.
+inline std::vector<Geoname> makeDataset(const std::string& kind, const size_t n, std::mt19937_64& rng,
+                                        const std::string& path = "") {
+    if (kind == "uniform") return uniformDataset(n, rng);
+    if (kind == "clustered") return clusteredDataset(n, rng);
+    if (kind == "geonames") {
+        if (!path.empty()) {
+            auto pts = loadGeonames(path, n);
+            if (!pts.empty()) return pts;
+        }
+        return geonamesLikeDataset(n, rng);
+    }
+    return {};
+}
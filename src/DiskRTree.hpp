@@ -0,0 +1,2720 @@
+#pragma once
+
+// Índice R-tree en disco (DiskRTreeIndex) y sus geometrías. Sin dependencias de
+// pybind11: los bindings están en hola.cpp.
+
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <queue>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+#include "utils.hpp"
+#include "Epoch.hpp"
+#include "Hilbert.hpp"
+#include "IdIndex.hpp"
+#include "QueryControl.hpp"
+#include "QueryProfile.hpp"
+
+namespace fs = std::filesystem;
+
+// === GEOMETRIC PRIMITIVES ===
+// Añadir después de la definición de Point2D
+struct Point2D { 
+    double x, y; 
+    Point2D() : x(0), y(0) {}
+    Point2D(double x, double y) : x(x), y(y) {}
+    
+    // Añadir operador < para permitir el uso en std::pair con std::less
+    bool operator<(const Point2D& other) const {
+        if (x != other.x) return x < other.x;
+        return y < other.y;
+    }
+    
+    void serialize(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(&x), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&y), sizeof(double));
+    }
+    
+    void deserialize(std::istream& in) {
+        in.read(reinterpret_cast<char*>(&x), sizeof(double));
+        in.read(reinterpret_cast<char*>(&y), sizeof(double));
+    }
+};
+
+// Añadir después de la definición de Point3D
+struct Point3D { 
+    double x, y, z; 
+    Point3D() : x(0), y(0), z(0) {}
+    Point3D(double x, double y, double z) : x(x), y(y), z(z) {}
+    
+    // Añadir operador < para permitir el uso en std::pair con std::less
+    bool operator<(const Point3D& other) const {
+        if (x != other.x) return x < other.x;
+        if (y != other.y) return y < other.y;
+        return z < other.z;
+    }
+    
+    void serialize(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(&x), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&y), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&z), sizeof(double));
+    }
+    
+    void deserialize(std::istream& in) {
+        in.read(reinterpret_cast<char*>(&x), sizeof(double));
+        in.read(reinterpret_cast<char*>(&y), sizeof(double));
+        in.read(reinterpret_cast<char*>(&z), sizeof(double));
+    }
+};
+
+struct Rectangle {
+    double x1, y1, x2, y2;
+    Rectangle() : x1(0), y1(0), x2(0), y2(0) {}
+    Rectangle(double x1, double y1, double x2, double y2) : x1(x1), y1(y1), x2(x2), y2(y2) {}
+    
+    bool contains(const Point2D &p) const { 
+        return p.x >= x1 && p.x <= x2 && p.y >= y1 && p.y <= y2; 
+    }
+    
+    bool contains(const Rectangle &o) const {
+        return o.x1 >= x1 && o.x2 <= x2 && o.y1 >= y1 && o.y2 <= y2;
+    }
+    
+    bool intersects(const Rectangle &o) const { 
+        return !(o.x1 > x2 || o.x2 < x1 || o.y1 > y2 || o.y2 < y1); 
+    }
+    
+    double area() const { return (x2 - x1) * (y2 - y1); }
+    
+    Rectangle enlarge(const Point2D &p) const {
+        return Rectangle(std::min(x1, p.x), std::min(y1, p.y), 
+                        std::max(x2, p.x), std::max(y2, p.y));
+    }
+    
+    Rectangle enlarge(const Rectangle &r) const {
+        return Rectangle(std::min(x1, r.x1), std::min(y1, r.y1), 
+                        std::max(x2, r.x2), std::max(y2, r.y2));
+    }
+    
+    void serialize(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(&x1), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&y1), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&x2), sizeof(double));
+        out.write(reinterpret_cast<const char*>(&y2), sizeof(double));
+    }
+    
+    void deserialize(std::istream& in) {
+        in.read(reinterpret_cast<char*>(&x1), sizeof(double));
+        in.read(reinterpret_cast<char*>(&y1), sizeof(double));
+        in.read(reinterpret_cast<char*>(&x2), sizeof(double));
+        in.read(reinterpret_cast<char*>(&y2), sizeof(double));
+    }
+};
+
+// Caja 3D. Por defecto vacía (min = +inf, max = -inf): no interseca nada y
+// enlarge la inicializa con lo primero que se le añada.
+struct Box3D {
+    double x1, y1, z1, x2, y2, z2;
+    Box3D() : x1(std::numeric_limits<double>::infinity()), y1(x1), z1(x1),
+              x2(-std::numeric_limits<double>::infinity()), y2(x2), z2(x2) {}
+    Box3D(double x1, double y1, double z1, double x2, double y2, double z2)
+        : x1(x1), y1(y1), z1(z1), x2(x2), y2(y2), z2(z2) {}
+    Box3D(const Rectangle& r, double z1, double z2) : Box3D(r.x1, r.y1, z1, r.x2, r.y2, z2) {}
+    
+    bool empty() const { return x1 > x2; }
+    
+    bool contains(const Point3D& p) const {
+        return p.x >= x1 && p.x <= x2 && p.y >= y1 && p.y <= y2 && p.z >= z1 && p.z <= z2;
+    }
+    
+    bool intersects(const Box3D& o) const {
+        return !(o.x1 > x2 || o.x2 < x1 || o.y1 > y2 || o.y2 < y1 || o.z1 > z2 || o.z2 < z1);
+    }
+    
+    Box3D enlarge(const Point3D& p) const {
+        return Box3D(std::min(x1, p.x), std::min(y1, p.y), std::min(z1, p.z),
+                     std::max(x2, p.x), std::max(y2, p.y), std::max(z2, p.z));
+    }
+    
+    Box3D enlarge(const Box3D& b) const {
+        return Box3D(std::min(x1, b.x1), std::min(y1, b.y1), std::min(z1, b.z1),
+                     std::max(x2, b.x2), std::max(y2, b.y2), std::max(z2, b.z2));
+    }
+    
+    /// Distancia euclídea mínima de p a la caja (infinito si está vacía).
+    double minDist(const Point3D& p) const {
+        if (empty()) return std::numeric_limits<double>::infinity();
+        const double dx = std::max({x1 - p.x, 0.0, p.x - x2});
+        const double dy = std::max({y1 - p.y, 0.0, p.y - y2});
+        const double dz = std::max({z1 - p.z, 0.0, p.z - z2});
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    
+    void serialize(std::ostream& out) const {
+        const double v[6] = {x1, y1, z1, x2, y2, z2};
+        out.write(reinterpret_cast<const char*>(v), sizeof(v));
+    }
+    
+    void deserialize(std::istream& in) {
+        double v[6];
+        in.read(reinterpret_cast<char*>(v), sizeof(v));
+        x1 = v[0]; y1 = v[1]; z1 = v[2]; x2 = v[3]; y2 = v[4]; z2 = v[5];
+    }
+};
+
+struct Polygon {
+    std::vector<Point2D> vertices;
+    
+    Polygon() {}
+    Polygon(const std::vector<Point2D>& points) : vertices(points) {}
+    
+    Rectangle getBoundingBox() const {
+        if (vertices.empty()) return Rectangle();
+        
+        double minX = vertices[0].x, maxX = vertices[0].x;
+        double minY = vertices[0].y, maxY = vertices[0].y;
+        
+        for (const auto& p : vertices) {
+            minX = std::min(minX, p.x);
+            maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y);
+            maxY = std::max(maxY, p.y);
+        }
+        
+        return Rectangle(minX, minY, maxX, maxY);
+    }
+    
+    bool contains(const Point2D& p) const {
+        if (vertices.size() < 3) return false;
+        
+        bool inside = false;
+        for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+            if (((vertices[i].y > p.y) != (vertices[j].y > p.y)) &&
+                (p.x < (vertices[j].x - vertices[i].x) * (p.y - vertices[i].y) / 
+                       (vertices[j].y - vertices[i].y) + vertices[i].x)) {
+                inside = !inside;
+            }
+        }
+        return inside;
+    }
+    
+    void serialize(std::ostream& out) const {
+        size_t size = vertices.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size_t));
+        for (const auto& v : vertices) {
+            v.serialize(out);
+        }
+    }
+    
+    void deserialize(std::istream& in) {
+        size_t size;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size_t));
+        vertices.resize(size);
+        for (auto& v : vertices) {
+            v.deserialize(in);
+        }
+    }
+};
+
+// Geometría preparada de un polígono para consultas repetidas. Las aristas van
+// en un árbol de intervalos centrado sobre su rango de y, en vectores planos:
+// cada nodo guarda las aristas que cruzan su y central, ordenadas por y mínima
+// y por y máxima, y las de debajo y encima van a sus hijos. Cada arista está
+// en un solo nodo, así que la memoria es lineal en los vértices aunque el
+// polígono sea un peine o una espiral (con franjas de altura fija eran
+// cuadráticos). El ray casting de un punto solo recorre las aristas que
+// cruzan su y más O(log V) nodos, y la intersección con una ventana las que
+// se solapan con su rango de y.
+class PreparedPolygon {
+public:
+    PreparedPolygon() = default;
+    
+    explicit PreparedPolygon(const Polygon& poly) : bbox(poly.getBoundingBox()) {
+        const auto& v = poly.vertices;
+        if (v.size() < 3) return;
+        edges.reserve(v.size());
+        for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+            edges.push_back({v[j].x, v[j].y, v[i].x, v[i].y});
+        }
+        std::vector<uint32_t> all(edges.size());
+        for (uint32_t k = 0; k < all.size(); ++k) all[k] = k;
+        byMin.reserve(edges.size());
+        byMax.reserve(edges.size());
+        build(all);
+        nodes.shrink_to_fit();
+    }
+    
+    const Rectangle& getBoundingBox() const { return bbox; }
+    
+    /// Mismo criterio que Polygon::contains (ray casting, regla par-impar).
+    bool contains(const Point2D& p) const {
+        if (edges.empty() || !bbox.contains(p)) return false;
+        bool inside = false;
+        overlapping(p.y, p.y, [&](const Edge& e) {
+            if ((e.y2 > p.y) != (e.y1 > p.y) &&
+                p.x < (e.x1 - e.x2) * (p.y - e.y2) / (e.y1 - e.y2) + e.x2) {
+                inside = !inside;
+            }
+            return false;
+        });
+        return inside;
+    }
+    
+    /// Intersección exacta con una ventana (bordes incluidos): alguna arista
+    /// toca la ventana, o la ventana queda dentro del polígono.
+    bool intersects(const Rectangle& r) const {
+        if (edges.empty() || !bbox.intersects(r)) return false;
+        if (r.x1 <= bbox.x1 && bbox.x2 <= r.x2 && r.y1 <= bbox.y1 && bbox.y2 <= r.y2) return true;
+        
+        if (overlapping(std::max(r.y1, bbox.y1), std::min(r.y2, bbox.y2),
+                        [&](const Edge& e) { return segmentIntersectsRect(e, r); })) {
+            return true;
+        }
+        return contains(Point2D(r.x1, r.y1));
+    }
+    
+    /// Como mucho 64 bytes por vértice más el objeto.
+    size_t getMemorySize() const {
+        return sizeof(*this) + edges.capacity() * sizeof(Edge) + nodes.capacity() * sizeof(Node) +
+               (byMin.capacity() + byMax.capacity()) * sizeof(uint32_t);
+    }
+    
+private:
+    struct Edge {
+        double x1, y1, x2, y2;
+        double ymin() const { return std::min(y1, y2); }
+        double ymax() const { return std::max(y1, y2); }
+    };
+    
+    // Aristas del nodo: byMin[begin, end) por y mínima creciente y
+    // byMax[begin, end) por y máxima decreciente. Hijos -1 si no hay.
+    struct Node {
+        double center;
+        uint32_t begin, end;
+        int32_t left, right;
+    };
+    
+    Rectangle bbox;
+    std::vector<Edge> edges;
+    std::vector<Node> nodes; // nodes[0] es la raíz
+    std::vector<uint32_t> byMin;
+    std::vector<uint32_t> byMax;
+    
+    // Centro: la mediana de los puntos medios, cuya arista se queda en el
+    // nodo; así ningún nodo está vacío y la altura es O(log V).
+    int32_t build(std::vector<uint32_t>& ids) {
+        if (ids.empty()) return -1;
+        auto mid = [&](const uint32_t k) { return (edges[k].y1 + edges[k].y2) / 2; };
+        std::nth_element(ids.begin(), ids.begin() + ids.size() / 2, ids.end(),
+                         [&](const uint32_t a, const uint32_t b) { return mid(a) < mid(b); });
+        const double center = mid(ids[ids.size() / 2]);
+        
+        std::vector<uint32_t> below, above;
+        const auto begin = static_cast<uint32_t>(byMin.size());
+        for (const uint32_t k : ids) {
+            if (edges[k].ymax() < center) below.push_back(k);
+            else if (edges[k].ymin() > center) above.push_back(k);
+            else byMin.push_back(k);
+        }
+        ids = {};
+        const auto end = static_cast<uint32_t>(byMin.size());
+        byMax.insert(byMax.end(), byMin.begin() + begin, byMin.end());
+        std::sort(byMin.begin() + begin, byMin.end(),
+                  [&](const uint32_t a, const uint32_t b) { return edges[a].ymin() < edges[b].ymin(); });
+        std::sort(byMax.begin() + begin, byMax.end(),
+                  [&](const uint32_t a, const uint32_t b) { return edges[a].ymax() > edges[b].ymax(); });
+        
+        const auto node = static_cast<int32_t>(nodes.size());
+        nodes.push_back({center, begin, end, -1, -1});
+        const int32_t left = build(below);
+        const int32_t right = build(above);
+        nodes[node].left = left;
+        nodes[node].right = right;
+        return node;
+    }
+    
+    // Llama a visit con cada arista cuyo rango de y se solapa con [lo, hi],
+    // una vez cada una, hasta que devuelva true.
+    template <typename Visit>
+    bool overlapping(const double lo, const double hi, const Visit& visit) const {
+        if (nodes.empty()) return false;
+        int32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& n = nodes[stack[--top]];
+            if (hi < n.center) {
+                // Todas acaban por encima de hi: basta con que empiecen antes
+                for (uint32_t k = n.begin; k < n.end && edges[byMin[k]].ymin() <= hi; ++k) {
+                    if (visit(edges[byMin[k]])) return true;
+                }
+                if (n.left >= 0) stack[top++] = n.left;
+            } else if (lo > n.center) {
+                for (uint32_t k = n.begin; k < n.end && edges[byMax[k]].ymax() >= lo; ++k) {
+                    if (visit(edges[byMax[k]])) return true;
+                }
+                if (n.right >= 0) stack[top++] = n.right;
+            } else {
+                for (uint32_t k = n.begin; k < n.end; ++k) {
+                    if (visit(edges[byMin[k]])) return true;
+                }
+                if (n.left >= 0) stack[top++] = n.left;
+                if (n.right >= 0) stack[top++] = n.right;
+            }
+        }
+        return false;
+    }
+    
+    // Recorte de Liang-Barsky del segmento contra la ventana cerrada.
+    static bool segmentIntersectsRect(const Edge& e, const Rectangle& r) {
+        const double dx = e.x2 - e.x1, dy = e.y2 - e.y1;
+        double t0 = 0, t1 = 1;
+        auto clip = [&](const double p, const double q) {
+            if (p == 0) return q >= 0;
+            const double t = q / p;
+            if (p < 0) {
+                if (t > t1) return false;
+                t0 = std::max(t0, t);
+            } else {
+                if (t < t0) return false;
+                t1 = std::min(t1, t);
+            }
+            return true;
+        };
+        return clip(-dx, e.x1 - r.x1) && clip(dx, r.x2 - e.x1) &&
+               clip(-dy, e.y1 - r.y1) && clip(dy, r.y2 - e.y1);
+    }
+};
+
+// === UTILITY FUNCTIONS ===
+inline double distance2D(const Point2D &a, const Point2D &b) {
+    double dx = a.x - b.x, dy = a.y - b.y;
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+inline double distance3D(const Point3D &a, const Point3D &b) {
+    double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+// === DISK STORAGE MANAGER ===
+class DiskStorageManager {
+private:
+    std::string baseDir;
+    std::string dataFile;
+    std::string indexFile;
+    std::fstream dataStream;
+    std::fstream indexStream;
+    std::unordered_map<size_t, size_t> pageOffsets; // pageId -> file offset
+    size_t nextOffset = 0;
+    std::mutex mutex;
+    
+    // Ficheros sustituidos por una compactación: siguen abiertos (ya sin
+    // nombre) para las consultas que aún leen versiones anteriores.
+    struct Segment {
+        std::fstream stream;
+        std::unordered_map<size_t, size_t> offsets;
+    };
+    std::deque<std::unique_ptr<Segment>> previous;
+    
+    // Compactación en curso: se escribe sin bloquear las lecturas
+    std::fstream compactStream;
+    std::unordered_map<size_t, size_t> compactOffsets;
+    
+    static std::string readAt(std::fstream& stream, size_t offset) {
+        stream.clear();
+        stream.seekg(offset);
+        size_t dataSize;
+        stream.read(reinterpret_cast<char*>(&dataSize), sizeof(size_t));
+        
+        std::string data(dataSize, '\0');
+        stream.read(&data[0], dataSize);
+        return data;
+    }
+    
+public:
+    DiskStorageManager(const std::string& dir) : baseDir(dir) {
+        fs::create_directories(baseDir);
+        dataFile = baseDir + "/data.bin";
+        indexFile = baseDir + "/index.bin";
+        
+        // Open or create files
+        dataStream.open(dataFile, std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
+        if (!dataStream.is_open()) {
+            dataStream.open(dataFile, std::ios::binary | std::ios::out);
+            dataStream.close();
+            dataStream.open(dataFile, std::ios::binary | std::ios::in | std::ios::out);
+        }
+        
+        loadIndex();
+    }
+    
+    ~DiskStorageManager() {
+        saveIndex();
+        if (dataStream.is_open()) dataStream.close();
+    }
+    
+    void savePage(size_t pageId, const std::string& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        size_t dataSize = data.size();
+        
+        // El fichero se abre en modo append y las páginas cambian de tamaño:
+        // cada versión se escribe al final y el índice apunta a la última.
+        dataStream.clear();
+        dataStream.seekp(0, std::ios::end);
+        pageOffsets[pageId] = static_cast<size_t>(dataStream.tellp());
+        
+        dataStream.write(reinterpret_cast<const char*>(&dataSize), sizeof(size_t));
+        dataStream.write(data.c_str(), dataSize);
+        dataStream.flush();
+    }
+    
+    std::string loadPage(size_t pageId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto it = pageOffsets.find(pageId);
+        if (it != pageOffsets.end()) {
+            return readAt(dataStream, it->second);
+        }
+        for (auto seg = previous.rbegin(); seg != previous.rend(); ++seg) {
+            auto old = (*seg)->offsets.find(pageId);
+            if (old != (*seg)->offsets.end()) return readAt((*seg)->stream, old->second);
+        }
+        return "";
+    }
+    
+    void deletePage(size_t pageId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pageOffsets.erase(pageId);
+    }
+    
+    /// Bytes de data.bin, incluidas las versiones ya sustituidas de cada página.
+    size_t fileSize() {
+        std::lock_guard<std::mutex> lock(mutex);
+        dataStream.flush();
+        std::error_code ec;
+        const auto size = fs::file_size(dataFile, ec);
+        return ec ? 0 : static_cast<size_t>(size);
+    }
+    
+    // --- Compactación ---
+    // beginCompaction() abre data.bin.compact, appendCompacted() escribe en él
+    // las páginas vivas y commitCompaction() lo pone en lugar de data.bin. Solo
+    // quedan las páginas escritas en la compactación; las demás se siguen
+    // leyendo del fichero anterior hasta dropPreviousFile(). Si algo falla
+    // entre medias, abortCompaction() lo deshace.
+    
+    void beginCompaction() {
+        compactOffsets.clear();
+        compactStream.open(dataFile + ".compact", std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!compactStream) throw std::runtime_error("DiskStorageManager: no se puede crear " + dataFile + ".compact");
+    }
+    
+    void appendCompacted(size_t pageId, const std::string& data) {
+        const size_t dataSize = data.size();
+        compactOffsets[pageId] = static_cast<size_t>(compactStream.tellp());
+        compactStream.write(reinterpret_cast<const char*>(&dataSize), sizeof(size_t));
+        compactStream.write(data.c_str(), dataSize);
+    }
+    
+    /// Cierra y borra data.bin.compact: data.bin sigue como estaba.
+    void abortCompaction() {
+        compactStream.close();
+        compactStream.clear();
+        compactOffsets.clear();
+        std::error_code ec;
+        fs::remove(dataFile + ".compact", ec);
+    }
+    
+    void commitCompaction() {
+        compactStream.close();
+        if (!compactStream) throw std::runtime_error("DiskStorageManager: error al escribir " + dataFile + ".compact");
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        fs::rename(dataFile + ".compact", dataFile);
+        auto old = std::make_unique<Segment>();
+        old->stream = std::move(dataStream);
+        old->offsets = std::move(pageOffsets);
+        previous.push_back(std::move(old));
+        
+        pageOffsets = std::move(compactOffsets);
+        compactOffsets.clear();
+        dataStream = std::fstream(dataFile, std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
+        saveIndex();
+    }
+    
+    /// Cierra el fichero más antiguo sustituido por una compactación.
+    void dropPreviousFile() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!previous.empty()) previous.pop_front();
+    }
+    
+private:
+    void saveIndex() {
+        std::ofstream out(indexFile, std::ios::binary);
+        size_t count = pageOffsets.size();
+        out.write(reinterpret_cast<const char*>(&count), sizeof(size_t));
+        
+        for (const auto& [pageId, offset] : pageOffsets) {
+            out.write(reinterpret_cast<const char*>(&pageId), sizeof(size_t));
+            out.write(reinterpret_cast<const char*>(&offset), sizeof(size_t));
+        }
+    }
+    
+    void loadIndex() {
+        std::ifstream in(indexFile, std::ios::binary);
+        if (!in.is_open()) return;
+        
+        size_t count;
+        in.read(reinterpret_cast<char*>(&count), sizeof(size_t));
+        
+        for (size_t i = 0; i < count; ++i) {
+            size_t pageId, offset;
+            in.read(reinterpret_cast<char*>(&pageId), sizeof(size_t));
+            in.read(reinterpret_cast<char*>(&offset), sizeof(size_t));
+            pageOffsets[pageId] = offset;
+            nextOffset = std::max(nextOffset, offset);
+        }
+    }
+};
+
+// === LRU CACHE ===
+template<typename K, typename V>
+class LRUCache {
+private:
+    size_t capacity;
+    std::list<std::pair<K, V>> itemList;
+    std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator> itemMap;
+    mutable std::mutex mutex;
+    
+public:
+    LRUCache(size_t cap) : capacity(cap) {}
+    
+    // Delete copy operations
+    LRUCache(const LRUCache&) = delete;
+    LRUCache& operator=(const LRUCache&) = delete;
+    
+    // Move operations
+    LRUCache(LRUCache&&) = default;
+    LRUCache& operator=(LRUCache&&) = default;
+    
+    bool get(const K& key, V& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto it = itemMap.find(key);
+        if (it == itemMap.end()) {
+            return false;
+        }
+        
+        // Move to front
+        itemList.splice(itemList.begin(), itemList, it->second);
+        value = it->second->second;
+        return true;
+    }
+    
+    void put(const K& key, const V& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto it = itemMap.find(key);
+        if (it != itemMap.end()) {
+            // Update existing
+            it->second->second = value;
+            itemList.splice(itemList.begin(), itemList, it->second);
+            return;
+        }
+        
+        // Insert new
+        if (itemList.size() >= capacity) {
+            // Remove LRU
+            auto& lru = itemList.back();
+            itemMap.erase(lru.first);
+            itemList.pop_back();
+        }
+        
+        itemList.emplace_front(key, value);
+        itemMap[key] = itemList.begin();
+    }
+    
+    void remove(const K& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto it = itemMap.find(key);
+        if (it != itemMap.end()) {
+            itemList.erase(it->second);
+            itemMap.erase(it);
+        }
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        itemList.clear();
+        itemMap.clear();
+    }
+    
+    void setCapacity(size_t newCapacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = newCapacity;
+        while (itemList.size() > capacity) {
+            auto& lru = itemList.back();
+            itemMap.erase(lru.first);
+            itemList.pop_back();
+        }
+    }
+};
+
+// === STORAGE STRUCTURES ===
+struct DataPage {
+    std::vector<Point2D> points2D;
+    std::vector<uint64_t> ids2D; // id de cada punto 2D; vacío si ninguno de la página tiene
+    std::vector<Point3D> points3D;
+    std::vector<Polygon> polygons;
+    UnitVecArray units2D; // vectores unitarios de points2D (x = lat, y = lon); no se serializa
+    std::vector<PreparedPolygon> prepared; // paralelo a polygons; no se serializa
+    Rectangle mbr;
+    Box3D mbr3D; // solo de points3D
+    size_t pageId;
+    bool dirty = false;
+    
+    static const size_t MAX_ENTRIES = 128;
+    static constexpr uint64_t NO_ID = std::numeric_limits<uint64_t>::max();
+    
+    size_t entryCount() const {
+        return points2D.size() + points3D.size() + polygons.size();
+    }
+    
+    uint64_t id2D(size_t i) const { return ids2D.empty() ? NO_ID : ids2D[i]; }
+    
+    void add2D(const Point2D& p, uint64_t id = NO_ID) {
+        if (id != NO_ID || !ids2D.empty()) {
+            ids2D.resize(points2D.size(), NO_ID);
+            ids2D.push_back(id);
+        }
+        points2D.push_back(p);
+        units2D.push_back(p.x, p.y);
+    }
+    
+    void erase2D(size_t i) {
+        points2D.erase(points2D.begin() + i);
+        if (!ids2D.empty()) ids2D.erase(ids2D.begin() + i);
+        units2D.xs.erase(units2D.xs.begin() + i);
+        units2D.ys.erase(units2D.ys.begin() + i);
+        units2D.zs.erase(units2D.zs.begin() + i);
+    }
+    
+    // Añade las entradas de `other` (al compactar); no rehace las derivadas.
+    void append(const DataPage& other) {
+        if (!ids2D.empty() || !other.ids2D.empty()) {
+            ids2D.resize(points2D.size(), NO_ID);
+            for (size_t i = 0; i < other.points2D.size(); ++i) ids2D.push_back(other.id2D(i));
+        }
+        points2D.insert(points2D.end(), other.points2D.begin(), other.points2D.end());
+        points3D.insert(points3D.end(), other.points3D.begin(), other.points3D.end());
+        polygons.insert(polygons.end(), other.polygons.begin(), other.polygons.end());
+    }
+    
+    // Estructuras derivadas que no van al disco: se rehacen al leer o partir la página.
+    void refreshDerived() {
+        units2D.clear();
+        units2D.reserve(points2D.size());
+        for (const auto& p : points2D) units2D.push_back(p.x, p.y);
+        prepared.clear();
+        prepared.reserve(polygons.size());
+        for (const auto& poly : polygons) prepared.emplace_back(poly);
+    }
+    
+    // Mueve a `other` la mitad superior de cada tipo de entrada, ordenando por
+    // el eje más largo del MBR (split por la mediana). Si dominan los puntos 3D
+    // también se considera z.
+    void splitInto(DataPage& other) {
+        const bool byX = (mbr.x2 - mbr.x1) >= (mbr.y2 - mbr.y1);
+        const bool byZ = points3D.size() > points2D.size() + polygons.size() &&
+                         mbr3D.z2 - mbr3D.z1 > std::max(mbr3D.x2 - mbr3D.x1, mbr3D.y2 - mbr3D.y1);
+        auto moveHalf = [](auto& from, auto& to, auto key) {
+            std::sort(from.begin(), from.end(), [&](const auto& a, const auto& b) { return key(a) < key(b); });
+            const size_t half = from.size() / 2;
+            to.assign(std::make_move_iterator(from.begin() + half), std::make_move_iterator(from.end()));
+            from.resize(half);
+        };
+        // Los puntos 2D se ordenan con sus ids
+        std::vector<std::pair<Point2D, uint64_t>> entries2D;
+        for (size_t i = 0; i < points2D.size(); ++i) entries2D.emplace_back(points2D[i], id2D(i));
+        std::vector<std::pair<Point2D, uint64_t>> moved2D;
+        moveHalf(entries2D, moved2D, [byX](const std::pair<Point2D, uint64_t>& e) { return byX ? e.first.x : e.first.y; });
+        const bool withIds = !ids2D.empty();
+        auto unzip = [withIds](const auto& from, DataPage& to) {
+            to.points2D.clear();
+            to.ids2D.clear();
+            for (const auto& [p, id] : from) {
+                to.points2D.push_back(p);
+                if (withIds) to.ids2D.push_back(id);
+            }
+        };
+        unzip(entries2D, *this);
+        unzip(moved2D, other);
+        moveHalf(points3D, other.points3D, [byX, byZ](const Point3D& p) { return byZ ? p.z : byX ? p.x : p.y; });
+        moveHalf(polygons, other.polygons, [byX](const Polygon& poly) {
+            const Rectangle r = poly.getBoundingBox();
+            return byX ? r.x1 + r.x2 : r.y1 + r.y2;
+        });
+        updateMBR();
+        other.updateMBR();
+        refreshDerived();
+        other.refreshDerived();
+        dirty = other.dirty = true;
+    }
+    
+    void updateMBR() {
+        mbr3D = Box3D();
+        for (const auto& p : points3D) mbr3D = mbr3D.enlarge(p);
+        
+        if (points2D.empty() && points3D.empty() && polygons.empty()) {
+            mbr = Rectangle();
+            return;
+        }
+        
+        double minX = std::numeric_limits<double>::max();
+        double maxX = std::numeric_limits<double>::lowest();
+        double minY = std::numeric_limits<double>::max();
+        double maxY = std::numeric_limits<double>::lowest();
+        
+        for (const auto& p : points2D) {
+            minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+        }
+        
+        for (const auto& p : points3D) {
+            minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+        }
+        
+        for (const auto& poly : polygons) {
+            Rectangle polyMBR = poly.getBoundingBox();
+            minX = std::min(minX, polyMBR.x1); maxX = std::max(maxX, polyMBR.x2);
+            minY = std::min(minY, polyMBR.y1); maxY = std::max(maxY, polyMBR.y2);
+        }
+        
+        mbr = Rectangle(minX, minY, maxX, maxY);
+    }
+    
+    size_t getMemorySize() const {
+        return points2D.size() * sizeof(Point2D) + 
+               ids2D.size() * sizeof(uint64_t) +
+               points3D.size() * sizeof(Point3D) + 
+               polygons.size() * sizeof(Polygon);
+    }
+    
+    std::string serialize() const {
+        std::ostringstream oss;
+        
+        // Write counts
+        size_t count2D = points2D.size();
+        size_t count3D = points3D.size();
+        size_t countPoly = polygons.size();
+        
+        oss.write(reinterpret_cast<const char*>(&count2D), sizeof(size_t));
+        oss.write(reinterpret_cast<const char*>(&count3D), sizeof(size_t));
+                oss.write(reinterpret_cast<const char*>(&countPoly), sizeof(size_t));
+        
+        // Write MBR
+        mbr.serialize(oss);
+        mbr3D.serialize(oss);
+        
+        // Write 2D points
+        for (const auto& p : points2D) {
+            p.serialize(oss);
+        }
+        
+        // Write 3D points
+        for (const auto& p : points3D) {
+            p.serialize(oss);
+        }
+        
+        // Write polygons
+        for (const auto& poly : polygons) {
+            poly.serialize(oss);
+        }
+        
+        // Ids de los puntos 2D (0 si no hay)
+        size_t countIds = ids2D.size();
+        oss.write(reinterpret_cast<const char*>(&countIds), sizeof(size_t));
+        oss.write(reinterpret_cast<const char*>(ids2D.data()), countIds * sizeof(uint64_t));
+        return oss.str();
+    }
+
+    void deserialize(const std::string& data) {
+        std::istringstream iss(data);
+        
+        // Read counts
+        size_t count2D, count3D, countPoly;
+        iss.read(reinterpret_cast<char*>(&count2D), sizeof(size_t));
+        iss.read(reinterpret_cast<char*>(&count3D), sizeof(size_t));
+        iss.read(reinterpret_cast<char*>(&countPoly), sizeof(size_t));
+        
+        // Read MBR
+        mbr.deserialize(iss);
+        mbr3D.deserialize(iss);
+        
+        // Read 2D points
+        points2D.resize(count2D);
+        for (auto& p : points2D) {
+            p.deserialize(iss);
+        }
+        
+        // Read 3D points
+        points3D.resize(count3D);
+        for (auto& p : points3D) {
+            p.deserialize(iss);
+        }
+        
+        // Read polygons
+        polygons.resize(countPoly);
+        for (auto& poly : polygons) {
+            poly.deserialize(iss);
+        }
+        
+        // Las páginas escritas antes de los ids terminan aquí
+        size_t countIds = 0;
+        if (!iss.read(reinterpret_cast<char*>(&countIds), sizeof(size_t))) countIds = 0;
+        ids2D.resize(countIds);
+        iss.read(reinterpret_cast<char*>(ids2D.data()), countIds * sizeof(uint64_t));
+        
+        refreshDerived();
+    }
+};
+
+// === RTREE NODE ===
+struct RTreeNode {
+    Rectangle mbr;
+    Box3D mbr3D; // caja de los puntos 3D del subárbol (vacía si no hay)
+    std::vector<std::shared_ptr<RTreeNode>> children;
+    size_t dataPageId = std::numeric_limits<size_t>::max();
+    bool isLeaf = false;
+    size_t nodeId;
+    bool dirty = false;
+    // Puntos 2D del subárbol, para countQuery2D. NO_COUNT en nodos guardados
+    // antes de llevar la cuenta: se desconoce hasta que se reescriben.
+    static constexpr size_t NO_COUNT = std::numeric_limits<size_t>::max();
+    size_t count = NO_COUNT;
+    
+    static const size_t MAX_ENTRIES = 50;
+    static const size_t MIN_ENTRIES = 20;
+    
+    void updateMBR() {
+        mbr3D = Box3D();
+        if (children.empty()) {
+            mbr = Rectangle();
+            count = 0;
+            return;
+        }
+        
+        count = 0;
+        for (const auto& child : children) {
+            count = child->count == NO_COUNT || count == NO_COUNT ? NO_COUNT : count + child->count;
+        }
+        mbr = children[0]->mbr;
+        for (size_t i = 1; i < children.size(); ++i) {
+            mbr = mbr.enlarge(children[i]->mbr);
+        }
+        for (const auto& child : children) {
+            mbr3D = mbr3D.enlarge(child->mbr3D);
+        }
+        dirty = true;
+    }
+    
+    std::string serialize() const {
+        std::ostringstream oss;
+        
+        // Write node info
+        oss.write(reinterpret_cast<const char*>(&nodeId), sizeof(size_t));
+        oss.write(reinterpret_cast<const char*>(&isLeaf), sizeof(bool));
+        oss.write(reinterpret_cast<const char*>(&dataPageId), sizeof(size_t));
+        
+        // Write MBR
+        mbr.serialize(oss);
+        mbr3D.serialize(oss);
+        
+        // Write children count and IDs
+        size_t childCount = children.size();
+        oss.write(reinterpret_cast<const char*>(&childCount), sizeof(size_t));
+        
+        for (const auto& child : children) {
+            size_t childId = child->nodeId;
+            oss.write(reinterpret_cast<const char*>(&childId), sizeof(size_t));
+            child->mbr.serialize(oss);
+            child->mbr3D.serialize(oss);
+        }
+        
+        // Cuentas al final, para que los nodos antiguos (sin ellas) se sigan leyendo
+        oss.write(reinterpret_cast<const char*>(&count), sizeof(size_t));
+        for (const auto& child : children) {
+            oss.write(reinterpret_cast<const char*>(&child->count), sizeof(size_t));
+        }
+        
+        return oss.str();
+    }
+    
+    void deserialize(const std::string& data, const std::unordered_map<size_t, std::shared_ptr<RTreeNode>>& nodeMap) {
+        std::istringstream iss(data);
+        
+        // Read node info
+        iss.read(reinterpret_cast<char*>(&nodeId), sizeof(size_t));
+        iss.read(reinterpret_cast<char*>(&isLeaf), sizeof(bool));
+        iss.read(reinterpret_cast<char*>(&dataPageId), sizeof(size_t));
+        
+        // Read MBR
+        mbr.deserialize(iss);
+        mbr3D.deserialize(iss);
+        
+        // Read children
+        size_t childCount;
+        iss.read(reinterpret_cast<char*>(&childCount), sizeof(size_t));
+        
+        children.clear();
+        for (size_t i = 0; i < childCount; ++i) {
+            size_t childId;
+            Rectangle childMBR;
+            Box3D childMBR3D;
+            iss.read(reinterpret_cast<char*>(&childId), sizeof(size_t));
+            childMBR.deserialize(iss);
+            childMBR3D.deserialize(iss);
+            
+            // Child will be loaded on demand
+            auto childNode = std::make_shared<RTreeNode>();
+            childNode->nodeId = childId;
+            childNode->mbr = childMBR;
+            childNode->mbr3D = childMBR3D;
+            children.push_back(childNode);
+        }
+        
+        if (!iss.read(reinterpret_cast<char*>(&count), sizeof(size_t))) count = NO_COUNT;
+        for (const auto& child : children) {
+            if (!iss.read(reinterpret_cast<char*>(&child->count), sizeof(size_t))) child->count = NO_COUNT;
+        }
+    }
+};
+
+// === BASE INDEX CLASS ===
+class SpatialIndex {
+public:
+    virtual void insert2D(const Point2D& p) = 0;
+    virtual void insert3D(const Point3D& p) = 0;
+    virtual void insertPolygon(const Polygon& poly) = 0;
+    virtual std::vector<Point2D> rangeQuery2D(const Rectangle& window) = 0;
+    virtual QueryProgress rangeQuery2DEach(const Rectangle& window, const QueryOptions& opts,
+                                           const std::function<bool(const Point2D&)>& sink) = 0;
+    virtual std::vector<Point3D> rangeQuery3D(const Rectangle& window) = 0;
+    virtual std::vector<Point3D> rangeQuery3D(const Box3D& box) = 0;
+    virtual std::vector<Polygon> rangeQueryPolygon(const Rectangle& window) = 0;
+    virtual std::vector<Polygon> stabQuery(const Point2D& p) = 0;
+    virtual std::vector<Point2D> knnQuery2D(const Point2D& p, int k) = 0;
+    virtual std::vector<Point3D> knnQuery3D(const Point3D& p, int k) = 0;
+    virtual std::vector<Point2D> radiusQuery(const Point2D& center, double meters) = 0;
+    virtual std::vector<std::pair<double, Point2D>> radiusQueryWithDistances(const Point2D& center, double meters) = 0;
+    virtual void save(const std::string &filename) = 0;
+    virtual void load(const std::string &filename) = 0;
+    virtual std::string getStats() = 0;
+    virtual void flush() = 0;
+    virtual void setCacheSize(size_t size) = 0;
+    virtual ~SpatialIndex() = default;
+
+    /// Perfilado opcional de rangeQuery2D, knnQuery2D y radiusQuery (QueryProfile.hpp).
+    QueryProfiler& profiler() { return profiler_; }
+
+protected:
+    QueryProfiler profiler_;
+};
+
+// === DISK-BASED RTREE INDEX ===
+//
+// Concurrencia: un escritor y lectores sin bloqueo. Las inserciones se
+// serializan con writeMutex y nunca modifican un nodo ni una página visibles:
+// copian el camino raíz -> hoja (copy-on-write) con ids nuevos y publican la
+// raíz nueva de forma atómica. Cada consulta fija una época (Epoch.hpp) y lee
+// la versión publicada en ese momento; las versiones sustituidas se liberan, y
+// sus ids se borran del disco tras el siguiente flush(), cuando ya no queda
+// ningún lector que pueda verlas. Las cachés y el almacenamiento mantienen sus
+// mutex internos. load() no admite consultas concurrentes.
+//
+// Los puntos 2D con id se localizan con una tabla hash id -> página
+// (IdIndex.hpp) que el escritor actualiza al guardar cada página nueva y que
+// se guarda en ids.bin junto a meta.dat.
+class DiskRTreeIndex : public SpatialIndex {
+private:
+    // Raíz de trabajo del escritor; coincide con la publicada fuera de insertEntry.
+    std::shared_ptr<RTreeNode> root;
+    std::unique_ptr<DiskStorageManager> storage;
+    std::string indexDir;
+    std::unique_ptr<LRUCache<size_t, std::shared_ptr<DataPage>>> pageCache;
+    std::unique_ptr<LRUCache<size_t, std::shared_ptr<RTreeNode>>> nodeCache;
+    std::atomic<size_t> nextPageId{0};
+    std::atomic<size_t> nextNodeId{0};
+    
+    // Statistics (relaxed: solo informativas)
+    std::atomic<size_t> totalPoints2D{0};
+    std::atomic<size_t> totalPoints3D{0};
+    std::atomic<size_t> totalPolygons{0};
+    std::atomic<size_t> diskReads{0};
+    std::atomic<size_t> diskWrites{0};
+    std::atomic<size_t> cacheHits{0};
+    std::atomic<size_t> cacheMisses{0};
+    
+    // Versión que leen las consultas; seq sube con cada publish() y marca los
+    // cursores de rangeQuery2DEach
+    struct Version {
+        std::shared_ptr<RTreeNode> root;
+        uint64_t seq;
+    };
+    std::atomic<Version*> published{nullptr};
+    uint64_t publishedSeq = 0; // solo el escritor
+    EpochManager epochs;
+    std::mutex writeMutex;
+    
+    // id de punto 2D -> página que lo tiene. Solo la modifica el escritor, con
+    // idMutex en exclusiva; getById la lee con idMutex compartido.
+    IdHashIndex<uint64_t> idIndex;
+    mutable std::shared_mutex idMutex;
+    bool idsDirty = false; // cambios desde el último ids.bin
+    uint64_t idsSavedAt = 0; // nextPageId de la cabecera del último ids.bin
+    
+    // Ids sustituidos desde el último flush(): el disco aún los referencia
+    std::vector<size_t> obsoletePages;
+    std::vector<size_t> obsoleteNodes;
+    
+    // Los nodos se guardan en el almacenamiento con la clave nodeKeyBase + id.
+    // Los índices de formato 1 usan 1000000; con copy-on-write los ids de
+    // página crecen con cada inserción, así que el formato 2 usa 2^62.
+    static constexpr size_t META_FORMAT = 2;
+    static constexpr size_t LEGACY_NODE_KEY_BASE = 1000000;
+    static constexpr size_t NODE_KEY_BASE = size_t(1) << 62;
+    size_t nodeKeyBase = NODE_KEY_BASE;
+    
+    // Cabecera de ids.bin: marca y el nextPageId de meta.dat al escribirlo; si
+    // no coincide al abrir, la tabla se reconstruye desde las hojas.
+    static constexpr uint64_t IDS_MAGIC = 0x3153444952545344ull; // "DSTRIDS1"
+    
+    size_t nodeKey(size_t nodeId) const { return nodeKeyBase + nodeId; }
+    
+    static void bump(std::atomic<size_t>& counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+    
+    // Raíz publicada; sus ids en disco siguen siendo válidos mientras viva el
+    // EpochManager::Guard tomado antes de llamarla.
+    std::shared_ptr<RTreeNode> snapshot() const {
+        return published.load(std::memory_order_seq_cst)->root;
+    }
+    
+    // Solo el escritor: publica `root` y retira la versión anterior.
+    void publish() {
+        Version* old = published.exchange(new Version{root, ++publishedSeq}, std::memory_order_seq_cst);
+        if (old) epochs.retire([old] { delete old; });
+        epochs.reclaim();
+    }
+    
+    std::shared_ptr<DataPage> loadPage(size_t pageId) {
+        NullProfile none;
+        return loadPage(pageId, none);
+    }
+    
+    // Los fallos de caché cuentan como fase Load y suman los bytes leídos al perfil.
+    template <typename Profile>
+    std::shared_ptr<DataPage> loadPage(size_t pageId, Profile& prof) {
+        std::shared_ptr<DataPage> page;
+        
+        // Check cache
+        if (pageCache->get(pageId, page)) {
+            bump(cacheHits);
+            return page;
+        }
+        
+        bump(cacheMisses);
+        bump(diskReads);
+        
+        // Load from disk
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Load);
+        std::string data = storage->loadPage(pageId);
+        prof.bytes(data.size());
+        if (data.empty()) {
+            return nullptr;
+        }
+        
+        page = std::make_shared<DataPage>();
+        page->pageId = pageId;
+        page->deserialize(data);
+        
+        // Add to cache
+        pageCache->put(pageId, page);
+        
+        return page;
+    }
+    
+    void savePage(std::shared_ptr<DataPage> page) {
+        if (!page->dirty) return;
+        
+        bump(diskWrites);
+        storage->savePage(page->pageId, page->serialize());
+        page->dirty = false;
+        indexIds(*page);
+    }
+    
+    // Apunta a `page` los ids de sus puntos 2D. Con writeMutex tomado.
+    void indexIds(const DataPage& page) {
+        if (page.ids2D.empty()) return;
+        std::unique_lock<std::shared_mutex> lock(idMutex);
+        for (const uint64_t id : page.ids2D) {
+            if (id != DataPage::NO_ID) idIndex.assign(id, page.pageId);
+        }
+        idsDirty = true;
+    }
+    
+    // Quita el id de la tabla tras un borrado. En un movimiento no se quita: la
+    // reinserción lo apunta a su página nueva y, mientras, getById ve la antigua.
+    void forgetId(const std::optional<uint64_t>& id) {
+        if (!id || *id == DataPage::NO_ID) return;
+        std::unique_lock<std::shared_mutex> lock(idMutex);
+        idIndex.erase(*id);
+        idsDirty = true;
+    }
+    
+    // Punto 2D con ese id según la tabla (sin candado: el llamador toma
+    // idMutex o writeMutex).
+    std::optional<Point2D> locate(uint64_t id) {
+        const uint64_t pageId = idIndex.find(id);
+        if (pageId == idIndex.NONE) return std::nullopt;
+        return pointInPage(id, pageId);
+    }
+    
+    std::optional<Point2D> pointInPage(uint64_t id, uint64_t pageId) {
+        const auto page = loadPage(pageId);
+        if (!page) return std::nullopt;
+        for (size_t i = 0; i < page->ids2D.size(); ++i) {
+            if (page->ids2D[i] == id) return page->points2D[i];
+        }
+        return std::nullopt;
+    }
+    
+    std::shared_ptr<RTreeNode> loadNode(size_t nodeId) {
+        NullProfile none;
+        return loadNode(nodeId, none);
+    }
+    
+    template <typename Profile>
+    std::shared_ptr<RTreeNode> loadNode(size_t nodeId, Profile& prof) {
+        std::shared_ptr<RTreeNode> node;
+        
+        // Check cache
+        if (nodeCache->get(nodeId, node)) {
+            bump(cacheHits);
+            return node;
+        }
+        
+        bump(cacheMisses);
+        bump(diskReads);
+        
+        // Load from disk
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Load);
+        std::string data = storage->loadPage(nodeKey(nodeId));
+        prof.bytes(data.size());
+        if (data.empty()) {
+            return nullptr;
+        }
+        
+        node = std::make_shared<RTreeNode>();
+        std::unordered_map<size_t, std::shared_ptr<RTreeNode>> emptyMap;
+        node->deserialize(data, emptyMap);
+        
+        // Add to cache
+        nodeCache->put(nodeId, node);
+        
+        return node;
+    }
+    
+    void saveNode(std::shared_ptr<RTreeNode> node) {
+        if (!node->dirty) return;
+        
+        bump(diskWrites);
+        storage->savePage(nodeKey(node->nodeId), node->serialize());
+        node->dirty = false;
+    }
+    
+    // Camino raíz -> hoja de menor ampliación para `mbr`, con el índice del hijo
+    // elegido en cada nivel en `slots`. Elige con los MBR guardados en el padre
+    // y solo lee del disco el hijo elegido: los nodos del camino pueden estar
+    // leyéndolos otras consultas y no se tocan. Para entradas 3D (box3D no
+    // vacía) los empates en 2D se deshacen por la ampliación en z. Con `depth`
+    // se para en ese nivel (0 = raíz) para reinsertar subárboles.
+    std::vector<std::shared_ptr<RTreeNode>> choosePath(const Rectangle& mbr, const Box3D& box3D,
+                                                       std::vector<size_t>& slots,
+                                                       size_t depth = std::numeric_limits<size_t>::max()) {
+        std::vector<std::shared_ptr<RTreeNode>> path{root};
+        auto node = root;
+        while (!node->isLeaf && path.size() <= depth) {
+            // Choose best child
+            std::shared_ptr<RTreeNode> best = nullptr;
+            size_t bestSlot = 0;
+            double minEnlargement = std::numeric_limits<double>::max();
+            double minZEnlargement = std::numeric_limits<double>::max();
+            
+            for (size_t c = 0; c < node->children.size(); ++c) {
+                const auto& child = node->children[c];
+                double enlargement = child->mbr.enlarge(mbr).area() - child->mbr.area();
+                double zEnlargement = 0;
+                if (!box3D.empty()) {
+                    const Box3D grown = child->mbr3D.enlarge(box3D);
+                    zEnlargement = (grown.z2 - grown.z1) - (child->mbr3D.empty() ? 0 : child->mbr3D.z2 - child->mbr3D.z1);
+                }
+                if (!best || enlargement < minEnlargement || 
+                    (enlargement == minEnlargement && (zEnlargement < minZEnlargement ||
+                     (zEnlargement == minZEnlargement && child->mbr.area() < best->mbr.area())))) {
+                    minEnlargement = enlargement;
+                    minZEnlargement = zEnlargement;
+                    best = child;
+                    bestSlot = c;
+                }
+            }
+            if (!best) throw std::runtime_error("DiskRTreeIndex: nodo interno sin hijos");
+            
+            node = resolveNode(best);
+            if (!node) throw std::runtime_error("DiskRTreeIndex: nodo " + std::to_string(best->nodeId) + " no encontrado en disco");
+            slots.push_back(bestSlot);
+            path.push_back(node);
+        }
+        
+        return path;
+    }
+    
+    // Copy-on-write: copia los nodos del camino con ids nuevos y engancha cada
+    // copia en la del nivel de arriba. Los originales quedan intactos para las
+    // consultas en curso; sus ids se borran del disco tras el próximo flush().
+    std::vector<std::shared_ptr<RTreeNode>> copyPath(const std::vector<std::shared_ptr<RTreeNode>>& path,
+                                                     const std::vector<size_t>& slots) {
+        std::vector<std::shared_ptr<RTreeNode>> copies(path.size());
+        for (size_t i = path.size(); i-- > 0;) {
+            auto copy = std::make_shared<RTreeNode>(*path[i]);
+            obsoleteNodes.push_back(path[i]->nodeId);
+            copy->nodeId = nextNodeId++;
+            copy->dirty = true;
+            if (i + 1 < path.size()) copy->children[slots[i]] = copies[i + 1];
+            copies[i] = std::move(copy);
+        }
+        return copies;
+    }
+    
+    std::pair<std::shared_ptr<RTreeNode>, std::shared_ptr<RTreeNode>> splitNode(std::shared_ptr<RTreeNode> node) {
+        auto newNode = std::make_shared<RTreeNode>();
+        newNode->isLeaf = node->isLeaf;
+        newNode->nodeId = nextNodeId++;
+        
+        // Quadratic split
+        size_t seed1 = 0, seed2 = 1;
+        double maxWaste = 0;
+        
+        // Find two seeds with maximum waste
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            for (size_t j = i + 1; j < node->children.size(); ++j) {
+                Rectangle combined = node->children[i]->mbr.enlarge(node->children[j]->mbr);
+                double waste = combined.area() - node->children[i]->mbr.area() - node->children[j]->mbr.area();
+                if (waste > maxWaste) {
+                    maxWaste = waste;
+                    seed1 = i;
+                    seed2 = j;
+                }
+            }
+        }
+        
+        // Distribute entries
+        std::vector<std::shared_ptr<RTreeNode>> group1, group2;
+        group1.push_back(node->children[seed1]);
+        group2.push_back(node->children[seed2]);
+        
+        Rectangle mbr1 = node->children[seed1]->mbr;
+        Rectangle mbr2 = node->children[seed2]->mbr;
+        
+        for (size_t i = 0; i < node->children.size(); ++i) {
+            if (i == seed1 || i == seed2) continue;
+            
+            double enlargement1 = mbr1.enlarge(node->children[i]->mbr).area() - mbr1.area();
+            double enlargement2 = mbr2.enlarge(node->children[i]->mbr).area() - mbr2.area();
+            
+            if (enlargement1 < enlargement2 || 
+                (enlargement1 == enlargement2 && group1.size() < group2.size())) {
+                group1.push_back(node->children[i]);
+                mbr1 = mbr1.enlarge(node->children[i]->mbr);
+            } else {
+                group2.push_back(node->children[i]);
+                mbr2 = mbr2.enlarge(node->children[i]->mbr);
+            }
+        }
+        
+        // Ensure minimum fill
+        while (group1.size() < RTreeNode::MIN_ENTRIES && !group2.empty()) {
+            group1.push_back(group2.back());
+            group2.pop_back();
+        }
+        while (group2.size() < RTreeNode::MIN_ENTRIES && !group1.empty()) {
+            group2.push_back(group1.back());
+            group1.pop_back();
+        }
+        
+        node->children = group1;
+        node->updateMBR();
+        node->dirty = true;
+        
+        newNode->children = group2;
+        newNode->updateMBR();
+        newNode->dirty = true;
+        
+        return {node, newNode};
+    }
+    
+    // Inserta una entrada en la hoja elegida para `mbr` sobre una copia del
+    // camino y de la página (copy-on-write): `add` la mete en la página; después
+    // el MBR de la hoja sigue al de su página y se ajustan los ancestros. Si la
+    // página se pasa de DataPage::MAX_ENTRIES, se parte. Al final se publica la
+    // raíz nueva.
+    template <typename AddFn>
+    void insertEntry(const Rectangle& mbr, AddFn add, const Box3D& box3D = Box3D()) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        insertLocked(mbr, add, box3D);
+        publish();
+    }
+    
+    // insertEntry sin candado ni publicación (con writeMutex tomado).
+    template <typename AddFn>
+    void insertLocked(const Rectangle& mbr, AddFn add, const Box3D& box3D = Box3D()) {
+        std::vector<size_t> slots;
+        auto path = copyPath(choosePath(mbr, box3D, slots), slots);
+        root = path.front();
+        auto leaf = path.back();
+        
+        std::shared_ptr<DataPage> page;
+        if (leaf->dataPageId != std::numeric_limits<size_t>::max()) {
+            if (auto current = loadPage(leaf->dataPageId)) {
+                page = std::make_shared<DataPage>(*current);
+            }
+            obsoletePages.push_back(leaf->dataPageId);
+        }
+        if (!page) page = std::make_shared<DataPage>();
+        page->pageId = nextPageId++;
+        leaf->dataPageId = page->pageId;
+        pageCache->put(page->pageId, page);
+        
+        add(*page);
+        page->updateMBR();
+        page->dirty = true;
+        leaf->mbr = page->mbr;
+        leaf->mbr3D = page->mbr3D;
+        leaf->count = page->points2D.size();
+        leaf->dirty = true;
+        
+        if (page->entryCount() > DataPage::MAX_ENTRIES) {
+            splitLeaf(path, page);
+        } else {
+            savePage(page);
+            for (size_t i = path.size() - 1; i-- > 0;) {
+                path[i]->updateMBR();
+            }
+        }
+    }
+    
+    void splitLeaf(const std::vector<std::shared_ptr<RTreeNode>>& path, std::shared_ptr<DataPage> page) {
+        auto sibling = std::make_shared<DataPage>();
+        sibling->pageId = nextPageId++;
+        page->splitInto(*sibling);
+        pageCache->put(sibling->pageId, sibling);
+        savePage(page);
+        savePage(sibling);
+        
+        auto leaf = path.back();
+        leaf->mbr = page->mbr;
+        leaf->mbr3D = page->mbr3D;
+        leaf->count = page->points2D.size();
+        leaf->dirty = true;
+        
+        auto newLeaf = std::make_shared<RTreeNode>();
+        newLeaf->nodeId = nextNodeId++;
+        newLeaf->isLeaf = true;
+        newLeaf->dataPageId = sibling->pageId;
+        newLeaf->mbr = sibling->mbr;
+        newLeaf->mbr3D = sibling->mbr3D;
+        newLeaf->count = sibling->points2D.size();
+        newLeaf->dirty = true;
+        
+        addToPath(path, path.size() - 1, newLeaf);
+    }
+    
+    // Engancha `pending` en path[levels - 1] y ajusta los MBR de ahí a la raíz;
+    // cada nodo que desborde se parte y sube la mitad nueva. Si se parte la
+    // raíz, el árbol crece un nivel y devuelve true. Los nodos de
+    // path[0, levels) deben ser copias (copyPath).
+    bool addToPath(const std::vector<std::shared_ptr<RTreeNode>>& path, size_t levels,
+                   std::shared_ptr<RTreeNode> pending) {
+        for (size_t i = levels; i-- > 0;) {
+            auto parent = path[i];
+            if (pending) {
+                parent->children.push_back(pending);
+                pending = nullptr;
+            }
+            parent->updateMBR();
+            if (parent->children.size() > RTreeNode::MAX_ENTRIES) {
+                pending = splitNode(parent).second;
+            }
+        }
+        
+        if (!pending) return false;
+        growRoot(pending);
+        return true;
+    }
+    
+    // Raíz nueva con la actual y `sibling` (de la misma altura) como hijos.
+    void growRoot(std::shared_ptr<RTreeNode> sibling) {
+        auto newRoot = std::make_shared<RTreeNode>();
+        newRoot->nodeId = nextNodeId++;
+        newRoot->isLeaf = false;
+        newRoot->children.push_back(root);
+        newRoot->children.push_back(sibling);
+        newRoot->updateMBR();
+        newRoot->dirty = true;
+        root = newRoot;
+    }
+    
+    // --- Borrado ---
+    
+    // Emparejadores para removeLocked: posición del punto en la página o npos
+    static auto exactly(const Point2D& p) {
+        return [p](const DataPage& page) {
+            for (size_t i = 0; i < page.points2D.size(); ++i) {
+                if (page.points2D[i].x == p.x && page.points2D[i].y == p.y) return i;
+            }
+            return std::numeric_limits<size_t>::max();
+        };
+    }
+    
+    static auto withId(uint64_t id) {
+        return [id](const DataPage& page) {
+            for (size_t i = 0; i < page.ids2D.size(); ++i) {
+                if (page.ids2D[i] == id) return i;
+            }
+            return std::numeric_limits<size_t>::max();
+        };
+    }
+    
+    // Busca en el subárbol de `node` (que ya es path.back()) una página cuyo
+    // `match(page)` devuelva la posición de un punto 2D; deja en path/slots el
+    // camino hasta su hoja. Solo baja por los hijos cuyo MBR corta `box`.
+    template <typename Match>
+    bool findEntry(const Rectangle& box, Match& match, std::vector<std::shared_ptr<RTreeNode>>& path,
+                   std::vector<size_t>& slots, size_t& position) {
+        const auto node = path.back();
+        if (node->isLeaf) {
+            if (node->dataPageId == std::numeric_limits<size_t>::max()) return false;
+            const auto page = loadPage(node->dataPageId);
+            if (!page) return false;
+            position = match(*page);
+            return position != std::numeric_limits<size_t>::max();
+        }
+        for (size_t c = 0; c < node->children.size(); ++c) {
+            if (!node->children[c]->mbr.intersects(box)) continue;
+            auto child = resolveNode(node->children[c]);
+            if (!child) continue;
+            path.push_back(child);
+            slots.push_back(c);
+            if (findEntry(box, match, path, slots, position)) return true;
+            path.pop_back();
+            slots.pop_back();
+        }
+        return false;
+    }
+    
+    // Borra el punto 2D que encuentre `match` en las hojas que cortan `box`,
+    // sobre una copia del camino, y condensa el árbol. Devuelve el id del punto
+    // borrado (NO_ID si no tenía) o nullopt si no estaba. Con writeMutex tomado.
+    template <typename Match>
+    std::optional<uint64_t> removeLocked(const Rectangle& box, Match match) {
+        std::vector<std::shared_ptr<RTreeNode>> found{root};
+        std::vector<size_t> slots;
+        size_t position = 0;
+        if (!findEntry(box, match, found, slots, position)) return std::nullopt;
+        
+        auto path = copyPath(found, slots);
+        root = path.front();
+        auto leaf = path.back();
+        
+        auto page = std::make_shared<DataPage>(*loadPage(leaf->dataPageId));
+        obsoletePages.push_back(leaf->dataPageId);
+        const uint64_t id = page->id2D(position);
+        page->erase2D(position);
+        page->updateMBR();
+        
+        if (page->entryCount() == 0) {
+            leaf->dataPageId = std::numeric_limits<size_t>::max();
+            leaf->mbr = Rectangle();
+            leaf->mbr3D = Box3D();
+            leaf->count = 0;
+        } else {
+            page->pageId = nextPageId++;
+            page->dirty = true;
+            pageCache->put(page->pageId, page);
+            savePage(page);
+            leaf->dataPageId = page->pageId;
+            leaf->mbr = page->mbr;
+            leaf->mbr3D = page->mbr3D;
+            leaf->count = page->points2D.size();
+        }
+        leaf->dirty = true;
+        condenseTree(path, slots);
+        totalPoints2D.fetch_sub(1, std::memory_order_relaxed);
+        return id;
+    }
+    
+    // Condensación tras un borrado (Guttman): sube por el camino copiado
+    // quitando de su padre las hojas vacías y los nodos internos con menos de
+    // RTreeNode::MIN_ENTRIES hijos; los hijos de estos se reinsertan enteros a
+    // su altura. Al final la raíz baja mientras tenga un solo hijo.
+    void condenseTree(const std::vector<std::shared_ptr<RTreeNode>>& path, const std::vector<size_t>& slots) {
+        // (subárbol, altura): las hojas tienen altura 0
+        std::vector<std::pair<std::shared_ptr<RTreeNode>, size_t>> orphans;
+        size_t height = path.size() - 1;
+        for (size_t i = path.size(); i-- > 1;) {
+            const auto node = path[i];
+            const bool underflow = node->isLeaf ? node->dataPageId == std::numeric_limits<size_t>::max()
+                                                : node->children.size() < RTreeNode::MIN_ENTRIES;
+            if (underflow) {
+                auto& siblings = path[i - 1]->children;
+                siblings.erase(siblings.begin() + slots[i - 1]);
+                for (const auto& child : node->children) orphans.emplace_back(child, path.size() - 2 - i);
+            } else if (!node->isLeaf) {
+                node->updateMBR();
+            }
+        }
+        if (!root->isLeaf) root->updateMBR();
+        
+        // Los más altos primero; si la raíz se ha quedado vacía, el primero la sustituye
+        std::stable_sort(orphans.begin(), orphans.end(),
+                         [](const auto& a, const auto& b) { return a.second > b.second; });
+        for (auto& [subtree, h] : orphans) {
+            if (!root->isLeaf && root->children.empty()) {
+                root = resolveNode(subtree);
+                if (!root) throw std::runtime_error("DiskRTreeIndex: nodo " + std::to_string(subtree->nodeId) + " no encontrado en disco");
+                height = h;
+            } else if (h == height) {
+                growRoot(subtree);
+                ++height;
+            } else {
+                std::vector<size_t> chosen;
+                auto target = copyPath(choosePath(subtree->mbr, subtree->mbr3D, chosen, height - h - 1), chosen);
+                root = target.front();
+                if (addToPath(target, target.size(), subtree)) ++height;
+            }
+        }
+        
+        while (!root->isLeaf && root->children.size() == 1) {
+            auto child = resolveNode(root->children.front());
+            if (!child) break;
+            root = child;
+        }
+        if (!root->isLeaf && root->children.empty()) {
+            root = std::make_shared<RTreeNode>();
+            root->nodeId = nextNodeId++;
+            root->isLeaf = true;
+            root->count = 0;
+            root->dirty = true;
+        }
+    }
+    
+    // Solo baja por los subárboles cuya caja 3D corta la consulta.
+    void rangeSearch3DNode(std::shared_ptr<RTreeNode> node, const Box3D& box, std::vector<Point3D>& results) {
+        node = resolveNode(node);
+        if (!node || !node->mbr3D.intersects(box)) return;
+        
+        if (!node->isLeaf) {
+            for (auto& child : node->children) {
+                rangeSearch3DNode(child, box, results);
+            }
+            return;
+        }
+        if (node->dataPageId == std::numeric_limits<size_t>::max()) return;
+        auto page = loadPage(node->dataPageId);
+        if (!page) return;
+        for (const auto& p : page->points3D) {
+            if (box.contains(p)) results.push_back(p);
+        }
+    }
+    
+    // Cursor de rangeQuery2DEach: en los 20 bits altos la marca de la versión
+    // que se recorría, después el índice de hijo por nivel (6 bits cada uno) y
+    // la posición en la página en los 8 bits bajos. La marca nunca es 0, así
+    // que un cursor para continuar tampoco; se repite cada 2^20 - 1 versiones.
+    static constexpr int CURSOR_STAMP_BITS = 20;
+    static constexpr int CURSOR_CHILD_BITS = 6;
+    static constexpr int CURSOR_OFFSET_BITS = 8;
+    static constexpr int CURSOR_MAX_DEPTH = (64 - CURSOR_STAMP_BITS - CURSOR_OFFSET_BITS) / CURSOR_CHILD_BITS;
+    
+    static int cursorShift(int level) { return 64 - CURSOR_STAMP_BITS - CURSOR_CHILD_BITS * (level + 1); }
+    static uint64_t cursorStamp(const uint64_t seq) {
+        return (seq % ((uint64_t(1) << CURSOR_STAMP_BITS) - 1) + 1) << (64 - CURSOR_STAMP_BITS);
+    }
+    
+    // rangeQuery2DEach sobre la versión (root, seq), que el llamador mantiene
+    // fijada con un Guard. Un cursor de otra versión no vale: tras un split o
+    // un borrado los índices de hijo apuntan a otros subárboles.
+    QueryProgress rangeEachVersion(const std::shared_ptr<RTreeNode>& top, const uint64_t seq, const Rectangle& window,
+                                   const QueryOptions& opts, const std::function<bool(const Point2D&)>& sink) {
+        const uint64_t stamp = cursorStamp(seq);
+        const uint64_t stampMask = ~uint64_t(0) << (64 - CURSOR_STAMP_BITS);
+        if (opts.cursor != 0 && (opts.cursor & stampMask) != stamp) {
+            throw std::runtime_error("rangeQuery2DEach: el cursor es de una versión anterior del índice");
+        }
+        QueryBudget budget(opts);
+        uint64_t cursor = 0;
+        rangeEachNode(top, window, 0, true, opts.cursor, stamp, budget, sink, cursor);
+        return budget.finish(cursor);
+    }
+    
+    // onPath: el camino hasta aquí coincide con el del cursor de partida, así
+    // que se salta lo anterior a él; fuera del camino se recorre entero.
+    bool rangeEachNode(std::shared_ptr<RTreeNode> node, const Rectangle& window, int level,
+                       bool onPath, uint64_t from, uint64_t prefix, QueryBudget& budget,
+                       const std::function<bool(const Point2D&)>& sink, uint64_t& cursor) {
+        node = resolveNode(node);
+        if (!node || !node->mbr.intersects(window)) return false;
+        
+        if (node->isLeaf) {
+            const size_t start = onPath ? (from & ((uint64_t(1) << CURSOR_OFFSET_BITS) - 1)) : 0;
+            if (budget.interrupted()) {
+                cursor = prefix | start;
+                return true;
+            }
+            if (node->dataPageId == std::numeric_limits<size_t>::max()) return false;
+            auto page = loadPage(node->dataPageId);
+            if (!page) return false;
+            for (size_t i = start; i < page->points2D.size(); ++i) {
+                const Point2D& p = page->points2D[i];
+                if (!window.contains(p)) continue;
+                if (!budget.admit()) {
+                    cursor = prefix | i;
+                    return true;
+                }
+                if (!sink(p)) {
+                    budget.stop();
+                    cursor = prefix | (i + 1);
+                    return true;
+                }
+            }
+            return false;
+        }
+        
+        if (level >= CURSOR_MAX_DEPTH) {
+            throw std::runtime_error("rangeQuery2DEach: árbol demasiado profundo para el cursor");
+        }
+        const int shift = cursorShift(level);
+        const size_t first = onPath ? ((from >> shift) & ((uint64_t(1) << CURSOR_CHILD_BITS) - 1)) : 0;
+        for (size_t c = first; c < node->children.size(); ++c) {
+            if (rangeEachNode(node->children[c], window, level + 1, onPath && c == first, from,
+                              prefix | (uint64_t(c) << shift), budget, sink, cursor)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void stabSearchNode(std::shared_ptr<RTreeNode> node, const Point2D& p, std::vector<Polygon>& results) {
+        node = resolveNode(node);
+        if (!node || !node->mbr.contains(p)) return;
+        
+        if (!node->isLeaf) {
+            for (auto& child : node->children) {
+                stabSearchNode(child, p, results);
+            }
+            return;
+        }
+        if (node->dataPageId == std::numeric_limits<size_t>::max()) return;
+        auto page = loadPage(node->dataPageId);
+        if (!page) return;
+        for (size_t i = 0; i < page->polygons.size(); ++i) {
+            if (page->prepared[i].contains(p)) {
+                results.push_back(page->polygons[i]);
+            }
+        }
+    }
+    
+    // Nodo listo para recorrer: si `node` es un hijo aún sin cargar, lo lee del disco.
+    std::shared_ptr<RTreeNode> resolveNode(const std::shared_ptr<RTreeNode>& node) {
+        NullProfile none;
+        return resolveNode(node, none);
+    }
+    
+    template <typename Profile>
+    std::shared_ptr<RTreeNode> resolveNode(const std::shared_ptr<RTreeNode>& node, Profile& prof) {
+        if (!node->children.empty() || node->isLeaf) return node;
+        return loadNode(node->nodeId, prof);
+    }
+    
+    // Radio geodésico (x = lat, y = lon): poda con el MINDIST esférico del MBR y
+    // acepta sin comprobar los subárboles cuyo MAXDIST cabe en el radio.
+    template <typename Profile>
+    void radiusSearchNode(std::shared_ptr<RTreeNode> node, size_t level, double lat, double lon,
+                          const UnitVec& uq, double c2max, bool withDist, bool acceptAll,
+                          std::vector<std::pair<double, Point2D>>& out, std::vector<double>& d2,
+                          Profile& prof) {
+        node = resolveNode(node, prof);
+        if (!node) return;
+        prof.node(level);
+        const Rectangle& r = node->mbr;
+        if (!acceptAll) {
+            prof.distances(1);
+            if (sphericalMinChord2(lat, lon, r.x1, r.y1, r.x2, r.y2) > c2max) return;
+            acceptAll = !withDist && sphericalMaxChord2(lat, lon, r.x1, r.y1, r.x2, r.y2) <= c2max;
+        }
+        
+        if (!node->isLeaf) {
+            for (auto& child : node->children) {
+                radiusSearchNode(child, level + 1, lat, lon, uq, c2max, withDist, acceptAll, out, d2, prof);
+            }
+            return;
+        }
+        if (node->dataPageId == std::numeric_limits<size_t>::max()) return;
+        auto page = loadPage(node->dataPageId, prof);
+        if (!page) return;
+        
+        prof.leaf();
+        prof.tested(page->points2D.size());
+        if (acceptAll) {
+            for (const auto& p : page->points2D) out.emplace_back(0.0, p);
+            return;
+        }
+        const auto& units = page->units2D;
+        prof.distances(units.size());
+        d2.resize(units.size());
+        chord2Batch(uq, units.xs.data(), units.ys.data(), units.zs.data(), units.size(), d2.data());
+        for (size_t i = 0; i < units.size(); ++i) {
+            if (d2[i] <= c2max) out.emplace_back(d2[i], page->points2D[i]);
+        }
+    }
+    
+    template <typename Profile>
+    void rangeSearchNode(std::shared_ptr<RTreeNode> node, size_t level, const Rectangle& window, 
+                        std::vector<Point2D>& results2D, std::vector<Polygon>& resultsPolygon,
+                        Profile& prof) {
+        if (!node->mbr.intersects(window)) return;
+        prof.node(level);
+        
+        if (node->isLeaf) {
+            if (node->dataPageId != std::numeric_limits<size_t>::max()) {
+                auto page = loadPage(node->dataPageId, prof);
+                if (page) {
+                    prof.leaf();
+                    prof.tested(page->points2D.size() + page->polygons.size());
+                    for (const auto& p : page->points2D) {
+                        if (window.contains(p)) {
+                            results2D.push_back(p);
+                        }
+                    }
+                    
+                    // Filtro por caja y refinamiento exacto con la geometría preparada
+                    for (size_t i = 0; i < page->polygons.size(); ++i) {
+                        if (page->prepared[i].intersects(window)) {
+                            resultsPolygon.push_back(page->polygons[i]);
+                        }
+                    }
+                }
+            }
+        } else {
+            for (auto& child : node->children) {
+                if (!child->children.empty() || child->isLeaf) {
+                    rangeSearchNode(child, level + 1, window, results2D, resultsPolygon, prof);
+                } else {
+                    auto loadedChild = loadNode(child->nodeId, prof);
+                    if (loadedChild) {
+                        rangeSearchNode(loadedChild, level + 1, window, results2D, resultsPolygon, prof);
+                    }
+                }
+            }
+        }
+    }
+    
+    // Un hijo cubierto por la ventana aporta la cuenta guardada en su padre sin
+    // cargarse; solo se leen los nodos y páginas que cortan el borde (o los
+    // que no tienen cuenta, de índices guardados antes de llevarla).
+    size_t countNode(const std::shared_ptr<RTreeNode>& child, const Rectangle& window) {
+        if (!child->mbr.intersects(window)) return 0;
+        if (child->count != RTreeNode::NO_COUNT && window.contains(child->mbr)) return child->count;
+        const auto node = resolveNode(child);
+        if (!node) return 0;
+        size_t total = 0;
+        if (!node->isLeaf) {
+            for (const auto& c : node->children) total += countNode(c, window);
+            return total;
+        }
+        if (node->dataPageId == std::numeric_limits<size_t>::max()) return 0;
+        const auto page = loadPage(node->dataPageId);
+        if (!page) return 0;
+        for (const auto& p : page->points2D) total += window.contains(p);
+        return total;
+    }
+    
+public:
+    DiskRTreeIndex(const std::string& dir, size_t cacheSize = 100) 
+        : indexDir(dir), 
+          pageCache(std::make_unique<LRUCache<size_t, std::shared_ptr<DataPage>>>(cacheSize)),
+          nodeCache(std::make_unique<LRUCache<size_t, std::shared_ptr<RTreeNode>>>(cacheSize)) {
+        storage = std::make_unique<DiskStorageManager>(dir);
+        
+        // Try to load existing index
+        root = loadMetadata(dir);
+        if (!root) {
+            // Create new root
+            root = std::make_shared<RTreeNode>();
+            root->nodeId = nextNodeId++;
+            root->isLeaf = true;
+            root->count = 0;
+            root->dirty = true;
+        }
+        loadIds();
+        publish();
+    }
+    
+    ~DiskRTreeIndex() {
+        flush();
+        epochs.drain();
+        delete published.load();
+    }
+    
+    void insert2D(const Point2D& p) override {
+        insert2D(p, DataPage::NO_ID);
+    }
+    
+    /// Inserta un punto con id, para getById, removeById y update(id, to).
+    /// Los ids son únicos: lanza std::invalid_argument si ya está (o si es
+    /// uno de los dos últimos valores, reservados).
+    void insert2D(const Point2D& p, uint64_t id) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (id != DataPage::NO_ID) {
+            if (!IdHashIndex<uint64_t>::validKey(id))
+                throw std::invalid_argument("DiskRTreeIndex: id reservado " + std::to_string(id));
+            if (idIndex.contains(id))
+                throw std::invalid_argument("DiskRTreeIndex: el id " + std::to_string(id) + " ya está en el índice");
+        }
+        insertLocked(Rectangle(p.x, p.y, p.x, p.y), [&](DataPage& page) { page.add2D(p, id); });
+        bump(totalPoints2D);
+        publish();
+    }
+    
+    /// Punto 2D con ese id: una búsqueda en la tabla de ids y una página.
+    std::optional<Point2D> getById(uint64_t id) {
+        auto guard = epochs.pin();
+        uint64_t pageId;
+        {
+            std::shared_lock<std::shared_mutex> lock(idMutex);
+            pageId = idIndex.find(id);
+        }
+        if (pageId == idIndex.NONE) return std::nullopt;
+        return pointInPage(id, pageId);
+    }
+    
+    /// Puntos 2D con id.
+    size_t idCount() const {
+        std::shared_lock<std::shared_mutex> lock(idMutex);
+        return idIndex.size();
+    }
+    
+    /// Borra un punto 2D igual a p (uno solo si está repetido). Devuelve si estaba.
+    bool remove2D(const Point2D& p) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        const auto removed = removeLocked(Rectangle(p.x, p.y, p.x, p.y), exactly(p));
+        forgetId(removed);
+        if (removed) publish();
+        return removed.has_value();
+    }
+    
+    /// Borra el punto 2D con ese id. La tabla de ids da su posición, así que
+    /// solo se baja por las hojas que la contienen.
+    bool removeById(uint64_t id) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        const auto p = locate(id);
+        if (!p) return false;
+        const auto removed = removeLocked(Rectangle(p->x, p->y, p->x, p->y), withId(id));
+        forgetId(removed);
+        if (removed) publish();
+        return removed.has_value();
+    }
+    
+    /// Mueve el punto `from` a `to` (conserva su id). Las consultas ven el
+    /// punto en un sitio o en el otro, nunca en los dos ni en ninguno. Devuelve
+    /// false, sin insertar nada, si `from` no estaba.
+    bool update(const Point2D& from, const Point2D& to) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        return moveLocked(removeLocked(Rectangle(from.x, from.y, from.x, from.y), exactly(from)), to);
+    }
+    
+    /// Mueve a `to` el punto con ese id (lo encuentra como removeById).
+    bool update(uint64_t id, const Point2D& to) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        const auto p = locate(id);
+        return p && moveLocked(removeLocked(Rectangle(p->x, p->y, p->x, p->y), withId(id)), to);
+    }
+    
+    void insert3D(const Point3D& p) override {
+        insertEntry(Rectangle(p.x, p.y, p.x, p.y), [&](DataPage& page) {
+            page.points3D.push_back(p);
+        }, Box3D(p.x, p.y, p.z, p.x, p.y, p.z));
+        bump(totalPoints3D);
+    }
+    
+    void insertPolygon(const Polygon& poly) override {
+        insertEntry(poly.getBoundingBox(), [&](DataPage& page) {
+            page.polygons.push_back(poly);
+            page.prepared.emplace_back(poly);
+        });
+        bump(totalPolygons);
+    }
+    
+    std::vector<Point2D> rangeQuery2D(const Rectangle& window) override {
+        auto guard = epochs.pin();
+        const auto top = snapshot();
+        auto query = [&](auto& prof) {
+            [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+            std::vector<Point2D> results;
+            std::vector<Polygon> dummyPoly;
+            rangeSearchNode(top, 0, window, results, dummyPoly, prof);
+            return results;
+        };
+        if (profiler_.enabled()) return profiler_.run(QueryKind::Range, query);
+        NullProfile none;
+        return query(none);
+    }
+    
+    /// Número de puntos 2D en la ventana sin materializarlos: O(log n) nodos
+    /// leídos, los del borde de la ventana.
+    size_t countQuery2D(const Rectangle& window) {
+        auto guard = epochs.pin();
+        return countNode(snapshot(), window);
+    }
+    
+    /// rangeQuery2D acotada (ver QueryControl.hpp). El cursor sigue el camino
+    /// en el árbol y lleva la marca de la versión publicada: si se ha publicado
+    /// otra (una inserción, un borrado...), continuar con él lanza
+    /// std::runtime_error. Para recorrer sin que eso pase, pinVersion().
+    QueryProgress rangeQuery2DEach(const Rectangle& window, const QueryOptions& opts,
+                                   const std::function<bool(const Point2D&)>& sink) override {
+        auto guard = epochs.pin();
+        const Version& version = *published.load(std::memory_order_seq_cst);
+        return rangeEachVersion(version.root, version.seq, window, opts, sink);
+    }
+    
+    QueryPage<Point2D> rangeQuery2DPage(const Rectangle& window, const QueryOptions& opts) {
+        QueryPage<Point2D> page;
+        page.progress = rangeQuery2DEach(window, opts, [&](const Point2D& p) {
+            page.results.push_back(p);
+            return true;
+        });
+        return page;
+    }
+    
+    /// Versión publicada fijada (época y raíz), como la de NeighborCursor: las
+    /// páginas pedidas con ella recorren siempre el mismo árbol aunque se
+    /// publiquen otras, pero mientras viva no se borran del disco los ids que
+    /// ese árbol referencia.
+    class PinnedVersion {
+    private:
+        friend class DiskRTreeIndex;
+        EpochManager::Guard guard;
+        std::shared_ptr<RTreeNode> root;
+        uint64_t seq = 0;
+    };
+    
+    PinnedVersion pinVersion() {
+        PinnedVersion pinned;
+        pinned.guard = epochs.pin();
+        const Version& version = *published.load(std::memory_order_seq_cst);
+        pinned.root = version.root;
+        pinned.seq = version.seq;
+        return pinned;
+    }
+    
+    /// rangeQuery2DPage sobre una versión fijada con pinVersion().
+    QueryPage<Point2D> rangeQuery2DPage(const PinnedVersion& version, const Rectangle& window,
+                                        const QueryOptions& opts) {
+        QueryPage<Point2D> page;
+        page.progress = rangeEachVersion(version.root, version.seq, window, opts, [&](const Point2D& p) {
+            page.results.push_back(p);
+            return true;
+        });
+        return page;
+    }
+    
+    /// Puntos 3D cuya (x, y) cae en la ventana, con cualquier z.
+    std::vector<Point3D> rangeQuery3D(const Rectangle& window) override {
+        return rangeQuery3D(Box3D(window, -std::numeric_limits<double>::infinity(),
+                                  std::numeric_limits<double>::infinity()));
+    }
+    
+    std::vector<Point3D> rangeQuery3D(const Box3D& box) override {
+        auto guard = epochs.pin();
+        std::vector<Point3D> results;
+        rangeSearch3DNode(snapshot(), box, results);
+        return results;
+    }
+    
+    std::vector<Polygon> rangeQueryPolygon(const Rectangle& window) override {
+        auto guard = epochs.pin();
+        std::vector<Point2D> dummy2D;
+        std::vector<Polygon> results;
+        NullProfile none;
+        rangeSearchNode(snapshot(), 0, window, dummy2D, results, none);
+        return results;
+    }
+    
+    /// Polígonos que contienen el punto p (geocodificación inversa).
+    std::vector<Polygon> stabQuery(const Point2D& p) override {
+        auto guard = epochs.pin();
+        std::vector<Polygon> results;
+        stabSearchNode(snapshot(), p, results);
+        return results;
+    }
+    
+    /// Puntos 2D a <= meters (geodésico, x = lat, y = lon) de center.
+    std::vector<Point2D> radiusQuery(const Point2D& center, double meters) override {
+        auto query = [&](auto& prof) {
+            const auto matches = radiusMatches(center, meters, false, prof);
+            [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+            std::vector<Point2D> results;
+            results.reserve(matches.size());
+            for (const auto& m : matches) results.push_back(m.second);
+            return results;
+        };
+        if (profiler_.enabled()) return profiler_.run(QueryKind::Radius, query);
+        NullProfile none;
+        return query(none);
+    }
+    
+    /// Como radiusQuery, con la distancia en metros y ordenado de menor a mayor.
+    std::vector<std::pair<double, Point2D>> radiusQueryWithDistances(const Point2D& center, double meters) override {
+        auto query = [&](auto& prof) {
+            auto matches = radiusMatches(center, meters, true, prof);
+            [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+            std::sort(matches.begin(), matches.end(),
+                      [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (auto& m : matches) m.first = chord2ToMeters(m.first);
+            return matches;
+        };
+        if (profiler_.enabled()) return profiler_.run(QueryKind::Radius, query);
+        NullProfile none;
+        return query(none);
+    }
+    
+private:
+    template <typename Profile>
+    std::vector<std::pair<double, Point2D>> radiusMatches(const Point2D& center, double meters, bool withDist,
+                                                          Profile& prof) {
+        auto guard = epochs.pin();
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        std::vector<std::pair<double, Point2D>> matches;
+        std::vector<double> d2;
+        if (meters >= 0) {
+            radiusSearchNode(snapshot(), 0, center.x, center.y, toUnitVec(center.x, center.y),
+                             metersToChord2(meters), withDist, false, matches, d2, prof);
+        }
+        return matches;
+    }
+    
+public:
+    
+    /// Recorrido best-first incremental: next() devuelve (distancia, punto) en
+    /// orden creciente de distancia, así que se puede parar en cualquier momento.
+    /// La cola guarda punteros crudos a nodos (`pinned` mantiene viva la versión
+    /// del árbol) y los hijos no cargados solo se leen del disco al salir de la
+    /// cola. El cursor recorre la versión publicada al crearlo: las inserciones
+    /// posteriores no le afectan, pero mientras viva no se borran del disco los
+    /// ids que esa versión referencia.
+    template <typename PointDist, typename RectDist, typename Profile = NullProfile>
+    class NeighborCursor {
+    public:
+        NeighborCursor(DiskRTreeIndex& index, const Point2D& q, PointDist pointDist, RectDist rectDist)
+            : index(index), guard(index.epochs.pin()), q(q), pointDist(std::move(pointDist)),
+              rectDist(std::move(rectDist)) {
+            pinned.push_back(index.snapshot());
+            const RTreeNode* top = pinned.back().get();
+            queue.push({this->rectDist(q, top->mbr), top, Point2D(), 0});
+        }
+        
+        std::optional<std::pair<double, Point2D>> next() {
+            while (!queue.empty()) {
+                const Entry e = queue.top();
+                queue.pop();
+                if (!e.node) return std::make_pair(e.dist, e.point);
+                
+                const RTreeNode* node = e.node;
+                if (node->children.empty() && !node->isLeaf) {
+                    auto loaded = index.loadNode(node->nodeId, prof);
+                    if (!loaded) continue;
+                    pinned.push_back(loaded);
+                    node = loaded.get();
+                }
+                prof.node(e.level);
+                
+                if (node->isLeaf) {
+                    if (node->dataPageId == std::numeric_limits<size_t>::max()) continue;
+                    auto page = index.loadPage(node->dataPageId, prof);
+                    if (!page) continue;
+                    prof.leaf();
+                    prof.tested(page->points2D.size());
+                    prof.distances(page->points2D.size());
+                    for (const auto& point : page->points2D) {
+                        queue.push({pointDist(q, point), nullptr, point, e.level});
+                    }
+                } else {
+                    prof.distances(node->children.size());
+                    for (const auto& child : node->children) {
+                        queue.push({rectDist(q, child->mbr), child.get(), Point2D(), e.level + 1});
+                    }
+                }
+            }
+            return std::nullopt;
+        }
+        
+        /// Contadores acumulados por este cursor (vacío con NullProfile).
+        Profile& profile() { return prof; }
+        
+    private:
+        // node == nullptr: entrada de punto
+        struct Entry {
+            double dist;
+            const RTreeNode* node;
+            Point2D point;
+            uint32_t level;
+            
+            // Min-heap; a igual distancia salen antes los puntos
+            bool operator<(const Entry& o) const {
+                if (dist != o.dist) return dist > o.dist;
+                return node != nullptr && o.node == nullptr;
+            }
+        };
+        
+        DiskRTreeIndex& index;
+        EpochManager::Guard guard;
+        Point2D q;
+        PointDist pointDist;
+        RectDist rectDist;
+        std::priority_queue<Entry> queue;
+        std::vector<std::shared_ptr<RTreeNode>> pinned;
+        Profile prof;
+    };
+    
+    using PointDistFn = std::function<double(const Point2D&, const Point2D&)>;
+    using RectDistFn = std::function<double(const Point2D&, const Rectangle&)>;
+    using DynamicNeighborCursor = NeighborCursor<PointDistFn, RectDistFn>;
+    
+    /// Vecinos de p (euclídeo) en orden de distancia, bajo demanda.
+    DynamicNeighborCursor nearestNeighbors(const Point2D& p) {
+        return DynamicNeighborCursor(*this, p,
+            [](const Point2D& a, const Point2D& b) { return distance2D(a, b); },
+            [this](const Point2D& q, const Rectangle& r) { return minDistToRectangle(q, r); });
+    }
+    
+    /// Como nearestNeighbors, geodésico (x = lat, y = lon, metros).
+    DynamicNeighborCursor nearestNeighborsGeo(const Point2D& p) {
+        return DynamicNeighborCursor(*this, p,
+            [](const Point2D& a, const Point2D& b) { return haversine(a.x, a.y, b.x, b.y); },
+            [this](const Point2D& q, const Rectangle& r) { return minGeoDistToRectangle(q, r); });
+    }
+    
+    std::vector<Point2D> knnQuery2D(const Point2D& p, int k) override {
+        return knnSearch2D(p, k,
+            [](const Point2D& a, const Point2D& b) { return distance2D(a, b); },
+            [this](const Point2D& q, const Rectangle& r) { return minDistToRectangle(q, r); });
+    }
+
+    /// kNN geodésico: x = latitud, y = longitud, distancias en metros.
+    std::vector<Point2D> knnQuery2DGeo(const Point2D& p, int k) {
+        return knnSearch2D(p, k,
+            [](const Point2D& a, const Point2D& b) { return haversine(a.x, a.y, b.x, b.y); },
+            [this](const Point2D& q, const Rectangle& r) { return minGeoDistToRectangle(q, r); });
+    }
+
+private:
+    template <typename PointDist, typename RectDist>
+    std::vector<Point2D> knnSearch2D(const Point2D& p, int k, PointDist pointDist, RectDist rectDist) {
+        if (!profiler_.enabled()) return knnTake<NullProfile>(p, k, std::move(pointDist), std::move(rectDist));
+        return profiler_.run(QueryKind::KNN, [&](QueryProfile& total) {
+            auto results = knnTake<QueryProfile>(p, k, std::move(pointDist), std::move(rectDist), &total);
+            return results;
+        });
+    }
+    
+    // El perfil vive dentro del cursor; al terminar se vuelca en `out`.
+    template <typename Profile, typename PointDist, typename RectDist>
+    std::vector<Point2D> knnTake(const Point2D& p, int k, PointDist pointDist, RectDist rectDist,
+                                 Profile* out = nullptr) {
+        NeighborCursor<PointDist, RectDist, Profile> cursor(*this, p, std::move(pointDist), std::move(rectDist));
+        std::vector<Point2D> results;
+        {
+            [[maybe_unused]] auto phase = cursor.profile().phase(QueryPhase::Traverse);
+            while (static_cast<int>(results.size()) < k) {
+                auto next = cursor.next();
+                if (!next) break;
+                results.push_back(next->second);
+            }
+        }
+        if (out) *out = cursor.profile();
+        return results;
+    }
+
+public:
+std::vector<Point3D> knnQuery3D(const Point3D& p, int k) override {
+    // Best-first sobre la caja 3D de cada subárbol; los subárboles sin puntos
+    // 3D tienen caja vacía (distancia infinita) y no se visitan.
+    using Entry = std::pair<double, std::shared_ptr<RTreeNode>>;
+    auto cmp = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+    std::priority_queue<Entry, std::vector<Entry>, decltype(cmp)> pq(cmp);
+    std::priority_queue<std::pair<double, Point3D>> results; // max-heap de los k mejores
+    
+    if (k <= 0) return {};
+    auto guard = epochs.pin();
+    const auto top = snapshot();
+    pq.push({top->mbr3D.minDist(p), top});
+    
+    while (!pq.empty()) {
+        auto [dist, node] = pq.top();
+        pq.pop();
+        if (std::isinf(dist)) break;
+        if (static_cast<int>(results.size()) == k && dist >= results.top().first) break;
+        
+        node = resolveNode(node);
+        if (!node) continue;
+        if (node->isLeaf) {
+            if (node->dataPageId == std::numeric_limits<size_t>::max()) continue;
+            auto page = loadPage(node->dataPageId);
+            if (!page) continue;
+            for (const auto& point : page->points3D) {
+                double d = distance3D(p, point);
+                if (static_cast<int>(results.size()) < k) {
+                    results.push({d, point});
+                } else if (d < results.top().first) {
+                    results.pop();
+                    results.push({d, point});
+                }
+            }
+        } else {
+            for (auto& child : node->children) {
+                double minDist = child->mbr3D.minDist(p);
+                if (static_cast<int>(results.size()) < k || minDist < results.top().first) {
+                    pq.push({minDist, child});
+                }
+            }
+        }
+    }
+    
+    std::vector<Point3D> finalResults;
+    while (!results.empty()) {
+        finalResults.push_back(results.top().second);
+        results.pop();
+    }
+    std::reverse(finalResults.begin(), finalResults.end());
+    return finalResults;
+}
+
+    void save(const std::string& filename) override {
+        flush();
+        
+        // Copy index directory to filename
+        std::ofstream out(filename);
+        out << indexDir << std::endl;
+    }
+    
+    /// Cambia al índice del directorio guardado en filename. No admite
+    /// consultas concurrentes; lo no guardado del índice actual se descarta.
+    void load(const std::string& filename) override {
+        std::ifstream in(filename);
+        std::string dir;
+        std::getline(in, dir);
+        
+        std::lock_guard<std::mutex> lock(writeMutex);
+        epochs.drain();
+        obsoletePages.clear();
+        obsoleteNodes.clear();
+        
+        // Reinitialize with loaded directory
+        indexDir = dir;
+        storage = std::make_unique<DiskStorageManager>(dir);
+        pageCache->clear();
+        nodeCache->clear();
+        
+        if (auto loaded = loadMetadata(dir)) {
+            root = loaded;
+            loadIds();
+            publish();
+        }
+    }
+    
+    std::string getStats() override {
+        const size_t hits = cacheHits.load(std::memory_order_relaxed);
+        const size_t misses = cacheMisses.load(std::memory_order_relaxed);
+        std::ostringstream stats;
+        stats << "Disk R-Tree Statistics:\n";
+        stats << "Total 2D Points: " << totalPoints2D.load(std::memory_order_relaxed) << "\n";
+        stats << "Total 3D Points: " << totalPoints3D.load(std::memory_order_relaxed) << "\n";
+        stats << "Total Polygons: " << totalPolygons.load(std::memory_order_relaxed) << "\n";
+        stats << "Disk Reads: " << diskReads.load(std::memory_order_relaxed) << "\n";
+        stats << "Disk Writes: " << diskWrites.load(std::memory_order_relaxed) << "\n";
+        stats << "Cache Hits: " << hits << "\n";
+        stats << "Cache Misses: " << misses << "\n";
+        stats << "Cache Hit Rate: " << (hits + misses > 0 ? 
+                (double)hits / (hits + misses) * 100 : 0) << "%\n";
+        stats << "Total Pages: " << nextPageId.load(std::memory_order_relaxed) << "\n";
+        stats << "Total Nodes: " << nextNodeId.load(std::memory_order_relaxed) << "\n";
+        return stats.str();
+    }
+    
+    /// Guarda los nodos pendientes y los metadatos. Los ids sustituidos hasta
+    /// aquí se borran del disco cuando ninguna consulta en curso los pueda leer.
+    void flush() override {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        flushLocked();
+    }
+    
+    enum class CompactOrder { STR, Hilbert };
+    
+    struct CompactStats {
+        size_t pagesBefore = 0, pagesAfter = 0; // páginas de datos vivas
+        size_t nodesAfter = 0;
+        size_t bytesBefore = 0, bytesAfter = 0; // tamaño de data.bin
+    };
+    
+    /// progress(hechas, total) tras cada página reescrita.
+    using CompactProgress = std::function<void(size_t, size_t)>;
+    
+    /// Reescribe data.bin solo con las páginas y nodos vivos. Las páginas se
+    /// escriben seguidas en orden STR o Hilbert de su MBR, juntando las
+    /// consecutivas que caben en una (DataPage::MAX_ENTRIES), y el árbol se
+    /// reconstruye empaquetado sobre ellas. Las consultas siguen durante la
+    /// compactación (leen la versión anterior, y el fichero anterior se cierra
+    /// cuando ya no queda ninguna); las inserciones y borrados esperan.
+    CompactStats compact(CompactOrder order = CompactOrder::STR, const CompactProgress& progress = nullptr) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        flushLocked();
+        CompactStats stats;
+        stats.bytesBefore = storage->fileSize();
+        
+        // Hojas con página y todos los ids que dejan de usarse
+        std::vector<std::pair<Rectangle, size_t>> leaves; // (MBR, página)
+        std::vector<size_t> oldNodes, oldPages;
+        collectLeaves(root, leaves, oldNodes, oldPages);
+        stats.pagesBefore = leaves.size();
+        
+        // Orden de escritura: STR (franjas por x, y dentro de cada franja) o Hilbert
+        auto center = [](const Rectangle& r) { return Point2D((r.x1 + r.x2) / 2, (r.y1 + r.y2) / 2); };
+        if (order == CompactOrder::Hilbert) {
+            std::vector<std::pair<uint64_t, size_t>> keyed;
+            for (size_t i = 0; i < leaves.size(); ++i) {
+                const Point2D c = center(leaves[i].first);
+                keyed.emplace_back(hilbertKey(c.x, c.y), i);
+            }
+            std::sort(keyed.begin(), keyed.end());
+            std::vector<std::pair<Rectangle, size_t>> sorted;
+            for (const auto& [key, i] : keyed) sorted.push_back(leaves[i]);
+            leaves.swap(sorted);
+        } else {
+            auto byX = [&](const auto& a, const auto& b) { return center(a.first).x < center(b.first).x; };
+            auto byY = [&](const auto& a, const auto& b) { return center(a.first).y < center(b.first).y; };
+            std::sort(leaves.begin(), leaves.end(), byX);
+            const size_t strips = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(leaves.size()))));
+            const size_t perStrip = strips ? (leaves.size() + strips - 1) / strips : 1;
+            for (size_t begin = 0; begin < leaves.size(); begin += perStrip) {
+                std::sort(leaves.begin() + begin, leaves.begin() + std::min(leaves.size(), begin + perStrip), byY);
+            }
+        }
+        
+        // Páginas nuevas (ids nuevos: las antiguas siguen siendo de la versión publicada).
+        // Si algo lanza antes de commitCompaction() (progress incluido), el
+        // guard descarta data.bin.compact y el índice queda como estaba.
+        storage->beginCompaction();
+        struct AbortGuard {
+            DiskStorageManager* storage;
+            ~AbortGuard() {
+                if (storage) storage->abortCompaction();
+            }
+        } abortGuard{storage.get()};
+        std::vector<std::shared_ptr<RTreeNode>> level;
+        std::vector<std::pair<uint64_t, size_t>> relocated; // (id, página nueva)
+        DataPage merged;
+        auto emit = [&] {
+            if (merged.entryCount() == 0) return;
+            merged.pageId = nextPageId++;
+            merged.updateMBR();
+            storage->appendCompacted(merged.pageId, merged.serialize());
+            for (const uint64_t id : merged.ids2D) {
+                if (id != DataPage::NO_ID) relocated.emplace_back(id, merged.pageId);
+            }
+            bump(diskWrites);
+            auto leaf = std::make_shared<RTreeNode>();
+            leaf->nodeId = nextNodeId++;
+            leaf->isLeaf = true;
+            leaf->dataPageId = merged.pageId;
+            leaf->mbr = merged.mbr;
+            leaf->mbr3D = merged.mbr3D;
+            leaf->count = merged.points2D.size();
+            level.push_back(leaf);
+            merged = DataPage();
+        };
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            const auto page = loadPage(leaves[i].second);
+            if (!page) throw std::runtime_error("DiskRTreeIndex: página " + std::to_string(leaves[i].second) + " no encontrada en disco");
+            if (merged.entryCount() + page->entryCount() > DataPage::MAX_ENTRIES) emit();
+            merged.append(*page);
+            if (progress) progress(i + 1, leaves.size());
+        }
+        emit();
+        stats.pagesAfter = level.size();
+        
+        // Directorio empaquetado de abajo arriba, repartiendo por igual entre los nodos
+        std::vector<std::shared_ptr<RTreeNode>> nodes(level);
+        while (level.size() > 1) {
+            const size_t groups = (level.size() + RTreeNode::MAX_ENTRIES - 1) / RTreeNode::MAX_ENTRIES;
+            std::vector<std::shared_ptr<RTreeNode>> parents;
+            for (size_t g = 0; g < groups; ++g) {
+                auto parent = std::make_shared<RTreeNode>();
+                parent->nodeId = nextNodeId++;
+                parent->isLeaf = false;
+                parent->children.assign(level.begin() + g * level.size() / groups,
+                                        level.begin() + (g + 1) * level.size() / groups);
+                parent->updateMBR();
+                parents.push_back(parent);
+                nodes.push_back(parent);
+            }
+            level.swap(parents);
+        }
+        if (level.empty()) {
+            auto empty = std::make_shared<RTreeNode>();
+            empty->nodeId = nextNodeId++;
+            empty->isLeaf = true;
+            empty->count = 0;
+            level.push_back(empty);
+            nodes.push_back(empty);
+        }
+        for (const auto& node : nodes) {
+            storage->appendCompacted(nodeKey(node->nodeId), node->serialize());
+            node->dirty = false;
+            bump(diskWrites);
+        }
+        stats.nodesAfter = nodes.size();
+        
+        // Cambio de fichero y de versión. El fichero anterior se cierra, y sus
+        // ids salen de las cachés, cuando ninguna consulta pueda leerlos.
+        storage->commitCompaction();
+        abortGuard.storage = nullptr;
+        {
+            // Las páginas nuevas solo se pueden leer desde commitCompaction()
+            std::unique_lock<std::shared_mutex> lock(idMutex);
+            for (const auto& [id, pageId] : relocated) idIndex.assign(id, pageId);
+            idsDirty = true;
+        }
+        root = level.front();
+        saveMetadata();
+        publish();
+        epochs.retire([this, pages = std::move(oldPages), nodes = std::move(oldNodes)] {
+            for (size_t id : pages) pageCache->remove(id);
+            for (size_t id : nodes) nodeCache->remove(id);
+            storage->dropPreviousFile();
+        });
+        epochs.reclaim();
+        stats.bytesAfter = storage->fileSize();
+        return stats;
+    }
+    
+private:
+    void flushLocked() {
+        // Save all dirty pages
+        flushNode(root);
+        saveMetadata();
+        
+        if (!obsoletePages.empty() || !obsoleteNodes.empty()) {
+            epochs.retire([this, pages = std::move(obsoletePages), nodes = std::move(obsoleteNodes)] {
+                for (size_t id : pages) {
+                    storage->deletePage(id);
+                    pageCache->remove(id);
+                }
+                for (size_t id : nodes) {
+                    storage->deletePage(nodeKey(id));
+                    nodeCache->remove(id);
+                }
+            });
+            obsoletePages.clear();
+            obsoleteNodes.clear();
+        }
+        epochs.reclaim();
+    }
+    
+public:
+    /// Versiones e ids sustituidos que esperan a que terminen las consultas
+    /// que aún los pueden leer.
+    size_t pendingReclaims() {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        epochs.reclaim();
+        return epochs.pending();
+    }
+    
+    void setCacheSize(size_t size) override {
+        pageCache->setCapacity(size);
+        nodeCache->setCapacity(size);
+    }
+    
+    /// Guarda lo pendiente y vacía las cachés de páginas y nodos, para medir
+    /// lecturas en frío.
+    void dropCaches() {
+        flush();
+        pageCache->clear();
+        nodeCache->clear();
+    }
+    
+private:
+    // Segunda mitad de update: inserta en `to` lo borrado y publica ambos cambios juntos.
+    bool moveLocked(const std::optional<uint64_t>& removed, const Point2D& to) {
+        if (!removed) return false;
+        insertLocked(Rectangle(to.x, to.y, to.x, to.y), [&](DataPage& page) { page.add2D(to, *removed); });
+        bump(totalPoints2D);
+        publish();
+        return true;
+    }
+    
+    // Hojas con página del árbol de `node` (cargando lo que haga falta) y los
+    // ids de todos sus nodos y páginas.
+    void collectLeaves(std::shared_ptr<RTreeNode> node, std::vector<std::pair<Rectangle, size_t>>& leaves,
+                       std::vector<size_t>& nodeIds, std::vector<size_t>& pageIds) {
+        node = resolveNode(node);
+        if (!node) throw std::runtime_error("DiskRTreeIndex: nodo no encontrado en disco");
+        nodeIds.push_back(node->nodeId);
+        if (node->isLeaf) {
+            if (node->dataPageId == std::numeric_limits<size_t>::max()) return;
+            leaves.emplace_back(node->mbr, node->dataPageId);
+            pageIds.push_back(node->dataPageId);
+            return;
+        }
+        for (const auto& child : node->children) collectLeaves(child, leaves, nodeIds, pageIds);
+    }
+    
+    void flushNode(std::shared_ptr<RTreeNode> node) {
+        if (!node) return;
+        
+        saveNode(node);
+        
+        if (!node->isLeaf) {
+            for (auto& child : node->children) {
+                if (!child->children.empty() || child->isLeaf) {
+                    flushNode(child);
+                }
+            }
+        }
+    }
+    
+    // Lee meta.dat de dir y devuelve su raíz (nullptr si no hay índice).
+    std::shared_ptr<RTreeNode> loadMetadata(const std::string& dir) {
+        std::ifstream metaIn(dir + "/meta.dat", std::ios::binary);
+        nodeKeyBase = NODE_KEY_BASE;
+        if (!metaIn.is_open()) return nullptr;
+        
+        size_t fields[6] = {};
+        metaIn.read(reinterpret_cast<char*>(fields), sizeof(fields));
+        size_t format = 1;
+        if (!metaIn.read(reinterpret_cast<char*>(&format), sizeof(size_t))) format = 1;
+        nodeKeyBase = format >= 2 ? NODE_KEY_BASE : LEGACY_NODE_KEY_BASE;
+        
+        nextPageId = fields[0];
+        nextNodeId = fields[1];
+        totalPoints2D = fields[2];
+        totalPoints3D = fields[3];
+        totalPolygons = fields[4];
+        return loadNode(fields[5]);
+    }
+    
+    void saveMetadata() {
+        saveIds();
+        std::string metaFile = indexDir + "/meta.dat";
+        std::ofstream out(metaFile, std::ios::binary);
+        
+        const size_t fields[7] = {
+            nextPageId.load(), nextNodeId.load(), totalPoints2D.load(), totalPoints3D.load(),
+            totalPolygons.load(), root ? root->nodeId : 0,
+            nodeKeyBase == NODE_KEY_BASE ? META_FORMAT : 1,
+        };
+        out.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+    }
+    
+    // ids.bin: IDS_MAGIC, nextPageId y la tabla (IdHashIndex::save). Se
+    // escribe aparte y se renombra, y solo si ha cambiado desde la última vez.
+    void saveIds() {
+        const uint64_t header[2] = {IDS_MAGIC, nextPageId.load()};
+        if (!idsDirty && idsSavedAt == header[1]) return;
+        const std::string file = indexDir + "/ids.bin";
+        {
+            std::ofstream out(file + ".tmp", std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+            idIndex.save(out);
+            if (!out) throw std::runtime_error("DiskRTreeIndex: error al escribir " + file);
+        }
+        std::filesystem::rename(file + ".tmp", file);
+        idsDirty = false;
+        idsSavedAt = header[1];
+    }
+    
+    // Lee ids.bin; si falta o no corresponde a meta.dat (índice anterior a la
+    // tabla, o caída entre los dos ficheros) la reconstruye desde las hojas.
+    void loadIds() {
+        std::unique_lock<std::shared_mutex> lock(idMutex);
+        std::ifstream in(indexDir + "/ids.bin", std::ios::binary);
+        uint64_t header[2] = {};
+        if (in.read(reinterpret_cast<char*>(header), sizeof(header)) && header[0] == IDS_MAGIC &&
+            header[1] == nextPageId.load() && idIndex.load(in)) {
+            idsDirty = false;
+            idsSavedAt = header[1];
+            return;
+        }
+        idIndex.clear();
+        std::vector<std::pair<Rectangle, size_t>> leaves;
+        std::vector<size_t> nodeIds, pageIds;
+        collectLeaves(root, leaves, nodeIds, pageIds);
+        for (const size_t pageId : pageIds) {
+            const auto page = loadPage(pageId);
+            if (!page) continue;
+            for (const uint64_t id : page->ids2D) {
+                if (id != DataPage::NO_ID) idIndex.assign(id, pageId);
+            }
+        }
+        idsDirty = true;
+    }
+    
+    double minDistToRectangle(const Point2D& p, const Rectangle& r) {
+        double dx = 0, dy = 0;
+        
+        if (p.x < r.x1) dx = r.x1 - p.x;
+        else if (p.x > r.x2) dx = p.x - r.x2;
+        
+        if (p.y < r.y1) dy = r.y1 - p.y;
+        else if (p.y > r.y2) dy = p.y - r.y2;
+        
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    /// MINDIST esférico (metros) con x = latitud, y = longitud; ver utils.hpp.
+    double minGeoDistToRectangle(const Point2D& p, const Rectangle& r) {
+        return sphericalMinDist(p.x, p.y, r.x1, r.y1, r.x2, r.y2);
+    }
+};
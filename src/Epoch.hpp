@@ -0,0 +1,128 @@
+#pragma once
+
+// Reclamación por épocas (EBR) para estructuras con lectores sin bloqueo y un
+// único escritor.
+//
+// Un lector fija la época global en un hueco libre (pin()) antes de leer la
+// versión publicada y lo suelta al terminar. El escritor publica la versión
+// nueva y retira la antigua con retire(): la retirada queda etiquetada con la
+// época actual y la época avanza. reclaim() ejecuta las retiradas cuya época es
+// menor que la de todos los lectores activos, que por tanto ya leyeron (o
+// leerán) la versión nueva.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+
+class EpochManager {
+public:
+    /// Lectores simultáneos como máximo; si están todos ocupados pin() espera.
+    static constexpr size_t SLOTS = 256;
+
+    /// Época fijada por un lector; se suelta al destruirse. Movible.
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& o) noexcept : slot_(std::exchange(o.slot_, nullptr)) {}
+        Guard& operator=(Guard&& o) noexcept {
+            if (this != &o) {
+                release();
+                slot_ = std::exchange(o.slot_, nullptr);
+            }
+            return *this;
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() { release(); }
+
+    private:
+        friend class EpochManager;
+        explicit Guard(std::atomic<uint64_t>* slot) : slot_(slot) {}
+        void release() {
+            if (slot_) slot_->store(IDLE, std::memory_order_release);
+            slot_ = nullptr;
+        }
+        std::atomic<uint64_t>* slot_ = nullptr;
+    };
+
+    EpochManager() {
+        for (auto& slot : slots_) slot.store(IDLE, std::memory_order_relaxed);
+    }
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+    ~EpochManager() { drain(); }
+
+    /// Fija la época actual. Todo lo que se retire mientras viva el Guard
+    /// sigue siendo válido para este lector.
+    Guard pin() {
+        const size_t start = std::hash<std::thread::id>()(std::this_thread::get_id()) % SLOTS;
+        for (;;) {
+            for (size_t i = 0; i < SLOTS; ++i) {
+                auto& slot = slots_[(start + i) % SLOTS];
+                uint64_t expected = IDLE;
+                if (slot.load(std::memory_order_relaxed) == IDLE &&
+                    slot.compare_exchange_strong(expected, epoch_.load(std::memory_order_seq_cst),
+                                                 std::memory_order_seq_cst)) {
+                    return Guard(&slot);
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /// Solo el escritor, después de publicar la versión que sustituye a lo
+    /// retirado: fn se ejecutará cuando ningún lector pueda verlo.
+    void retire(std::function<void()> fn) {
+        retired_.push_back({epoch_.load(std::memory_order_seq_cst), std::move(fn)});
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    /// Solo el escritor: ejecuta las retiradas que ya no puede ver ningún
+    /// lector y devuelve cuántas.
+    size_t reclaim() {
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for (const auto& slot : slots_) {
+            const uint64_t e = slot.load(std::memory_order_seq_cst);
+            if (e != IDLE) oldest = std::min(oldest, e);
+        }
+        size_t n = 0;
+        while (!retired_.empty() && retired_.front().epoch < oldest) {
+            auto fn = std::move(retired_.front().fn);
+            retired_.pop_front();
+            fn();
+            ++n;
+        }
+        return n;
+    }
+
+    /// Ejecuta todo lo retirado. Solo sin lectores activos (p. ej. al destruir).
+    void drain() {
+        while (!retired_.empty()) {
+            auto fn = std::move(retired_.front().fn);
+            retired_.pop_front();
+            fn();
+        }
+    }
+
+    /// Retiradas pendientes de reclamar.
+    size_t pending() const { return retired_.size(); }
+
+private:
+    static constexpr uint64_t IDLE = 0;
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> fn;
+    };
+
+    std::atomic<uint64_t> epoch_{1};
+    std::array<std::atomic<uint64_t>, SLOTS> slots_;
+    std::deque<Retired> retired_; // épocas crecientes
+};
@@ -1,14 +1,15 @@
 #pragma once
 
+#include <cmath>
 #include <string>
 
 struct Geoname {
-    long geonameId;
+    long geonameId = -1; // -1: sin id (no entra en la tabla de ids)
     std::string name;
     double latitude = 0.0;
     double longitude = 0.0;
     Geoname() : latitude(0.0f), longitude(0.0f) {}
-    Geoname(float x, float y) : latitude(x), longitude(y) {}
+    Geoname(double x, double y) : latitude(x), longitude(y) {}
     
     float distanceTo(const Geoname &other) const {
         float dx = latitude - other.latitude;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Geoname.hpp"
+
+/// Lee puntos de un volcado de GeoNames (TSV: geonameid, name, asciiname,
+/// alternatenames, latitude, longitude, ...) o de un CSV simple "x,y" como
+/// src/inputs.csv. Las líneas mal formadas se omiten.
+inline std::vector<Geoname> loadGeonames(const std::string& path,
+                                         size_t limit = std::numeric_limits<size_t>::max()) {
+    std::vector<Geoname> out;
+    std::ifstream in(path);
+    if (!in.is_open()) return out;
+
+    std::string line;
+    long nextId = 1;
+    while (out.size() < limit && std::getline(in, line)) {
+        if (line.empty()) continue;
+        try {
+            if (line.find('\t') != std::string::npos) {
+                std::vector<std::string> cols;
+                std::istringstream ss(line);
+                std::string col;
+                while (cols.size() < 6 && std::getline(ss, col, '\t')) cols.push_back(col);
+                if (cols.size() < 6) continue;
+                Geoname g;
+                g.latitude = std::stod(cols[4]);
+                g.longitude = std::stod(cols[5]);
+                g.geonameId = std::stol(cols[0]);
+                g.name = cols[1];
+                out.push_back(std::move(g));
+            } else {
+                const auto comma = line.find(',');
+                if (comma == std::string::npos) continue;
+                Geoname g;
+                g.latitude = std::stod(line.substr(0, comma));
+                g.longitude = std::stod(line.substr(comma + 1));
+                g.geonameId = nextId++;
+                out.push_back(std::move(g));
+            }
+        } catch (const std::exception&) {
+            continue; // cabecera o línea inválida
+        }
+    }
+    return out;
+}
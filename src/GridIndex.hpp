@@ -2,147 +2,638 @@
 
 #include "Index.hpp"
 #include "utils.hpp"
+#include "Metric.hpp"
+#include "NameIndex.hpp"
+#include "PointStore.hpp"
+#include "Rect.hpp"
 #include <vector>
+#include <functional>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <queue>
+#include <limits>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 
-static constexpr double EARTH_RADIUS = 6'371'000.0; // metros
+/// Rejilla uniforme sobre el rectángulo de los datos.
+///   Coord   tipo de las coordenadas guardadas (float o double)
+///   Metric  HaversineMetric (metros) o PlanarMetric (unidades de las coordenadas)
+template <typename Coord = double, typename Metric = HaversineMetric>
+class BasicGridIndex : public Index {
+    static_assert(std::is_floating_point<Coord>::value, "Coord debe ser float o double");
 
-class GridIndex : public Index {
 public:
     /// gx × gy celdas (por defecto 10×10)
-    explicit GridIndex(size_t gx = 10, size_t gy = 10);
+    explicit BasicGridIndex(size_t gx = 10, size_t gy = 10);
 
     void build(const std::vector<Geoname>& records) override;
+    /// Con pesos (uno por registro) aggregateQuery devuelve además su suma.
+    void build(const std::vector<Geoname>& records, const std::vector<double>& weights) override;
     std::vector<Geoname> rangeQuery(double minLat, double minLon,
                                     double maxLat, double maxLon) override;
+    ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon) override;
+    /// rangeQueryChunks contando en prof (para los índices que delegan en este).
+    template <typename Profile>
+    ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon,
+                                             Profile& prof) const {
+        if (store_.empty()) return {};
+        return rangeQueryImpl(minLat, minLon, maxLat, maxLon, nullptr, prof);
+    }
+    QueryProgress rangeQueryEach(double minLat, double minLon, double maxLat, double maxLon,
+                                 const QueryOptions& opts,
+                                 const std::function<bool(const Geoname&)>& sink) override;
+    Aggregate aggregateQuery(double minLat, double minLon, double maxLat, double maxLon) override;
+    std::optional<Geoname> getById(long id) override;
     std::vector<Geoname> kNN(const Geoname& q, int k) override;
+    std::vector<Geoname> rangeQueryWithPrefix(double minLat, double minLon, double maxLat, double maxLon,
+                                              const std::string& namePrefix) override;
+    std::vector<Geoname> kNNWithPrefix(const Geoname& q, int k, const std::string& namePrefix) override;
+    std::vector<Geoname> radiusQuery(double lat, double lon, double meters) override;
+    std::vector<std::pair<double, Geoname>> radiusQueryWithDistances(double lat, double lon,
+                                                                     double meters) override;
+    size_t memoryUsage() const override;
+    /// Reparto de las consultas de rango grandes entre hilos (ParallelScan.hpp).
+    ParallelScan& parallelScan() { return scan_; }
+
+    /// Trabajo de rangeQuery sin mirar los puntos: celdas que visita la
+    /// ventana y puntos que hay en ellas (candidatos a probar).
+    struct WindowStats {
+        size_t cells = 0, candidates = 0;
+    };
+    WindowStats windowStats(double minLat, double minLon, double maxLat, double maxLon) const;
 
 private:
     size_t gx_, gy_;
     double minLat_, maxLat_, minLon_, maxLon_;
     double cellHeight_, cellWidth_;
 
-    std::vector<Geoname> allRecords_;
-    // cells_[i][j]: registros en fila i (latitud), columna j (longitud)
-    std::vector<std::vector<std::vector<Geoname>>> cells_;
+    // Los puntos van ordenados por celda (fila i de latitud, columna j de
+    // longitud, celda lineal i * gx + j): la celda c ocupa
+    // store_[cellStart_[c], cellStart_[c + 1]).
+    PointStore<Coord, Metric> store_;
+    std::vector<uint32_t> cellStart_;
+    size_t maxCellSize_ = 0;
+    std::vector<NameSignature> cellSigs_; // resumen de los nombres de cada celda; vacío sin nombres
+    ParallelScan scan_;                   // reparto de las consultas de rango grandes
 
-    void assignToCells();
     std::pair<size_t, size_t> getCellIndices(double lat, double lon) const;
+    size_t cellBegin(size_t i, size_t j) const { return cellStart_[i * gx_ + j]; }
+    size_t cellEnd(size_t i, size_t j) const { return cellStart_[i * gx_ + j + 1]; }
+    Rect cellRect(size_t i, size_t j) const {
+        return Rect(minLat_ + i * cellHeight_, minLon_ + j * cellWidth_,
+                    minLat_ + (i + 1) * cellHeight_, minLon_ + (j + 1) * cellWidth_);
+    }
+
+    // ¿Puede la celda tener algún nombre con prefix? (nullptr: sin filtro)
+    bool cellMayMatch(size_t i, size_t j, const std::string* prefix) const {
+        return !prefix || cellSigs_[i * gx_ + j].mayHavePrefix(*prefix);
+    }
+
+    // Los recorridos son plantillas sobre el perfil (QueryProfile.hpp); en la
+    // rejilla cada celda visitada cuenta como un nodo de nivel 0. `prefix`
+    // (normalizado) limita los resultados a los nombres que empiezan por él.
+    template <typename Profile>
+    ChunkedResults<Geoname> rangeQueryImpl(double minLat, double minLon, double maxLat, double maxLon,
+                                           const std::string* prefix, Profile& prof) const;
+    template <typename Profile>
+    void scanRows(size_t i0, size_t i1, size_t j0, size_t j1, const BasicRect<Coord>& query,
+                  const std::string* prefix, std::vector<Geoname>& result, Profile& prof) const;
+
+    using KnnHeap = std::priority_queue<std::pair<double, uint32_t>>;
+    template <typename Profile>
+    void scanCell(size_t i, size_t j, double lat, double lon, const typename Metric::Query& mq, size_t k,
+                  const std::string* prefix, KnnHeap& pq, std::vector<Coord>& d2, Profile& prof) const;
+    double ringExitBound(double lat, double lon, long ci, long cj, long r) const;
+    template <typename Profile>
+    std::vector<Geoname> kNNImpl(const Geoname& q, int k, const std::string* prefix, Profile& prof) const;
+
+    template <typename Profile>
+    std::vector<std::pair<double, uint32_t>> radiusMatches(double lat, double lon, double distance,
+                                                           bool withDist, Profile& prof) const;
+    template <typename Profile>
+    std::vector<Geoname> radiusQueryImpl(double lat, double lon, double distance, Profile& prof) const;
+    template <typename Profile>
+    std::vector<std::pair<double, Geoname>> radiusWithDistancesImpl(double lat, double lon, double distance,
+                                                                    Profile& prof) const;
 
 };
 
+/// Configuración original: double y distancia geodésica.
+using GridIndex = BasicGridIndex<>;
 
-inline GridIndex::GridIndex(size_t gx, size_t gy)
-    : gx_(gx), gy_(gy),
+
+template <typename Coord, typename Metric>
+inline BasicGridIndex<Coord, Metric>::BasicGridIndex(size_t gx, size_t gy)
+    : gx_(std::max<size_t>(1, gx)), gy_(std::max<size_t>(1, gy)),
       minLat_(0), maxLat_(0), minLon_(0), maxLon_(0),
       cellHeight_(0), cellWidth_(0) {}
 
-inline void GridIndex::build(const std::vector<Geoname>& records) {
-    if (records.empty()) return;
+template <typename Coord, typename Metric>
+inline void BasicGridIndex<Coord, Metric>::build(const std::vector<Geoname>& records) {
+    build(records, {});
+}
 
-    // 1) almacena todos
-    allRecords_ = records;
+template <typename Coord, typename Metric>
+inline void BasicGridIndex<Coord, Metric>::build(const std::vector<Geoname>& records,
+                                                 const std::vector<double>& weights) {
+    if (!weights.empty() && weights.size() != records.size())
+        throw std::invalid_argument("build: hace falta un peso por registro");
+    store_.clear();
+    cellStart_.clear();
+    cellSigs_.clear();
+    maxCellSize_ = 0;
+    if (records.empty()) return;
 
-    // 2) calcula bounds globales
-    minLat_ = maxLat_ = records[0].latitude;
-    minLon_ = maxLon_ = records[0].longitude;
+    // 1) bounds globales sobre las coordenadas ya redondeadas a Coord, para
+    //    que cada punto guardado caiga dentro de la celda que le toca
+    auto rounded = [](const double v) { return static_cast<double>(static_cast<Coord>(v)); };
+    minLat_ = maxLat_ = rounded(records[0].latitude);
+    minLon_ = maxLon_ = rounded(records[0].longitude);
     for (const auto& g : records) {
-        minLat_ = std::min(minLat_, g.latitude);
-        maxLat_ = std::max(maxLat_, g.latitude);
-        minLon_ = std::min(minLon_, g.longitude);
-        maxLon_ = std::max(maxLon_, g.longitude);
+        minLat_ = std::min(minLat_, rounded(g.latitude));
+        maxLat_ = std::max(maxLat_, rounded(g.latitude));
+        minLon_ = std::min(minLon_, rounded(g.longitude));
+        maxLon_ = std::max(maxLon_, rounded(g.longitude));
     }
 
-    // 3) dim celdas
+    // 2) dim celdas
     cellHeight_ = (maxLat_ - minLat_) / static_cast<double>(gy_);
     cellWidth_ = (maxLon_ - minLon_) / static_cast<double>(gx_);
 
-    // 4) prepara estructura cells_
-    cells_.assign(gy_, std::vector<std::vector<Geoname>>(gx_));
-    // 5) asigna cada registro a su celda
-    assignToCells();
+    // 3) counting sort por celda
+    std::vector<uint32_t> cellOf(records.size());
+    cellStart_.assign(gx_ * gy_ + 1, 0);
+    for (size_t r = 0; r < records.size(); ++r) {
+        const auto [i, j] = getCellIndices(rounded(records[r].latitude), rounded(records[r].longitude));
+        cellOf[r] = static_cast<uint32_t>(i * gx_ + j);
+        ++cellStart_[cellOf[r] + 1];
+    }
+    for (size_t c = 0; c < gx_ * gy_; ++c) {
+        maxCellSize_ = std::max<size_t>(maxCellSize_, cellStart_[c + 1]);
+        cellStart_[c + 1] += cellStart_[c];
+    }
+    std::vector<uint32_t> order(records.size());
+    std::vector<uint32_t> next(cellStart_.begin(), cellStart_.end() - 1);
+    for (size_t r = 0; r < records.size(); ++r) order[next[cellOf[r]]++] = static_cast<uint32_t>(r);
+
+    // 4) guarda los puntos en orden de celda
+    store_.assign(records, order);
+    if (!weights.empty()) store_.assignWeights(weights, order);
+
+    // 5) resumen de nombres por celda
+    if (!store_.hasNames()) return;
+    cellSigs_.resize(gx_ * gy_);
+    for (size_t c = 0; c < gx_ * gy_; ++c) cellSigs_[c] = store_.signature(cellStart_[c], cellStart_[c + 1]);
 }
 
-inline void GridIndex::assignToCells() {
-    for (const auto& g : allRecords_) {
-        auto [i, j] = getCellIndices(g.latitude, g.longitude);
-        cells_[i][j].push_back(g);
-    }
+template <typename Coord, typename Metric>
+inline std::optional<Geoname> BasicGridIndex<Coord, Metric>::getById(const long id) {
+    const uint32_t i = store_.find(id);
+    if (i == store_.NOT_FOUND) return std::nullopt;
+    return store_[i];
 }
 
-inline std::pair<size_t, size_t> GridIndex::getCellIndices(const double lat, const double lon) const {
-    size_t i =  std::min<double>(
-        gy_ - 1,
-        std::floor((lat - minLat_) / cellHeight_)
-        );
+template <typename Coord, typename Metric>
+inline size_t BasicGridIndex<Coord, Metric>::memoryUsage() const {
+    return sizeof(*this) + cellStart_.capacity() * sizeof(uint32_t) + store_.memoryUsage()
+         + cellSigs_.capacity() * sizeof(NameSignature);
+}
 
-    size_t j = std::min<double>(
-        gx_ - 1,
-       std::floor((lon - minLon_) / cellWidth_)
-       );
+template <typename Coord, typename Metric>
+inline std::pair<size_t, size_t> BasicGridIndex<Coord, Metric>::getCellIndices(const double lat,
+                                                                               const double lon) const {
+    // fuera de los bounds se recorta a la celda del borde
+    const double fi = cellHeight_ > 0 ? std::floor((lat - minLat_) / cellHeight_) : 0.0;
+    const double fj = cellWidth_ > 0 ? std::floor((lon - minLon_) / cellWidth_) : 0.0;
+    size_t i = static_cast<size_t>(std::clamp(fi, 0.0, static_cast<double>(gy_ - 1)));
+    size_t j = static_cast<size_t>(std::clamp(fj, 0.0, static_cast<double>(gx_ - 1)));
     return {i, j};
 }
 
-inline std::vector<Geoname> GridIndex::rangeQuery(const double minLat, const double minLon,
-                                                  const double maxLat, const double maxLon) {
-    if (allRecords_.empty()) {
+// Las celdas j0..j1 de una fila son contiguas en store_: los candidatos de
+// cada fila salen de cellStart_ sin mirar los puntos.
+template <typename Coord, typename Metric>
+inline typename BasicGridIndex<Coord, Metric>::WindowStats BasicGridIndex<Coord, Metric>::windowStats(
+        const double minLat, const double minLon, const double maxLat, const double maxLon) const {
+    WindowStats stats;
+    if (store_.empty()) return stats;
+    auto [i0, j0] = getCellIndices(minLat, minLon);
+    auto [i1, j1] = getCellIndices(maxLat, maxLon);
+    if (i0 > i1) std::swap(i0, i1);
+    if (j0 > j1) std::swap(j0, j1);
+    stats.cells = (i1 - i0 + 1) * (j1 - j0 + 1);
+    for (size_t i = i0; i <= i1; ++i) stats.candidates += cellEnd(i, j1) - cellBegin(i, j0);
+    return stats;
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::rangeQuery(const double minLat, const double minLon,
+                                                                      const double maxLat, const double maxLon) {
+    return rangeQueryChunks(minLat, minLon, maxLat, maxLon).flatten();
+}
+
+template <typename Coord, typename Metric>
+inline ChunkedResults<Geoname> BasicGridIndex<Coord, Metric>::rangeQueryChunks(
+        const double minLat, const double minLon, const double maxLat, const double maxLon) {
+    if (store_.empty()) {
         std::cout << "[rangeQuery] No hay registros cargados." << std::endl;
         return {};
     }
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::Range, [&](QueryProfile& p) {
+            return rangeQueryImpl(minLat, minLon, maxLat, maxLon, nullptr, p);
+        });
+    NullProfile none;
+    return rangeQueryImpl(minLat, minLon, maxLat, maxLon, nullptr, none);
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::rangeQueryWithPrefix(
+        const double minLat, const double minLon, const double maxLat, const double maxLon,
+        const std::string& namePrefix) {
+    if (namePrefix.empty()) return rangeQuery(minLat, minLon, maxLat, maxLon);
+    if (store_.empty()) return {};
+    const std::string prefix = normalizeName(namePrefix);
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::Range, [&](QueryProfile& p) {
+            return rangeQueryImpl(minLat, minLon, maxLat, maxLon, &prefix, p);
+        }).flatten();
+    NullProfile none;
+    return rangeQueryImpl(minLat, minLon, maxLat, maxLon, &prefix, none).flatten();
+}
+
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline ChunkedResults<Geoname> BasicGridIndex<Coord, Metric>::rangeQueryImpl(
+        const double minLat, const double minLon, const double maxLat, const double maxLon,
+        const std::string* prefix, Profile& prof) const {
+    [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
 
     auto [i0, j0] = getCellIndices(minLat, minLon);
     auto [i1, j1] = getCellIndices(maxLat, maxLon);
 
-    std::vector<Geoname> result;
+    ChunkedResults<Geoname> out;
 
     if (i0 > i1) std::swap(i0, i1);
     if (j0 > j1) std::swap(j0, j1);
 
+    const auto query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+    if (prefix) {
+        // Pocos registros con el prefijo: se miran directamente
+        const auto [first, last] = store_.withPrefix(*prefix);
+        if (static_cast<size_t>(last - first) <= NAME_DIRECT_LIMIT) {
+            prof.tested(static_cast<size_t>(last - first));
+            std::vector<Geoname> result;
+            for (const uint32_t* p = first; p != last; ++p) {
+                if (query.contains(store_.lat(*p), store_.lon(*p))) result.push_back(store_[*p]);
+            }
+            out.add(std::move(result));
+            return out;
+        }
+    }
+
+    std::vector<size_t> rowEnd;   // fila siguiente a la última de cada franja
+    const size_t candidates = windowStats(minLat, minLon, maxLat, maxLon).candidates;
+    if (scan_.worth(candidates)) {
+        // Franjas de filas con unos candidates / targetTasks candidatos cada una
+        const size_t perTask = std::max<size_t>(1, candidates / scan_.targetTasks());
+        size_t acc = 0;
+        for (size_t i = i0; i <= i1; ++i) {
+            acc += cellEnd(i, j1) - cellBegin(i, j0);
+            if (acc >= perTask || i == i1) {
+                rowEnd.push_back(i + 1);
+                acc = 0;
+            }
+        }
+    }
+    if (rowEnd.size() <= 1) {
+        std::vector<Geoname> result;
+        scanRows(i0, i1, j0, j1, query, prefix, result, prof);
+        out.add(std::move(result));
+        return out;
+    }
+    std::vector<std::vector<Geoname>> parts(rowEnd.size());
+    std::vector<Profile> profs(rowEnd.size());
+    scan_.run(rowEnd.size(), [&](const size_t t) {
+        scanRows(t == 0 ? i0 : rowEnd[t - 1], rowEnd[t] - 1, j0, j1, query, prefix, parts[t], profs[t]);
+    });
+    for (size_t t = 0; t < parts.size(); ++t) {
+        prof.merge(profs[t]);
+        out.add(std::move(parts[t]));
+    }
+    return out;
+}
+
+// Celdas de las filas i0..i1 y columnas j0..j1 que cortan query.
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline void BasicGridIndex<Coord, Metric>::scanRows(const size_t i0, const size_t i1, const size_t j0,
+                                                    const size_t j1, const BasicRect<Coord>& query,
+                                                    const std::string* prefix, std::vector<Geoname>& result,
+                                                    Profile& prof) const {
+    std::vector<uint32_t> sel(maxCellSize_);
     for (size_t i = i0; i <= i1; ++i) {
         for (size_t j = j0; j <= j1; ++j) {
-            for (auto const& g : cells_[i][j]) {
-                if (g.latitude >= minLat && g.latitude <= maxLat &&
-                    g.longitude >= minLon && g.longitude <= maxLon) {
-                    result.push_back(g);
-                }
+            const size_t begin = cellBegin(i, j), end = cellEnd(i, j);
+            prof.node(0);
+            if (!cellMayMatch(i, j, prefix)) continue;
+            prof.leaf();
+            prof.tested(end - begin);
+            const size_t m = store_.select(query, begin, end, sel.data());
+            for (size_t s = 0; s < m; ++s) {
+                if (!prefix || store_.nameHasPrefix(sel[s], *prefix)) result.push_back(store_[sel[s]]);
             }
         }
     }
-    return result;
 }
 
-inline std::vector<Geoname> GridIndex::kNN(const Geoname& q, int k) {
-    using Pair = std::pair<double, Geoname>;
-    auto cmp = [](Pair const& a, Pair const& b)
-    {
-        return a.first < b.first;
-    };
-    std::priority_queue<Pair, std::vector<Pair>, decltype(cmp)> pq(cmp);
+// getCellIndices es monótona, así que un punto de una celda estrictamente
+// entre las de las esquinas de la ventana (en las dos direcciones) está dentro
+// de la ventana: esas celdas se suman enteras y solo se filtra el borde.
+template <typename Coord, typename Metric>
+inline Aggregate BasicGridIndex<Coord, Metric>::aggregateQuery(const double minLat, const double minLon,
+                                                               const double maxLat, const double maxLon) {
+    Aggregate acc;
+    if (store_.empty() || minLat > maxLat || minLon > maxLon) return acc;
 
-    for (auto const& g : allRecords_) {
-        // if (g.geonameId == q.geonameId) continue;
+    const auto [i0, j0] = getCellIndices(minLat, minLon);
+    const auto [i1, j1] = getCellIndices(maxLat, maxLon);
+    const auto query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+    std::vector<uint32_t> sel(maxCellSize_);
+    for (size_t i = i0; i <= i1; ++i) {
+        const bool innerRow = i > i0 && i < i1;
+        for (size_t j = j0; j <= j1; ++j) {
+            const size_t begin = cellBegin(i, j), end = cellEnd(i, j);
+            if (innerRow && j > j0 && j < j1) {
+                acc.count += end - begin;
+                acc.sum += store_.weightSum(begin, end);
+                continue;
+            }
+            const size_t m = store_.select(query, begin, end, sel.data());
+            acc.count += m;
+            for (size_t s = 0; s < m; ++s) acc.sum += store_.weight(sel[s]);
+        }
+    }
+    return acc;
+}
 
-        double d = haversine(q.latitude, q.longitude,
-                             g.latitude, g.longitude);
+// Cursor: (celda lineal i * gx + j) << 32 | posición dentro de la celda. Las
+// celdas se recorren por filas, así que el cursor crece con el recorrido.
+template <typename Coord, typename Metric>
+inline QueryProgress BasicGridIndex<Coord, Metric>::rangeQueryEach(
+        const double minLat, const double minLon, const double maxLat, const double maxLon,
+        const QueryOptions& opts, const std::function<bool(const Geoname&)>& sink) {
+    QueryBudget budget(opts);
+    if (store_.empty()) return budget.finish(0);
 
-        if (pq.size() < static_cast<size_t>(k)) {
-            pq.emplace(d, g);
+    auto [i0, j0] = getCellIndices(minLat, minLon);
+    auto [i1, j1] = getCellIndices(maxLat, maxLon);
+    if (i0 > i1) std::swap(i0, i1);
+    if (j0 > j1) std::swap(j0, j1);
+
+    const auto query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+    const uint64_t fromCell = opts.cursor >> 32;
+    const uint64_t fromOffset = opts.cursor & 0xFFFFFFFFu;
+    for (size_t i = i0; i <= i1; ++i) {
+        for (size_t j = j0; j <= j1; ++j) {
+            const uint64_t cell = static_cast<uint64_t>(i) * gx_ + j;
+            if (cell < fromCell) continue;
+            const size_t start = cell == fromCell ? fromOffset : 0;
+            if (budget.interrupted()) return budget.finish(cell << 32 | start);
+
+            const size_t begin = cellBegin(i, j), size = cellEnd(i, j) - begin;
+            for (size_t k = start; k < size; ++k) {
+                if (!query.contains(store_.lat(begin + k), store_.lon(begin + k))) continue;
+                if (!budget.admit()) return budget.finish(cell << 32 | k);
+                if (!sink(store_[begin + k])) {
+                    budget.stop();
+                    return budget.finish(cell << 32 | (k + 1));
+                }
+            }
+        }
+    }
+    return budget.finish(0);
+}
+
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline void BasicGridIndex<Coord, Metric>::scanCell(const size_t i, const size_t j, const double lat,
+                                                    const double lon, const typename Metric::Query& mq,
+                                                    const size_t k, const std::string* prefix, KnnHeap& pq,
+                                                    std::vector<Coord>& d2, Profile& prof) const {
+    const size_t begin = cellBegin(i, j), n = cellEnd(i, j) - begin;
+    prof.node(0);
+    if (n == 0 || !cellMayMatch(i, j, prefix)) return;
+    if (pq.size() == k) {
+        prof.distances(1);
+        if (Metric::minKey(lat, lon, cellRect(i, j)) >= pq.top().first) return;
+    }
+    prof.leaf();
+    prof.tested(n);
+    prof.distances(n);
+    d2.resize(n);
+    store_.keys(mq, begin, n, d2.data());
+
+    for (size_t m = 0; m < n; ++m) {
+        // if (store_[begin + m].geonameId == q.geonameId) continue;
+        if (prefix && !store_.nameHasPrefix(begin + m, *prefix)) continue;
+        if (pq.size() < k) {
+            pq.emplace(d2[m], static_cast<uint32_t>(begin + m));
         }
-        else if (d < pq.top().first) {
+        else if (d2[m] < pq.top().first) {
             pq.pop();
-            pq.emplace(d, g);
+            pq.emplace(d2[m], static_cast<uint32_t>(begin + m));
+        }
+    }
+}
+
+/// Cota inferior (clave de la métrica) de la distancia desde (lat, lon) a
+/// cualquier celda fuera de los anillos 0..r alrededor de (ci, cj): la menor
+/// distancia a las franjas de filas y columnas que quedan por visitar.
+/// Infinita si ya no queda nada.
+template <typename Coord, typename Metric>
+inline double BasicGridIndex<Coord, Metric>::ringExitBound(const double lat, const double lon,
+                                                           const long ci, const long cj, const long r) const {
+    const long i0 = std::max(0L, ci - r), i1 = std::min<long>(gy_ - 1, ci + r);
+    const long j0 = std::max(0L, cj - r), j1 = std::min<long>(gx_ - 1, cj + r);
+    const double boxMinLat = minLat_ + i0 * cellHeight_, boxMaxLat = minLat_ + (i1 + 1) * cellHeight_;
+    const double boxMinLon = minLon_ + j0 * cellWidth_, boxMaxLon = minLon_ + (j1 + 1) * cellWidth_;
+
+    double bound = std::numeric_limits<double>::infinity();
+    if (i0 > 0) bound = std::min(bound, Metric::minKey(lat, lon, Rect(minLat_, minLon_, boxMinLat, maxLon_)));
+    if (i1 < static_cast<long>(gy_) - 1)
+        bound = std::min(bound, Metric::minKey(lat, lon, Rect(boxMaxLat, minLon_, maxLat_, maxLon_)));
+    if (j0 > 0) bound = std::min(bound, Metric::minKey(lat, lon, Rect(minLat_, minLon_, maxLat_, boxMinLon)));
+    if (j1 < static_cast<long>(gx_) - 1)
+        bound = std::min(bound, Metric::minKey(lat, lon, Rect(minLat_, boxMaxLon, maxLat_, maxLon_)));
+    return bound;
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::kNN(const Geoname& q, int k) {
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, nullptr, p); });
+    NullProfile none;
+    return kNNImpl(q, k, nullptr, none);
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::kNNWithPrefix(const Geoname& q, const int k,
+                                                                         const std::string& namePrefix) {
+    if (namePrefix.empty()) return kNN(q, k);
+    const std::string prefix = normalizeName(namePrefix);
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, &prefix, p); });
+    NullProfile none;
+    return kNNImpl(q, k, &prefix, none);
+}
+
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::kNNImpl(const Geoname& q, int k,
+                                                                   const std::string* prefix, Profile& prof) const {
+    if (k <= 0 || store_.empty()) return {};
+    // max-heap sobre la clave de la métrica: el tope es el peor de los k actuales
+    KnnHeap pq;
+    const size_t kk = static_cast<size_t>(k);
+    const auto mq = Metric::query(q.latitude, q.longitude);
+    std::vector<Coord> d2;
+
+    const auto [first, last] = prefix ? store_.withPrefix(*prefix)
+                                      : std::pair<const uint32_t*, const uint32_t*>(nullptr, nullptr);
+    if (prefix && static_cast<size_t>(last - first) <= NAME_DIRECT_LIMIT) {
+        // Pocos registros con el prefijo: sus distancias directamente
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        prof.tested(static_cast<size_t>(last - first));
+        prof.distances(static_cast<size_t>(last - first));
+        for (const uint32_t* p = first; p != last; ++p) {
+            const double key = Metric::toKey(Metric::distance(q.latitude, q.longitude, store_.lat(*p), store_.lon(*p)));
+            if (pq.size() < kk) {
+                pq.emplace(key, *p);
+            } else if (key < pq.top().first) {
+                pq.pop();
+                pq.emplace(key, *p);
+            }
+        }
+    } else {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        // búsqueda por anillos alrededor de la celda de q, hasta que ninguna celda
+        // fuera de los anillos visitados pueda mejorar el k-ésimo vecino
+        const auto [qi, qj] = getCellIndices(q.latitude, q.longitude);
+        const long ci = static_cast<long>(qi), cj = static_cast<long>(qj);
+        const long maxR = static_cast<long>(std::max(gx_, gy_));
+        for (long r = 0; r <= maxR; ++r) {
+            for (long i = std::max(0L, ci - r); i <= std::min<long>(gy_ - 1, ci + r); ++i) {
+                // filas del borde completas; en las interiores solo las dos columnas extremas
+                const long step = std::abs(i - ci) == r ? 1 : std::max(1L, 2 * r);
+                for (long j = cj - r; j <= cj + r; j += step) {
+                    if (j < 0 || j >= static_cast<long>(gx_)) continue;
+                    scanCell(i, j, q.latitude, q.longitude, mq, kk, prefix, pq, d2, prof);
+                }
+            }
+            prof.distances(4);
+            if (pq.size() == kk && ringExitBound(q.latitude, q.longitude, ci, cj, r) >= pq.top().first) break;
         }
     }
 
+    [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
     std::vector<Geoname> neighbors;
     neighbors.reserve(pq.size());
     while (!pq.empty()) {
-        neighbors.push_back(pq.top().second);
+        neighbors.push_back(store_[pq.top().second]);
         pq.pop();
     }
     std::reverse(neighbors.begin(), neighbors.end());
     return neighbors;
-}
\ No newline at end of file
+}
+
+/// Candidatos (clave, posición en store_) a <= distance de (lat, lon). Recorre
+/// solo las filas/columnas de Metric::searchBox; las celdas con MAXDIST dentro
+/// del radio se aceptan enteras si no hacen falta distancias.
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline std::vector<std::pair<double, uint32_t>> BasicGridIndex<Coord, Metric>::radiusMatches(
+        const double lat, const double lon, const double distance, const bool withDist, Profile& prof) const {
+    [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+    std::vector<std::pair<double, uint32_t>> out;
+    if (store_.empty() || distance < 0) return out;
+
+    const double c2max = Metric::toKey(distance);
+    const Rect box = Metric::searchBox(lat, lon, distance);
+    const auto [i0, j0] = getCellIndices(box.minLat, box.minLon);
+    const auto [i1, j1] = getCellIndices(box.maxLat, box.maxLon);
+
+    const auto mq = Metric::query(lat, lon);
+    std::vector<Coord> d2;
+    for (size_t i = i0; i <= i1; ++i) {
+        for (size_t j = j0; j <= j1; ++j) {
+            const size_t begin = cellBegin(i, j), n = cellEnd(i, j) - begin;
+            prof.node(0);
+            if (n == 0) continue;
+            prof.distances(withDist ? 1 : 2);
+            const Rect cell = cellRect(i, j);
+            if (Metric::minKey(lat, lon, cell) > c2max) continue;
+            if (!withDist && Metric::maxKey(lat, lon, cell) <= c2max) {
+                for (size_t m = begin; m < begin + n; ++m) out.emplace_back(0.0, static_cast<uint32_t>(m));
+                continue;
+            }
+            prof.leaf();
+            prof.tested(n);
+            prof.distances(n);
+            d2.resize(n);
+            store_.keys(mq, begin, n, d2.data());
+            for (size_t m = 0; m < n; ++m)
+                if (d2[m] <= c2max) out.emplace_back(d2[m], static_cast<uint32_t>(begin + m));
+        }
+    }
+    return out;
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::radiusQuery(const double lat, const double lon,
+                                                                       const double meters) {
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::Radius, [&](QueryProfile& p) { return radiusQueryImpl(lat, lon, meters, p); });
+    NullProfile none;
+    return radiusQueryImpl(lat, lon, meters, none);
+}
+
+template <typename Coord, typename Metric>
+inline std::vector<std::pair<double, Geoname>> BasicGridIndex<Coord, Metric>::radiusQueryWithDistances(
+        const double lat, const double lon, const double meters) {
+    if (profiler_.enabled())
+        return profiler_.run(QueryKind::Radius,
+                             [&](QueryProfile& p) { return radiusWithDistancesImpl(lat, lon, meters, p); });
+    NullProfile none;
+    return radiusWithDistancesImpl(lat, lon, meters, none);
+}
+
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline std::vector<Geoname> BasicGridIndex<Coord, Metric>::radiusQueryImpl(const double lat, const double lon,
+                                                                           const double distance,
+                                                                           Profile& prof) const {
+    const auto matches = radiusMatches(lat, lon, distance, false, prof);
+    [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+    std::vector<Geoname> result;
+    result.reserve(matches.size());
+    for (const auto& [_, i] : matches) result.push_back(store_[i]);
+    return result;
+}
+
+template <typename Coord, typename Metric>
+template <typename Profile>
+inline std::vector<std::pair<double, Geoname>> BasicGridIndex<Coord, Metric>::radiusWithDistancesImpl(
+        const double lat, const double lon, const double distance, Profile& prof) const {
+    auto matches = radiusMatches(lat, lon, distance, true, prof);
+    [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+    std::sort(matches.begin(), matches.end());
+    std::vector<std::pair<double, Geoname>> result;
+    result.reserve(matches.size());
+    for (const auto& [c2, i] : matches) result.emplace_back(Metric::toDistance(c2), store_[i]);
+    return result;
+}
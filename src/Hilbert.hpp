@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Posición de la celda (x, y) en la curva de Hilbert que recorre una
+/// rejilla de 2^bits × 2^bits celdas (bits <= 32).
+inline uint64_t hilbertIndex(uint64_t x, uint64_t y, const unsigned bits) {
+    if (bits == 0) return 0;
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    uint64_t d = 0;
+    for (uint64_t s = uint64_t(1) << (bits - 1); s > 0; s >>= 1) {
+        const uint64_t rx = (x & s) ? 1 : 0;
+        const uint64_t ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        // rotar el cuadrante
+        if (ry == 0) {
+            if (rx == 1) {
+                x = mask - x;
+                y = mask - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+/// Clave de Hilbert de 64 bits (orden 32) para un punto lat/lon.
+inline uint64_t hilbertKey(const double lat, const double lon) {
+    constexpr double SCALE = 4294967295.0; // 2^32 - 1
+    const auto x = static_cast<uint64_t>(std::clamp((lon + 180.0) / 360.0, 0.0, 1.0) * SCALE);
+    const auto y = static_cast<uint64_t>(std::clamp((lat + 90.0) / 180.0, 0.0, 1.0) * SCALE);
+    return hilbertIndex(x, y, 32);
+}
+
+/// Radix sort LSD (8 pasadas de 8 bits) de pares (clave, índice) en paralelo:
+/// cada hilo hace el histograma de su trozo y luego reparte en su rango de salida.
+/// Las pasadas cuyo byte es igual en todas las claves se saltan.
+inline void parallelRadixSort(std::vector<std::pair<uint64_t, uint32_t>>& items,
+                              unsigned threads = std::thread::hardware_concurrency()) {
+    using Item = std::pair<uint64_t, uint32_t>;
+    const size_t n = items.size();
+    if (n < 2) return;
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(n / 65536 + 1)));
+
+    std::vector<Item> tmp(n);
+    std::vector<std::vector<size_t>> hist(threads, std::vector<size_t>(256));
+    const size_t chunk = (n + threads - 1) / threads;
+
+    auto runParallel = [threads](auto&& fn) {
+        if (threads == 1) { fn(0u); return; }
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(fn, t);
+        for (auto& th : pool) th.join();
+    };
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        runParallel([&](unsigned t) {
+            auto& h = hist[t];
+            std::fill(h.begin(), h.end(), 0);
+            const size_t end = std::min(n, (t + 1) * chunk);
+            for (size_t i = t * chunk; i < end; ++i) ++h[(items[i].first >> shift) & 0xFF];
+        });
+
+        // offsets: por cubeta, y dentro de cada cubeta por hilo (estable)
+        size_t sum = 0, nonEmpty = 0;
+        for (size_t b = 0; b < 256; ++b) {
+            size_t bucketTotal = 0;
+            for (unsigned t = 0; t < threads; ++t) {
+                const size_t c = hist[t][b];
+                hist[t][b] = sum;
+                sum += c;
+                bucketTotal += c;
+            }
+            if (bucketTotal) ++nonEmpty;
+        }
+        if (nonEmpty == 1) continue;
+
+        runParallel([&](unsigned t) {
+            auto& h = hist[t];
+            const size_t end = std::min(n, (t + 1) * chunk);
+            for (size_t i = t * chunk; i < end; ++i) tmp[h[(items[i].first >> shift) & 0xFF]++] = items[i];
+        });
+        items.swap(tmp);
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+/// Tabla hash de direccionamiento abierto (sondeo lineal) de ids de 64 bits a
+/// posiciones: el índice por clave primaria que acompaña a los índices
+/// espaciales. Claves y valores van en arrays separados; los borrados dejan
+/// una lápida que se limpia al crecer. Las dos últimas claves están reservadas.
+template <typename Value = uint64_t>
+class IdHashIndex {
+public:
+    static constexpr uint64_t EMPTY = std::numeric_limits<uint64_t>::max();
+    static constexpr uint64_t TOMBSTONE = EMPTY - 1;
+    static constexpr Value NONE = std::numeric_limits<Value>::max();
+
+    static bool validKey(const uint64_t key) { return key < TOMBSTONE; }
+
+    /// Valor de key, o NONE si no está.
+    Value find(const uint64_t key) const {
+        if (keys_.empty() || !validKey(key)) return NONE;
+        for (size_t i = slot(key);; i = (i + 1) & mask()) {
+            if (keys_[i] == key) return values_[i];
+            if (keys_[i] == EMPTY) return NONE;
+        }
+    }
+    bool contains(const uint64_t key) const { return find(key) != NONE; }
+
+    /// Inserta key -> value si key no estaba; devuelve si la insertó.
+    bool insert(const uint64_t key, const Value value) { return put(key, value, false); }
+    /// Inserta o sustituye el valor de key.
+    void assign(const uint64_t key, const Value value) { put(key, value, true); }
+
+    bool erase(const uint64_t key) {
+        if (keys_.empty() || !validKey(key)) return false;
+        for (size_t i = slot(key);; i = (i + 1) & mask()) {
+            if (keys_[i] == key) {
+                keys_[i] = TOMBSTONE;
+                --size_;
+                ++tombstones_;
+                return true;
+            }
+            if (keys_[i] == EMPTY) return false;
+        }
+    }
+
+    void clear() {
+        keys_.clear();
+        values_.clear();
+        size_ = tombstones_ = 0;
+    }
+
+    /// Reserva sitio para n claves sin volver a crecer.
+    void reserve(const size_t n) {
+        if (n * 10 > capacity() * 7) rehash(n);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return keys_.size(); }
+    size_t memoryUsage() const { return keys_.capacity() * sizeof(uint64_t) + values_.capacity() * sizeof(Value); }
+
+    /// fn(key, value) para cada entrada, en el orden de la tabla.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t i = 0; i < keys_.size(); ++i)
+            if (validKey(keys_[i])) fn(keys_[i], values_[i]);
+    }
+
+    // Formato: número de entradas (u64) y los pares (clave u64, valor).
+    void save(std::ostream& out) const {
+        const uint64_t n = size_;
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        forEach([&](const uint64_t key, const Value value) {
+            out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+            out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        });
+    }
+    /// Devuelve false si el flujo se corta antes de tiempo (la tabla queda vacía).
+    bool load(std::istream& in) {
+        clear();
+        uint64_t n = 0;
+        if (!in.read(reinterpret_cast<char*>(&n), sizeof(n))) return false;
+        reserve(static_cast<size_t>(n));
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t key;
+            Value value;
+            in.read(reinterpret_cast<char*>(&key), sizeof(key));
+            if (!in.read(reinterpret_cast<char*>(&value), sizeof(value)) || !validKey(key)) {
+                clear();
+                return false;
+            }
+            assign(key, value);
+        }
+        return true;
+    }
+
+private:
+    std::vector<uint64_t> keys_;
+    std::vector<Value> values_;
+    size_t size_ = 0, tombstones_ = 0;
+
+    size_t mask() const { return keys_.size() - 1; }
+
+    // splitmix64: los ids suelen ser consecutivos y el sondeo lineal necesita
+    // que se repartan por toda la tabla
+    size_t slot(uint64_t key) const {
+        key += 0x9E3779B97F4A7C15ull;
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<size_t>(key ^ (key >> 31)) & mask();
+    }
+
+    bool put(const uint64_t key, const Value value, const bool replace) {
+        if (!validKey(key)) return false;
+        // Carga máxima del 70 % contando las lápidas
+        if ((size_ + tombstones_ + 1) * 10 > capacity() * 7) rehash(size_ + 1);
+        size_t grave = EMPTY;
+        for (size_t i = slot(key);; i = (i + 1) & mask()) {
+            if (keys_[i] == key) {
+                if (replace) values_[i] = value;
+                return false;
+            }
+            if (keys_[i] == TOMBSTONE && grave == EMPTY) grave = i;
+            if (keys_[i] == EMPTY) {
+                if (grave != EMPTY) {
+                    i = grave;
+                    --tombstones_;
+                }
+                keys_[i] = key;
+                values_[i] = value;
+                ++size_;
+                return true;
+            }
+        }
+    }
+
+    // Tabla nueva (potencia de dos) con sitio para n claves, sin lápidas.
+    void rehash(const size_t n) {
+        size_t cap = 16;
+        while (n * 10 > cap * 7) cap *= 2;
+        std::vector<uint64_t> keys(cap, EMPTY);
+        std::vector<Value> values(cap);
+        keys.swap(keys_);
+        values.swap(values_);
+        size_ = tombstones_ = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (!validKey(keys[i])) continue;
+            size_t j = slot(keys[i]);
+            while (keys_[j] != EMPTY) j = (j + 1) & mask();
+            keys_[j] = keys[i];
+            values_[j] = values[i];
+            ++size_;
+        }
+    }
+};
@@ -1,15 +1,171 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
 #include <vector>
+#include <utility>
 #include "Geoname.hpp"
+#include "NameIndex.hpp"
+#include "ParallelScan.hpp"
+#include "QueryControl.hpp"
+#include "QueryProfile.hpp"
+
+/// Resultado de aggregateQuery: cuántos puntos caen en la ventana y la suma
+/// de sus pesos (sin pesos cada punto pesa 1, así que sum == count).
+struct Aggregate {
+    size_t count = 0;
+    double sum = 0;
+};
 
 class Index {
 public:
     using JoinResult = std::vector<std::pair<Geoname, Geoname>>;
     virtual ~Index() = default;
     virtual void build(const std::vector<Geoname>& points) = 0;
+    /// build() con un peso por registro (mismo orden) para aggregateQuery.
+    /// Sin pesos equivale a build(points).
+    virtual void build(const std::vector<Geoname>& points, const std::vector<double>& weights) {
+        if (!weights.empty()) throw std::invalid_argument("este índice no admite pesos");
+        build(points);
+    }
     virtual std::vector<Geoname> rangeQuery(double minLat, double minLon,
                                             double maxLat, double maxLon) = 0;
+    /// rangeQuery en trozos (ParallelScan.hpp): los índices que reparten las
+    /// consultas grandes entre hilos devuelven el vector de cada tarea sin
+    /// juntarlos. Por defecto, un único trozo con rangeQuery.
+    virtual ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon) {
+        ChunkedResults<Geoname> out;
+        out.add(rangeQuery(minLat, minLon, maxLat, maxLon));
+        return out;
+    }
+    /// rangeQuery acotada (ver QueryControl.hpp): entrega cada resultado a sink,
+    /// que puede devolver false para parar, y sigue desde opts.cursor.
+    virtual QueryProgress rangeQueryEach(double minLat, double minLon, double maxLat, double maxLon,
+                                         const QueryOptions& opts,
+                                         const std::function<bool(const Geoname&)>& sink) = 0;
+    /// Una página de rangeQueryEach, con el cursor para pedir la siguiente.
+    QueryPage<Geoname> rangeQueryPage(double minLat, double minLon, double maxLat, double maxLon,
+                                      const QueryOptions& opts) {
+        QueryPage<Geoname> page;
+        page.progress = rangeQueryEach(minLat, minLon, maxLat, maxLon, opts, [&](const Geoname& g) {
+            page.results.push_back(g);
+            return true;
+        });
+        return page;
+    }
+    /// Número de puntos en la ventana y suma de sus pesos sin materializarlos.
+    /// Por defecto recorre rangeQueryEach; los índices la redefinen para sumar
+    /// de una vez los nodos o celdas que la ventana cubre enteros.
+    virtual Aggregate aggregateQuery(double minLat, double minLon, double maxLat, double maxLon) {
+        Aggregate acc;
+        rangeQueryEach(minLat, minLon, maxLat, maxLon, QueryOptions(), [&](const Geoname&) {
+            ++acc.count;
+            return true;
+        });
+        acc.sum = static_cast<double>(acc.count);
+        return acc;
+    }
+    size_t countQuery(double minLat, double minLon, double maxLat, double maxLon) {
+        return aggregateQuery(minLat, minLon, maxLat, maxLon).count;
+    }
+    /// Registro con ese geonameId. Por defecto recorre todo el índice; los
+    /// índices con tabla hash de ids (IdIndex.hpp) la redefinen en O(1).
+    virtual std::optional<Geoname> getById(long id) {
+        constexpr double inf = std::numeric_limits<double>::infinity();
+        std::optional<Geoname> found;
+        rangeQueryEach(-inf, -inf, inf, inf, QueryOptions(), [&](const Geoname& g) {
+            if (g.geonameId == id) found = g;
+            return !found;
+        });
+        return found;
+    }
     virtual std::vector<Geoname> kNN(const Geoname& q, int k) = 0;
+
+    /// rangeQuery con solo los registros cuyo nombre empieza por namePrefix
+    /// (sin distinguir mayúsculas ASCII, ver NameIndex.hpp). Por defecto
+    /// filtra rangeQueryEach.
+    virtual std::vector<Geoname> rangeQueryWithPrefix(double minLat, double minLon, double maxLat, double maxLon,
+                                                      const std::string& namePrefix) {
+        const std::string prefix = normalizeName(namePrefix);
+        std::vector<Geoname> out;
+        rangeQueryEach(minLat, minLon, maxLat, maxLon, QueryOptions(), [&](const Geoname& g) {
+            if (hasNamePrefix(g.name, prefix)) out.push_back(g);
+            return true;
+        });
+        return out;
+    }
+    /// Los k vecinos de q entre los registros cuyo nombre empieza por
+    /// namePrefix. Por defecto repite kNN con k cada vez mayor hasta reunirlos;
+    /// los índices en memoria la redefinen con su orden por nombre y los
+    /// resúmenes de nombres de sus nodos o celdas.
+    virtual std::vector<Geoname> kNNWithPrefix(const Geoname& q, int k, const std::string& namePrefix) {
+        if (namePrefix.empty()) return kNN(q, k);
+        const std::string prefix = normalizeName(namePrefix);
+        std::vector<Geoname> out;
+        if (k <= 0) return out;
+        for (size_t want = 4 * static_cast<size_t>(k);; want *= 4) {
+            want = std::min<size_t>(want, INT_MAX);
+            const auto found = kNN(q, static_cast<int>(want));
+            out.clear();
+            for (const auto& g : found) {
+                if (out.size() < static_cast<size_t>(k) && hasNamePrefix(g.name, prefix)) out.push_back(g);
+            }
+            if (out.size() == static_cast<size_t>(k) || found.size() < want || want == INT_MAX) return out;
+        }
+    }
+    /// Todos los registros a <= meters de (lat, lon). Con la métrica geodésica
+    /// son metros; con PlanarMetric, unidades de las coordenadas (Metric.hpp).
+    virtual std::vector<Geoname> radiusQuery(double lat, double lon, double meters) = 0;
+    /// Igual que radiusQuery, con la distancia y ordenado de menor a mayor.
+    virtual std::vector<std::pair<double, Geoname>> radiusQueryWithDistances(double lat, double lon,
+                                                                             double meters) = 0;
+    /// Bytes de memoria reservados por el índice.
+    virtual size_t memoryUsage() const = 0;
+
+    /// Perfilado de rangeQuery, kNN y radiusQuery (apagado por defecto).
+    QueryProfiler& profiler() { return profiler_; }
+
+    /// build() en exclusiva frente a los recorridos que se reanudan (los
+    /// iteradores por trozos toman readLock() en cada trozo) y subiendo la
+    /// generación, para que un iterador creado antes sepa que su índice ya no
+    /// existe. Es lo que usan los bindings y ClusteredIndex.
+    void rebuild(const std::vector<Geoname>& points) {
+        std::unique_lock<std::shared_mutex> lock(rebuildMutex_);
+        build(points);
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    void rebuild(const std::vector<Geoname>& points, const std::vector<double>& weights) {
+        std::unique_lock<std::shared_mutex> lock(rebuildMutex_);
+        build(points, weights);
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+    /// Número de rebuild() hechos.
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+    /// Impide un rebuild() mientras se tenga.
+    std::shared_lock<std::shared_mutex> readLock() const { return std::shared_lock<std::shared_mutex>(rebuildMutex_); }
+    /// rangeQueryPage de un recorrido que empezó en la generación `generation`,
+    /// con readLock() tomado. Si ha habido un rebuild() desde entonces, el
+    /// cursor no vale para el índice nuevo: lanza std::runtime_error.
+    QueryPage<Geoname> resumeRangeQueryPage(const uint64_t generation, double minLat, double minLon, double maxLat,
+                                            double maxLon, const QueryOptions& opts) {
+        const auto lock = readLock();
+        if (this->generation() != generation)
+            throw std::runtime_error("rangeQuery2DIter: el índice se reconstruyó durante el recorrido");
+        return rangeQueryPage(minLat, minLon, maxLat, maxLon, opts);
+    }
+
+protected:
+    QueryProfiler profiler_;
+
+private:
+    mutable std::shared_mutex rebuildMutex_;
+    std::atomic<uint64_t> generation_{0};
 };
 
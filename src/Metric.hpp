@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "Rect.hpp"
+#include "utils.hpp"
+
+// --- Métricas de los índices en memoria ---
+//
+// Cada métrica trabaja con una clave monótona con su distancia (para ordenar
+// y podar sin raíces ni trigonometría) y convierte solo al final:
+//   Points<Coord>   datos precalculados por punto, en SoA
+//   query(lat, lon) punto de consulta preparado para batch()
+//   batch(...)      claves de n puntos consecutivos (bucle vectorizable)
+//   minKey/maxKey   cotas de la clave hasta un rectángulo
+//   toKey/toDistance  distancia <-> clave
+//   searchBox       rectángulo que contiene la bola de radio `distance`
+
+/// Distancia geodésica en metros; la clave es la cuerda al cuadrado (utils.hpp).
+struct HaversineMetric {
+    static constexpr const char* name = "haversine";
+
+    template <typename Coord>
+    using Points = BasicUnitVecArray<Coord>;
+    using Query = UnitVec;
+
+    static Query query(const double lat, const double lon) { return toUnitVec(lat, lon); }
+
+    template <typename Coord>
+    static void batch(const Query& q, const Coord*, const Coord*, const Points<Coord>& pts,
+                      const size_t begin, const size_t n, Coord* out) {
+        chord2Batch(q, pts.xs.data() + begin, pts.ys.data() + begin, pts.zs.data() + begin, n, out);
+    }
+
+    template <typename Coord>
+    static double minKey(const double lat, const double lon, const BasicRect<Coord>& r) {
+        return sphericalMinChord2(lat, lon, r.minLat, r.minLon, r.maxLat, r.maxLon);
+    }
+    template <typename Coord>
+    static double maxKey(const double lat, const double lon, const BasicRect<Coord>& r) {
+        return sphericalMaxChord2(lat, lon, r.minLat, r.minLon, r.maxLat, r.maxLon);
+    }
+
+    static double toKey(const double meters) { return metersToChord2(meters); }
+    static double toDistance(const double key) { return chord2ToMeters(key); }
+    static double distance(const double lat1, const double lon1, const double lat2, const double lon2) {
+        return haversine(lat1, lon1, lat2, lon2);
+    }
+
+    /// Banda de latitudes ±radio y, si el círculo no toca un polo ni cruza el
+    /// antimeridiano, el rango de longitudes que abarca; si no, todas.
+    static Rect searchBox(const double lat, const double lon, const double meters) {
+        constexpr double inf = std::numeric_limits<double>::infinity();
+        const double rad = meters / EARTH_RADIUS_M;
+        const double dLat = rad / DEG_TO_RAD;
+        Rect box(lat - dLat, -inf, lat + dLat, inf);
+        const double sinR = std::sin(std::min(rad, M_PI / 2)), cosPhi = std::cos(lat * DEG_TO_RAD);
+        if (std::abs(lat) + dLat < 90.0 && rad < M_PI / 2 && sinR < cosPhi) {
+            const double dLon = std::asin(sinR / cosPhi) / DEG_TO_RAD;
+            if (lon - dLon >= -180.0 && lon + dLon <= 180.0) {
+                box.minLon = lon - dLon;
+                box.maxLon = lon + dLon;
+            }
+        }
+        return box;
+    }
+};
+
+/// Distancia euclídea tomando (lat, lon) como coordenadas planas (datos ya
+/// proyectados). Distancias y radios van en las unidades de las coordenadas;
+/// la clave es la distancia al cuadrado y no necesita datos por punto.
+struct PlanarMetric {
+    static constexpr const char* name = "planar";
+
+    template <typename Coord>
+    struct Points {
+        void clear() {}
+        void reserve(size_t) {}
+        void push_back(double, double) {}
+        size_t capacityBytes() const { return 0; }
+    };
+    struct Query {
+        double lat, lon;
+    };
+
+    static Query query(const double lat, const double lon) { return {lat, lon}; }
+
+    template <typename Coord>
+    static void batch(const Query& q, const Coord* __restrict lats, const Coord* __restrict lons,
+                      const Points<Coord>&, const size_t begin, const size_t n, Coord* __restrict out) {
+        const Coord qLat = static_cast<Coord>(q.lat), qLon = static_cast<Coord>(q.lon);
+        lats += begin;
+        lons += begin;
+        for (size_t i = 0; i < n; ++i) {
+            const Coord dx = lats[i] - qLat, dy = lons[i] - qLon;
+            out[i] = dx * dx + dy * dy;
+        }
+    }
+
+    template <typename Coord>
+    static double minKey(const double lat, const double lon, const BasicRect<Coord>& r) {
+        const double dx = std::max({0.0, r.minLat - lat, lat - r.maxLat});
+        const double dy = std::max({0.0, r.minLon - lon, lon - r.maxLon});
+        return dx * dx + dy * dy;
+    }
+    template <typename Coord>
+    static double maxKey(const double lat, const double lon, const BasicRect<Coord>& r) {
+        const double dx = std::max(std::abs(lat - r.minLat), std::abs(lat - r.maxLat));
+        const double dy = std::max(std::abs(lon - r.minLon), std::abs(lon - r.maxLon));
+        return dx * dx + dy * dy;
+    }
+
+    static double toKey(const double distance) { return distance * distance; }
+    static double toDistance(const double key) { return std::sqrt(key); }
+    static double distance(const double lat1, const double lon1, const double lat2, const double lon2) {
+        return std::hypot(lat1 - lat2, lon1 - lon2);
+    }
+
+    static Rect searchBox(const double lat, const double lon, const double distance) {
+        return Rect(lat - distance, lon - distance, lat + distance, lon + distance);
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// --- Búsqueda por prefijo del nombre ---
+//
+// Los nombres se comparan sin distinguir mayúsculas ASCII (los bytes UTF-8 de
+// fuera de ASCII se comparan tal cual). Los índices guardan los registros
+// ordenados por nombre, para sacar con una búsqueda binaria los que empiezan
+// por un prefijo, y un resumen NameSignature por nodo o celda, para saltarse
+// los que no pueden tener ninguno.
+
+/// Con como mucho tantos registros con el prefijo, las consultas los recorren
+/// directamente en vez de bajar por el índice espacial.
+static constexpr size_t NAME_DIRECT_LIMIT = 1024;
+
+inline char foldChar(const char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline std::string normalizeName(const std::string_view name) {
+    std::string out(name);
+    for (char& c : out) c = foldChar(c);
+    return out;
+}
+
+/// ¿name empieza por prefix? prefix ya normalizado.
+inline bool hasNamePrefix(const std::string_view name, const std::string_view prefix) {
+    if (name.size() < prefix.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i)
+        if (foldChar(name[i]) != prefix[i]) return false;
+    return true;
+}
+
+/// Orden de los nombres sin distinguir mayúsculas: < 0, 0 o > 0. Con
+/// `length` solo cuenta ese prefijo de a (para buscar tramos por prefijo).
+inline int compareNames(const std::string_view a, const std::string_view b,
+                        const size_t length = std::string_view::npos) {
+    const size_t na = std::min(a.size(), length), nb = std::min(b.size(), length);
+    for (size_t i = 0; i < std::min(na, nb); ++i) {
+        const auto ca = static_cast<unsigned char>(foldChar(a[i]));
+        const auto cb = static_cast<unsigned char>(foldChar(b[i]));
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    return na == nb ? 0 : (na < nb ? -1 : 1);
+}
+
+/// Filtro de Bloom de 256 bits con los prefijos de 1 a GRAMS letras de los
+/// nombres de un subárbol o celda. Si mayHavePrefix(p) es false, ningún
+/// nombre empieza por p; si es true, puede que alguno.
+struct NameSignature {
+    static constexpr size_t GRAMS = 3;
+    uint64_t bits[4] = {0, 0, 0, 0};
+
+    void add(const std::string_view name) {
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (size_t n = 0; n < std::min(name.size(), GRAMS); ++n) {
+            h = (h ^ static_cast<unsigned char>(foldChar(name[n]))) * 0x100000001B3ull;
+            set(h);
+        }
+    }
+    void merge(const NameSignature& o) {
+        for (int w = 0; w < 4; ++w) bits[w] |= o.bits[w];
+    }
+    bool mayHavePrefix(const std::string_view prefix) const {
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (size_t n = 0; n < std::min(prefix.size(), GRAMS); ++n) {
+            h = (h ^ static_cast<unsigned char>(prefix[n])) * 0x100000001B3ull;
+            if (!test(h)) return false;
+        }
+        return true;
+    }
+
+private:
+    // bit con los 8 bits altos del hash (FNV-1a mezcla mejor hacia arriba)
+    void set(const uint64_t h) { bits[h >> 62] |= uint64_t(1) << ((h >> 56) & 63); }
+    bool test(const uint64_t h) const { return bits[h >> 62] >> ((h >> 56) & 63) & 1; }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ThreadPool.hpp"
+
+/// Resultado en trozos: cada tarea de un recorrido en paralelo llena su propio
+/// vector y los trozos se devuelven tal cual, sin juntarlos. Juntos (en
+/// cualquier orden) son el resultado completo.
+template <typename T>
+struct ChunkedResults {
+    std::vector<std::vector<T>> chunks;
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& c : chunks) n += c.size();
+        return n;
+    }
+    bool empty() const { return chunks.empty(); }
+
+    /// Añade un trozo (los vacíos no se guardan).
+    void add(std::vector<T>&& chunk) {
+        if (!chunk.empty()) chunks.push_back(std::move(chunk));
+    }
+
+    /// Todo en un vector: con un solo trozo es ese mismo vector; con varios se
+    /// mueven los elementos.
+    std::vector<T> flatten() && {
+        if (chunks.empty()) return {};
+        if (chunks.size() == 1) return std::move(chunks.front());
+        std::vector<T> out;
+        out.reserve(size());
+        for (auto& c : chunks) std::move(c.begin(), c.end(), std::back_inserter(out));
+        return out;
+    }
+};
+
+/// Reparto de las consultas de rango grandes entre hilos. El índice estima
+/// cuántos puntos candidatos tiene la ventana; si llegan a minCandidates, parte
+/// el recorrido en unas TASKS_PER_THREAD tareas por hilo (subárboles, franjas
+/// de filas) que los hilos del pool van tomando según quedan libres.
+///
+/// El pool se crea con la primera consulta que lo necesita. configure() no
+/// puede llamarse a la vez que una consulta (igual que build()).
+class ParallelScan {
+public:
+    static constexpr size_t DEFAULT_MIN_CANDIDATES = 100'000;
+    static constexpr size_t TASKS_PER_THREAD = 4;
+
+    /// threads: 0 = std::thread::hardware_concurrency(); 1 = siempre en serie.
+    explicit ParallelScan(const unsigned threads = 0, const size_t minCandidates = DEFAULT_MIN_CANDIDATES) {
+        configure(threads, minCandidates);
+    }
+
+    void configure(unsigned threads, const size_t minCandidates) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pool_ && pool_->size() != threads) pool_.reset();
+        threads_ = threads;
+        minCandidates_ = minCandidates;
+    }
+
+    unsigned threads() const { return threads_; }
+    size_t minCandidates() const { return minCandidates_; }
+
+    /// ¿Compensa repartir una consulta con tantos candidatos?
+    bool worth(const size_t candidates) const { return threads_ > 1 && candidates >= minCandidates_; }
+    /// Tareas a las que apunta un reparto (más que hilos, para equilibrar).
+    size_t targetTasks() const { return threads_ * TASKS_PER_THREAD; }
+
+    /// fn(t) para t en [0, n) en el pool.
+    template <typename Fn>
+    void run(const size_t n, Fn&& fn) const {
+        pool().parallelFor(n, std::forward<Fn>(fn));
+    }
+
+private:
+    unsigned threads_ = 1;
+    size_t minCandidates_ = DEFAULT_MIN_CANDIDATES;
+    mutable std::mutex mutex_;
+    mutable std::unique_ptr<ThreadPool> pool_;
+
+    ThreadPool& pool() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pool_) pool_ = std::make_unique<ThreadPool>(threads_);
+        return *pool_;
+    }
+};
@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Index.hpp"
+#include "Metric.hpp"
+#include "Rect.hpp"
+#include "ThreadPool.hpp"
+
+// --- Índice particionado global/local (como SpatialHadoop) ---
+//
+// build() toma una muestra de los datos, calcula con ella las fronteras de las
+// particiones (rejilla, STR o k-d) y reparte todos los puntos: cada partición
+// tiene su propio índice local y el índice global guarda el MBR real y el
+// tamaño de cada una. Las consultas se planifican contra el índice global y
+// solo se ejecutan en las particiones que pueden aportar resultados, en
+// paralelo en un ThreadPool.
+
+/// Cómo se trazan las fronteras a partir de la muestra.
+///   Grid    rejilla uniforme sobre el rectángulo de la muestra
+///   STR     franjas de latitud con el mismo número de puntos y, dentro de
+///           cada una, celdas de longitud con el mismo número de puntos
+///   KdTree  cortes por la mediana alternando latitud y longitud
+enum class PartitionScheme { Grid, STR, KdTree };
+
+/// "grid", "str" o "kdtree" (para el constructor de Python y el benchmark).
+inline PartitionScheme parsePartitionScheme(const std::string& name) {
+    if (name == "grid" || name == "Grid") return PartitionScheme::Grid;
+    if (name == "str" || name == "STR") return PartitionScheme::STR;
+    if (name == "kdtree" || name == "kd" || name == "KdTree") return PartitionScheme::KdTree;
+    throw std::invalid_argument("esquema de particion desconocido: " + name);
+}
+
+/// Fronteras de las particiones: un árbol binario de cortes que cubre todo el
+/// plano, de modo que cada punto cae en exactamente una partición.
+class SpatialPartitioner {
+public:
+    /// Calcula las fronteras de ~`partitions` particiones con la muestra dada
+    /// (se reordena). Grid y STR redondean a franjas × celdas.
+    void compute(std::vector<Geoname>& sample, const PartitionScheme scheme, size_t partitions) {
+        splits_.clear();
+        count_ = 0;
+        partitions = std::max<size_t>(1, partitions);
+        if (sample.empty() || partitions == 1) {
+            root_ = leaf();
+            return;
+        }
+        const size_t strips = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(partitions))));
+        const size_t cells = (partitions + strips - 1) / strips;
+        switch (scheme) {
+        case PartitionScheme::Grid: root_ = computeGrid(sample, strips, cells); break;
+        case PartitionScheme::STR: root_ = computeSTR(sample, strips, cells); break;
+        case PartitionScheme::KdTree: root_ = kdSplit(sample, 0, sample.size(), partitions, false); break;
+        }
+    }
+
+    size_t size() const { return count_; }
+
+    size_t partitionOf(const double lat, const double lon) const {
+        int32_t node = root_;
+        while (node >= 0) {
+            const Split& s = splits_[node];
+            node = (s.byLon ? lon : lat) < s.value ? s.lo : s.hi;
+        }
+        return static_cast<size_t>(~node);
+    }
+
+private:
+    // Hijo >= 0: otro corte; hijo < 0: la partición ~hijo. Los puntos con la
+    // coordenada igual al corte van al lado hi.
+    struct Split {
+        bool byLon;
+        double value;
+        int32_t lo, hi;
+    };
+    std::vector<Split> splits_;
+    int32_t root_ = -1;
+    size_t count_ = 0;
+
+    int32_t leaf() { return ~static_cast<int32_t>(count_++); }
+
+    static double coord(const Geoname& g, const bool byLon) { return byLon ? g.longitude : g.latitude; }
+
+    // Árbol equilibrado sobre los intervalos [lo, hi) que separan los cortes
+    // cuts (el intervalo i queda entre cuts[i - 1] y cuts[i]).
+    template <typename Leaf>
+    int32_t chain(const std::vector<double>& cuts, const bool byLon, const size_t lo, const size_t hi, Leaf& makeLeaf) {
+        if (hi - lo == 1) return makeLeaf(lo);
+        const size_t mid = (lo + hi) / 2;
+        const int32_t node = static_cast<int32_t>(splits_.size());
+        splits_.push_back({byLon, cuts[mid - 1], 0, 0});
+        const int32_t left = chain(cuts, byLon, lo, mid, makeLeaf);
+        const int32_t right = chain(cuts, byLon, mid, hi, makeLeaf);
+        splits_[node].lo = left;
+        splits_[node].hi = right;
+        return node;
+    }
+
+    int32_t computeGrid(const std::vector<Geoname>& sample, const size_t strips, const size_t cells) {
+        const Rect box = Rect::boundingRect(sample);
+        auto uniform = [](const double from, const double to, const size_t n) {
+            std::vector<double> cuts;
+            for (size_t i = 1; i < n; ++i) cuts.push_back(from + (to - from) * i / n);
+            return cuts;
+        };
+        const std::vector<double> latCuts = uniform(box.minLat, box.maxLat, strips);
+        const std::vector<double> lonCuts = uniform(box.minLon, box.maxLon, cells);
+        auto cell = [&](size_t) { return leaf(); };
+        auto strip = [&](size_t) { return chain(lonCuts, true, 0, cells, cell); };
+        return chain(latCuts, false, 0, strips, strip);
+    }
+
+    // Cortes en los cuantiles de [begin, end) por la coordenada dada (ordena el tramo).
+    static std::vector<double> quantileCuts(std::vector<Geoname>& sample, const size_t begin, const size_t end,
+                                            const bool byLon, const size_t n, std::vector<size_t>* bounds = nullptr) {
+        std::sort(sample.begin() + begin, sample.begin() + end,
+                  [byLon](const Geoname& a, const Geoname& b) { return coord(a, byLon) < coord(b, byLon); });
+        std::vector<double> cuts;
+        if (bounds) bounds->assign(1, begin);
+        for (size_t i = 1; i < n; ++i) {
+            const size_t at = begin + (end - begin) * i / n;
+            cuts.push_back(at < end ? coord(sample[at], byLon) : std::numeric_limits<double>::infinity());
+            if (bounds) bounds->push_back(at);
+        }
+        if (bounds) bounds->push_back(end);
+        return cuts;
+    }
+
+    int32_t computeSTR(std::vector<Geoname>& sample, const size_t strips, const size_t cells) {
+        std::vector<size_t> bounds;
+        const std::vector<double> latCuts = quantileCuts(sample, 0, sample.size(), false, strips, &bounds);
+        auto cell = [&](size_t) { return leaf(); };
+        auto strip = [&](const size_t s) {
+            const std::vector<double> lonCuts = quantileCuts(sample, bounds[s], bounds[s + 1], true, cells);
+            return chain(lonCuts, true, 0, cells, cell);
+        };
+        return chain(latCuts, false, 0, strips, strip);
+    }
+
+    int32_t kdSplit(std::vector<Geoname>& sample, const size_t begin, const size_t end, const size_t parts,
+                    const bool byLon) {
+        if (parts == 1) return leaf();
+        const size_t leftParts = parts / 2;
+        const size_t mid = begin + (end - begin) * leftParts / parts;
+        double value = std::numeric_limits<double>::infinity();
+        if (mid < end) {
+            std::nth_element(sample.begin() + begin, sample.begin() + mid, sample.begin() + end,
+                             [byLon](const Geoname& a, const Geoname& b) { return coord(a, byLon) < coord(b, byLon); });
+            value = coord(sample[mid], byLon);
+        }
+        const int32_t node = static_cast<int32_t>(splits_.size());
+        splits_.push_back({byLon, value, 0, 0});
+        const int32_t left = kdSplit(sample, begin, mid, leftParts, !byLon);
+        const int32_t right = kdSplit(sample, mid, end, parts - leftParts, !byLon);
+        splits_[node].lo = left;
+        splits_[node].hi = right;
+        return node;
+    }
+};
+
+/// Índice global/local. Cada partición es un Index independiente creado con
+/// `makeLocal` (todos con la métrica Metric, que es la que usa el índice global
+/// para podar y para mezclar kNN).
+template <typename Metric = HaversineMetric>
+class BasicPartitionedIndex : public Index {
+public:
+    using LocalFactory = std::function<std::unique_ptr<Index>()>;
+
+    /// Puntos de muestra por partición al calcular las fronteras.
+    static constexpr size_t SAMPLE_PER_PARTITION = 1000;
+    /// Bits bajos del cursor de rangeQueryEach reservados al cursor local; los
+    /// altos llevan la partición.
+    static constexpr int LOCAL_CURSOR_BITS = 48;
+
+    /// threads = 0: un hilo por núcleo.
+    BasicPartitionedIndex(LocalFactory makeLocal, PartitionScheme scheme = PartitionScheme::STR,
+                          size_t partitions = 16, unsigned threads = 0)
+        : makeLocal_(std::move(makeLocal)), scheme_(scheme), partitions_(std::max<size_t>(1, partitions)),
+          pool_(threads) {}
+
+    void build(const std::vector<Geoname>& records) override { build(records, {}); }
+
+    /// Los pesos se reparten con sus registros y cada partición los recibe en
+    /// su build local.
+    void build(const std::vector<Geoname>& records, const std::vector<double>& weights) override {
+        if (!weights.empty() && weights.size() != records.size())
+            throw std::invalid_argument("build: hace falta un peso por registro");
+        locals_.clear();
+        mbrs_.clear();
+        sizes_.clear();
+
+        std::vector<Geoname> sample = drawSample(records);
+        partitioner_.compute(sample, scheme_, partitions_);
+
+        std::vector<std::vector<Geoname>> parts(partitioner_.size());
+        std::vector<std::vector<double>> partWeights(weights.empty() ? 0 : parts.size());
+        for (size_t r = 0; r < records.size(); ++r) {
+            const size_t p = partitioner_.partitionOf(records[r].latitude, records[r].longitude);
+            parts[p].push_back(records[r]);
+            if (!weights.empty()) partWeights[p].push_back(weights[r]);
+        }
+        size_t kept = 0;
+        for (size_t p = 0; p < parts.size(); ++p) {
+            if (parts[p].empty() || kept++ == p) continue;
+            parts[kept - 1].swap(parts[p]);
+            if (!weights.empty()) partWeights[kept - 1].swap(partWeights[p]);
+        }
+        parts.resize(kept);
+
+        locals_.resize(parts.size());
+        mbrs_.resize(parts.size());
+        sizes_.resize(parts.size());
+        pool_.parallelFor(parts.size(), [&](const size_t p) {
+            locals_[p] = makeLocal_();
+            if (weights.empty()) locals_[p]->build(parts[p]);
+            else locals_[p]->build(parts[p], partWeights[p]);
+            mbrs_[p] = Rect::boundingRect(parts[p]);
+            sizes_[p] = parts[p].size();
+            std::vector<Geoname>().swap(parts[p]);
+        });
+    }
+
+    std::vector<Geoname> rangeQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Range, [&](QueryProfile& p) { return rangeImpl(minLat, minLon, maxLat, maxLon, "", p); });
+        NullProfile none;
+        return rangeImpl(minLat, minLon, maxLat, maxLon, "", none);
+    }
+
+    /// Recorre las particiones en orden y, dentro de cada una, sigue el orden
+    /// del índice local. El cursor lleva la partición en los bits altos, así
+    /// que el cursor local debe caber en LOCAL_CURSOR_BITS.
+    QueryProgress rangeQueryEach(double minLat, double minLon, double maxLat, double maxLon,
+                                 const QueryOptions& opts,
+                                 const std::function<bool(const Geoname&)>& sink) override {
+        const Rect window(minLat, minLon, maxLat, maxLon);
+        QueryOptions local = opts;
+        if (opts.timeoutMs > 0) {
+            // Un único plazo para todas las particiones
+            local.deadline = std::min(opts.deadline, QueryOptions::Clock::now() +
+                std::chrono::duration_cast<QueryOptions::Clock::duration>(
+                    std::chrono::duration<double, std::milli>(opts.timeoutMs)));
+            local.timeoutMs = 0;
+        }
+        QueryProgress total;
+        const size_t from = static_cast<size_t>(opts.cursor >> LOCAL_CURSOR_BITS);
+        for (size_t p = from; p < locals_.size(); ++p) {
+            if (!mbrs_[p].intersects(window)) continue;
+            local.cursor = p == from ? opts.cursor & LOCAL_CURSOR_MASK : 0;
+            local.limit = opts.limit - total.emitted;
+            const QueryProgress part = locals_[p]->rangeQueryEach(minLat, minLon, maxLat, maxLon, local, sink);
+            total.emitted += part.emitted;
+            if (!part.done()) {
+                if (part.cursor > LOCAL_CURSOR_MASK)
+                    throw std::runtime_error("rangeQueryEach: el cursor local no cabe en el cursor particionado");
+                total.status = part.status;
+                total.cursor = (static_cast<uint64_t>(p) << LOCAL_CURSOR_BITS) | part.cursor;
+                return total;
+            }
+        }
+        return total;
+    }
+
+    /// Suma de los agregados locales de las particiones que corta la ventana,
+    /// calculados en paralelo.
+    Aggregate aggregateQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        const Rect window(minLat, minLon, maxLat, maxLon);
+        std::vector<size_t> candidates;
+        for (size_t p = 0; p < locals_.size(); ++p) {
+            if (mbrs_[p].intersects(window)) candidates.push_back(p);
+        }
+        NullProfile none;
+        Aggregate total;
+        for (const Aggregate& a : forCandidates(candidates, none, [&](Index& local) {
+                 return local.aggregateQuery(minLat, minLon, maxLat, maxLon);
+             })) {
+            total.count += a.count;
+            total.sum += a.sum;
+        }
+        return total;
+    }
+
+    /// Pregunta a cada partición; con índices locales con tabla de ids son
+    /// `partitions` búsquedas O(1).
+    std::optional<Geoname> getById(const long id) override {
+        for (const auto& local : locals_) {
+            if (auto g = local->getById(id)) return g;
+        }
+        return std::nullopt;
+    }
+
+    std::vector<Geoname> kNN(const Geoname& q, int k) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, "", p); });
+        NullProfile none;
+        return kNNImpl(q, k, "", none);
+    }
+
+    /// Cada partición resuelve el prefijo con su propio índice de nombres.
+    std::vector<Geoname> rangeQueryWithPrefix(double minLat, double minLon, double maxLat, double maxLon,
+                                              const std::string& namePrefix) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Range, [&](QueryProfile& p) {
+                return rangeImpl(minLat, minLon, maxLat, maxLon, namePrefix, p);
+            });
+        NullProfile none;
+        return rangeImpl(minLat, minLon, maxLat, maxLon, namePrefix, none);
+    }
+
+    std::vector<Geoname> kNNWithPrefix(const Geoname& q, int k, const std::string& namePrefix) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, namePrefix, p); });
+        NullProfile none;
+        return kNNImpl(q, k, namePrefix, none);
+    }
+
+    std::vector<Geoname> radiusQuery(double lat, double lon, double meters) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Radius, [&](QueryProfile& p) { return radiusImpl(lat, lon, meters, p); });
+        NullProfile none;
+        return radiusImpl(lat, lon, meters, none);
+    }
+
+    std::vector<std::pair<double, Geoname>> radiusQueryWithDistances(double lat, double lon,
+                                                                     double meters) override {
+        auto query = [&](auto& prof) {
+            auto parts = forCandidates(radiusCandidates(lat, lon, meters), prof, [&](Index& local) {
+                return local.radiusQueryWithDistances(lat, lon, meters);
+            });
+            [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+            auto out = concat(std::move(parts));
+            std::stable_sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            return out;
+        };
+        if (profiler_.enabled()) return profiler_.run(QueryKind::Radius, query);
+        NullProfile none;
+        return query(none);
+    }
+
+    /// Join por distancia: pares (externo, interno) con el punto interno a <=
+    /// `distance` del externo. Cada partición solo recibe los puntos externos
+    /// cuya distancia a su MBR cabe en `distance`, y las particiones se
+    /// procesan en paralelo.
+    JoinResult distanceJoin(const std::vector<Geoname>& outer, const double distance) {
+        std::vector<std::vector<uint32_t>> probes(locals_.size());
+        const double maxKey = Metric::toKey(distance);
+        for (uint32_t i = 0; i < outer.size(); ++i) {
+            for (size_t p = 0; p < locals_.size(); ++p) {
+                if (Metric::minKey(outer[i].latitude, outer[i].longitude, mbrs_[p]) <= maxKey) probes[p].push_back(i);
+            }
+        }
+        std::vector<JoinResult> parts(locals_.size());
+        pool_.parallelFor(locals_.size(), [&](const size_t p) {
+            for (const uint32_t i : probes[p]) {
+                for (auto& g : locals_[p]->radiusQuery(outer[i].latitude, outer[i].longitude, distance))
+                    parts[p].emplace_back(outer[i], std::move(g));
+            }
+        });
+        return concat(std::move(parts));
+    }
+
+    size_t memoryUsage() const override {
+        size_t bytes = locals_.capacity() * sizeof(std::unique_ptr<Index>) + mbrs_.capacity() * sizeof(Rect)
+                     + sizes_.capacity() * sizeof(size_t);
+        for (const auto& local : locals_) bytes += local->memoryUsage();
+        return bytes;
+    }
+
+    /// Índice global: particiones no vacías, su MBR y su número de puntos.
+    size_t partitionCount() const { return locals_.size(); }
+    const Rect& partitionMBR(const size_t p) const { return mbrs_[p]; }
+    size_t partitionSize(const size_t p) const { return sizes_[p]; }
+    unsigned threads() const { return pool_.size(); }
+
+private:
+    static constexpr uint64_t LOCAL_CURSOR_MASK = (uint64_t(1) << LOCAL_CURSOR_BITS) - 1;
+
+    LocalFactory makeLocal_;
+    PartitionScheme scheme_;
+    size_t partitions_;
+    ThreadPool pool_;
+    SpatialPartitioner partitioner_;
+    std::vector<std::unique_ptr<Index>> locals_;
+    std::vector<Rect> mbrs_;
+    std::vector<size_t> sizes_;
+
+    // Muestra uniforme (con una semilla fija, para que build sea determinista).
+    std::vector<Geoname> drawSample(const std::vector<Geoname>& records) const {
+        const size_t target = partitions_ * SAMPLE_PER_PARTITION;
+        if (records.size() <= target) return records;
+        std::mt19937_64 rng(records.size());
+        std::uniform_int_distribution<size_t> pick(0, records.size() - 1);
+        std::vector<Geoname> sample;
+        sample.reserve(target);
+        for (size_t i = 0; i < target; ++i) sample.push_back(records[pick(rng)]);
+        return sample;
+    }
+
+    template <typename T>
+    static std::vector<T> concat(std::vector<std::vector<T>> parts) {
+        size_t n = 0;
+        for (const auto& p : parts) n += p.size();
+        std::vector<T> out;
+        out.reserve(n);
+        for (auto& p : parts) std::move(p.begin(), p.end(), std::back_inserter(out));
+        return out;
+    }
+
+    // Ejecuta fn(local) en las particiones candidatas, en paralelo; cada
+    // partición consultada cuenta como un nodo de nivel 0 en el perfil.
+    template <typename Profile, typename Fn>
+    auto forCandidates(const std::vector<size_t>& candidates, Profile& prof, Fn&& fn) {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        std::vector<decltype(fn(std::declval<Index&>()))> parts(candidates.size());
+        pool_.parallelFor(candidates.size(), [&](const size_t c) { parts[c] = fn(*locals_[candidates[c]]); });
+        for (size_t c = 0; c < candidates.size(); ++c) prof.node(0);
+        return parts;
+    }
+
+    std::vector<size_t> radiusCandidates(const double lat, const double lon, const double distance) const {
+        std::vector<size_t> out;
+        if (distance < 0) return out;
+        const double maxKey = Metric::toKey(distance);
+        for (size_t p = 0; p < locals_.size(); ++p) {
+            if (Metric::minKey(lat, lon, mbrs_[p]) <= maxKey) out.push_back(p);
+        }
+        return out;
+    }
+
+    // namePrefix vacío: sin filtro por nombre.
+    template <typename Profile>
+    std::vector<Geoname> rangeImpl(double minLat, double minLon, double maxLat, double maxLon,
+                                   const std::string& namePrefix, Profile& prof) {
+        const Rect window(minLat, minLon, maxLat, maxLon);
+        std::vector<size_t> candidates;
+        for (size_t p = 0; p < locals_.size(); ++p) {
+            if (mbrs_[p].intersects(window)) candidates.push_back(p);
+        }
+        auto parts = forCandidates(candidates, prof, [&](Index& local) {
+            return namePrefix.empty() ? local.rangeQuery(minLat, minLon, maxLat, maxLon)
+                                      : local.rangeQueryWithPrefix(minLat, minLon, maxLat, maxLon, namePrefix);
+        });
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        return concat(std::move(parts));
+    }
+
+    template <typename Profile>
+    std::vector<Geoname> radiusImpl(double lat, double lon, double distance, Profile& prof) {
+        auto parts = forCandidates(radiusCandidates(lat, lon, distance), prof, [&](Index& local) {
+            return local.radiusQuery(lat, lon, distance);
+        });
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        return concat(std::move(parts));
+    }
+
+    // Primero la partición más cercana a q; su k-ésima distancia acota qué
+    // otras particiones pueden mejorar el resultado, y esas van en paralelo.
+    template <typename Profile>
+    std::vector<Geoname> kNNImpl(const Geoname& q, int k, const std::string& namePrefix, Profile& prof) {
+        if (k <= 0 || locals_.empty()) return {};
+        const double lat = q.latitude, lon = q.longitude;
+        std::vector<std::pair<double, size_t>> order;
+        order.reserve(locals_.size());
+        for (size_t p = 0; p < locals_.size(); ++p) order.emplace_back(Metric::minKey(lat, lon, mbrs_[p]), p);
+        std::sort(order.begin(), order.end());
+
+        using Candidate = std::pair<double, Geoname>;
+        std::vector<Candidate> best;
+        auto keyed = [&](std::vector<Geoname> found) {
+            std::vector<Candidate> out;
+            out.reserve(found.size());
+            for (auto& g : found)
+                out.emplace_back(Metric::toKey(Metric::distance(lat, lon, g.latitude, g.longitude)), std::move(g));
+            return out;
+        };
+
+        auto search = [&](Index& local) { return keyed(local.kNNWithPrefix(q, k, namePrefix)); };
+        auto first = forCandidates({order[0].second}, prof, search);
+        best = std::move(first[0]);
+        std::sort(best.begin(), best.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        const double bound = static_cast<int>(best.size()) < k ? std::numeric_limits<double>::infinity()
+                                                               : best.back().first;
+
+        std::vector<size_t> rest;
+        for (size_t o = 1; o < order.size() && order[o].first <= bound; ++o) rest.push_back(order[o].second);
+        auto parts = forCandidates(rest, prof, search);
+
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        for (auto& part : parts) std::move(part.begin(), part.end(), std::back_inserter(best));
+        const size_t n = std::min(best.size(), static_cast<size_t>(k));
+        std::partial_sort(best.begin(), best.begin() + n, best.end(),
+                          [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<Geoname> result;
+        result.reserve(n);
+        for (size_t i = 0; i < n; ++i) result.push_back(std::move(best[i].second));
+        return result;
+    }
+};
+
+/// Particiones con distancia geodésica.
+using PartitionedIndex = BasicPartitionedIndex<>;
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "GridIndex.hpp"
+#include "Index.hpp"
+#include "Metric.hpp"
+#include "ParallelScan.hpp"
+#include "PointStore.hpp"
+#include "QueryProfile.hpp"
+#include "RTree.hpp"
+#include "Rect.hpp"
+
+/// Histograma 2D equi-profundo: franjas de latitud con el mismo número de
+/// puntos y, dentro de cada franja, cubetas de longitud también con el mismo
+/// número. Cada cubeta guarda el MBR de sus puntos y cuántos son; estimate()
+/// supone los puntos repartidos uniformemente dentro de cada MBR, así que el
+/// error se concentra en las cubetas que corta el borde de la ventana.
+class EquiDepthHistogram {
+public:
+    explicit EquiDepthHistogram(const size_t slabs = 32, const size_t perSlab = 32)
+        : slabs_(std::max<size_t>(1, slabs)), perSlab_(std::max<size_t>(1, perSlab)) {}
+
+    void build(const std::vector<Geoname>& points) {
+        buckets_.clear();
+        slabBoxes_.clear();
+        slabStart_.assign(1, 0);
+        total_ = points.size();
+        if (points.empty()) return;
+
+        const size_t n = points.size();
+        std::vector<uint32_t> order(n);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) {
+            return points[a].latitude < points[b].latitude;
+        });
+        for (size_t s = 0; s < slabs_; ++s) {
+            const size_t begin = n * s / slabs_, end = n * (s + 1) / slabs_;
+            if (begin == end) continue;
+            std::sort(order.begin() + begin, order.begin() + end, [&](const uint32_t a, const uint32_t b) {
+                return points[a].longitude < points[b].longitude;
+            });
+            Rect slab = Rect::empty();
+            for (size_t b = 0; b < perSlab_; ++b) {
+                const size_t lo = begin + (end - begin) * b / perSlab_;
+                const size_t hi = begin + (end - begin) * (b + 1) / perSlab_;
+                if (lo == hi) continue;
+                Bucket bucket{Rect(points[order[lo]]), hi - lo};
+                for (size_t i = lo + 1; i < hi; ++i) bucket.box.expand(Rect(points[order[i]]));
+                slab.expand(bucket.box);
+                buckets_.push_back(bucket);
+            }
+            slabBoxes_.push_back(slab);
+            slabStart_.push_back(buckets_.size());
+        }
+    }
+
+    /// Puntos estimados dentro de w.
+    double estimate(const Rect& w) const {
+        double est = 0;
+        for (size_t s = 0; s < slabBoxes_.size(); ++s) {
+            if (!slabBoxes_[s].intersects(w)) continue;
+            for (size_t b = slabStart_[s]; b < slabStart_[s + 1]; ++b) {
+                const Bucket& k = buckets_[b];
+                if (!k.box.intersects(w)) continue;
+                est += static_cast<double>(k.count) * overlap(k.box.minLat, k.box.maxLat, w.minLat, w.maxLat)
+                     * overlap(k.box.minLon, k.box.maxLon, w.minLon, w.maxLon);
+            }
+        }
+        return est;
+    }
+
+    size_t total() const { return total_; }
+    size_t buckets() const { return buckets_.size(); }
+    size_t memoryUsage() const {
+        return buckets_.capacity() * sizeof(Bucket) + slabBoxes_.capacity() * sizeof(Rect)
+             + slabStart_.capacity() * sizeof(size_t);
+    }
+
+private:
+    struct Bucket {
+        Rect box;
+        size_t count;
+    };
+
+    size_t slabs_, perSlab_;
+    size_t total_ = 0;
+    std::vector<Bucket> buckets_;     // franja a franja
+    std::vector<Rect> slabBoxes_;     // MBR de cada franja
+    std::vector<size_t> slabStart_;   // cubetas de la franja s: [slabStart_[s], slabStart_[s + 1])
+
+    // Fracción de [lo, hi] dentro de [wlo, whi], que ya se cortan; un
+    // intervalo de un solo valor está entero dentro.
+    static double overlap(const double lo, const double hi, const double wlo, const double whi) {
+        if (hi <= lo) return 1.0;
+        return (std::min(hi, whi) - std::max(lo, wlo)) / (hi - lo);
+    }
+};
+
+/// Coste relativo de cada plan de una consulta de rango, en unidades de "un
+/// punto probado en una celda de la rejilla". Copiar los resultados cuesta lo
+/// mismo en los tres planes y no cuenta.
+struct PlannerCosts {
+    double gridCell = 8.0;    // visitar una celda
+    double gridPoint = 1.0;   // probar un punto de una celda visitada
+    double treeQuery = 200.0; // bajar por el R-tree hasta la ventana
+    double treePoint = 2.0;   // probar un punto de una hoja (accesos menos contiguos)
+    double scanPoint = 0.75;  // probar un punto en el barrido por columnas
+};
+
+/// Decisión del planificador para una ventana, con lo que la justifica.
+struct RangePlan {
+    QueryPlan plan = QueryPlan::RTree;
+    double estimate = 0;                    // puntos en la ventana según el histograma
+    size_t gridCells = 0, gridCandidates = 0;
+    double gridCost = 0, treeCost = 0, scanCost = 0;
+};
+
+/// Índice compuesto que elige la estructura para cada consulta. build()
+/// construye un R-tree, una rejilla y una copia por columnas de los puntos,
+/// más un histograma equi-profundo. Cada rango estima sus puntos con el
+/// histograma y sus candidatos con los recuentos de las celdas, y va a la
+/// estructura más barata según PlannerCosts: la rejilla en ventanas pequeñas
+/// y densas, el R-tree si las celdas son mucho mayores que la ventana, el
+/// barrido secuencial si la ventana cubre buena parte de los datos. kNN,
+/// radio, prefijos de nombre y paginación van siempre al R-tree, y los
+/// agregados a la rejilla. Con el perfilado encendido, QueryProfile::plan y
+/// estimatedPoints dicen qué se eligió.
+///
+/// Guarda los puntos tres veces: es para cargas de solo lectura en las que la
+/// memoria importa menos que la latencia de cada forma de consulta.
+class PlannedIndex : public Index {
+public:
+    /// cellsPerSide = 0: rejilla de unos CELL_TARGET puntos por celda.
+    explicit PlannedIndex(const int degree = 16, const size_t cellsPerSide = 0,
+                          const PlannerCosts costs = PlannerCosts())
+        : rtree_(degree, RTreeBuildMode::STR), grid_(std::make_unique<GridIndex>(1, 1)),
+          cellsPerSide_(cellsPerSide), costs_(costs) {}
+
+    static constexpr size_t CELL_TARGET = 32;
+    static constexpr size_t SCAN_BLOCK = 4096;
+
+    void build(const std::vector<Geoname>& points) override { build(points, {}); }
+    void build(const std::vector<Geoname>& points, const std::vector<double>& weights) override {
+        if (!weights.empty() && weights.size() != points.size())
+            throw std::invalid_argument("build: hace falta un peso por registro");
+        rtree_.build(points, weights);
+
+        size_t side = cellsPerSide_;
+        if (side == 0)
+            side = std::clamp<size_t>(static_cast<size_t>(std::sqrt(points.size() / double(CELL_TARGET))), 1, 1024);
+        grid_ = std::make_unique<GridIndex>(side, side);
+        grid_->parallelScan().configure(scan_.threads(), scan_.minCandidates());
+        grid_->build(points, weights);
+
+        std::vector<uint32_t> order(points.size());
+        std::iota(order.begin(), order.end(), 0u);
+        columns_.assign(points, order);
+        histogram_.build(points);
+        for (auto& c : planCounts_) c.store(0, std::memory_order_relaxed);
+    }
+
+    /// Plan que seguiría rangeQuery en esta ventana.
+    RangePlan plan(double minLat, double minLon, double maxLat, double maxLon) const {
+        RangePlan p;
+        const size_t n = columns_.size();
+        if (n == 0) return p;
+        p.estimate = histogram_.estimate(Rect(minLat, minLon, maxLat, maxLon));
+        const auto ws = grid_->windowStats(minLat, minLon, maxLat, maxLon);
+        p.gridCells = ws.cells;
+        p.gridCandidates = ws.candidates;
+        p.gridCost = costs_.gridCell * ws.cells + costs_.gridPoint * ws.candidates;
+        // Además de los puntos de la ventana se prueban las hojas que corta su
+        // borde: del orden del perímetro en hojas, 4 · sqrt(estimate / grado)
+        p.treeCost = costs_.treeQuery
+                   + costs_.treePoint * (p.estimate + 4 * std::sqrt(p.estimate * rtree_.degree()));
+        p.scanCost = costs_.scanPoint * n;
+        if (p.gridCost <= p.treeCost && p.gridCost <= p.scanCost) p.plan = QueryPlan::Grid;
+        else if (p.treeCost <= p.scanCost) p.plan = QueryPlan::RTree;
+        else p.plan = QueryPlan::Scan;
+        return p;
+    }
+
+    /// Consultas de rango resueltas con cada plan desde build().
+    uint64_t planCount(const QueryPlan plan) const {
+        return planCounts_[static_cast<size_t>(plan)].load(std::memory_order_relaxed);
+    }
+
+    /// Reparto entre hilos de los rangos grandes, en las tres estructuras.
+    void setParallelScan(const unsigned threads, const size_t minCandidates) {
+        scan_.configure(threads, minCandidates);
+        rtree_.parallelScan().configure(threads, minCandidates);
+        grid_->parallelScan().configure(threads, minCandidates);
+    }
+
+    std::vector<Geoname> rangeQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        return rangeQueryChunks(minLat, minLon, maxLat, maxLon).flatten();
+    }
+    ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Range,
+                                 [&](QueryProfile& p) { return rangeImpl(minLat, minLon, maxLat, maxLon, p); });
+        NullProfile none;
+        return rangeImpl(minLat, minLon, maxLat, maxLon, none);
+    }
+    // La paginación sigue siempre la misma estructura para que el cursor valga
+    QueryProgress rangeQueryEach(double minLat, double minLon, double maxLat, double maxLon,
+                                 const QueryOptions& opts,
+                                 const std::function<bool(const Geoname&)>& sink) override {
+        return rtree_.rangeQueryEach(minLat, minLon, maxLat, maxLon, opts, sink);
+    }
+    Aggregate aggregateQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        return grid_->aggregateQuery(minLat, minLon, maxLat, maxLon);
+    }
+    std::optional<Geoname> getById(const long id) override {
+        const uint32_t i = columns_.find(id);
+        if (i == columns_.NOT_FOUND) return std::nullopt;
+        return columns_[i];
+    }
+    std::vector<Geoname> rangeQueryWithPrefix(double minLat, double minLon, double maxLat, double maxLon,
+                                              const std::string& namePrefix) override {
+        return viaTree(QueryKind::Range, [&] {
+            return rtree_.rangeQueryWithPrefix(minLat, minLon, maxLat, maxLon, namePrefix);
+        });
+    }
+    std::vector<Geoname> kNN(const Geoname& q, int k) override {
+        return viaTree(QueryKind::KNN, [&] { return rtree_.kNN(q, k); });
+    }
+    std::vector<Geoname> kNNWithPrefix(const Geoname& q, int k, const std::string& namePrefix) override {
+        return viaTree(QueryKind::KNN, [&] { return rtree_.kNNWithPrefix(q, k, namePrefix); });
+    }
+    std::vector<Geoname> radiusQuery(double lat, double lon, double meters) override {
+        return viaTree(QueryKind::Radius, [&] { return rtree_.radiusQuery(lat, lon, meters); });
+    }
+    std::vector<std::pair<double, Geoname>> radiusQueryWithDistances(double lat, double lon,
+                                                                     double meters) override {
+        return viaTree(QueryKind::Radius, [&] { return rtree_.radiusQueryWithDistances(lat, lon, meters); });
+    }
+
+    /// Bytes de las tres estructuras y del histograma.
+    size_t memoryUsage() const override {
+        return sizeof(*this) + rtree_.memoryUsage() + grid_->memoryUsage() + columns_.memoryUsage()
+             + histogram_.memoryUsage();
+    }
+
+private:
+    RTreeIndex rtree_;
+    std::unique_ptr<GridIndex> grid_; // se rehace en build() con el tamaño de los datos
+    PointStore<double, PlanarMetric> columns_; // puntos en el orden de build(), para el barrido
+    EquiDepthHistogram histogram_;
+    ParallelScan scan_;
+    size_t cellsPerSide_;
+    PlannerCosts costs_;
+    std::array<std::atomic<uint64_t>, 4> planCounts_{};
+
+    template <typename Profile>
+    ChunkedResults<Geoname> rangeImpl(double minLat, double minLon, double maxLat, double maxLon, Profile& prof) {
+        const RangePlan p = plan(minLat, minLon, maxLat, maxLon);
+        prof.planned(p.plan, static_cast<uint64_t>(std::llround(p.estimate)));
+        planCounts_[static_cast<size_t>(p.plan)].fetch_add(1, std::memory_order_relaxed);
+        switch (p.plan) {
+            case QueryPlan::Grid: return grid_->rangeQueryChunks(minLat, minLon, maxLat, maxLon, prof);
+            case QueryPlan::RTree: return rtree_.rangeQueryChunks(minLat, minLon, maxLat, maxLon, prof);
+            default: return scanImpl(Rect(minLat, minLon, maxLat, maxLon), prof);
+        }
+    }
+
+    // Barrido de todas las columnas por bloques; repartido en franjas
+    // contiguas si hay hilos (todos los puntos son candidatos).
+    template <typename Profile>
+    ChunkedResults<Geoname> scanImpl(const Rect& w, Profile& prof) const {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        const size_t n = columns_.size();
+        const size_t tasks = scan_.worth(n) ? scan_.targetTasks() : 1;
+        std::vector<std::vector<Geoname>> parts(tasks);
+        auto run = [&](const size_t t) {
+            std::vector<uint32_t> sel(SCAN_BLOCK);
+            const size_t end = n * (t + 1) / tasks;
+            for (size_t b = n * t / tasks; b < end; b += SCAN_BLOCK) {
+                const size_t m = columns_.select(w, b, std::min(b + SCAN_BLOCK, end), sel.data());
+                for (size_t i = 0; i < m; ++i) parts[t].push_back(columns_[sel[i]]);
+            }
+        };
+        if (tasks == 1) run(0);
+        else scan_.run(tasks, run);
+        // cada bloque cuenta como un nodo hoja de nivel 0
+        for (size_t b = 0; b < n; b += SCAN_BLOCK) {
+            prof.node(0);
+            prof.leaf();
+        }
+        prof.tested(n);
+
+        ChunkedResults<Geoname> out;
+        for (auto& part : parts) out.add(std::move(part));
+        return out;
+    }
+
+    // kNN, radio y prefijos: siempre el R-tree; con perfilado queda anotado.
+    template <typename Fn>
+    auto viaTree(const QueryKind kind, Fn&& fn) -> decltype(fn()) {
+        if (profiler_.enabled())
+            return profiler_.run(kind, [&](QueryProfile& p) {
+                p.planned(QueryPlan::RTree, 0);
+                return fn();
+            });
+        return fn();
+    }
+};
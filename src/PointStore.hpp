@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Geoname.hpp"
+#include "IdIndex.hpp"
+#include "NameIndex.hpp"
+#include "Rect.hpp"
+
+/// Puntos de un índice en memoria, en SoA: coordenadas en Coord, los datos
+/// que precalcula la métrica, los ids y los nombres concatenados en un único
+/// buffer, más una tabla hash id -> posición y las posiciones ordenadas por
+/// nombre (NameIndex.hpp). Los Geoname se reconstruyen al devolver resultados.
+template <typename Coord, typename Metric>
+class PointStore {
+public:
+    using MetricPoints = typename Metric::template Points<Coord>;
+
+    /// Copia src en el orden dado por `order` (posiciones en src).
+    void assign(const std::vector<Geoname>& src, const std::vector<uint32_t>& order) {
+        clear();
+        const size_t n = order.size();
+        lats_.reserve(n);
+        lons_.reserve(n);
+        ids_.reserve(n);
+        nameEnd_.reserve(n);
+        metric_.reserve(n);
+        byId_.reserve(n);
+        for (const uint32_t o : order) {
+            const Geoname& g = src[o];
+            lats_.push_back(static_cast<Coord>(g.latitude));
+            lons_.push_back(static_cast<Coord>(g.longitude));
+            ids_.push_back(g.geonameId);
+            names_ += g.name;
+            nameEnd_.push_back(static_cast<uint32_t>(names_.size()));
+            metric_.push_back(lats_.back(), lons_.back());
+            // Con ids repetidos se queda el primero
+            byId_.insert(static_cast<uint64_t>(g.geonameId), static_cast<uint32_t>(ids_.size() - 1));
+        }
+        names_.shrink_to_fit();
+
+        // Orden por nombre, solo si hay nombres
+        if (names_.empty()) return;
+        byName_.resize(n);
+        std::iota(byName_.begin(), byName_.end(), 0u);
+        std::sort(byName_.begin(), byName_.end(), [&](const uint32_t a, const uint32_t b) {
+            return compareNames(name(a), name(b)) < 0;
+        });
+    }
+
+    /// Pesos de src (uno por registro, mismo `order` que assign) guardados como
+    /// sumas prefijas en el orden del almacén: la suma de un tramo es O(1).
+    void assignWeights(const std::vector<double>& weights, const std::vector<uint32_t>& order) {
+        prefix_.assign(order.size() + 1, 0.0);
+        for (size_t i = 0; i < order.size(); ++i) prefix_[i + 1] = prefix_[i] + weights[order[i]];
+    }
+
+    void clear() {
+        prefix_.clear();
+        lats_.clear();
+        lons_.clear();
+        ids_.clear();
+        nameEnd_.clear();
+        names_.clear();
+        metric_.clear();
+        byId_.clear();
+        byName_.clear();
+    }
+
+    size_t size() const { return lats_.size(); }
+    bool empty() const { return lats_.empty(); }
+    Coord lat(const size_t i) const { return lats_[i]; }
+    Coord lon(const size_t i) const { return lons_[i]; }
+    const Coord* lats() const { return lats_.data(); }
+    const Coord* lons() const { return lons_.data(); }
+    const MetricPoints& metricPoints() const { return metric_; }
+
+    std::string_view name(const size_t i) const {
+        const uint32_t begin = i == 0 ? 0 : nameEnd_[i - 1];
+        return std::string_view(names_).substr(begin, nameEnd_[i] - begin);
+    }
+    /// prefix normalizado (normalizeName).
+    bool nameHasPrefix(const size_t i, const std::string_view prefix) const {
+        return hasNamePrefix(name(i), prefix);
+    }
+    /// Posiciones, en orden de nombre, de los registros cuyo nombre empieza
+    /// por prefix (normalizado): dos búsquedas binarias. Sin nombres, ninguna.
+    std::pair<const uint32_t*, const uint32_t*> withPrefix(const std::string_view prefix) const {
+        if (byName_.empty()) return {nullptr, nullptr};
+        const size_t n = prefix.size();
+        const uint32_t* first = std::lower_bound(byName_.data(), byName_.data() + byName_.size(), prefix,
+            [&](const uint32_t i, const std::string_view p) { return compareNames(name(i), p, n) < 0; });
+        const uint32_t* last = std::upper_bound(first, byName_.data() + byName_.size(), prefix,
+            [&](const std::string_view p, const uint32_t i) { return compareNames(name(i), p, n) > 0; });
+        return {first, last};
+    }
+    /// Resumen de los nombres de [begin, end).
+    NameSignature signature(const size_t begin, const size_t end) const {
+        NameSignature sig;
+        for (size_t i = begin; i < end; ++i) sig.add(name(i));
+        return sig;
+    }
+    bool hasNames() const { return !byName_.empty(); }
+
+    /// Posición del registro con ese geonameId, o NOT_FOUND.
+    static constexpr uint32_t NOT_FOUND = IdHashIndex<uint32_t>::NONE;
+    uint32_t find(const long id) const { return byId_.find(static_cast<uint64_t>(id)); }
+
+    /// Suma de los pesos de [begin, end); sin pesos cada punto pesa 1.
+    double weightSum(const size_t begin, const size_t end) const {
+        return prefix_.empty() ? static_cast<double>(end - begin) : prefix_[end] - prefix_[begin];
+    }
+    double weight(const size_t i) const { return weightSum(i, i + 1); }
+
+    Geoname operator[](const size_t i) const {
+        Geoname g(lats_[i], lons_[i]);
+        g.geonameId = ids_[i];
+        g.name = name(i);
+        return g;
+    }
+
+    /// Claves de la métrica de los puntos [begin, begin + n) respecto a q.
+    void keys(const typename Metric::Query& q, const size_t begin, const size_t n, Coord* out) const {
+        Metric::batch(q, lats_.data(), lons_.data(), metric_, begin, n, out);
+    }
+
+    /// Escribe en sel las posiciones de [begin, end) dentro de q y devuelve
+    /// cuántas son. Sin saltos: la comparación vectoriza.
+    size_t select(const BasicRect<Coord>& q, const size_t begin, const size_t end, uint32_t* sel) const {
+        size_t m = 0;
+        for (size_t i = begin; i < end; ++i) {
+            sel[m] = static_cast<uint32_t>(i);
+            m += (lats_[i] >= q.minLat) & (lats_[i] <= q.maxLat) & (lons_[i] >= q.minLon) & (lons_[i] <= q.maxLon);
+        }
+        return m;
+    }
+
+    size_t memoryUsage() const {
+        return (lats_.capacity() + lons_.capacity()) * sizeof(Coord) + ids_.capacity() * sizeof(long)
+             + nameEnd_.capacity() * sizeof(uint32_t) + names_.capacity() + metric_.capacityBytes()
+             + prefix_.capacity() * sizeof(double) + byId_.memoryUsage() + byName_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    std::vector<Coord> lats_, lons_;
+    std::vector<long> ids_;
+    std::vector<uint32_t> nameEnd_; // fin del nombre i en names_
+    std::string names_;
+    MetricPoints metric_;
+    std::vector<double> prefix_; // vacío sin pesos; si no, size() + 1 sumas prefijas
+    IdHashIndex<uint32_t> byId_;
+    std::vector<uint32_t> byName_; // posiciones por nombre; vacío si no hay nombres
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// --- Consultas acotadas: límite, plazo, cancelación y continuación ---
+//
+// Las variantes *Each/*Page de las consultas recorren el índice en un orden
+// fijo y, al cortar (límite, plazo o cancelación), devuelven un cursor opaco
+// con la posición del primer resultado no entregado. Pasándolo en
+// QueryOptions::cursor la siguiente llamada sigue desde ahí. El cursor solo
+// vale mientras el índice no se modifique.
+
+/// Se puede cancelar desde otro hilo mientras la consulta corre.
+class CancellationToken {
+public:
+    void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+    void reset() { cancelled_.store(false, std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled_{false};
+};
+
+struct QueryOptions {
+    using Clock = std::chrono::steady_clock;
+
+    size_t limit = std::numeric_limits<size_t>::max(); // máximo de resultados por llamada
+    double timeoutMs = 0;                               // 0 = sin plazo relativo
+    Clock::time_point deadline = Clock::time_point::max(); // plazo absoluto
+    std::shared_ptr<CancellationToken> cancel;
+    uint64_t cursor = 0;                                // 0 = desde el principio
+};
+
+enum class QueryStatus {
+    Complete,         // no quedan resultados
+    LimitReached,     // se entregaron `limit` resultados y hay más
+    DeadlineExceeded, // venció el plazo
+    Cancelled,        // se canceló el token
+    Stopped           // el consumidor pidió parar
+};
+
+struct QueryProgress {
+    QueryStatus status = QueryStatus::Complete;
+    uint64_t cursor = 0;  // para continuar si status != Complete
+    size_t emitted = 0;   // resultados entregados en esta llamada
+
+    bool done() const { return status == QueryStatus::Complete; }
+};
+
+template <typename T>
+struct QueryPage {
+    std::vector<T> results;
+    QueryProgress progress;
+};
+
+/// Estado de una ejecución acotada. Los índices llaman a interrupted() una vez
+/// por hoja/celda/página (no por punto) y a admit() antes de entregar cada resultado.
+class QueryBudget {
+public:
+    explicit QueryBudget(const QueryOptions& opts)
+        : limit_(opts.limit), deadline_(opts.deadline), cancel_(opts.cancel.get()) {
+        if (opts.timeoutMs > 0) {
+            const auto relative = QueryOptions::Clock::now() +
+                std::chrono::duration_cast<QueryOptions::Clock::duration>(
+                    std::chrono::duration<double, std::milli>(opts.timeoutMs));
+            deadline_ = std::min(deadline_, relative);
+        }
+    }
+
+    bool interrupted() {
+        if (cancel_ && cancel_->cancelled()) {
+            progress_.status = QueryStatus::Cancelled;
+            return true;
+        }
+        if (deadline_ != QueryOptions::Clock::time_point::max() &&
+            QueryOptions::Clock::now() >= deadline_) {
+            progress_.status = QueryStatus::DeadlineExceeded;
+            return true;
+        }
+        return false;
+    }
+
+    bool admit() {
+        if (progress_.emitted >= limit_) {
+            progress_.status = QueryStatus::LimitReached;
+            return false;
+        }
+        ++progress_.emitted;
+        return true;
+    }
+
+    void stop() { progress_.status = QueryStatus::Stopped; }
+
+    /// Cierra la ejecución; `cursor` solo cuenta si se cortó.
+    QueryProgress finish(const uint64_t cursor) const {
+        QueryProgress p = progress_;
+        p.cursor = p.done() ? 0 : cursor;
+        return p;
+    }
+
+private:
+    size_t limit_;
+    QueryOptions::Clock::time_point deadline_;
+    const CancellationToken* cancel_;
+    QueryProgress progress_;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "QueryControl.hpp"
+
+// Bindings de QueryControl.hpp compartidos por los dos módulos (spatial_index.cpp y hola.cpp).
+
+inline void bindQueryControl(pybind11::module_& m) {
+    namespace py = pybind11;
+
+    py::class_<CancellationToken, std::shared_ptr<CancellationToken>>(m, "CancellationToken")
+        .def(py::init<>())
+        .def("cancel", &CancellationToken::cancel)
+        .def("cancelled", &CancellationToken::cancelled)
+        .def("reset", &CancellationToken::reset);
+
+    py::class_<QueryOptions>(m, "QueryOptions")
+        .def(py::init([](size_t limit, double timeoutMs, uint64_t cursor,
+                         std::shared_ptr<CancellationToken> cancel) {
+                 QueryOptions opts;
+                 opts.limit = limit;
+                 opts.timeoutMs = timeoutMs;
+                 opts.cursor = cursor;
+                 opts.cancel = std::move(cancel);
+                 return opts;
+             }),
+             py::arg("limit") = std::numeric_limits<size_t>::max(), py::arg("timeoutMs") = 0.0,
+             py::arg("cursor") = 0, py::arg("cancel") = nullptr)
+        .def_readwrite("limit", &QueryOptions::limit)
+        .def_readwrite("timeoutMs", &QueryOptions::timeoutMs)
+        .def_readwrite("cursor", &QueryOptions::cursor)
+        .def_readwrite("cancel", &QueryOptions::cancel);
+
+    py::enum_<QueryStatus>(m, "QueryStatus")
+        .value("Complete", QueryStatus::Complete)
+        .value("LimitReached", QueryStatus::LimitReached)
+        .value("DeadlineExceeded", QueryStatus::DeadlineExceeded)
+        .value("Cancelled", QueryStatus::Cancelled)
+        .value("Stopped", QueryStatus::Stopped);
+
+    py::class_<QueryProgress>(m, "QueryProgress")
+        .def_readonly("status", &QueryProgress::status)
+        .def_readonly("cursor", &QueryProgress::cursor)
+        .def_readonly("emitted", &QueryProgress::emitted)
+        .def("done", &QueryProgress::done);
+}
+
+/// QueryPage<T> como `name`: results, progress y atajos status/cursor/done.
+template <typename T>
+void bindQueryPage(pybind11::module_& m, const char* name) {
+    namespace py = pybind11;
+    using Page = QueryPage<T>;
+    py::class_<Page>(m, name)
+        .def_readonly("results", &Page::results)
+        .def_readonly("progress", &Page::progress)
+        .def_property_readonly("status", [](const Page& p) { return p.progress.status; })
+        .def_property_readonly("cursor", [](const Page& p) { return p.progress.cursor; })
+        .def("done", [](const Page& p) { return p.progress.done(); });
+}
+
+/// Recorre una consulta paginada por trozos de hasta chunkSize resultados,
+/// reanudando desde el cursor de la página anterior. Un timeoutMs en las
+/// opciones base se fija como plazo absoluto para todo el recorrido.
+template <typename T>
+class ChunkIterator {
+public:
+    using Fetch = std::function<QueryPage<T>(const QueryOptions&)>;
+
+    ChunkIterator(Fetch fetch, size_t chunkSize, QueryOptions base)
+        : fetch_(std::move(fetch)), chunkSize_(std::max<size_t>(1, chunkSize)), opts_(std::move(base)) {
+        if (opts_.timeoutMs > 0) {
+            opts_.deadline = std::min(opts_.deadline, QueryOptions::Clock::now() +
+                std::chrono::duration_cast<QueryOptions::Clock::duration>(
+                    std::chrono::duration<double, std::milli>(opts_.timeoutMs)));
+            opts_.timeoutMs = 0;
+        }
+        remaining_ = opts_.limit;
+    }
+
+    std::optional<std::vector<T>> next() {
+        if (finished_ || remaining_ == 0) return std::nullopt;
+        opts_.limit = std::min(chunkSize_, remaining_);
+        QueryPage<T> page = fetch_(opts_);
+        status_ = page.progress.status;
+        opts_.cursor = page.progress.cursor;
+        remaining_ -= page.results.size();
+        // Solo LimitReached significa "hay más"; plazo, cancelación o fin cierran el recorrido
+        finished_ = status_ != QueryStatus::LimitReached;
+        if (page.results.empty()) return std::nullopt;
+        return std::move(page.results);
+    }
+
+    QueryStatus status() const { return status_; }
+    uint64_t cursor() const { return finished_ && status_ == QueryStatus::Complete ? 0 : opts_.cursor; }
+
+private:
+    Fetch fetch_;
+    size_t chunkSize_;
+    QueryOptions opts_;
+    size_t remaining_;
+    bool finished_ = false;
+    QueryStatus status_ = QueryStatus::Complete;
+};
+
+/// ChunkIterator<T> como iterador Python `name`: cada __next__ devuelve una
+/// lista; la consulta corre sin el GIL y solo la conversión a lista lo toma.
+template <typename T>
+void bindChunkIterator(pybind11::module_& m, const char* name) {
+    namespace py = pybind11;
+    using It = ChunkIterator<T>;
+    py::class_<It>(m, name)
+        .def("__iter__", [](py::object self) { return self; })
+        .def("__next__", [](It& it) {
+            std::optional<std::vector<T>> chunk;
+            {
+                py::gil_scoped_release release;
+                chunk = it.next();
+            }
+            if (!chunk) throw py::stop_iteration();
+            return std::move(*chunk);
+        })
+        .def_property_readonly("status", &It::status)
+        .def_property_readonly("cursor", &It::cursor);
+}
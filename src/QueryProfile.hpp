@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// --- Perfil por consulta ---
+//
+// Los recorridos de los índices son plantillas sobre el perfil: con
+// NullProfile todas las llamadas son vacías y el compilador las elimina, así
+// que con el perfilado apagado la consulta es la misma de siempre. Con
+// QueryProfile se cuentan nodos por nivel, hojas, puntos probados, distancias
+// evaluadas y bytes leídos, y se mide el tiempo de cada fase.
+
+enum class QueryKind { Range, KNN, Radius };
+static constexpr size_t QUERY_KINDS = 3;
+
+/// Traverse: descenso y filtrado; Load: lecturas de disco (dentro de Traverse);
+/// Finalize: ordenar y convertir el resultado.
+enum class QueryPhase { Traverse, Load, Finalize };
+static constexpr size_t QUERY_PHASES = 3;
+
+/// Estructura que resolvió la consulta en un índice con planificador
+/// (PlannedIndex.hpp); Default en los demás índices.
+enum class QueryPlan { Default, Grid, RTree, Scan };
+
+inline const char* queryPlanName(const QueryPlan plan) {
+    switch (plan) {
+        case QueryPlan::Grid: return "grid";
+        case QueryPlan::RTree: return "rtree";
+        case QueryPlan::Scan: return "scan";
+        default: return "default";
+    }
+}
+
+using ProfileClock = std::chrono::steady_clock;
+
+inline uint64_t elapsedNs(const ProfileClock::time_point since) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(ProfileClock::now() - since).count());
+}
+
+class ScopedPhase {
+public:
+    explicit ScopedPhase(uint64_t& acc) : acc_(acc), start_(ProfileClock::now()) {}
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+    ~ScopedPhase() { acc_ += elapsedNs(start_); }
+
+private:
+    uint64_t& acc_;
+    ProfileClock::time_point start_;
+};
+
+struct QueryProfile {
+    static constexpr bool enabled = true;
+
+    std::vector<uint64_t> nodesPerLevel; // [0] = raíz
+    uint64_t leavesScanned = 0;
+    uint64_t pointsTested = 0;
+    uint64_t pointsReturned = 0;
+    uint64_t distanceEvals = 0;
+    uint64_t bytesRead = 0;
+    std::array<uint64_t, QUERY_PHASES> phaseNs{};
+    uint64_t totalNs = 0;
+    QueryPlan plan = QueryPlan::Default; // plan elegido y puntos que estimó el planificador
+    uint64_t estimatedPoints = 0;
+
+    void node(const size_t level) {
+        if (level >= nodesPerLevel.size()) nodesPerLevel.resize(level + 1, 0);
+        ++nodesPerLevel[level];
+    }
+    void leaf() { ++leavesScanned; }
+    void tested(const uint64_t n) { pointsTested += n; }
+    void distances(const uint64_t n) { distanceEvals += n; }
+    void bytes(const uint64_t n) { bytesRead += n; }
+    void planned(const QueryPlan p, const uint64_t estimate) {
+        plan = p;
+        estimatedPoints = estimate;
+    }
+    ScopedPhase phase(const QueryPhase p) { return ScopedPhase(phaseNs[static_cast<size_t>(p)]); }
+
+    uint64_t nodesVisited() const {
+        uint64_t total = 0;
+        for (const auto n : nodesPerLevel) total += n;
+        return total;
+    }
+
+    void merge(const QueryProfile& o) {
+        if (o.nodesPerLevel.size() > nodesPerLevel.size()) nodesPerLevel.resize(o.nodesPerLevel.size(), 0);
+        for (size_t i = 0; i < o.nodesPerLevel.size(); ++i) nodesPerLevel[i] += o.nodesPerLevel[i];
+        leavesScanned += o.leavesScanned;
+        pointsTested += o.pointsTested;
+        pointsReturned += o.pointsReturned;
+        distanceEvals += o.distanceEvals;
+        bytesRead += o.bytesRead;
+        for (size_t i = 0; i < QUERY_PHASES; ++i) phaseNs[i] += o.phaseNs[i];
+        totalNs += o.totalNs;
+    }
+};
+
+struct NullProfile {
+    static constexpr bool enabled = false;
+
+    struct NullPhase {};
+
+    void node(size_t) {}
+    void leaf() {}
+    void tested(uint64_t) {}
+    void distances(uint64_t) {}
+    void bytes(uint64_t) {}
+    void planned(QueryPlan, uint64_t) {}
+    NullPhase phase(QueryPhase) { return {}; }
+    void merge(const NullProfile&) {}
+};
+
+/// Histograma de latencias tipo HDR: exacto por debajo de 64 ns y, por encima,
+/// 64 cubetas lineales por potencia de dos (error relativo < 1.6 %).
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 6;
+    static constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+    static constexpr size_t BUCKETS = SUB + (64 - SUB_BITS) * SUB;
+
+    LatencyHistogram() : counts_(BUCKETS, 0) {}
+
+    void record(const uint64_t ns) {
+        ++counts_[bucketOf(ns)];
+        ++count_;
+        sum_ += ns;
+        min_ = count_ == 1 ? ns : std::min(min_, ns);
+        max_ = std::max(max_, ns);
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += o.counts_[i];
+        if (o.count_) min_ = count_ ? std::min(min_, o.min_) : o.min_;
+        count_ += o.count_;
+        sum_ += o.sum_;
+        max_ = std::max(max_, o.max_);
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return min_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+    /// Valor (ns) bajo el que cae la fracción q de las muestras, q en [0, 1].
+    uint64_t percentile(const double q) const {
+        if (!count_) return 0;
+        const auto target = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= std::max<uint64_t>(target, 1)) return std::min(upperOf(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0, sum_ = 0, min_ = 0, max_ = 0;
+
+    static size_t bucketOf(const uint64_t v) {
+        if (v < SUB) return static_cast<size_t>(v);
+        const int e = 63 - __builtin_clzll(v);
+        const uint64_t top = v >> (e - SUB_BITS);
+        return static_cast<size_t>(SUB + (e - SUB_BITS) * SUB + (top - SUB));
+    }
+
+    static uint64_t upperOf(const size_t i) {
+        if (i < SUB) return i;
+        const int e = static_cast<int>((i - SUB) / SUB) + SUB_BITS;
+        const uint64_t top = (i - SUB) % SUB + SUB;
+        return ((top + 1) << (e - SUB_BITS)) - 1;
+    }
+};
+
+struct ProfileStats {
+    uint64_t queries = 0;
+    LatencyHistogram latency;
+    QueryProfile totals;
+};
+
+/// Perfilado opcional de un índice: apagado por defecto. Encendido, cada
+/// consulta deja su QueryProfile en last() y se acumula en stats(kind).
+class QueryProfiler {
+public:
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    void setEnabled(const bool on) { enabled_.store(on, std::memory_order_relaxed); }
+
+    QueryProfile last() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+
+    ProfileStats stats(const QueryKind kind) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_[static_cast<size_t>(kind)];
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_ = QueryProfile();
+        for (auto& s : stats_) s = ProfileStats();
+    }
+
+    /// Ejecuta fn(QueryProfile&) cronometrada y registra el perfil; fn devuelve
+    /// el vector de resultados.
+    template <typename Fn>
+    auto run(const QueryKind kind, Fn&& fn) {
+        QueryProfile profile;
+        const auto start = ProfileClock::now();
+        auto result = fn(profile);
+        profile.totalNs = elapsedNs(start);
+        profile.pointsReturned = result.size();
+        record(kind, profile);
+        return result;
+    }
+
+    void record(const QueryKind kind, const QueryProfile& profile) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_ = profile;
+        auto& s = stats_[static_cast<size_t>(kind)];
+        ++s.queries;
+        s.latency.record(profile.totalNs);
+        s.totals.merge(profile);
+    }
+
+private:
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex mutex_;
+    QueryProfile last_;
+    std::array<ProfileStats, QUERY_KINDS> stats_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "QueryProfile.hpp"
+
+// Bindings de QueryProfile.hpp compartidos por los dos módulos (spatial_index.cpp y hola.cpp).
+
+inline void bindQueryProfile(pybind11::module_& m) {
+    namespace py = pybind11;
+
+    py::enum_<QueryKind>(m, "QueryKind")
+        .value("Range", QueryKind::Range)
+        .value("KNN", QueryKind::KNN)
+        .value("Radius", QueryKind::Radius);
+
+    py::enum_<QueryPhase>(m, "QueryPhase")
+        .value("Traverse", QueryPhase::Traverse)
+        .value("Load", QueryPhase::Load)
+        .value("Finalize", QueryPhase::Finalize);
+
+    py::enum_<QueryPlan>(m, "QueryPlan")
+        .value("Default", QueryPlan::Default)
+        .value("Grid", QueryPlan::Grid)
+        .value("RTree", QueryPlan::RTree)
+        .value("Scan", QueryPlan::Scan);
+
+    py::class_<QueryProfile>(m, "QueryProfile")
+        .def_readonly("nodesPerLevel", &QueryProfile::nodesPerLevel)
+        .def_readonly("leavesScanned", &QueryProfile::leavesScanned)
+        .def_readonly("pointsTested", &QueryProfile::pointsTested)
+        .def_readonly("pointsReturned", &QueryProfile::pointsReturned)
+        .def_readonly("distanceEvals", &QueryProfile::distanceEvals)
+        .def_readonly("bytesRead", &QueryProfile::bytesRead)
+        .def_readonly("totalNs", &QueryProfile::totalNs)
+        .def_readonly("plan", &QueryProfile::plan)
+        .def_readonly("estimatedPoints", &QueryProfile::estimatedPoints)
+        .def("nodesVisited", &QueryProfile::nodesVisited)
+        .def("phaseNs", [](const QueryProfile& p, QueryPhase phase) {
+            return p.phaseNs[static_cast<size_t>(phase)];
+        });
+
+    py::class_<LatencyHistogram>(m, "LatencyHistogram")
+        .def("count", &LatencyHistogram::count)
+        .def("min", &LatencyHistogram::min)
+        .def("max", &LatencyHistogram::max)
+        .def("mean", &LatencyHistogram::mean)
+        .def("percentile", &LatencyHistogram::percentile, py::arg("q"));
+
+    py::class_<ProfileStats>(m, "ProfileStats")
+        .def_readonly("queries", &ProfileStats::queries)
+        .def_readonly("latency", &ProfileStats::latency)
+        .def_readonly("totals", &ProfileStats::totals);
+
+    py::class_<QueryProfiler>(m, "QueryProfiler")
+        .def_property("enabled", &QueryProfiler::enabled, &QueryProfiler::setEnabled)
+        .def("last", &QueryProfiler::last)
+        .def("stats", &QueryProfiler::stats, py::arg("kind"))
+        .def("reset", &QueryProfiler::reset);
+}
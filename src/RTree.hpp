@@ -5,201 +5,688 @@
 #include <algorithm>
 #include <queue>
 #include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include "utils.hpp"
+#include "Hilbert.hpp"
+#include "Metric.hpp"
+#include "NameIndex.hpp"
+#include "PointStore.hpp"
+#include "Rect.hpp"
 
-struct Rect {
-    double minLat, minLon, maxLat, maxLon;
-    Rect() : minLat(0), minLon(0), maxLat(0), maxLon(0) {}
-    Rect(double minLat, double minLon, double maxLat, double maxLon)
-        : minLat(minLat), minLon(minLon), maxLat(maxLat), maxLon(maxLon) {}
-    Rect(const Geoname& g)
-        : minLat(g.latitude), minLon(g.longitude), maxLat(g.latitude), maxLon(g.longitude) {}
-    void expand(const Rect& r) {
-        minLat = std::min(minLat, r.minLat);
-        minLon = std::min(minLon, r.minLon);
-        maxLat = std::max(maxLat, r.maxLat);
-        maxLon = std::max(maxLon, r.maxLon);
-    }
-    bool contains(const Geoname& g) const {
-        return g.latitude >= minLat && g.latitude <= maxLat &&
-               g.longitude >= minLon && g.longitude <= maxLon;
-    }
-    bool intersects(const Rect& r) const {
-        return !(r.minLat > maxLat || r.maxLat < minLat ||
-                 r.minLon > maxLon || r.maxLon < minLon);
-    }
-    double area() const {
-        return (maxLat - minLat) * (maxLon - minLon);
-    }
-    static Rect boundingRect(const std::vector<Geoname>& points) {
-        if (points.empty()) return Rect();
-        double minLat = points[0].latitude, maxLat = points[0].latitude;
-        double minLon = points[0].longitude, maxLon = points[0].longitude;
-        for (const auto& g : points) {
-            minLat = std::min(minLat, g.latitude);
-            maxLat = std::max(maxLat, g.latitude);
-            minLon = std::min(minLon, g.longitude);
-            maxLon = std::max(maxLon, g.longitude);
-        }
-        return Rect(minLat, minLon, maxLat, maxLon);
-    }
-};
+/// Algoritmo de carga masiva usado por build().
+enum class RTreeBuildMode { STR, Hilbert };
+
+/// "str" o "hilbert" (para el constructor de Python).
+inline RTreeBuildMode parseRTreeBuildMode(const std::string& name) {
+    if (name == "str" || name == "STR") return RTreeBuildMode::STR;
+    if (name == "hilbert" || name == "Hilbert") return RTreeBuildMode::Hilbert;
+    throw std::invalid_argument("modo de construccion desconocido: " + name);
+}
+
+/// R-tree estático en memoria.
+///   Coord   tipo de las coordenadas guardadas (float basta para ~1 m en lat/lon
+///           y deja los puntos en la mitad de memoria)
+///   Fanout  grado máximo fijo en compilación; 0 = grado elegido en el constructor
+///   Metric  HaversineMetric (metros) o PlanarMetric (unidades de las coordenadas)
+template <typename Coord = double, int Fanout = 0, typename Metric = HaversineMetric>
+class BasicRTreeIndex : public Index {
+    static_assert(std::is_floating_point<Coord>::value, "Coord debe ser float o double");
+    static_assert(Fanout == 0 || Fanout >= 2, "Fanout debe ser 0 (en ejecución) o >= 2");
 
-class RTreeIndex : public Index {
+public:
+    using BuildMode = RTreeBuildMode;
+    using Box = BasicRect<Coord>;
+
+private:
+    // Los nodos viven en un pool (nodes_) propiedad del índice y los puntos en
+    // store_, en orden de hojas. Los hijos de un nodo interno son contiguos en
+    // el pool y los puntos de una hoja contiguos en store_, así que Node es
+    // trivialmente destructible: liberar el árbol es O(1) y reconstruir reutiliza
+    // la capacidad ya reservada. Los MBR van aparte, en SoA (boxes_), para que
+    // el test de los hijos de un nodo recorra arrays contiguos.
     struct Node {
-        bool isLeaf;
-        std::vector<Geoname> points; // solo para hojas
-        std::vector<Node*> children; // solo para internos
-        std::vector<Rect> mbrs; // bounding rectangles de los hijos
-        Rect mbr; // bounding rectangle de este nodo
-        Node(bool leaf) : isLeaf(leaf) {}
+        uint32_t first = 0;  // hoja: primer punto en store_; interno: primer hijo en nodes_
+        uint32_t count = 0;  // número de puntos (hoja) o de hijos (interno)
+        uint32_t pointBegin = 0, pointEnd = 0; // puntos del subárbol: store_[pointBegin, pointEnd)
+        bool isLeaf = true;
     };
-    Node* root;
+    struct Boxes {
+        std::vector<Coord> minLat, minLon, maxLat, maxLon;
+
+        void clear() { minLat.clear(); minLon.clear(); maxLat.clear(); maxLon.clear(); }
+        void resize(const size_t n) {
+            const Box e = Box::empty();
+            minLat.resize(n, e.minLat); minLon.resize(n, e.minLon);
+            maxLat.resize(n, e.maxLat); maxLon.resize(n, e.maxLon);
+        }
+        void set(const size_t i, const Box& b) {
+            minLat[i] = b.minLat; minLon[i] = b.minLon; maxLat[i] = b.maxLat; maxLon[i] = b.maxLon;
+        }
+        Box operator[](const size_t i) const { return Box(minLat[i], minLon[i], maxLat[i], maxLon[i]); }
+        size_t capacityBytes() const { return 4 * minLat.capacity() * sizeof(Coord); }
+    };
+    static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+    std::vector<Node> nodes_;
+    Boxes boxes_;
+    PointStore<Coord, Metric> store_;
+    std::vector<NameSignature> sigs_; // resumen de los nombres de cada nodo; vacío sin nombres
+    ParallelScan scan_;               // reparto de las consultas de rango grandes
+    uint32_t root = NO_NODE;
     int maxDegree;
+    BuildMode mode;
 
+    /// MBR de los puntos src[order[begin, end)], ya redondeados a Coord.
+    static Box leafRect(const std::vector<Geoname>& src, const std::vector<uint32_t>& order,
+                        const size_t begin, const size_t end) {
+        Box r(src[order[begin]]);
+        for (size_t i = begin + 1; i < end; ++i) r.expand(Box(src[order[i]]));
+        return r;
+    }
 
-    // --- STR Build ---
-    Node* buildSTR(std::vector<Geoname>& points, int degree, int depth = 0) {
-        // std::cout << "construyendo para " << points.size() << " puntos con grado " << degree << "y profundidad " << depth << "\n";
-        if (points.empty())
-            return nullptr;
+    uint32_t allocNode() {
+        const auto idx = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        boxes_.resize(nodes_.size());
+        return idx;
+    }
 
-        if (points.size() <= degree) {
-            const auto leaf = new Node(true);
-            leaf->points = points;
-            leaf->mbr = Rect::boundingRect(points);
-            return leaf;
+    /// Reserva un bloque para n hijos. Con Fanout fijo el bloque siempre tiene
+    /// Fanout huecos: los sobrantes quedan como hojas vacías con MBR vacío.
+    uint32_t allocBlock(const size_t n) {
+        const auto first = static_cast<uint32_t>(nodes_.size());
+        const size_t lanes = Fanout > 0 ? static_cast<size_t>(Fanout) : n;
+        nodes_.resize(nodes_.size() + lanes);
+        boxes_.resize(nodes_.size());
+        return first;
+    }
+
+    /// Resumen de nombres de idx y de todo su subárbol, de abajo arriba.
+    const NameSignature& signRec(const uint32_t idx) {
+        const Node& node = nodes_[idx];
+        if (node.isLeaf) {
+            sigs_[idx] = store_.signature(node.first, node.first + node.count);
+        } else {
+            NameSignature sig;
+            for (uint32_t c = node.first; c < node.first + node.count; ++c) sig.merge(signRec(c));
+            sigs_[idx] = sig;
         }
+        return sigs_[idx];
+    }
+
+    // --- STR Build ---
+    // Ordena order[begin, end) en su sitio, así que al terminar order ya queda
+    // en orden de hojas. Los hijos se reservan en bloque antes de bajar.
+    void buildSTR(const std::vector<Geoname>& src, std::vector<uint32_t>& order,
+                  uint32_t idx, size_t begin, size_t end) {
+        const size_t degree = static_cast<size_t>(maxDegree);
+        const size_t n = end - begin;
+        if (n <= degree) {
+            nodes_[idx] = {static_cast<uint32_t>(begin), static_cast<uint32_t>(n),
+                           static_cast<uint32_t>(begin), static_cast<uint32_t>(end), true};
+            boxes_.set(idx, leafRect(src, order, begin, end));
+            return;
+        }
+        // capacidad de cada hijo: el menor degree^h que deja <= degree hijos
+        size_t cap = degree;
+        while (cap * degree < n) cap *= degree;
+        const size_t nChildren = (n + cap - 1) / cap;
+        const size_t nSlices = (size_t)std::ceil(std::sqrt((double)nChildren));
+        const size_t S = ((nChildren + nSlices - 1) / nSlices) * cap;
+
         // 1. Ordenar por latitud
-        std::sort(points.begin(), points.end(), [](const Geoname& a, const Geoname& b) {
-            return a.latitude < b.latitude;
+        const auto base = order.begin();
+        std::sort(base + begin, base + end, [&](const uint32_t a, const uint32_t b) {
+            return src[a].latitude < src[b].latitude;
         });
-        int S = (int)std::ceil((double)points.size() / degree);
-        std::vector<std::vector<Geoname>> slices;
-        // std::cout << "S: " << S << "\n";
-        for (int i = 0; i < points.size(); i += S) {
-            int end = std::min(i + S, (int)points.size());
-            std::vector<Geoname> slice(points.begin() + i, points.begin() + end);
-            // 2. Ordenar cada slice por longitud
-            std::sort(slice.begin(), slice.end(), [](const Geoname& a, const Geoname& b) {
-                return a.longitude < b.longitude;
+        // 2. Ordenar cada slice por longitud y cortarla en grupos de `cap`
+        std::vector<std::pair<size_t, size_t>> groups;
+        for (size_t i = begin; i < end; i += S) {
+            const size_t sliceEnd = std::min(i + S, end);
+            std::sort(base + i, base + sliceEnd, [&](const uint32_t a, const uint32_t b) {
+                return src[a].longitude < src[b].longitude;
             });
-            slices.push_back(std::move(slice));
-        }
-        std::vector<Node*> children;
-        std::vector<Rect> mbrs;
-        for (auto& slice : slices) {
-            for (int i = 0; i < slice.size(); i += degree) {
-                int end = std::min(i + degree, (int)slice.size());
-                std::vector<Geoname> group(slice.begin() + i, slice.begin() + end);
-                auto child = buildSTR(group, degree, depth + 1);
-                mbrs.push_back(child->mbr);
-                children.push_back(std::move(child));
+            for (size_t g = i; g < sliceEnd; g += cap) groups.emplace_back(g, std::min(g + cap, sliceEnd));
+        }
+
+        const uint32_t first = allocBlock(groups.size());
+        for (size_t c = 0; c < groups.size(); ++c)
+            buildSTR(src, order, first + c, groups[c].first, groups[c].second);
+        Box mbr = boxes_[first];
+        for (size_t c = 1; c < groups.size(); ++c) mbr.expand(boxes_[first + c]);
+        nodes_[idx] = {first, static_cast<uint32_t>(groups.size()),
+                       static_cast<uint32_t>(begin), static_cast<uint32_t>(end), false};
+        boxes_.set(idx, mbr);
+    }
+
+    // --- Hilbert Build ---
+    // Ordena por clave de Hilbert (radix sort paralelo) y empaqueta de abajo
+    // arriba: hojas de `degree` puntos consecutivos, luego cada nivel agrupa
+    // `degree` nodos consecutivos del anterior. La raíz queda al final del pool.
+    uint32_t buildHilbert(const std::vector<Geoname>& src, std::vector<uint32_t>& order) {
+        std::vector<std::pair<uint64_t, uint32_t>> keys(src.size());
+        for (size_t i = 0; i < src.size(); ++i)
+            keys[i] = {hilbertKey(src[i].latitude, src[i].longitude), static_cast<uint32_t>(i)};
+        parallelRadixSort(keys);
+        for (size_t i = 0; i < keys.size(); ++i) order[i] = keys[i].second;
+
+        const size_t deg = static_cast<size_t>(maxDegree);
+        std::vector<std::pair<Node, Box>> level, parents;
+        for (size_t i = 0; i < order.size(); i += deg) {
+            const size_t end = std::min(i + deg, order.size());
+            level.push_back({{static_cast<uint32_t>(i), static_cast<uint32_t>(end - i),
+                              static_cast<uint32_t>(i), static_cast<uint32_t>(end), true},
+                             leafRect(src, order, i, end)});
+        }
+        while (level.size() > 1) {
+            parents.clear();
+            for (size_t i = 0; i < level.size(); i += deg) {
+                const size_t end = std::min(i + deg, level.size());
+                const uint32_t first = allocBlock(end - i);
+                Box mbr = level[i].second;
+                for (size_t j = i; j < end; ++j) {
+                    nodes_[first + (j - i)] = level[j].first;
+                    boxes_.set(first + (j - i), level[j].second);
+                    mbr.expand(level[j].second);
+                }
+                parents.push_back({{first, static_cast<uint32_t>(end - i),
+                                    level[i].first.pointBegin, level[end - 1].first.pointEnd, false},
+                                   mbr});
             }
+            level.swap(parents);
         }
-        const auto node = new Node(false);
-        node->children = std::move(children);
-        node->mbrs = std::move(mbrs);
-        node->mbr = Rect::boundingRect(points);
-        return node;
+        const uint32_t idx = allocNode();
+        nodes_[idx] = level[0].first;
+        boxes_.set(idx, level[0].second);
+        return idx;
+    }
+
+    /// Llama a visit(c) para cada hijo c de `node` cuyo MBR corta q, en orden,
+    /// hasta que visit devuelva true. Con Fanout fijo el test recorre siempre
+    /// Fanout carriles contiguos (los de relleno nunca cortan): el compilador
+    /// desenrolla y vectoriza el bucle.
+    template <typename Visit>
+    bool visitIntersecting(const Node& node, const Box& q, Visit&& visit) const {
+        if constexpr (Fanout > 0) {
+            const Coord* minLat = boxes_.minLat.data() + node.first;
+            const Coord* minLon = boxes_.minLon.data() + node.first;
+            const Coord* maxLat = boxes_.maxLat.data() + node.first;
+            const Coord* maxLon = boxes_.maxLon.data() + node.first;
+            bool hit[Fanout];
+            for (int l = 0; l < Fanout; ++l)
+                hit[l] = (q.minLat <= maxLat[l]) & (q.maxLat >= minLat[l]) &
+                         (q.minLon <= maxLon[l]) & (q.maxLon >= minLon[l]);
+            for (int l = 0; l < Fanout; ++l)
+                if (hit[l] && visit(node.first + static_cast<uint32_t>(l))) return true;
+        } else {
+            for (uint32_t c = node.first; c < node.first + node.count; ++c)
+                if (boxes_[c].intersects(q) && visit(c)) return true;
+        }
+        return false;
     }
 
     // --- Range Query ---
-    void rangeQueryRec(const Node* node, const Rect& query, std::vector<Geoname>& result) const {
-        if (!node) return;
-        if (!node->mbr.intersects(query)) return;
-        if (node->isLeaf) {
-            for (const auto& g : node->points) {
-                if (query.contains(g)) result.push_back(g);
+    template <typename Profile>
+    void rangeQueryRec(uint32_t idx, size_t level, const Box& query, std::vector<Geoname>& result,
+                       std::vector<uint32_t>& sel, Profile& prof) const {
+        const Node& node = nodes_[idx];
+        prof.node(level);
+        if (node.isLeaf) {
+            prof.leaf();
+            prof.tested(node.count);
+            const size_t m = store_.select(query, node.first, node.first + node.count, sel.data());
+            for (size_t i = 0; i < m; ++i) result.push_back(store_[sel[i]]);
+        } else {
+            visitIntersecting(node, query, [&](const uint32_t c) {
+                rangeQueryRec(c, level + 1, query, result, sel, prof);
+                return false;
+            });
+        }
+    }
+
+    // Como rangeQueryRec, saltándose los hijos cuyo resumen descarta el prefijo.
+    template <typename Profile>
+    void rangePrefixRec(uint32_t idx, size_t level, const Box& query, const std::string& prefix,
+                        std::vector<Geoname>& result, Profile& prof) const {
+        const Node& node = nodes_[idx];
+        prof.node(level);
+        if (node.isLeaf) {
+            prof.leaf();
+            prof.tested(node.count);
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (query.contains(store_.lat(i), store_.lon(i)) && store_.nameHasPrefix(i, prefix))
+                    result.push_back(store_[i]);
             }
         } else {
-            for (size_t i = 0; i < node->children.size(); ++i) {
-                if (node->mbrs[i].intersects(query))
-                    rangeQueryRec(node->children[i], query, result);
+            visitIntersecting(node, query, [&](const uint32_t c) {
+                if (sigs_[c].mayHavePrefix(prefix)) rangePrefixRec(c, level + 1, query, prefix, result, prof);
+                return false;
+            });
+        }
+    }
+
+    // Versión acotada: el cursor es la posición en store_ (orden de hojas) del
+    // primer punto pendiente, así que los subárboles con pointEnd <= from ya se
+    // entregaron. Devuelve true si hay que cortar, con la posición en `cursor`.
+    bool rangeEachRec(uint32_t idx, const Box& query, uint64_t from, QueryBudget& budget,
+                      const std::function<bool(const Geoname&)>& sink, uint64_t& cursor) const {
+        const Node& node = nodes_[idx];
+        if (node.pointEnd <= from) return false;
+        if (node.isLeaf) {
+            const uint32_t start = static_cast<uint32_t>(std::max<uint64_t>(node.first, from));
+            if (budget.interrupted()) {
+                cursor = start;
+                return true;
+            }
+            for (uint32_t i = start; i < node.first + node.count; ++i) {
+                if (!query.contains(store_.lat(i), store_.lon(i))) continue;
+                if (!budget.admit()) {
+                    cursor = i;
+                    return true;
+                }
+                if (!sink(store_[i])) {
+                    budget.stop();
+                    cursor = i + 1;
+                    return true;
+                }
             }
+            return false;
+        }
+        return visitIntersecting(node, query, [&](const uint32_t c) {
+            return rangeEachRec(c, query, from, budget, sink, cursor);
+        });
+    }
+
+    // --- Aggregate Query ---
+    // Los puntos de un subárbol son contiguos en store_, así que si la ventana
+    // cubre su MBR se suman de una vez (tamaño del tramo y sumas prefijas de
+    // los pesos) sin bajar: solo se desciende por los nodos del borde.
+    void aggregateRec(uint32_t idx, const Box& query, Aggregate& acc, std::vector<uint32_t>& sel) const {
+        const Node& node = nodes_[idx];
+        if (query.contains(boxes_[idx])) {
+            acc.count += node.pointEnd - node.pointBegin;
+            acc.sum += store_.weightSum(node.pointBegin, node.pointEnd);
+        } else if (node.isLeaf) {
+            const size_t m = store_.select(query, node.first, node.first + node.count, sel.data());
+            acc.count += m;
+            for (size_t i = 0; i < m; ++i) acc.sum += store_.weight(sel[i]);
+        } else {
+            visitIntersecting(node, query, [&](const uint32_t c) {
+                aggregateRec(c, query, acc, sel);
+                return false;
+            });
         }
     }
 
     // --- kNN Query ---
-    struct QueueEntry {
-        const Node* node;
-        double minDist;
-        bool operator<(const QueueEntry& o) const { return minDist > o.minDist; }
-    };
-    static double minDistRect(const Rect& r, double lat, double lon) {
-        const double clat = std::clamp(lat, r.minLat, r.maxLat);
-        const double clon = std::clamp(lon, r.minLon, r.maxLon);
-        return haversine(lat, lon, clat, clon);
-    }
-
-    template <typename Compare>
-    void kNNQuery(
-        const Node* node,
-        double qLat,
-        double qLon,
-        int k,
-        std::priority_queue<
-            std::pair<double, Geoname>,
-            std::vector<std::pair<double, Geoname>>,
-            Compare> &pq
-            ) const {
-        if (!node) return;
-        if (node->isLeaf) {
-            for (const auto& g : node->points) {
-                if (qLat == g.latitude && qLon == g.longitude) continue;
-                double d = haversine(qLat, qLon, g.latitude, g.longitude);
+    // Las distancias se manejan como claves de la métrica (cuerda al cuadrado
+    // en haversine); pq es un max-heap cuyo tope es el peor de los k vecinos actuales.
+    using KnnHeap = std::priority_queue<std::pair<double, uint32_t>>;
+
+    // Con prefix solo cuentan los puntos con ese prefijo de nombre y se
+    // saltan los hijos cuyo resumen lo descarta.
+    template <typename Profile>
+    void kNNQuery(uint32_t idx, size_t level, double qLat, double qLon, const typename Metric::Query& mq,
+                  size_t k, const std::string* prefix, KnnHeap& pq, std::vector<Coord>& d2, Profile& prof) const {
+        const Node& node = nodes_[idx];
+        prof.node(level);
+        if (node.isLeaf) {
+            prof.leaf();
+            prof.tested(node.count);
+            prof.distances(node.count);
+            d2.resize(node.count);
+            store_.keys(mq, node.first, node.count, d2.data());
+            const Coord cLat = static_cast<Coord>(qLat), cLon = static_cast<Coord>(qLon);
+            for (uint32_t m = 0; m < node.count; ++m) {
+                const uint32_t i = node.first + m;
+                if (cLat == store_.lat(i) && cLon == store_.lon(i)) continue;
+                if (prefix && !store_.nameHasPrefix(i, *prefix)) continue;
                 if (pq.size() < k)
-                    pq.emplace(d, g);
-                else if (d < pq.top().first) {
+                    pq.emplace(d2[m], i);
+                else if (d2[m] < pq.top().first) {
                     pq.pop();
-                    pq.emplace(d, g);
+                    pq.emplace(d2[m], i);
                 }
             }
         } else {
-            // Buscar hijos por orden de distancia mínima
-            std::vector<std::pair<double, int>> order;
-            for (int i = 0; i < node->children.size(); ++i) {
-                double d = minDistRect(node->mbrs[i], qLat, qLon);
-                order.emplace_back(d, i);
+            // Buscar hijos por orden de distancia mínima, podando los que no pueden mejorar
+            std::vector<std::pair<double, uint32_t>> order;
+            order.reserve(node.count);
+            for (uint32_t c = node.first; c < node.first + node.count; ++c) {
+                if (prefix && !sigs_[c].mayHavePrefix(*prefix)) continue;
+                order.emplace_back(Metric::minKey(qLat, qLon, boxes_[c]), c);
             }
+            prof.distances(node.count);
             std::sort(order.begin(), order.end());
-            for (auto [_, i] : order) {
-                kNNQuery(node->children[i], qLat, qLon, k, pq);
+            for (auto [d, c] : order) {
+                if (pq.size() == k && d >= pq.top().first) break;
+                kNNQuery(c, level + 1, qLat, qLon, mq, k, prefix, pq, d2, prof);
             }
         }
     }
 
-public:
-    explicit RTreeIndex(const int degree = 16) : maxDegree(degree) {}
-    void build(const std::vector<Geoname>& points) override {
-        if (points.empty()) { root = nullptr; return; }
-        std::vector<Geoname> pts = points;
-        root = buildSTR(pts, maxDegree);
+    // --- Radius Query ---
+    // Poda con el MINDIST de la métrica y acepta sin comprobar los subárboles
+    // cuyo MAXDIST ya cabe en el radio; en las hojas frontera filtra en lote.
+    template <typename Profile>
+    void radiusQueryRec(uint32_t idx, size_t level, double qLat, double qLon, const typename Metric::Query& mq,
+                        double c2max, bool withDist, std::vector<std::pair<double, uint32_t>>& out,
+                        std::vector<Coord>& d2, Profile& prof) const {
+        const Node& node = nodes_[idx];
+        prof.node(level);
+        prof.distances(1);
+        const bool inside = Metric::maxKey(qLat, qLon, boxes_[idx]) <= c2max;
+        if (inside && !withDist) {
+            for (uint32_t i = node.pointBegin; i < node.pointEnd; ++i) out.emplace_back(0.0, i);
+            return;
+        }
+        if (node.isLeaf || inside) {
+            const uint32_t n = node.pointEnd - node.pointBegin;
+            prof.leaf();
+            prof.tested(n);
+            prof.distances(n);
+            d2.resize(n);
+            store_.keys(mq, node.pointBegin, n, d2.data());
+            for (uint32_t m = 0; m < n; ++m)
+                if (d2[m] <= c2max) out.emplace_back(d2[m], node.pointBegin + m);
+            return;
+        }
+        prof.distances(node.count);
+        for (uint32_t c = node.first; c < node.first + node.count; ++c) {
+            if (Metric::minKey(qLat, qLon, boxes_[c]) <= c2max)
+                radiusQueryRec(c, level + 1, qLat, qLon, mq, c2max, withDist, out, d2, prof);
+        }
     }
-    std::vector<Geoname> rangeQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+
+    template <typename Profile>
+    std::vector<std::pair<double, uint32_t>> radiusMatches(double lat, double lon, double distance,
+                                                           bool withDist, Profile& prof) const {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        std::vector<std::pair<double, uint32_t>> out;
+        if (root == NO_NODE || distance < 0) return out;
+        const double c2max = Metric::toKey(distance);
+        std::vector<Coord> d2;
+        if (Metric::minKey(lat, lon, boxes_[root]) <= c2max)
+            radiusQueryRec(root, 0, lat, lon, Metric::query(lat, lon), c2max, withDist, out, d2, prof);
+        return out;
+    }
+
+    // Baja por el árbol en anchura mientras los candidatos (puntos de los
+    // subárboles que cortan la ventana) justifiquen repartir y haya pocas
+    // tareas; cada nodo de la frontera es luego una tarea de rangeQueryRec.
+    // Las consultas pequeñas se quedan en unos pocos nodos y van en serie.
+    template <typename Profile>
+    ChunkedResults<Geoname> rangeQueryImpl(const Box& query, Profile& prof) const {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+        ChunkedResults<Geoname> out;
+        if (root == NO_NODE || !boxes_[root].intersects(query)) return out;
+
+        std::vector<std::pair<uint32_t, size_t>> frontier{{root, 0}}, next; // (nodo, nivel)
+        size_t candidates = nodes_[root].pointEnd - nodes_[root].pointBegin;
+        bool split = true;
+        while (split && scan_.worth(candidates) && frontier.size() < scan_.targetTasks()) {
+            next.clear();
+            candidates = 0;
+            split = false;
+            for (const auto& [idx, level] : frontier) {
+                const Node& node = nodes_[idx];
+                if (node.isLeaf) {
+                    next.emplace_back(idx, level);
+                    candidates += node.count;
+                    continue;
+                }
+                prof.node(level);
+                split = true;
+                visitIntersecting(node, query, [&](const uint32_t c) {
+                    next.emplace_back(c, level + 1);
+                    candidates += nodes_[c].pointEnd - nodes_[c].pointBegin;
+                    return false;
+                });
+            }
+            frontier.swap(next);
+        }
+
+        if (!scan_.worth(candidates) || frontier.size() == 1) {
+            std::vector<Geoname> result;
+            std::vector<uint32_t> sel(static_cast<size_t>(maxDegree));
+            for (const auto& [idx, level] : frontier) rangeQueryRec(idx, level, query, result, sel, prof);
+            out.add(std::move(result));
+            return out;
+        }
+        std::vector<std::vector<Geoname>> parts(frontier.size());
+        std::vector<Profile> profs(frontier.size());
+        scan_.run(frontier.size(), [&](const size_t t) {
+            std::vector<uint32_t> sel(static_cast<size_t>(maxDegree));
+            rangeQueryRec(frontier[t].first, frontier[t].second, query, parts[t], sel, profs[t]);
+        });
+        for (size_t t = 0; t < parts.size(); ++t) {
+            prof.merge(profs[t]);
+            out.add(std::move(parts[t]));
+        }
+        return out;
+    }
+
+    // Con pocos registros con el prefijo se miran directamente (orden por
+    // nombre de store_); si no, se baja por el árbol podando con los resúmenes.
+    template <typename Profile>
+    std::vector<Geoname> rangePrefixImpl(const Box& query, const std::string& prefix, Profile& prof) const {
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
         std::vector<Geoname> result;
-        if (!root) return result;
-        const Rect query(minLat, minLon, maxLat, maxLon);
-        rangeQueryRec(root, query, result);
+        const auto [first, last] = store_.withPrefix(prefix);
+        if (static_cast<size_t>(last - first) <= NAME_DIRECT_LIMIT) {
+            prof.tested(static_cast<size_t>(last - first));
+            for (const uint32_t* p = first; p != last; ++p) {
+                if (query.contains(store_.lat(*p), store_.lon(*p))) result.push_back(store_[*p]);
+            }
+        } else if (root != NO_NODE && boxes_[root].intersects(query)) {
+            rangePrefixRec(root, 0, query, prefix, result, prof);
+        }
         return result;
     }
-    std::vector<Geoname> kNN(const Geoname& q, int k) override {
-        using Pair = std::pair<double, Geoname>;
 
-        auto cmp = [](const Pair& a, const Pair& b) {
-            return a.first > b.first;
-        };
+    template <typename Profile>
+    std::vector<Geoname> radiusQueryImpl(double lat, double lon, double distance, Profile& prof) const {
+        const auto matches = radiusMatches(lat, lon, distance, false, prof);
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        std::vector<Geoname> result;
+        result.reserve(matches.size());
+        for (const auto& [_, i] : matches) result.push_back(store_[i]);
+        return result;
+    }
+
+    template <typename Profile>
+    std::vector<std::pair<double, Geoname>> radiusWithDistancesImpl(double lat, double lon, double distance,
+                                                                    Profile& prof) const {
+        auto matches = radiusMatches(lat, lon, distance, true, prof);
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        std::sort(matches.begin(), matches.end());
+        std::vector<std::pair<double, Geoname>> result;
+        result.reserve(matches.size());
+        for (const auto& [c2, i] : matches) result.emplace_back(Metric::toDistance(c2), store_[i]);
+        return result;
+    }
 
-        std::priority_queue<Pair, std::vector<Pair>, decltype(cmp)> pq(cmp);
-        kNNQuery(root, q.latitude, q.longitude, k, pq);
+    // prefix (normalizado) o nullptr. Con pocos registros con el prefijo se
+    // calculan sus distancias directamente, como en rangePrefixImpl.
+    template <typename Profile>
+    std::vector<Geoname> kNNImpl(const Geoname& q, int k, const std::string* prefix, Profile& prof) const {
         std::vector<Geoname> res;
+        if (root == NO_NODE || k <= 0) return res;
+        KnnHeap pq;
+        {
+            [[maybe_unused]] auto phase = prof.phase(QueryPhase::Traverse);
+            const size_t kk = static_cast<size_t>(k);
+            const auto [first, last] = prefix ? store_.withPrefix(*prefix)
+                                              : std::pair<const uint32_t*, const uint32_t*>(nullptr, nullptr);
+            if (prefix && static_cast<size_t>(last - first) <= NAME_DIRECT_LIMIT) {
+                const Coord cLat = static_cast<Coord>(q.latitude), cLon = static_cast<Coord>(q.longitude);
+                prof.tested(static_cast<size_t>(last - first));
+                prof.distances(static_cast<size_t>(last - first));
+                for (const uint32_t* p = first; p != last; ++p) {
+                    if (cLat == store_.lat(*p) && cLon == store_.lon(*p)) continue;
+                    const double key = Metric::toKey(Metric::distance(q.latitude, q.longitude,
+                                                                      store_.lat(*p), store_.lon(*p)));
+                    if (pq.size() < kk) {
+                        pq.emplace(key, *p);
+                    } else if (key < pq.top().first) {
+                        pq.pop();
+                        pq.emplace(key, *p);
+                    }
+                }
+            } else {
+                std::vector<Coord> d2;
+                kNNQuery(root, 0, q.latitude, q.longitude, Metric::query(q.latitude, q.longitude),
+                         kk, prefix, pq, d2, prof);
+            }
+        }
+        [[maybe_unused]] auto phase = prof.phase(QueryPhase::Finalize);
+        res.reserve(pq.size());
         while (!pq.empty()) {
-            // if (pq.top().second.geonameId != q.geonameId) // evitar el mismo punto
-                res.push_back(pq.top().second);
+            // if (store_[pq.top().second].geonameId != q.geonameId) // evitar el mismo punto
+                res.push_back(store_[pq.top().second]);
             pq.pop();
         }
         std::reverse(res.begin(), res.end());
-        if (res.size() > k) res.resize(k);
         return res;
     }
-};
\ No newline at end of file
+
+public:
+    static constexpr int fanout = Fanout;
+
+    /// Con Fanout fijo el grado se limita a [2, Fanout] y por defecto es Fanout.
+    explicit BasicRTreeIndex(const int degree = Fanout > 0 ? Fanout : 16, const BuildMode buildMode = BuildMode::STR)
+        : maxDegree(std::clamp(degree, 2, Fanout > 0 ? Fanout : std::numeric_limits<int>::max())),
+          mode(buildMode) {}
+
+    static BuildMode parseBuildMode(const std::string& name) { return parseRTreeBuildMode(name); }
+
+    /// Reconstruye el índice. El árbol anterior se descarta sin recorrerlo y su
+    /// capacidad se reutiliza para el nuevo.
+    void build(const std::vector<Geoname>& points) override { build(points, {}); }
+
+    /// Con pesos (uno por punto) aggregateQuery devuelve además su suma.
+    void build(const std::vector<Geoname>& points, const std::vector<double>& weights) override {
+        if (!weights.empty() && weights.size() != points.size())
+            throw std::invalid_argument("build: hace falta un peso por punto");
+        nodes_.clear();
+        boxes_.clear();
+        sigs_.clear();
+        root = NO_NODE;
+        if (points.empty()) { store_.clear(); return; }
+
+        std::vector<uint32_t> order(points.size());
+        if (mode == BuildMode::Hilbert) {
+            root = buildHilbert(points, order);
+        } else {
+            std::iota(order.begin(), order.end(), 0u);
+            root = allocNode();
+            buildSTR(points, order, root, 0, points.size());
+        }
+        store_.assign(points, order);
+        if (!weights.empty()) store_.assignWeights(weights, order);
+        sigs_.clear();
+        if (store_.hasNames()) {
+            sigs_.resize(nodes_.size());
+            signRec(root);
+        }
+    }
+
+    BuildMode buildMode() const { return mode; }
+    /// Reparto de las consultas de rango grandes entre hilos (ParallelScan.hpp).
+    ParallelScan& parallelScan() { return scan_; }
+    int degree() const { return maxDegree; }
+    size_t size() const { return store_.size(); }
+
+    std::optional<Geoname> getById(const long id) override {
+        const uint32_t i = store_.find(id);
+        if (i == store_.NOT_FOUND) return std::nullopt;
+        return store_[i];
+    }
+
+    /// Bytes reservados por el índice (pool de nodos, MBR, puntos y resúmenes de nombres).
+    size_t memoryUsage() const override {
+        return sizeof(*this) + nodes_.capacity() * sizeof(Node) + boxes_.capacityBytes() + store_.memoryUsage()
+             + sigs_.capacity() * sizeof(NameSignature);
+    }
+
+    std::vector<Geoname> rangeQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        return rangeQueryChunks(minLat, minLon, maxLat, maxLon).flatten();
+    }
+    ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon) override {
+        const Box query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Range, [&](QueryProfile& p) { return rangeQueryImpl(query, p); });
+        NullProfile none;
+        return rangeQueryImpl(query, none);
+    }
+    /// rangeQueryChunks contando en prof (para los índices que delegan en este).
+    template <typename Profile>
+    ChunkedResults<Geoname> rangeQueryChunks(double minLat, double minLon, double maxLat, double maxLon,
+                                             Profile& prof) const {
+        return rangeQueryImpl(inwardRect<Coord>(minLat, minLon, maxLat, maxLon), prof);
+    }
+    QueryProgress rangeQueryEach(double minLat, double minLon, double maxLat, double maxLon,
+                                 const QueryOptions& opts,
+                                 const std::function<bool(const Geoname&)>& sink) override {
+        QueryBudget budget(opts);
+        uint64_t cursor = 0;
+        const Box query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+        if (root != NO_NODE && boxes_[root].intersects(query))
+            rangeEachRec(root, query, opts.cursor, budget, sink, cursor);
+        return budget.finish(cursor);
+    }
+    Aggregate aggregateQuery(double minLat, double minLon, double maxLat, double maxLon) override {
+        const Box query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+        Aggregate acc;
+        std::vector<uint32_t> sel(static_cast<size_t>(maxDegree));
+        if (root != NO_NODE && boxes_[root].intersects(query)) aggregateRec(root, query, acc, sel);
+        return acc;
+    }
+    std::vector<Geoname> radiusQuery(double lat, double lon, double meters) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Radius, [&](QueryProfile& p) { return radiusQueryImpl(lat, lon, meters, p); });
+        NullProfile none;
+        return radiusQueryImpl(lat, lon, meters, none);
+    }
+    std::vector<std::pair<double, Geoname>> radiusQueryWithDistances(double lat, double lon,
+                                                                     double meters) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Radius,
+                                 [&](QueryProfile& p) { return radiusWithDistancesImpl(lat, lon, meters, p); });
+        NullProfile none;
+        return radiusWithDistancesImpl(lat, lon, meters, none);
+    }
+    std::vector<Geoname> kNN(const Geoname& q, int k) override {
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, nullptr, p); });
+        NullProfile none;
+        return kNNImpl(q, k, nullptr, none);
+    }
+    std::vector<Geoname> rangeQueryWithPrefix(double minLat, double minLon, double maxLat, double maxLon,
+                                              const std::string& namePrefix) override {
+        if (namePrefix.empty()) return rangeQuery(minLat, minLon, maxLat, maxLon);
+        const Box query = inwardRect<Coord>(minLat, minLon, maxLat, maxLon);
+        const std::string prefix = normalizeName(namePrefix);
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::Range, [&](QueryProfile& p) { return rangePrefixImpl(query, prefix, p); });
+        NullProfile none;
+        return rangePrefixImpl(query, prefix, none);
+    }
+    std::vector<Geoname> kNNWithPrefix(const Geoname& q, int k, const std::string& namePrefix) override {
+        if (namePrefix.empty()) return kNN(q, k);
+        const std::string prefix = normalizeName(namePrefix);
+        if (profiler_.enabled())
+            return profiler_.run(QueryKind::KNN, [&](QueryProfile& p) { return kNNImpl(q, k, &prefix, p); });
+        NullProfile none;
+        return kNNImpl(q, k, &prefix, none);
+    }
+};
+
+/// Configuración original: double, grado en ejecución, distancia geodésica.
+using RTreeIndex = BasicRTreeIndex<>;
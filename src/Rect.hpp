@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Geoname.hpp"
+
+/// Rectángulo lat/lon con coordenadas de tipo T (float o double).
+template <typename T>
+struct BasicRect {
+    T minLat, minLon, maxLat, maxLon;
+    BasicRect() : minLat(0), minLon(0), maxLat(0), maxLon(0) {}
+    BasicRect(T minLat, T minLon, T maxLat, T maxLon)
+        : minLat(minLat), minLon(minLon), maxLat(maxLat), maxLon(maxLon) {}
+    BasicRect(const Geoname& g)
+        : minLat(static_cast<T>(g.latitude)), minLon(static_cast<T>(g.longitude)),
+          maxLat(static_cast<T>(g.latitude)), maxLon(static_cast<T>(g.longitude)) {}
+
+    /// Rectángulo vacío: no corta a nada y expand() lo sustituye por el otro.
+    static BasicRect empty() {
+        constexpr T hi = std::numeric_limits<T>::max();
+        return BasicRect(hi, hi, std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest());
+    }
+
+    void expand(const BasicRect& r) {
+        minLat = std::min(minLat, r.minLat);
+        minLon = std::min(minLon, r.minLon);
+        maxLat = std::max(maxLat, r.maxLat);
+        maxLon = std::max(maxLon, r.maxLon);
+    }
+    bool contains(const T lat, const T lon) const {
+        return lat >= minLat && lat <= maxLat && lon >= minLon && lon <= maxLon;
+    }
+    bool contains(const Geoname& g) const {
+        return g.latitude >= minLat && g.latitude <= maxLat &&
+               g.longitude >= minLon && g.longitude <= maxLon;
+    }
+    /// r entero dentro (bordes incluidos).
+    bool contains(const BasicRect& r) const {
+        return r.minLat >= minLat && r.maxLat <= maxLat && r.minLon >= minLon && r.maxLon <= maxLon;
+    }
+    bool intersects(const BasicRect& r) const {
+        return !(r.minLat > maxLat || r.maxLat < minLat ||
+                 r.minLon > maxLon || r.maxLon < minLon);
+    }
+    double area() const {
+        return (static_cast<double>(maxLat) - minLat) * (static_cast<double>(maxLon) - minLon);
+    }
+    static BasicRect boundingRect(const std::vector<Geoname>& points) {
+        if (points.empty()) return BasicRect();
+        BasicRect r(points[0]);
+        for (const auto& g : points) r.expand(BasicRect(g));
+        return r;
+    }
+};
+
+using Rect = BasicRect<double>;
+
+// --- Redondeo de las consultas a Coord ---
+//
+// Para un valor x representable en Coord, x >= v <=> x >= coordAtLeast(v) y
+// x <= v <=> x <= coordAtMost(v). Así una ventana en double se compara contra
+// coordenadas float sin convertir cada punto y con el mismo resultado.
+
+template <typename Coord>
+inline Coord coordAtLeast(const double v) {
+    Coord c = static_cast<Coord>(v);
+    if (c < v) c = std::nextafter(c, std::numeric_limits<Coord>::infinity());
+    return c;
+}
+
+template <typename Coord>
+inline Coord coordAtMost(const double v) {
+    Coord c = static_cast<Coord>(v);
+    if (c > v) c = std::nextafter(c, -std::numeric_limits<Coord>::infinity());
+    return c;
+}
+
+/// Ventana en double redondeada hacia dentro a Coord (mismos puntos dentro).
+template <typename Coord>
+inline BasicRect<Coord> inwardRect(const double minLat, const double minLon,
+                                   const double maxLat, const double maxLon) {
+    return BasicRect<Coord>(coordAtLeast<Coord>(minLat), coordAtLeast<Coord>(minLon),
+                            coordAtMost<Coord>(maxLat), coordAtMost<Coord>(maxLon));
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Pool fijo de hilos para tareas independientes (particiones, franjas de un
+/// recorrido). parallelFor(n, fn) ejecuta fn(i) para cada i en [0, n) y espera:
+/// el hilo que llama también toma índices, así que un pool de un hilo ejecuta
+/// en serie y las llamadas anidadas desde una tarea no se bloquean.
+class ThreadPool {
+public:
+    /// threads = hilos que trabajan en cada parallelFor, contando el que llama
+    /// (0 = std::thread::hardware_concurrency()).
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned t = 1; t < threads; ++t) workers_.emplace_back([this] { work(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    /// fn(i) para i en [0, n), repartido entre los hilos. La primera excepción
+    /// de una tarea se relanza aquí cuando han terminado todas.
+    template <typename Fn>
+    void parallelFor(const size_t n, Fn&& fn) {
+        if (n == 0) return;
+        if (n == 1 || workers_.empty()) {
+            for (size_t i = 0; i < n; ++i) fn(i);
+            return;
+        }
+
+        // Los ayudantes que empiecen tarde solo encuentran el contador agotado,
+        // por eso el estado compartido vive en el heap.
+        struct Batch {
+            std::function<void(size_t)> fn;
+            size_t n;
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> finished{0};
+            std::mutex mutex;
+            std::condition_variable done;
+            std::exception_ptr error;
+        };
+        auto batch = std::make_shared<Batch>();
+        batch->fn = std::forward<Fn>(fn);
+        batch->n = n;
+
+        auto run = [](Batch& b) {
+            size_t ran = 0;
+            for (size_t i; (i = b.next.fetch_add(1)) < b.n; ++ran) {
+                try {
+                    b.fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(b.mutex);
+                    if (!b.error) b.error = std::current_exception();
+                }
+            }
+            if (ran && b.finished.fetch_add(ran) + ran == b.n) {
+                std::lock_guard<std::mutex> lock(b.mutex);
+                b.done.notify_all();
+            }
+        };
+
+        const size_t helpers = std::min(workers_.size(), n - 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t h = 0; h < helpers; ++h) tasks_.emplace_back([batch, run] { run(*batch); });
+        }
+        wake_.notify_all();
+
+        run(*batch);
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait(lock, [&] { return batch->finished.load() == n; });
+        if (batch->error) std::rethrow_exception(batch->error);
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Geoname.hpp"
+#include "Hilbert.hpp"
+#include "Index.hpp"
+#include "Rect.hpp"
+#include "ThreadPool.hpp"
+#include "WebMercator.hpp"
+
+// --- Pirámide de teselas z/x/y ---
+//
+// writeTileArchive recorre un índice en memoria de zoom en zoom y guarda en un
+// único fichero todas las teselas no vacías, listo para servirse con mmap sin
+// calcular nada por petición. Solo se bajan los hijos de las teselas con
+// puntos, así que el coste depende de los datos y no de 4^maxZoom.
+//
+// Fichero (enteros little-endian):
+//   cabecera   "SPTILES1", minZoom u32, maxZoom u32, extent u32, 0 u32,
+//              número de teselas u64, offset del directorio u64
+//   teselas    una tras otra, en orden de tileId
+//   directorio por tesela: tileId u64, offset u64, longitud u64, ordenado
+//
+// tileId numera las teselas de zoom en zoom y, dentro de cada zoom, en el
+// orden de la curva de Hilbert: las teselas vecinas quedan cerca en el fichero.
+//
+// Tesela: varint con los puntos que caen en ella, varint con los que lleva
+// (como mucho featureCap, repartidos por igual si hay más) y por punto las
+// diferencias en zigzag de x e y respecto al anterior (coordenadas de 0 a
+// extent dentro de la tesela, ordenadas por fila) y el geonameId en zigzag.
+
+struct TileOptions {
+    int minZoom = 0;
+    int maxZoom = 10;
+    size_t featureCap = 4096; // puntos como mucho por tesela
+    uint32_t extent = 4096;   // resolución de las coordenadas dentro de la tesela
+    unsigned threads = 0;     // 0 = un hilo por núcleo
+};
+
+struct TileStats {
+    size_t tiles = 0;
+    size_t features = 0;
+    uint64_t bytes = 0; // tamaño del fichero
+};
+
+/// Id de la tesela: teselas de los zooms anteriores + posición de Hilbert.
+inline uint64_t tileId(const int z, const uint32_t x, const uint32_t y) {
+    const uint64_t before = ((uint64_t(1) << (2 * z)) - 1) / 3; // 4^0 + ... + 4^(z-1)
+    return before + hilbertIndex(x, y, static_cast<unsigned>(z));
+}
+
+/// Ventana lat/lon de la tesela. Las filas del borde llegan hasta los polos,
+/// que Web Mercator no representa.
+inline Rect tileBounds(const int z, const uint32_t x, const uint32_t y) {
+    const double n = static_cast<double>(uint64_t(1) << z);
+    const double maxLat = y == 0 ? 90.0 : mercatorLat(y / n);
+    const double minLat = y + 1 == n ? -90.0 : mercatorLat((y + 1) / n);
+    return Rect(minLat, mercatorLon(x / n), maxLat, mercatorLon((x + 1) / n));
+}
+
+inline void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t getVarint(const std::string_view data, size_t& pos) {
+    uint64_t v = 0;
+    for (int shift = 0; pos < data.size() && shift < 64; shift += 7) {
+        const auto b = static_cast<uint8_t>(data[pos++]);
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    throw std::runtime_error("tesela corrupta");
+}
+
+inline uint64_t zigzagEncode(const int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+inline int64_t zigzagDecode(const uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/// Entrada del directorio del fichero de teselas.
+struct TileDirEntry {
+    uint64_t id, offset, length;
+};
+
+static constexpr char TILE_ARCHIVE_MAGIC[8] = {'S', 'P', 'T', 'I', 'L', 'E', 'S', '1'};
+static constexpr size_t TILE_ARCHIVE_HEADER = 8 + 4 * 4 + 2 * 8;
+
+/// Codifica una tesela con los puntos dados (ya recortados a featureCap).
+inline std::string encodeTile(const int z, const uint32_t x, const uint32_t y, const uint32_t extent,
+                              const size_t total, const std::vector<Geoname>& points) {
+    const double n = static_cast<double>(uint64_t(1) << z);
+    struct Feature {
+        int64_t x, y;
+        long id;
+    };
+    std::vector<Feature> features;
+    features.reserve(points.size());
+    for (const auto& g : points) {
+        auto local = [&](const double v, const uint32_t origin) {
+            return std::clamp<int64_t>(std::llround((v * n - origin) * extent), 0, extent);
+        };
+        features.push_back({local(mercatorX(g.longitude), x), local(mercatorY(g.latitude), y), g.geonameId});
+    }
+    std::sort(features.begin(), features.end(),
+              [](const Feature& a, const Feature& b) { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+
+    std::string out;
+    putVarint(out, total);
+    putVarint(out, features.size());
+    int64_t px = 0, py = 0;
+    for (const auto& f : features) {
+        putVarint(out, zigzagEncode(f.x - px));
+        putVarint(out, zigzagEncode(f.y - py));
+        putVarint(out, zigzagEncode(f.id));
+        px = f.x;
+        py = f.y;
+    }
+    return out;
+}
+
+/// Puntos de una tesela, con las coordenadas redondeadas a su rejilla de
+/// extent × extent. `total` recibe los puntos que caían en ella.
+inline std::vector<Geoname> decodeTile(const std::string_view data, const int z, const uint32_t x, const uint32_t y,
+                                       const uint32_t extent, size_t* total = nullptr) {
+    size_t pos = 0;
+    const uint64_t all = getVarint(data, pos);
+    if (total) *total = all;
+    const uint64_t count = getVarint(data, pos);
+    const double n = static_cast<double>(uint64_t(1) << z);
+    std::vector<Geoname> points;
+    points.reserve(count);
+    int64_t px = 0, py = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        px += zigzagDecode(getVarint(data, pos));
+        py += zigzagDecode(getVarint(data, pos));
+        Geoname g(mercatorLat((y + static_cast<double>(py) / extent) / n),
+                  mercatorLon((x + static_cast<double>(px) / extent) / n));
+        g.geonameId = static_cast<long>(zigzagDecode(getVarint(data, pos)));
+        points.push_back(g);
+    }
+    return points;
+}
+
+/// Genera la pirámide de minZoom a maxZoom a partir de `index` (ya construido)
+/// y la escribe en `path`. Las teselas de cada zoom se calculan en paralelo;
+/// el índice solo recibe consultas, que pueden ir a la vez.
+inline TileStats writeTileArchive(Index& index, const std::string& path, const TileOptions& options = TileOptions()) {
+    if (options.minZoom < 0 || options.maxZoom < options.minZoom || options.maxZoom > 28)
+        throw std::invalid_argument("writeTileArchive: zooms fuera de [0, 28]");
+    if (options.featureCap == 0 || options.extent == 0)
+        throw std::invalid_argument("writeTileArchive: featureCap y extent deben ser > 0");
+
+    // Se escribe aparte y se renombra: quien tenga abierto el fichero anterior
+    // con TileArchive sigue viéndolo entero
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("writeTileArchive: no se puede crear " + tmp);
+    auto putRaw = [&out](const auto& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    out.write(std::string(TILE_ARCHIVE_HEADER, '\0').data(), TILE_ARCHIVE_HEADER);
+
+    ThreadPool pool(options.threads);
+    TileStats stats;
+    std::vector<TileDirEntry> directory;
+    uint64_t offset = TILE_ARCHIVE_HEADER;
+    struct TileRef {
+        uint32_t x, y;
+        uint64_t id;
+    };
+    std::vector<TileRef> level{{0, 0, 0}};
+    for (int z = 0; z <= options.maxZoom && !level.empty(); ++z) {
+        for (auto& t : level) t.id = tileId(z, t.x, t.y);
+        std::sort(level.begin(), level.end(), [](const TileRef& a, const TileRef& b) { return a.id < b.id; });
+
+        // Puntos de cada tesela; con más de featureCap se toma uno de cada `stride`
+        const bool emit = z >= options.minZoom;
+        std::vector<size_t> totals(level.size());
+        std::vector<std::string> blobs(emit ? level.size() : 0);
+        std::vector<size_t> kept(level.size());
+        pool.parallelFor(level.size(), [&](const size_t i) {
+            const Rect w = tileBounds(z, level[i].x, level[i].y);
+            totals[i] = index.countQuery(w.minLat, w.minLon, w.maxLat, w.maxLon);
+            if (!emit || totals[i] == 0) return;
+            const size_t stride = (totals[i] + options.featureCap - 1) / options.featureCap;
+            std::vector<Geoname> points;
+            size_t seen = 0;
+            index.rangeQueryEach(w.minLat, w.minLon, w.maxLat, w.maxLon, QueryOptions(), [&](const Geoname& g) {
+                if (seen++ % stride == 0) points.push_back(g);
+                return true;
+            });
+            kept[i] = points.size();
+            blobs[i] = encodeTile(z, level[i].x, level[i].y, options.extent, totals[i], points);
+        });
+
+        std::vector<TileRef> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            if (totals[i] == 0) continue;
+            if (emit) {
+                out.write(blobs[i].data(), static_cast<std::streamsize>(blobs[i].size()));
+                directory.push_back({level[i].id, offset, blobs[i].size()});
+                offset += blobs[i].size();
+                stats.features += kept[i];
+            }
+            if (z < options.maxZoom) {
+                for (uint32_t d = 0; d < 4; ++d) next.push_back({2 * level[i].x + (d & 1), 2 * level[i].y + (d >> 1), 0});
+            }
+        }
+        level.swap(next);
+    }
+
+    for (const auto& e : directory) {
+        putRaw(e.id);
+        putRaw(e.offset);
+        putRaw(e.length);
+    }
+    out.seekp(0);
+    out.write(TILE_ARCHIVE_MAGIC, sizeof(TILE_ARCHIVE_MAGIC));
+    putRaw(static_cast<uint32_t>(options.minZoom));
+    putRaw(static_cast<uint32_t>(options.maxZoom));
+    putRaw(options.extent);
+    putRaw(uint32_t(0));
+    putRaw(static_cast<uint64_t>(directory.size()));
+    putRaw(offset);
+    out.close();
+    if (!out) throw std::runtime_error("writeTileArchive: error al escribir " + tmp);
+    std::filesystem::rename(tmp, path);
+
+    stats.tiles = directory.size();
+    stats.bytes = offset + directory.size() * sizeof(TileDirEntry);
+    return stats;
+}
+
+/// Fichero de teselas proyectado en memoria: tile() devuelve una vista a los
+/// bytes de la tesela sin copiarlos, válida mientras viva el objeto.
+class TileArchive {
+public:
+    explicit TileArchive(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) throw std::runtime_error("TileArchive: no se puede abrir " + path);
+        struct stat st {};
+        if (::fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < TILE_ARCHIVE_HEADER) {
+            ::close(fd_);
+            throw std::runtime_error("TileArchive: " + path + " no es un fichero de teselas");
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* base = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (base == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("TileArchive: mmap de " + path + " fallido");
+        }
+        data_ = static_cast<const char*>(base);
+
+        uint32_t fields[4];
+        uint64_t count = 0, dirOffset = 0;
+        std::memcpy(fields, data_ + 8, sizeof(fields));
+        std::memcpy(&count, data_ + 24, sizeof(count));
+        std::memcpy(&dirOffset, data_ + 32, sizeof(dirOffset));
+        if (std::memcmp(data_, TILE_ARCHIVE_MAGIC, sizeof(TILE_ARCHIVE_MAGIC)) != 0 || dirOffset + count * sizeof(TileDirEntry) > size_) {
+            unmap();
+            throw std::runtime_error("TileArchive: " + path + " no es un fichero de teselas");
+        }
+        minZoom_ = static_cast<int>(fields[0]);
+        maxZoom_ = static_cast<int>(fields[1]);
+        extent_ = fields[2];
+        count_ = count;
+        directory_ = data_ + dirOffset;
+    }
+
+    TileArchive(const TileArchive&) = delete;
+    TileArchive& operator=(const TileArchive&) = delete;
+    ~TileArchive() { unmap(); }
+
+    /// Bytes de la tesela z/x/y; vacío si no tiene puntos o está fuera de rango.
+    std::string_view tile(const int z, const uint32_t x, const uint32_t y) const {
+        if (z < minZoom_ || z > maxZoom_ || x >> z || y >> z) return {};
+        const uint64_t id = tileId(z, x, y);
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            const auto e = entry(mid);
+            if (e.id == id) return std::string_view(data_ + e.offset, e.length);
+            if (e.id < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return {};
+    }
+
+    std::vector<Geoname> points(const int z, const uint32_t x, const uint32_t y) const {
+        const auto data = tile(z, x, y);
+        return data.empty() ? std::vector<Geoname>() : decodeTile(data, z, x, y, extent_);
+    }
+
+    size_t tileCount() const { return count_; }
+    int minZoom() const { return minZoom_; }
+    int maxZoom() const { return maxZoom_; }
+    uint32_t extent() const { return extent_; }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    const char* directory_ = nullptr;
+    size_t count_ = 0;
+    int minZoom_ = 0, maxZoom_ = 0;
+    uint32_t extent_ = 0;
+
+    TileDirEntry entry(const size_t i) const {
+        TileDirEntry e;
+        std::memcpy(&e, directory_ + i * sizeof(e), sizeof(e));
+        return e;
+    }
+
+    void unmap() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        data_ = nullptr;
+        fd_ = -1;
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// --- Web Mercator ---
+//
+// Coordenadas normalizadas del mapa web: x en [0, 1] de oeste a este e y en
+// [0, 1] de norte a sur, como las teselas z/x/y. En el zoom z el mapa mide
+// 2^z teselas de lado.
+
+static constexpr double MERCATOR_MAX_LAT = 85.05112877980659;
+
+inline double mercatorX(const double lon) {
+    return std::clamp((lon + 180.0) / 360.0, 0.0, 1.0);
+}
+
+inline double mercatorY(const double lat) {
+    const double s = std::sin(std::clamp(lat, -MERCATOR_MAX_LAT, MERCATOR_MAX_LAT) * M_PI / 180.0);
+    return std::clamp(0.5 - std::log((1.0 + s) / (1.0 - s)) / (4.0 * M_PI), 0.0, 1.0);
+}
+
+inline double mercatorLon(const double x) { return x * 360.0 - 180.0; }
+
+inline double mercatorLat(const double y) {
+    return std::atan(std::sinh(M_PI * (1.0 - 2.0 * y))) * 180.0 / M_PI;
+}
+
+/// Fila o columna de una rejilla de `cells` de lado que contiene la
+/// coordenada normalizada v (el borde 1.0 cae en la última).
+inline uint32_t mercatorCell(const double v, const uint64_t cells) {
+    return static_cast<uint32_t>(std::min<double>(std::floor(v * static_cast<double>(cells)),
+                                                  static_cast<double>(cells - 1)));
+}
@@ -1,71 +1,472 @@
-#include <iostream>
-#include <vector>
-#include <queue>
-#include <limits>
-#include <algorithm>
+// Benchmark de RTreeIndex, GridIndex y DiskRTreeIndex.
+//
+//   c++ -O3 -march=native -std=c++17 -pthread -Isrc src/main.cpp -o spatial_bench
+//   ./spatial_bench [opciones] > resultados.json
+//
+// Opciones (valores por defecto entre corchetes):
+//   --sizes 1e4,1e5,1e6          tamaños de los conjuntos, de 1e4 a 1e8
+//   --datasets uniform,clustered,geonames
+//   --geonames FICHERO           volcado de GeoNames o CSV "lat,lon" para "geonames"
+//                                [sin fichero: sintético tipo GeoNames]
+//   --indexes rtree,grid,disk     también rtree-f32 y grid-f32 (coordenadas float,
+//                                R-tree con grado fijo 32) y partitioned (particiones
+//                                STR, 4 por núcleo, con un R-tree en cada una)
+//   --queries N                  consultas por carga de trabajo [1000]
+//   --format json|csv            [json]
+//   --out FICHERO                [salida estándar]
+//   --seed N                     [42]
+//   --disk-dir DIR               directorio temporal del índice en disco [spatial_bench_idx]
+//   --disk-cache N               páginas/nodos en caché del índice en disco [4096]
+//   --disk-max N                 no construye el índice en disco por encima de N puntos [1e6]
+//
+// Cargas: construcción (tiempo y memoria), rango con selectividad 1e-4..1e-2
+// (ventanas centradas en puntos del conjunto), kNN con k = 1, 10, 100, radio de
+// 1, 10 y 100 km y un join por distancia (10 km) contra otro conjunto de la
+// misma distribución. El índice en disco se mide en frío (cachés vaciadas
+// antes de cada consulta, tras reabrirlo) y en caliente (segunda pasada).
+// Los tiempos de cada consulta van a un LatencyHistogram; el progreso sale por stderr.
+
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
-#include <ctime>
-#include <cassert>
-#include <set>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "Datasets.hpp"
+#include "DiskRTree.hpp"
 #include "GridIndex.hpp"
 #include "Index.hpp"
+#include "PartitionedIndex.hpp"
+#include "QueryProfile.hpp"
 #include "RTree.hpp"
 
-int main() {
-    // 1. Definir un conjunto de puntos de ejemplo
-   std::vector<Geoname> puntos = {
-    {-6.3577f, -78.7999f},
-    {-6.3930f, -78.7987f},
-    {-6.45528f, -78.799f},
-    {-6.6852f, -78.8024f},
-    {-6.70405f, -78.7988f},
-    {-7.10162f, -78.801f},
-    {-7.08333f, -78.8f},
-    {-7.07332f, -78.8004f},
-    {-6.90934f, -78.8156f}
-    // {6.5f, 2.5f},
-    // {8.0f, 8.0f},
-    // {9.1f, 3.3f},
-    // {10.0f, 5.0f},
-    // {7.3f, 6.6f}
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig {
+    std::vector<size_t> sizes{10'000, 100'000, 1'000'000};
+    std::vector<std::string> datasets{"uniform", "clustered", "geonames"};
+    std::vector<std::string> indexes{"rtree", "grid", "disk"};
+    std::string geonamesPath;
+    size_t queries = 1000;
+    std::string format = "json";
+    std::string out;
+    uint64_t seed = 42;
+    std::string diskDir = "spatial_bench_idx";
+    size_t diskCache = 4096;
+    size_t diskMax = 1'000'000;
+};
+
+/// Una fila de resultados. Los campos que no aplican a la operación quedan a 0 / "".
+struct BenchRecord {
+    std::string dataset;
+    size_t n = 0;
+    std::string index;
+    std::string op;     // build, range, knn, radius, join
+    std::string param;  // sel=0.001, k=10, r=10000, eps=10000
+    std::string cache;  // cold / warm (solo disk)
+    size_t queries = 0;
+    double totalMs = 0;
+    double meanUs = 0, p50Us = 0, p99Us = 0, maxUs = 0;
+    double resultsMean = 0;
+    double selectivity = 0;
+    size_t memoryBytes = 0;
+    size_t diskBytes = 0;
+    long rssDeltaBytes = 0;
 };
 
+// --- Memoria ---
+
+/// RSS actual en bytes (Linux; 0 si no hay /proc).
+static long residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * 4096;
+}
+
+static size_t directoryBytes(const std::string& dir) {
+    size_t total = 0;
+    std::error_code ec;
+    for (const auto& e : std::filesystem::recursive_directory_iterator(dir, ec))
+        if (e.is_regular_file(ec)) total += e.file_size(ec);
+    return total;
+}
+
+// --- Adaptadores: mismas consultas sobre Index y DiskRTreeIndex ---
+
+class BenchTarget {
+public:
+    virtual ~BenchTarget() = default;
+    virtual size_t range(const Rect& w) = 0;
+    virtual size_t knn(const Geoname& q, int k) = 0;
+    virtual size_t radius(const Geoname& q, double meters) = 0;
+    /// Se llama antes de cada consulta en las pasadas en frío.
+    virtual void dropCaches() {}
+};
+
+class MemoryTarget : public BenchTarget {
+public:
+    explicit MemoryTarget(Index& index) : index_(index) {}
+    size_t range(const Rect& w) override {
+        return index_.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon).size();
+    }
+    size_t knn(const Geoname& q, const int k) override { return index_.kNN(q, k).size(); }
+    size_t radius(const Geoname& q, const double meters) override {
+        return index_.radiusQuery(q.latitude, q.longitude, meters).size();
+    }
+
+private:
+    Index& index_;
+};
+
+class DiskTarget : public BenchTarget {
+public:
+    explicit DiskTarget(DiskRTreeIndex& index) : index_(index) {}
+    size_t range(const Rect& w) override {
+        return index_.rangeQuery2D(Rectangle(w.minLat, w.minLon, w.maxLat, w.maxLon)).size();
+    }
+    size_t knn(const Geoname& q, const int k) override {
+        return index_.knnQuery2DGeo(Point2D(q.latitude, q.longitude), k).size();
+    }
+    size_t radius(const Geoname& q, const double meters) override {
+        return index_.radiusQuery(Point2D(q.latitude, q.longitude), meters).size();
+    }
+    void dropCaches() override { index_.dropCaches(); }
+
+private:
+    DiskRTreeIndex& index_;
+};
+
+// --- Cargas de trabajo ---
+
+struct Workload {
+    std::vector<std::pair<double, std::vector<Rect>>> ranges; // (selectividad objetivo, ventanas)
+    std::vector<Geoname> points;                              // centros de kNN y radio
+    std::vector<Geoname> joinOuter;                           // lado externo del join
+};
+
+static Workload makeWorkload(const std::vector<Geoname>& pts, std::vector<Geoname> joinOuter,
+                             const BenchConfig& cfg, std::mt19937_64& rng) {
+    Workload w;
+    w.joinOuter = std::move(joinOuter);
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+    for (const auto& p : pts) {
+        minLat = std::min(minLat, p.latitude);
+        maxLat = std::max(maxLat, p.latitude);
+        minLon = std::min(minLon, p.longitude);
+        maxLon = std::max(maxLon, p.longitude);
+    }
+    const double area = std::max(1e-9, (maxLat - minLat) * (maxLon - minLon));
+    std::uniform_int_distribution<size_t> pick(0, pts.size() - 1);
+
+    // Ventana cuadrada con área = selectividad × área del conjunto; en datos no
+    // uniformes la selectividad real se mide y se informa aparte.
+    for (const double sel : {1e-4, 1e-3, 1e-2}) {
+        const double half = std::sqrt(sel * area) / 2;
+        std::vector<Rect> windows(cfg.queries);
+        for (auto& r : windows) {
+            const auto& c = pts[pick(rng)];
+            r = Rect(c.latitude - half, c.longitude - half, c.latitude + half, c.longitude + half);
+        }
+        w.ranges.emplace_back(sel, std::move(windows));
+    }
 
-/*
+    std::normal_distribution<double> jitter(0, 0.01);
+    w.points.resize(cfg.queries);
+    for (auto& q : w.points) {
+        q = pts[pick(rng)];
+        q.latitude = std::clamp(q.latitude + jitter(rng), -90.0, 90.0);
+        q.longitude = std::clamp(q.longitude + jitter(rng), -180.0, 180.0);
+    }
+    return w;
+}
 
+/// Ejecuta fn(i) para cada consulta y devuelve el registro con latencias y
+/// número medio de resultados.
+static BenchRecord timeQueries(const size_t count, const bool cold, BenchTarget& target,
+                               const std::function<size_t(size_t)>& fn) {
+    BenchRecord r;
+    LatencyHistogram hist;
+    size_t results = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (cold) target.dropCaches();
+        const auto start = ProfileClock::now();
+        results += fn(i);
+        hist.record(elapsedNs(start));
+    }
+    r.queries = count;
+    r.meanUs = hist.mean() / 1e3;
+    r.p50Us = hist.percentile(0.5) / 1e3;
+    r.p99Us = hist.percentile(0.99) / 1e3;
+    r.maxUs = hist.max() / 1e3;
+    r.resultsMean = count ? static_cast<double>(results) / count : 0;
+    return r;
+}
 
-6. 13261340 El Chito [-6.70405, -78.7988]
-7. 13239333 El Ingenio [-7.10162, -78.801]
-8. 3694056 Paloblanco [-7.08333, -78.8]
-9. 3699079 Cajaquis [-7.08333, -78.8]
-10. 13239916 Dos de Mayo [-7.07332, -78.8004]
-11. 13261346 El Convento [-6.90934, -78.8156]
+static void runQueries(BenchTarget& target, const Workload& w, const BenchRecord& base, const size_t n,
+                       const std::string& cache, std::vector<BenchRecord>& out) {
+    const bool cold = cache == "cold";
+    auto emit = [&](BenchRecord r, const std::string& op, const std::string& param) {
+        r.dataset = base.dataset;
+        r.n = base.n;
+        r.index = base.index;
+        r.op = op;
+        r.param = param;
+        r.cache = cache;
+        std::cerr << "  " << base.index << (cache.empty() ? "" : " " + cache) << " " << op << " " << param
+                  << ": " << std::fixed << std::setprecision(1) << r.meanUs << " us\n";
+        out.push_back(std::move(r));
+    };
 
-*/
+    for (const auto& [sel, windows] : w.ranges) {
+        auto r = timeQueries(windows.size(), cold, target, [&](size_t i) { return target.range(windows[i]); });
+        r.selectivity = n ? r.resultsMean / n : 0;
+        std::ostringstream param;
+        param << "sel=" << sel;
+        emit(r, "range", param.str());
+    }
+    for (const int k : {1, 10, 100}) {
+        emit(timeQueries(w.points.size(), cold, target, [&](size_t i) { return target.knn(w.points[i], k); }),
+             "knn", "k=" + std::to_string(k));
+    }
+    for (const double meters : {1'000.0, 10'000.0, 100'000.0}) {
+        emit(timeQueries(w.points.size(), cold, target,
+                         [&](size_t i) { return target.radius(w.points[i], meters); }),
+             "radius", "r=" + std::to_string(static_cast<long>(meters)));
+    }
 
-    // 2. Inicializar el RTree con un máximo de 4 entradas por nodo
-    RTreeIndex rtree(4);
+    // Join por distancia: index nested loop, una consulta de radio por punto externo.
+    constexpr double JOIN_EPS = 10'000.0;
+    auto join = timeQueries(w.joinOuter.size(), cold, target,
+                            [&](size_t i) { return target.radius(w.joinOuter[i], JOIN_EPS); });
+    join.totalMs = join.meanUs * join.queries / 1e3;
+    emit(join, "join", "eps=" + std::to_string(static_cast<long>(JOIN_EPS)));
+}
 
-    // 3. Construir el árbol usando bulk-load STR
-    rtree.build(puntos);
+// --- Índices ---
 
+static void benchMemoryIndex(const std::string& name, const std::vector<Geoname>& pts, const Workload& w,
+                             BenchRecord base, std::vector<BenchRecord>& out) {
+    base.index = name;
+    std::unique_ptr<Index> index;
+    // ~64 puntos por celda con datos uniformes
+    const auto side = std::max<size_t>(10, static_cast<size_t>(std::sqrt(pts.size() / 64.0)));
+    if (name == "rtree") {
+        index = std::make_unique<RTreeIndex>(16);
+    } else if (name == "rtree-f32") {
+        index = std::make_unique<BasicRTreeIndex<float, 32>>();
+    } else if (name == "grid-f32") {
+        index = std::make_unique<BasicGridIndex<float>>(side, side);
+    } else if (name == "partitioned") {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        index = std::make_unique<PartitionedIndex>([] { return std::make_unique<RTreeIndex>(16); },
+                                                   PartitionScheme::STR, 4 * cores);
+    } else {
+        index = std::make_unique<GridIndex>(side, side);
+    }
 
-    // 5. Probar k-NN
-    float qx = -6.9092f, qy = -78.7987f;
-    int k = 10;
-    Geoname query{qx, qy};
-    std::cout << "Consulta k-NN para punto (" << qx << "," << qy << "), k=" << k << "\n";
-    auto vecinos = rtree.kNN(query, k);
+    const long rss0 = residentBytes();
+    const auto start = Clock::now();
+    index->build(pts);
+    BenchRecord build = base;
+    build.op = "build";
+    build.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    build.memoryBytes = index->memoryUsage();
+    build.rssDeltaBytes = residentBytes() - rss0;
+    std::cerr << "  " << name << " build: " << std::fixed << std::setprecision(1) << build.totalMs << " ms\n";
+    out.push_back(build);
 
-    std::cout << "Los " << k << " vecinos mas cercanos son:\n";
-    for (int i = 0; i < vecinos.size(); ++i) {
-        std::cout << "  " << i+1 << ": ("
-                  << vecinos[i].latitude << ", " << vecinos[i].longitude << ")\n";
+    MemoryTarget target(*index);
+    runQueries(target, w, base, pts.size(), "", out);
+}
+
+static void benchDiskIndex(const std::vector<Geoname>& pts, const Workload& w, BenchRecord base,
+                           const BenchConfig& cfg, std::vector<BenchRecord>& out) {
+    base.index = "disk";
+    std::filesystem::remove_all(cfg.diskDir);
+
+    const long rss0 = residentBytes();
+    BenchRecord build = base;
+    build.op = "build";
+    {
+        const auto start = Clock::now();
+        DiskRTreeIndex index(cfg.diskDir, cfg.diskCache);
+        for (const auto& p : pts) index.insert2D(Point2D(p.latitude, p.longitude));
+        index.flush();
+        build.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        build.rssDeltaBytes = residentBytes() - rss0;
     }
+    build.diskBytes = directoryBytes(cfg.diskDir);
+    std::cerr << "  disk build: " << std::fixed << std::setprecision(1) << build.totalMs << " ms\n";
+    out.push_back(build);
+
+    // Reabierto solo la raíz está en memoria; el resto se lee bajo demanda.
+    DiskRTreeIndex index(cfg.diskDir, cfg.diskCache);
+    DiskTarget target(index);
+    runQueries(target, w, base, pts.size(), "cold", out);
+    runQueries(target, w, base, pts.size(), "warm", out);
+}
+
+// --- Salida ---
 
+static std::string jsonEscape(const std::string& s) {
+    std::string r;
+    for (const char c : s) {
+        if (c == '"' || c == '\\') r += '\\';
+        r += c;
+    }
+    return r;
+}
+
+static void writeJson(std::ostream& os, const BenchConfig& cfg, const std::vector<BenchRecord>& records) {
+    os << "{\n  \"meta\": {\"seed\": " << cfg.seed << ", \"queries\": " << cfg.queries
+       << ", \"compiler\": \"" << jsonEscape(__VERSION__) << "\"},\n  \"results\": [\n";
+    os << std::setprecision(6) << std::defaultfloat;
+    for (size_t i = 0; i < records.size(); ++i) {
+        const auto& r = records[i];
+        os << "    {\"dataset\": \"" << r.dataset << "\", \"n\": " << r.n << ", \"index\": \"" << r.index
+           << "\", \"op\": \"" << r.op << "\", \"param\": \"" << r.param << "\", \"cache\": \"" << r.cache
+           << "\", \"queries\": " << r.queries << ", \"total_ms\": " << r.totalMs
+           << ", \"mean_us\": " << r.meanUs << ", \"p50_us\": " << r.p50Us << ", \"p99_us\": " << r.p99Us
+           << ", \"max_us\": " << r.maxUs << ", \"results_mean\": " << r.resultsMean
+           << ", \"selectivity\": " << r.selectivity << ", \"memory_bytes\": " << r.memoryBytes
+           << ", \"disk_bytes\": " << r.diskBytes << ", \"rss_delta_bytes\": " << r.rssDeltaBytes << "}"
+           << (i + 1 < records.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
 
+static void writeCsv(std::ostream& os, const std::vector<BenchRecord>& records) {
+    os << "dataset,n,index,op,param,cache,queries,total_ms,mean_us,p50_us,p99_us,max_us,results_mean,"
+          "selectivity,memory_bytes,disk_bytes,rss_delta_bytes\n";
+    os << std::setprecision(6) << std::defaultfloat;
+    for (const auto& r : records) {
+        os << r.dataset << ',' << r.n << ',' << r.index << ',' << r.op << ',' << r.param << ',' << r.cache << ','
+           << r.queries << ',' << r.totalMs << ',' << r.meanUs << ',' << r.p50Us << ',' << r.p99Us << ','
+           << r.maxUs << ',' << r.resultsMean << ',' << r.selectivity << ',' << r.memoryBytes << ','
+           << r.diskBytes << ',' << r.rssDeltaBytes << '\n';
+    }
+}
+
+// --- Línea de órdenes ---
+
+static std::vector<std::string> splitList(const std::string& s) {
+    std::vector<std::string> items;
+    std::istringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+/// Admite notación científica: "1e6" == 1000000.
+static size_t parseCount(const std::string& s) {
+    return static_cast<size_t>(std::llround(std::stod(s)));
+}
+
+static bool parseArgs(const int argc, char** argv, BenchConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "falta el valor de " << arg << "\n";
+            return false;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (arg == "--sizes") {
+                cfg.sizes.clear();
+                for (const auto& s : splitList(value)) cfg.sizes.push_back(parseCount(s));
+            } else if (arg == "--datasets") cfg.datasets = splitList(value);
+            else if (arg == "--indexes") cfg.indexes = splitList(value);
+            else if (arg == "--geonames") cfg.geonamesPath = value;
+            else if (arg == "--queries") cfg.queries = std::max<size_t>(1, parseCount(value));
+            else if (arg == "--format") cfg.format = value;
+            else if (arg == "--out") cfg.out = value;
+            else if (arg == "--seed") cfg.seed = std::stoull(value);
+            else if (arg == "--disk-dir") cfg.diskDir = value;
+            else if (arg == "--disk-cache") cfg.diskCache = parseCount(value);
+            else if (arg == "--disk-max") cfg.diskMax = parseCount(value);
+            else {
+                std::cerr << "opción desconocida: " << arg << "\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "valor inválido para " << arg << ": " << value << "\n";
+            return false;
+        }
+    }
+    if (cfg.format != "json" && cfg.format != "csv") {
+        std::cerr << "--format debe ser json o csv\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) {
+        std::cerr << "uso: " << argv[0] << " [--sizes 1e4,1e5] [--datasets uniform,clustered,geonames]"
+                  << " [--indexes rtree,grid,disk] [--queries N] [--format json|csv] [--out FICHERO]\n";
+        return 1;
+    }
+
+    std::vector<BenchRecord> records;
+    for (const auto& dataset : cfg.datasets) {
+        for (const size_t n : cfg.sizes) {
+            // Se generan n puntos más el lado externo del join (10 %, como mucho
+            // 100000), que así sigue la misma distribución sin estar en el índice.
+            std::mt19937_64 rng(cfg.seed);
+            const size_t outer = std::clamp<size_t>(n / 10, 1, 100'000);
+            auto pts = makeDataset(dataset, n + outer, rng, cfg.geonamesPath);
+            if (pts.size() < 2) {
+                std::cerr << "conjunto desconocido o vacío: " << dataset << "\n";
+                continue;
+            }
+            const size_t inner = std::max(pts.size() - outer, pts.size() / 2);
+            std::vector<Geoname> joinOuter(pts.begin() + inner, pts.end());
+            pts.resize(inner);
+            std::cerr << dataset << ", " << pts.size() << " puntos\n";
+            const Workload w = makeWorkload(pts, std::move(joinOuter), cfg, rng);
+
+            BenchRecord base;
+            base.dataset = dataset;
+            base.n = pts.size();
+            for (const auto& name : cfg.indexes) {
+                if (name == "rtree" || name == "grid" || name == "rtree-f32" || name == "grid-f32" ||
+                    name == "partitioned") {
+                    benchMemoryIndex(name, pts, w, base, records);
+                } else if (name == "disk") {
+                    if (pts.size() > cfg.diskMax) {
+                        std::cerr << "  disk: omitido (" << pts.size() << " > --disk-max " << cfg.diskMax << ")\n";
+                        continue;
+                    }
+                    benchDiskIndex(pts, w, base, cfg, records);
+                } else {
+                    std::cerr << "índice desconocido: " << name << "\n";
+                }
+            }
+        }
+    }
+    std::filesystem::remove_all(cfg.diskDir);
+
+    std::ofstream file;
+    if (!cfg.out.empty()) {
+        file.open(cfg.out);
+        if (!file) {
+            std::cerr << "no se puede escribir " << cfg.out << "\n";
+            return 1;
+        }
+    }
+    std::ostream& os = cfg.out.empty() ? std::cout : file;
+    if (cfg.format == "json") writeJson(os, cfg, records);
+    else writeCsv(os, records);
     return 0;
-}
\ No newline at end of file
+}
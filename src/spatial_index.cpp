@@ -13,9 +13,15 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "ClusterIndex.hpp"
 #include "GridIndex.hpp"
 #include "Index.hpp"
+#include "PartitionedIndex.hpp"
+#include "PlannedIndex.hpp"
 #include "RTree.hpp"
+#include "TileArchive.hpp"
+#include "QueryControlBindings.hpp"
+#include "QueryProfileBindings.hpp"
 
 typedef unsigned int  uint;
 typedef unsigned char uchar;
@@ -30,36 +36,244 @@ float distance2D(const Geoname& a, const Geoname& b) {
     return std::sqrt(dx * dx + dy * dy);
 }
 
+template <typename Tree>
+static void bindRTree(py::module_& m, const char* name, const int defaultDegree = Tree::fanout) {
+    py::class_<Tree, Index, std::shared_ptr<Tree>>(m, name)
+        .def(py::init([](int degree, const std::string& build) {
+                 return std::make_shared<Tree>(degree, Tree::parseBuildMode(build));
+             }),
+             py::arg("degree") = defaultDegree, py::arg("build") = "str")  // Constructor con grado y modo ("str" | "hilbert")
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&>(&Index::rebuild), py::arg("points"))  // Método build
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&, const std::vector<double>&>(&Index::rebuild),
+             py::arg("points"), py::arg("weights"))
+        .def("rangeQuery2D", &Tree::rangeQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon") )  // Método rangeQuery
+        .def("knnQuery2D", &Tree::kNN, py::arg("q"), py::arg("k"))
+        .def("rangeQuery2D", &Tree::rangeQueryWithPrefix, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"),
+             py::arg("maxLon"), py::arg("namePrefix"))
+        .def("knnQuery2D", &Tree::kNNWithPrefix, py::arg("q"), py::arg("k"), py::arg("namePrefix"))
+        .def("radiusQuery2D", &Tree::radiusQuery, py::arg("lat"), py::arg("lon"), py::arg("meters"))
+        .def("radiusQuery2DWithDistances", &Tree::radiusQueryWithDistances, py::arg("lat"), py::arg("lon"), py::arg("meters"))
+        .def("memoryUsage", &Tree::memoryUsage)
+        // Rangos con al menos minCandidates candidatos se reparten entre threads hilos
+        .def("setParallelScan",
+             [](Tree& self, unsigned threads, size_t minCandidates) { self.parallelScan().configure(threads, minCandidates); },
+             py::arg("threads") = 0, py::arg("minCandidates") = ParallelScan::DEFAULT_MIN_CANDIDATES)
+        .def_property_readonly("degree", &Tree::degree);
+}
+
+template <typename Grid>
+static void bindGrid(py::module_& m, const char* name) {
+    py::class_<Grid, Index, std::shared_ptr<Grid>>(m, name)
+        .def(py::init<int, int>(), py::arg("gx") = 10, py::arg("gy") = 10)
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&>(&Index::rebuild), py::arg("records"))
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&, const std::vector<double>&>(&Index::rebuild),
+             py::arg("records"), py::arg("weights"))
+        .def("rangeQuery2D", &Grid::rangeQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))  // Método rangeQuery
+        .def("knnQuery2D", &Grid::kNN, py::arg("q"), py::arg("k"))
+        .def("rangeQuery2D", &Grid::rangeQueryWithPrefix, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"),
+             py::arg("maxLon"), py::arg("namePrefix"))
+        .def("knnQuery2D", &Grid::kNNWithPrefix, py::arg("q"), py::arg("k"), py::arg("namePrefix"))
+        .def("radiusQuery2D", &Grid::radiusQuery, py::arg("lat"), py::arg("lon"), py::arg("meters"))
+        .def("radiusQuery2DWithDistances", &Grid::radiusQueryWithDistances, py::arg("lat"), py::arg("lon"), py::arg("meters"))
+        .def("memoryUsage", &Grid::memoryUsage)
+        // Rangos con al menos minCandidates candidatos se reparten entre threads hilos
+        .def("setParallelScan",
+             [](Grid& self, unsigned threads, size_t minCandidates) { self.parallelScan().configure(threads, minCandidates); },
+             py::arg("threads") = 0, py::arg("minCandidates") = ParallelScan::DEFAULT_MIN_CANDIDATES);
+}
+
 PYBIND11_MODULE(spatialcpp, m) {
     m.doc() = "Python bindings for RTree+ spatial index";
 
     // Punto 2D
     py::class_<Geoname>(m, "Point2D")
         .def(py::init<>())
-        .def(py::init<float, float>(), py::arg("x"), py::arg("y"))
+        .def(py::init<double, double>(), py::arg("x"), py::arg("y"))
         .def_readwrite("x", &Geoname::latitude)
         .def_readwrite("y", &Geoname::longitude)
+        .def_readwrite("id", &Geoname::geonameId)
+        .def_readwrite("name", &Geoname::name)
         .def("distance_to", &Geoname::distanceTo);
 
+    bindQueryControl(m);
+    bindQueryPage<Geoname>(m, "Point2DPage");
+    bindChunkIterator<Geoname>(m, "Point2DChunkIterator");
+    bindQueryProfile(m);
+
+    // count y suma de pesos de aggregateQuery
+    py::class_<Aggregate>(m, "Aggregate")
+        .def_readonly("count", &Aggregate::count)
+        .def_readonly("sum", &Aggregate::sum);
+
     // Index CLASE ABSTRACT
     
     py::class_<Index, std::shared_ptr<Index>>(m, "Index")
-        .def("insert2D", &Index::build)
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&>(&Index::rebuild))
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&, const std::vector<double>&>(&Index::rebuild),
+             py::arg("points"), py::arg("weights"))
+        .def("profiler", &Index::profiler, py::return_value_policy::reference_internal)
         .def("rangeQuery2D", &Index::rangeQuery)
-        .def("knnQuery2D", &Index::kNN);
+        .def("rangeQuery2DPage", &Index::rangeQueryPage, py::arg("minLat"), py::arg("minLon"),
+             py::arg("maxLat"), py::arg("maxLon"), py::arg("options"))
+        // for chunk in index.rangeQuery2DIter(...): chunk es una lista de hasta chunkSize puntos
+        .def("rangeQuery2DIter",
+             [](Index& self, double minLat, double minLon, double maxLat, double maxLon,
+                size_t chunkSize, const QueryOptions& options) {
+                 // Cada trozo corre sin el GIL y con el índice bloqueado para
+                 // insert2D; si se reconstruyó entre dos trozos, RuntimeError
+                 return ChunkIterator<Geoname>(
+                     [&self, generation = self.generation(), minLat, minLon, maxLat, maxLon](const QueryOptions& opts) {
+                         return self.resumeRangeQueryPage(generation, minLat, minLon, maxLat, maxLon, opts);
+                     },
+                     chunkSize, options);
+             },
+             py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"),
+             py::arg("chunkSize") = 4096, py::arg("options") = QueryOptions(), py::keep_alive<0, 1>())
+        // Lista de listas: el resultado de cada tarea de un rango repartido, sin juntar
+        .def("rangeQuery2DChunks",
+             [](Index& self, double minLat, double minLon, double maxLat, double maxLon) {
+                 return std::move(self.rangeQueryChunks(minLat, minLon, maxLat, maxLon).chunks);
+             },
+             py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))
+        .def("countQuery2D", &Index::countQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))
+        .def("aggregateQuery2D", &Index::aggregateQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))
+        .def("getById", &Index::getById, py::arg("id"))
+        .def("knnQuery2D", &Index::kNN)
+        // Con namePrefix: solo los puntos cuyo nombre empieza así (sin distinguir mayúsculas)
+        .def("rangeQuery2D", &Index::rangeQueryWithPrefix, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"),
+             py::arg("maxLon"), py::arg("namePrefix"))
+        .def("knnQuery2D", &Index::kNNWithPrefix, py::arg("q"), py::arg("k"), py::arg("namePrefix"))
+        .def("radiusQuery2D", &Index::radiusQuery)
+        .def("radiusQuery2DWithDistances", &Index::radiusQueryWithDistances);
 
-    py::class_<RTreeIndex, Index, std::shared_ptr<RTreeIndex>>(m, "RTree")
-        .def(py::init<int>(), py::arg("degree") = 8)  // Constructor con grado
-        .def("insert2D", &RTreeIndex::build, py::arg("points"))  // Método build
-        .def("rangeQuery2D", &RTreeIndex::rangeQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon") )  // Método rangeQuery
-        .def("knnQuery2D", &RTreeIndex::kNN, py::arg("q"), py::arg("k"));
+    // Configuraciones precompiladas (RTree.hpp / GridIndex.hpp). RTree y
+    // GridIndex son las originales (double, haversine); los sufijos F16/F32/F64
+    // usan float con el grado fijo en compilación, y Planar la métrica euclídea.
+    bindRTree<RTreeIndex>(m, "RTree", 8);
+    bindRTree<BasicRTreeIndex<float, 16>>(m, "RTreeF16");
+    bindRTree<BasicRTreeIndex<float, 32>>(m, "RTreeF32");
+    bindRTree<BasicRTreeIndex<float, 64>>(m, "RTreeF64");
+    bindRTree<BasicRTreeIndex<double, 0, PlanarMetric>>(m, "RTreePlanar", 16);
+    bindGrid<GridIndex>(m, "GridIndex");
+    bindGrid<BasicGridIndex<float>>(m, "GridIndexF32");
+    bindGrid<BasicGridIndex<double, PlanarMetric>>(m, "GridIndexPlanar");
 
-    py::class_<GridIndex, Index, std::shared_ptr<GridIndex>>(m, "GridIndex")
-        .def(py::init<int, int>(), py::arg("gx") = 10, py::arg("gy") = 10)
-        .def("insert2D", &GridIndex::build, py::arg("records"))  
-        .def("rangeQuery2D", &GridIndex::rangeQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))  // Método rangeQuery
-        .def("knnQuery2D", &GridIndex::kNN, py::arg("q"), py::arg("k"));
-        
+    // Índice particionado: local = "rtree" | "grid"; cada partición se
+    // construye y se consulta en paralelo (threads = 0: un hilo por núcleo)
+    py::class_<PartitionedIndex, Index, std::shared_ptr<PartitionedIndex>>(m, "PartitionedIndex")
+        .def(py::init([](const std::string& scheme, size_t partitions, const std::string& local, unsigned threads) {
+                 PartitionedIndex::LocalFactory make;
+                 if (local == "rtree") make = [] { return std::make_unique<RTreeIndex>(16); };
+                 else if (local == "grid") make = [] { return std::make_unique<GridIndex>(16, 16); };
+                 else throw std::invalid_argument("indice local desconocido: " + local);
+                 return std::make_shared<PartitionedIndex>(make, parsePartitionScheme(scheme), partitions, threads);
+             }),
+             py::arg("scheme") = "str", py::arg("partitions") = 16, py::arg("local") = "rtree", py::arg("threads") = 0)
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&>(&Index::rebuild), py::arg("points"))
+        .def("insert2D", py::overload_cast<const std::vector<Geoname>&, const std::vector<double>&>(&Index::rebuild),
+             py::arg("points"), py::arg("weights"))
+        .def("rangeQuery2D", &PartitionedIndex::rangeQuery, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("knnQuery2D", &PartitionedIndex::kNN, py::arg("q"), py::arg("k"), py::call_guard<py::gil_scoped_release>())
+        .def("rangeQuery2D", &PartitionedIndex::rangeQueryWithPrefix, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"),
+             py::arg("maxLon"), py::arg("namePrefix"), py::call_guard<py::gil_scoped_release>())
+        .def("knnQuery2D", &PartitionedIndex::kNNWithPrefix, py::arg("q"), py::arg("k"), py::arg("namePrefix"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("radiusQuery2D", &PartitionedIndex::radiusQuery, py::arg("lat"), py::arg("lon"), py::arg("meters"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("radiusQuery2DWithDistances", &PartitionedIndex::radiusQueryWithDistances, py::arg("lat"), py::arg("lon"), py::arg("meters"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("distanceJoin", &PartitionedIndex::distanceJoin, py::arg("outer"), py::arg("meters"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("memoryUsage", &PartitionedIndex::memoryUsage)
+        .def_property_readonly("partitions", &PartitionedIndex::partitionCount)
+        .def_property_readonly("threads", &PartitionedIndex::threads);
+
+    // Índice con planificador (PlannedIndex.hpp): cada rango va a la rejilla,
+    // al R-tree o al barrido según el histograma; plan() dice cuál y por qué
+    py::class_<PlannerCosts>(m, "PlannerCosts")
+        .def(py::init<>())
+        .def_readwrite("gridCell", &PlannerCosts::gridCell)
+        .def_readwrite("gridPoint", &PlannerCosts::gridPoint)
+        .def_readwrite("treeQuery", &PlannerCosts::treeQuery)
+        .def_readwrite("treePoint", &PlannerCosts::treePoint)
+        .def_readwrite("scanPoint", &PlannerCosts::scanPoint);
+
+    py::class_<RangePlan>(m, "RangePlan")
+        .def_readonly("plan", &RangePlan::plan)
+        .def_readonly("estimate", &RangePlan::estimate)
+        .def_readonly("gridCells", &RangePlan::gridCells)
+        .def_readonly("gridCandidates", &RangePlan::gridCandidates)
+        .def_readonly("gridCost", &RangePlan::gridCost)
+        .def_readonly("treeCost", &RangePlan::treeCost)
+        .def_readonly("scanCost", &RangePlan::scanCost)
+        .def_property_readonly("name", [](const RangePlan& p) { return queryPlanName(p.plan); });
+
+    py::class_<PlannedIndex, Index, std::shared_ptr<PlannedIndex>>(m, "PlannedIndex")
+        .def(py::init<int, size_t, PlannerCosts>(), py::arg("degree") = 16, py::arg("cellsPerSide") = 0,
+             py::arg("costs") = PlannerCosts())
+        .def("plan", &PlannedIndex::plan, py::arg("minLat"), py::arg("minLon"), py::arg("maxLat"), py::arg("maxLon"))
+        .def("planCount", &PlannedIndex::planCount, py::arg("plan"))
+        .def("setParallelScan", &PlannedIndex::setParallelScan, py::arg("threads") = 0,
+             py::arg("minCandidates") = ParallelScan::DEFAULT_MIN_CANDIDATES)
+        .def("memoryUsage", &PlannedIndex::memoryUsage);
+
+    // Agrupamiento por zoom para el mapa (ClusterIndex.hpp) sobre cualquier índice
+    py::class_<Cluster>(m, "Cluster")
+        .def_readonly("x", &Cluster::latitude)
+        .def_readonly("y", &Cluster::longitude)
+        .def_readonly("count", &Cluster::count);
+    py::class_<ClusterResult>(m, "ClusterResult")
+        .def_readonly("zoom", &ClusterResult::zoom)
+        .def_readonly("raw", &ClusterResult::raw)
+        .def_readonly("clusters", &ClusterResult::clusters)
+        .def_readonly("points", &ClusterResult::points);
+    py::class_<ClusterOptions>(m, "ClusterOptions")
+        .def(py::init<>())
+        .def_readwrite("maxZoom", &ClusterOptions::maxZoom)
+        .def_readwrite("cellsPerTile", &ClusterOptions::cellsPerTile)
+        .def_readwrite("rawZoom", &ClusterOptions::rawZoom)
+        .def_readwrite("rawLimit", &ClusterOptions::rawLimit)
+        .def_readwrite("maxClusters", &ClusterOptions::maxClusters);
+    py::class_<ClusteredIndex, std::shared_ptr<ClusteredIndex>>(m, "ClusteredIndex")
+        .def(py::init<std::shared_ptr<Index>, ClusterOptions>(), py::arg("index"), py::arg("options") = ClusterOptions())
+        // insert2D deja la pirámide para el siguiente clusterQuery; build la calcula ya
+        .def("insert2D", &ClusteredIndex::insert, py::arg("points"))
+        .def("build", &ClusteredIndex::build, py::arg("points"))
+        .def("refresh", &ClusteredIndex::refresh)
+        .def_property_readonly("dirty", &ClusteredIndex::dirty)
+        .def("clusterQuery", &ClusteredIndex::clusterQuery, py::arg("minLat"), py::arg("minLon"),
+             py::arg("maxLat"), py::arg("maxLon"), py::arg("zoom"), py::call_guard<py::gil_scoped_release>())
+        .def("clusterCount", &ClusteredIndex::clusterCount, py::arg("zoom"))
+        .def("memoryUsage", &ClusteredIndex::memoryUsage);
+
+    // Pirámide de teselas z/x/y en un fichero proyectado en memoria (TileArchive.hpp)
+    py::class_<TileOptions>(m, "TileOptions")
+        .def(py::init<>())
+        .def_readwrite("minZoom", &TileOptions::minZoom)
+        .def_readwrite("maxZoom", &TileOptions::maxZoom)
+        .def_readwrite("featureCap", &TileOptions::featureCap)
+        .def_readwrite("extent", &TileOptions::extent)
+        .def_readwrite("threads", &TileOptions::threads);
+    py::class_<TileStats>(m, "TileStats")
+        .def_readonly("tiles", &TileStats::tiles)
+        .def_readonly("features", &TileStats::features)
+        .def_readonly("bytes", &TileStats::bytes);
+    m.def("writeTileArchive", &writeTileArchive, py::arg("index"), py::arg("path"), py::arg("options") = TileOptions(),
+          py::call_guard<py::gil_scoped_release>());
+    py::class_<TileArchive, std::shared_ptr<TileArchive>>(m, "TileArchive")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        // bytes de la tesela (vacío si no tiene puntos)
+        .def("tile", [](const TileArchive& self, int z, uint32_t x, uint32_t y) {
+                 const auto data = self.tile(z, x, y);
+                 return py::bytes(data.data(), data.size());
+             },
+             py::arg("z"), py::arg("x"), py::arg("y"))
+        .def("points", &TileArchive::points, py::arg("z"), py::arg("x"), py::arg("y"))
+        .def_property_readonly("tileCount", &TileArchive::tileCount)
+        .def_property_readonly("minZoom", &TileArchive::minZoom)
+        .def_property_readonly("maxZoom", &TileArchive::maxZoom)
+        .def_property_readonly("extent", &TileArchive::extent);
 
     // RTree
 
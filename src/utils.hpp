@@ -1,13 +1,242 @@
 #pragma once
 #include <cmath>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <utility>
+
+static constexpr double EARTH_RADIUS_M = 6371000.0;
+static constexpr double DEG_TO_RAD = M_PI / 180.0;
 
 inline double haversine(const double lat1, const double lon1, const double lat2, const double lon2) {
-    constexpr double R = 6371000.0;
     const double phi1 = lat1 * M_PI / 180.0;
     const double phi2 = lat2 * M_PI / 180.0;
     const double dphi = (lat2 - lat1) * M_PI / 180.0;
     const double dlambda = (lon2 - lon1) * M_PI / 180.0;
     const double a = sin(dphi / 2) * sin(dphi / 2) + cos(phi1) * cos(phi2) * sin(dlambda / 2) * sin(dlambda / 2);
 
-    return 2 * R * std::asin(std::sqrt(a));
-}
\ No newline at end of file
+    return 2 * EARTH_RADIUS_M * std::asin(std::sqrt(a));
+}
+
+// --- Distancia sustituta (cuerda al cuadrado sobre la esfera unitaria) ---
+//
+// chord2 = |u - v|^2 = 4 * a, con "a" el término interno del haversine. Es
+// monótona con la distancia geodésica, así que sirve para ordenar y podar sin
+// asin/sqrt; a metros solo se convierte el resultado final.
+
+struct UnitVec {
+    double x, y, z;
+};
+
+inline UnitVec toUnitVec(const double lat, const double lon) {
+    const double phi = lat * DEG_TO_RAD;
+    const double lambda = lon * DEG_TO_RAD;
+    const double c = std::cos(phi);
+    return {c * std::cos(lambda), c * std::sin(lambda), std::sin(phi)};
+}
+
+inline double chord2(const UnitVec& a, const UnitVec& b) {
+    const double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/// Cuerda al cuadrado directamente desde lat/lon (haversine sin asin/sqrt).
+inline double haversineChord2(const double lat1, const double lon1, const double lat2, const double lon2) {
+    const double sdphi = std::sin((lat2 - lat1) * DEG_TO_RAD / 2);
+    const double sdlambda = std::sin((lon2 - lon1) * DEG_TO_RAD / 2);
+    const double a = sdphi * sdphi + std::cos(lat1 * DEG_TO_RAD) * std::cos(lat2 * DEG_TO_RAD) * sdlambda * sdlambda;
+    return 4 * a;
+}
+
+inline double chord2ToMeters(const double c2) {
+    return 2 * EARTH_RADIUS_M * std::asin(std::min(1.0, std::sqrt(c2) / 2));
+}
+
+inline double metersToChord2(const double meters) {
+    if (meters >= M_PI * EARTH_RADIUS_M) return 4.0;
+    const double s = 2 * std::sin(meters / (2 * EARTH_RADIUS_M));
+    return s * s;
+}
+
+/// Vectores unitarios en formato SoA, para que los bucles de distancia vectoricen.
+/// Con T = float ocupan la mitad y caben el doble por registro SIMD (~0.5 m de error).
+template <typename T>
+struct BasicUnitVecArray {
+    std::vector<T> xs, ys, zs;
+
+    size_t size() const { return xs.size(); }
+    void clear() { xs.clear(); ys.clear(); zs.clear(); }
+    void reserve(const size_t n) { xs.reserve(n); ys.reserve(n); zs.reserve(n); }
+    void push_back(const double lat, const double lon) {
+        const UnitVec u = toUnitVec(lat, lon);
+        xs.push_back(static_cast<T>(u.x)); ys.push_back(static_cast<T>(u.y)); zs.push_back(static_cast<T>(u.z));
+    }
+    UnitVec operator[](const size_t i) const { return {xs[i], ys[i], zs[i]}; }
+    size_t capacityBytes() const { return 3 * xs.capacity() * sizeof(T); }
+};
+using UnitVecArray = BasicUnitVecArray<double>;
+
+/// out[i] = chord2(q, (xs[i], ys[i], zs[i])) para i en [0, n). Solo mul/add: vectoriza con -O3.
+template <typename T>
+inline void chord2Batch(const UnitVec& q, const T* __restrict xs, const T* __restrict ys,
+                        const T* __restrict zs, const size_t n, T* __restrict out) {
+    const T qx = static_cast<T>(q.x), qy = static_cast<T>(q.y), qz = static_cast<T>(q.z);
+    for (size_t i = 0; i < n; ++i) {
+        const T dx = xs[i] - qx, dy = ys[i] - qy, dz = zs[i] - qz;
+        out[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+// Series de Taylor para haversineBatch: coeficientes de x^(2n + 1) en sin,
+// de x^(2n) en cos y de t^(2n + 1) en asin, por recurrencia.
+template <size_t N>
+constexpr std::array<double, N> sinSeries() {
+    std::array<double, N> c{};
+    double term = 1;
+    for (size_t n = 0; n < N; ++n) {
+        c[n] = term;
+        term = -term / static_cast<double>((2 * n + 2) * (2 * n + 3));
+    }
+    return c;
+}
+
+template <size_t N>
+constexpr std::array<double, N> cosSeries() {
+    std::array<double, N> c{};
+    double term = 1;
+    for (size_t n = 0; n < N; ++n) {
+        c[n] = term;
+        term = -term / static_cast<double>((2 * n + 1) * (2 * n + 2));
+    }
+    return c;
+}
+
+template <size_t N>
+constexpr std::array<double, N> asinSeries() {
+    std::array<double, N> c{};
+    double central = 1; // (2n)! / (4^n n!^2)
+    for (size_t n = 0; n < N; ++n) {
+        c[n] = central / static_cast<double>(2 * n + 1);
+        central = central * static_cast<double>(2 * n + 1) / static_cast<double>(2 * n + 2);
+    }
+    return c;
+}
+
+// Horner en x2 = x^2, desenrollado para que el bucle de fuera vectorice.
+template <size_t N, size_t... I>
+inline double evenPoly(const std::array<double, N>& c, const double x2, std::index_sequence<I...>) {
+    double r = c[N - 1];
+    ((r = r * x2 + c[N - 2 - I]), ...);
+    return r;
+}
+
+template <size_t N>
+inline double evenPoly(const std::array<double, N>& c, const double x2) {
+    return evenPoly(c, x2, std::make_index_sequence<N - 1>());
+}
+
+/// Haversine en lote sobre arrays lat/lon (metros), con latitudes en
+/// [-90, 90]. sin, cos y asin son polinomios (sin llamadas a libm), así que
+/// con -O3 y -fno-math-errno (sqrt sin errno, como en CMakeLists.txt) el
+/// bucle vectoriza. El error es del orden del de haversine(): unos 2e-6 m
+/// hasta 0.999 * pi * R; junto a la antípoda los dos pierden precisión igual.
+///   sin: el semiángulo se reduce a [-pi/2, pi/2] (sin^2 tiene periodo pi) y
+///        la serie hasta x^21 deja un error < 3e-16.
+///   asin(s): serie en [0, 1/2]; por encima, asin(s) = pi/2 - 2 asin(sqrt((1 - s) / 2)).
+inline void haversineBatch(const double lat, const double lon, const double* __restrict lats,
+                           const double* __restrict lons, const size_t n, double* __restrict out) {
+    static constexpr auto SIN = sinSeries<11>();
+    static constexpr auto COS = cosSeries<12>();
+    static constexpr auto ASIN = asinSeries<24>();
+    constexpr double ROUND = 0x1.8p52; // (x + ROUND) - ROUND redondea al entero más cercano
+    const double cosPhi1 = std::cos(lat * DEG_TO_RAD);
+    auto sinHalf2 = [&](const double degrees) {
+        double x = degrees * (DEG_TO_RAD / 2);
+        x -= ((x * (1 / M_PI) + ROUND) - ROUND) * M_PI;
+        const double s = x * evenPoly(SIN, x * x);
+        return s * s;
+    };
+    for (size_t i = 0; i < n; ++i) {
+        const double phi2 = lats[i] * DEG_TO_RAD;
+        const double cosPhi2 = evenPoly(COS, phi2 * phi2);
+        double a = sinHalf2(lats[i] - lat) + cosPhi1 * cosPhi2 * sinHalf2(lons[i] - lon);
+        a = std::min(1.0, std::max(0.0, a));
+
+        const double s = std::sqrt(a);
+        const bool high = s > 0.5;
+        const double z = high ? (1 - s) / 2 : a;
+        const double t = high ? std::sqrt(z) : s;
+        const double r = t * evenPoly(ASIN, z);
+        out[i] = 2 * EARTH_RADIUS_M * (high ? M_PI / 2 - 2 * r : r);
+    }
+}
+
+inline double angleToChord2(const double radians) {
+    if (radians >= M_PI) return 4.0;
+    const double s = 2 * std::sin(radians / 2);
+    return s * s;
+}
+
+/// Longitud normalizada a [-180, 180].
+inline double wrapLon(const double lon) {
+    return std::remainder(lon, 360.0);
+}
+
+// --- MINDIST / MAXDIST esféricos punto-rectángulo lat/lon ---
+//
+// Si la longitud del punto cae dentro del rango del rectángulo, el punto más
+// cercano está en su mismo meridiano (latitud recortada). Si no, está sobre el
+// borde meridiano más próximo en longitud: a lo largo de ese meridiano el
+// coseno de la distancia es cos(φe - θ) con θ = atan2(sin φ, cos φ cos Δλ), así
+// que gana θ si cae en el rango de latitudes y, si no, el extremo más cercano
+// a θ sobre el círculo. Vale cerca de los polos y del antimeridiano.
+
+/// Punto (lat, lon) del rectángulo más cercano a (lat, lon) sobre la esfera.
+inline std::pair<double, double> nearestPointOnRect(const double lat, const double lon,
+                                                     const double minLat, const double minLon,
+                                                     const double maxLat, const double maxLon) {
+    const double qLon = wrapLon(lon);
+    if ((qLon >= minLon && qLon <= maxLon) || maxLon - minLon >= 360.0) {
+        return {std::clamp(lat, minLat, maxLat), qLon};
+    }
+    const double dWest = wrapLon(minLon - qLon);
+    const double dEast = wrapLon(maxLon - qLon);
+    const bool west = std::abs(dWest) <= std::abs(dEast);
+    const double edgeLon = west ? minLon : maxLon;
+    const double dl = (west ? dWest : dEast) * DEG_TO_RAD;
+
+    const double phi = lat * DEG_TO_RAD;
+    const double theta = std::atan2(std::sin(phi), std::cos(phi) * std::cos(dl)) / DEG_TO_RAD;
+    if (theta >= minLat && theta <= maxLat) return {theta, edgeLon};
+    const double toMin = std::abs(std::remainder(minLat - theta, 360.0));
+    const double toMax = std::abs(std::remainder(maxLat - theta, 360.0));
+    return {toMin <= toMax ? minLat : maxLat, edgeLon};
+}
+
+/// Cota inferior exacta (cuerda al cuadrado) de la distancia a cualquier punto del rectángulo.
+inline double sphericalMinChord2(const double lat, const double lon,
+                                 const double minLat, const double minLon,
+                                 const double maxLat, const double maxLon) {
+    const auto [nLat, nLon] = nearestPointOnRect(lat, lon, minLat, minLon, maxLat, maxLon);
+    return haversineChord2(lat, lon, nLat, nLon);
+}
+
+/// Cota superior exacta: el punto más lejano es el más cercano a la antípoda.
+inline double sphericalMaxChord2(const double lat, const double lon,
+                                 const double minLat, const double minLon,
+                                 const double maxLat, const double maxLon) {
+    return 4.0 - sphericalMinChord2(-lat, wrapLon(lon + 180.0), minLat, minLon, maxLat, maxLon);
+}
+
+inline double sphericalMinDist(const double lat, const double lon,
+                               const double minLat, const double minLon,
+                               const double maxLat, const double maxLon) {
+    return chord2ToMeters(sphericalMinChord2(lat, lon, minLat, minLon, maxLat, maxLon));
+}
+
+inline double sphericalMaxDist(const double lat, const double lon,
+                               const double minLat, const double minLon,
+                               const double maxLat, const double maxLon) {
+    return chord2ToMeters(sphericalMaxChord2(lat, lon, minLat, minLon, maxLat, maxLon));
+}
@@ -110,7 +110,7 @@ if [ "$NEED_COMPILE" = true ]; then
     else
         # Compilación directa
         echo "Compilando directamente..."
-        c++ -O3 -Wall -shared -std=c++20 -fPIC \
+        c++ -O3 -fno-math-errno -Wall -shared -std=c++20 -fPIC \
             $(python3 -m pybind11 --includes) \
             src/spatial_index.cpp -o spatialcpp$(python3-config --extension-suffix)
 
@@ -0,0 +1,299 @@
+// Lecturas concurrentes con escrituras en DiskRTreeIndex y LsmRTreeIndex (ctest:
+// test_concurrency). Pensada para ejecutarse también con ./build.sh tsan.
+//
+// Un escritor inserta puntos de uno en uno mientras varios lectores consultan.
+// Cada consulta debe ver una versión completa: el rango mundial devuelve entre
+// los puntos publicados al empezar y los publicados al terminar, y el kNN y el
+// radio concuerdan con ese mismo rango. Con movimientos (update) y
+// compactaciones en marcha, el número de puntos visibles no cambia.
+//
+// Además, varios hilos lanzan a la vez consultas de rango que los índices en
+// memoria reparten en su pool (ParallelScan.hpp), y otros recorren un índice
+// en memoria por trozos mientras se reconstruye (Index::rebuild).
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Datasets.hpp"
+#include "DiskRTree.hpp"
+#include "GridIndex.hpp"
+#include "LsmRTree.hpp"
+#include "RTree.hpp"
+
+static std::atomic<int> failures{0};
+
+#define CHECK(cond)                                                                      \
+    do {                                                                                 \
+        if (!(cond)) {                                                                   \
+            ++failures;                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": falla " #cond "\n";           \
+        }                                                                                \
+    } while (0)
+
+static void testConcurrentInserts(const std::vector<Geoname>& pts) {
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_concurrency").string();
+    std::filesystem::remove_all(dir);
+    const Rectangle world(-90, -180, 90, 180);
+
+    {
+        DiskRTreeIndex index(dir, 64);
+        std::atomic<size_t> published{0}; // inserciones ya devueltas
+        std::atomic<bool> done{false};
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&, r] {
+                std::mt19937_64 rng(r);
+                size_t last = 0;
+                while (!done.load()) {
+                    const size_t lo = published.load();
+                    const size_t n = index.rangeQuery2D(world).size();
+                    const size_t hi = published.load();
+                    // El escritor puede haber publicado uno más sin contarlo aún
+                    CHECK(n >= lo && n <= hi + 1);
+                    CHECK(n >= last);
+                    last = n;
+
+                    const Geoname& c = pts[rng() % pts.size()];
+                    const Point2D p(c.latitude, c.longitude);
+                    const size_t knnLo = published.load();
+                    CHECK(index.knnQuery2DGeo(p, 10).size() >= std::min<size_t>(10, knnLo));
+                    CHECK(index.radiusQuery(p, 21'000'000.0).size() >= knnLo);
+
+                    auto cursor = index.nearestNeighborsGeo(p);
+                    double prev = 0;
+                    for (int k = 0; k < 20; ++k) {
+                        auto next = cursor.next();
+                        if (!next) break;
+                        CHECK(next->first >= prev);
+                        prev = next->first;
+                    }
+                }
+            });
+        }
+
+        for (size_t i = 0; i < pts.size(); ++i) {
+            index.insert2D(Point2D(pts[i].latitude, pts[i].longitude));
+            published.store(i + 1);
+            if (i % 1'000 == 999) index.flush();
+        }
+        done.store(true);
+        for (auto& t : readers) t.join();
+
+        CHECK(index.rangeQuery2D(world).size() == pts.size());
+        index.flush();
+        // Sin lectores, todo lo sustituido se puede liberar
+        CHECK(index.pendingReclaims() == 0);
+    }
+    {
+        // Los ids borrados del disco no son los que referencia el índice guardado
+        DiskRTreeIndex index(dir, 64);
+        index.dropCaches();
+        CHECK(index.rangeQuery2D(world).size() == pts.size());
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Movimientos y compactaciones con lectores: update() publica el borrado y la
+// inserción juntos, así que el rango mundial siempre ve todos los puntos y
+// getById siempre encuentra el id.
+static void testConcurrentUpdates(const std::vector<Geoname>& pts) {
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_concurrency_updates").string();
+    std::filesystem::remove_all(dir);
+    const Rectangle world(-90, -180, 90, 180);
+    const size_t n = 3'000;
+
+    {
+        DiskRTreeIndex index(dir, 64);
+        for (size_t i = 0; i < n; ++i) index.insert2D(Point2D(pts[i].latitude, pts[i].longitude), i);
+        index.flush();
+
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&, r] {
+                std::mt19937_64 rng(r);
+                while (!done.load()) {
+                    CHECK(index.rangeQuery2D(world).size() == n);
+                    const Geoname& c = pts[rng() % n];
+                    CHECK(index.knnQuery2DGeo(Point2D(c.latitude, c.longitude), 10).size() == 10);
+                    CHECK(index.getById(rng() % n).has_value());
+                }
+            });
+        }
+
+        std::mt19937_64 rng(3);
+        for (size_t m = 0; m < 3'000; ++m) {
+            const size_t id = rng() % n;
+            const Geoname& to = pts[n + rng() % (pts.size() - n)];
+            CHECK(index.update(id, Point2D(to.latitude, to.longitude)));
+            if (m % 1'000 == 999) index.compact(m % 2000 == 999 ? DiskRTreeIndex::CompactOrder::STR
+                                                                 : DiskRTreeIndex::CompactOrder::Hilbert);
+        }
+        done.store(true);
+        for (auto& t : readers) t.join();
+        index.flush();
+        CHECK(index.pendingReclaims() == 0);
+    }
+    {
+        DiskRTreeIndex index(dir, 64);
+        CHECK(index.rangeQuery2D(world).size() == n);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Capa LSM: las escrituras de memtables y las fusiones en segundo plano no
+// pueden hacer que una consulta pierda ni duplique puntos.
+static void testLsmConcurrentInserts(const std::vector<Geoname>& pts) {
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_concurrency_lsm").string();
+    std::filesystem::remove_all(dir);
+    const Rectangle world(-90, -180, 90, 180);
+
+    LsmOptions options;
+    options.memtableCapacity = 256;
+    options.mergeFactor = 3;
+    {
+        LsmRTreeIndex index(dir, options);
+        std::atomic<size_t> published{0};
+        std::atomic<bool> done{false};
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&, r] {
+                std::mt19937_64 rng(r);
+                while (!done.load()) {
+                    const size_t lo = published.load();
+                    const size_t n = index.rangeQuery2D(world).size();
+                    const size_t hi = published.load();
+                    CHECK(n >= lo && n <= hi + 1);
+
+                    const Geoname& c = pts[rng() % pts.size()];
+                    const Point2D p(c.latitude, c.longitude);
+                    const size_t knnLo = published.load();
+                    CHECK(index.knnQuery2DGeo(p, 10).size() >= std::min<size_t>(10, knnLo));
+                    CHECK(index.radiusQuery(p, 21'000'000.0).size() >= knnLo);
+                }
+            });
+        }
+
+        for (size_t i = 0; i < pts.size(); ++i) {
+            index.insert2D(Point2D(pts[i].latitude, pts[i].longitude));
+            published.store(i + 1);
+        }
+        done.store(true);
+        for (auto& t : readers) t.join();
+        CHECK(index.rangeQuery2D(world).size() == pts.size());
+    }
+    {
+        LsmRTreeIndex index(dir, options);
+        CHECK(index.rangeQuery2D(world).size() == pts.size());
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Cada lector compara sus consultas repartidas con las mismas en serie.
+static void testConcurrentParallelScans(Index& index, ParallelScan& scan, const std::vector<Geoname>& pts) {
+    index.build(pts);
+    std::vector<Rect> windows;
+    std::vector<size_t> expected;
+    std::mt19937_64 rng(3);
+    for (int w = 0; w < 20; ++w) {
+        const Geoname& c = pts[rng() % pts.size()];
+        const double h = 1.0 + static_cast<double>(rng() % 40);
+        windows.emplace_back(c.latitude - h, c.longitude - h, c.latitude + h, c.longitude + h);
+        expected.push_back(index.rangeQuery(c.latitude - h, c.longitude - h, c.latitude + h, c.longitude + h).size());
+    }
+    scan.configure(4, 500);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&, r] {
+            for (int round = 0; round < 20; ++round) {
+                const size_t w = static_cast<size_t>(r * 7 + round) % windows.size();
+                const Rect& b = windows[w];
+                CHECK(index.rangeQuery(b.minLat, b.minLon, b.maxLat, b.maxLon).size() == expected[w]);
+            }
+        });
+    }
+    for (auto& t : readers) t.join();
+    scan.configure(1, ParallelScan::DEFAULT_MIN_CANDIDATES);
+}
+
+// Recorridos por trozos (como rangeQuery2DIter) mientras otro hilo reconstruye
+// el índice: cada recorrido o termina entero sobre un mismo conjunto o lanza
+// porque el índice cambió; nunca lee a medias de una reconstrucción.
+static void testRebuildDuringPaging(Index& index, const std::vector<Geoname>& pts) {
+    const std::vector<Geoname> half(pts.begin(), pts.begin() + pts.size() / 2);
+    index.rebuild(pts);
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (int round = 0; round < 40; ++round) index.rebuild(round % 2 ? pts : half);
+        done = true;
+    });
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            while (!done) {
+                const uint64_t generation = index.generation();
+                QueryOptions opts;
+                opts.limit = 500;
+                size_t total = 0;
+                try {
+                    for (;;) {
+                        const auto page = index.resumeRangeQueryPage(generation, -90, -180, 90, 180, opts);
+                        total += page.results.size();
+                        if (page.progress.done()) break;
+                        opts.cursor = page.progress.cursor;
+                    }
+                    CHECK(total == pts.size() || total == half.size());
+                } catch (const std::runtime_error&) {
+                    // el índice se reconstruyó a mitad: se vuelve a empezar
+                }
+            }
+        });
+    }
+    writer.join();
+    for (auto& t : readers) t.join();
+    // Sin reconstrucciones, el mismo recorrido siempre termina
+    const uint64_t generation = index.generation();
+    QueryOptions opts;
+    opts.limit = 500;
+    size_t total = 0;
+    for (;;) {
+        const auto page = index.resumeRangeQueryPage(generation, -90, -180, 90, 180, opts);
+        total += page.results.size();
+        if (page.progress.done()) break;
+        opts.cursor = page.progress.cursor;
+    }
+    CHECK(total == pts.size());
+    index.rebuild(half);
+    bool threw = false;
+    try {
+        index.resumeRangeQueryPage(generation, -90, -180, 90, 180, opts);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main() {
+    std::mt19937_64 rng(7);
+    const auto pts = makeDataset("clustered", 10'000, rng);
+    testConcurrentInserts(pts);
+    testConcurrentUpdates(pts);
+    testLsmConcurrentInserts(pts);
+    RTreeIndex tree(16);
+    testConcurrentParallelScans(tree, tree.parallelScan(), pts);
+    GridIndex grid(32, 32);
+    testConcurrentParallelScans(grid, grid.parallelScan(), pts);
+    testRebuildDuringPaging(tree, pts);
+    testRebuildDuringPaging(grid, pts);
+    std::cout << "disk, lsm, rangos en paralelo y recorridos por trozos concurrentes: " << (failures ? "FALLA" : "ok") << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,1145 @@
+// Pruebas de los índices en C++ contra fuerza bruta (ctest: test_indexes).
+//
+// Cada índice responde rango, kNN, radio y rango paginado sobre los mismos
+// conjuntos; los resultados se comparan con una búsqueda lineal.
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "ClusterIndex.hpp"
+#include "Datasets.hpp"
+#include "DiskRTree.hpp"
+#include "GridIndex.hpp"
+#include "LsmRTree.hpp"
+#include "PartitionedIndex.hpp"
+#include "PlannedIndex.hpp"
+#include "RTree.hpp"
+#include "TileArchive.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                      \
+    do {                                                                                 \
+        if (!(cond)) {                                                                   \
+            ++failures;                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": falla " #cond "\n";           \
+        }                                                                                \
+    } while (0)
+
+// --- Fuerza bruta ---
+
+static size_t bruteRange(const std::vector<Geoname>& pts, const Rect& w) {
+    return static_cast<size_t>(std::count_if(pts.begin(), pts.end(), [&](const Geoname& g) { return w.contains(g); }));
+}
+
+// Distancia de referencia de cada métrica y tolerancia de la configuración
+// (0 = exacta; con coordenadas float, unos metros o 1e-4 grados en plano).
+struct Oracle {
+    std::function<double(double, double, double, double)> dist = haversine;
+    double tolerance = 0.0;
+    std::vector<double> radii{5'000.0, 150'000.0};
+};
+
+static Oracle planarOracle(const double tolerance) {
+    Oracle o;
+    o.dist = PlanarMetric::distance;
+    o.tolerance = tolerance;
+    o.radii = {0.05, 1.5};
+    return o;
+}
+
+static std::vector<double> bruteKnn(const std::vector<Geoname>& pts, const Oracle& o, const double lat,
+                                    const double lon, const size_t k) {
+    std::vector<double> d;
+    d.reserve(pts.size());
+    for (const auto& g : pts) d.push_back(o.dist(lat, lon, g.latitude, g.longitude));
+    std::sort(d.begin(), d.end());
+    d.resize(std::min(k, d.size()));
+    return d;
+}
+
+static std::vector<double> bruteRadius(const std::vector<Geoname>& pts, const double lat, const double lon,
+                                       const double meters, const Oracle& o = Oracle()) {
+    std::vector<double> d;
+    for (const auto& g : pts) {
+        const double m = o.dist(lat, lon, g.latitude, g.longitude);
+        if (m <= meters) d.push_back(m);
+    }
+    std::sort(d.begin(), d.end());
+    return d;
+}
+
+static bool sameDistances(const std::vector<double>& a, const std::vector<double>& b, const double tol = 0.0) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::abs(a[i] - b[i]) > tol + 1e-6 * std::max(1.0, b[i])) return false;
+    return true;
+}
+
+/// Los puntos tal como los guarda un índice con coordenadas Coord.
+template <typename Coord>
+static std::vector<Geoname> roundedTo(std::vector<Geoname> pts) {
+    for (auto& g : pts) {
+        g.latitude = static_cast<Coord>(g.latitude);
+        g.longitude = static_cast<Coord>(g.longitude);
+    }
+    return pts;
+}
+
+// Consultas comunes: ventanas y centros alrededor de puntos del conjunto.
+struct Queries {
+    std::vector<Rect> windows;
+    std::vector<Geoname> centers;
+};
+
+static Queries makeQueries(const std::vector<Geoname>& pts, std::mt19937_64& rng, const size_t n = 60) {
+    Queries q;
+    std::uniform_int_distribution<size_t> pick(0, pts.size() - 1);
+    std::uniform_real_distribution<double> half(0.1, 8.0);
+    for (size_t i = 0; i < n; ++i) {
+        const auto& c = pts[pick(rng)];
+        const double h = half(rng);
+        q.windows.emplace_back(c.latitude - h, c.longitude - h, c.latitude + h, c.longitude + h);
+        q.centers.push_back(c);
+        q.centers.back().latitude = std::clamp(c.latitude + 0.3, -90.0, 90.0);
+    }
+    return q;
+}
+
+// haversineBatch (polinomios) contra haversine() (libm): desde los centros de
+// las consultas, los polos y el antimeridiano a todos los puntos y a las
+// antípodas de los centros. Junto a la antípoda asin está mal condicionado y
+// los dos se separan hasta ~1e-8 relativo.
+static void testHaversineBatch(const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    std::vector<std::pair<double, double>> from{{90, 0}, {-90, 0}, {0, 180}, {0, -180}, {45.5, 179.99}};
+    for (const auto& c : q.centers) from.emplace_back(c.latitude, c.longitude);
+    std::vector<double> lats, lons;
+    for (const auto& p : pts) {
+        lats.push_back(p.latitude);
+        lons.push_back(p.longitude);
+    }
+    for (const auto& [lat, lon] : from) {
+        lats.push_back(-lat);
+        lons.push_back(lon + 180);
+    }
+    std::vector<double> out(lats.size());
+    for (const auto& [lat, lon] : from) {
+        haversineBatch(lat, lon, lats.data(), lons.data(), lats.size(), out.data());
+        for (size_t i = 0; i < lats.size(); ++i) {
+            const double want = haversine(lat, lon, lats[i], lons[i]);
+            const double tolerance = want < 0.999 * M_PI * EARTH_RADIUS_M ? 1e-5 : 1e-7 * want;
+            CHECK(std::abs(out[i] - want) <= tolerance);
+        }
+    }
+    std::cout << "haversineBatch: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// --- Índices en memoria ---
+
+// pts son los puntos que se insertan; el índice guarda roundedTo<Coord>(pts),
+// así que la fuerza bruta va sobre `stored`.
+static void testMemoryIndex(const std::string& name, Index& index, const std::vector<Geoname>& pts,
+                            const std::vector<Geoname>& stored, const Queries& q, const Oracle& o = Oracle()) {
+    const int before = failures;
+    index.build(pts);
+
+    for (const auto& w : q.windows) {
+        CHECK(index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon).size() == bruteRange(stored, w));
+        CHECK(index.countQuery(w.minLat, w.minLon, w.maxLat, w.maxLon) == bruteRange(stored, w));
+
+        // Páginas de 50 encadenadas por el cursor = la consulta completa
+        QueryOptions opts;
+        opts.limit = 50;
+        size_t total = 0;
+        for (int guard = 0; guard < 10000; ++guard) {
+            const auto page = index.rangeQueryPage(w.minLat, w.minLon, w.maxLat, w.maxLon, opts);
+            total += page.results.size();
+            if (page.progress.done()) break;
+            CHECK(page.progress.status == QueryStatus::LimitReached);
+            opts.cursor = page.progress.cursor;
+        }
+        CHECK(total == bruteRange(stored, w));
+    }
+
+    // Búsqueda por geonameId (los ids de pts son 0..n-1)
+    for (size_t i = 0; i < stored.size(); i += 97) {
+        const auto g = index.getById(stored[i].geonameId);
+        CHECK(g && g->latitude == stored[i].latitude && g->longitude == stored[i].longitude);
+    }
+    CHECK(!index.getById(static_cast<long>(stored.size())));
+    CHECK(!index.getById(-1));
+
+    for (const auto& c : q.centers) {
+        for (const int k : {1, 10, 100}) {
+            std::vector<double> got;
+            for (const auto& g : index.kNN(c, k))
+                got.push_back(o.dist(c.latitude, c.longitude, g.latitude, g.longitude));
+            CHECK(sameDistances(got, bruteKnn(stored, o, c.latitude, c.longitude, k), o.tolerance));
+        }
+        for (const double radius : o.radii) {
+            std::vector<double> got;
+            for (const auto& [m, g] : index.radiusQueryWithDistances(c.latitude, c.longitude, radius)) got.push_back(m);
+            CHECK(index.radiusQuery(c.latitude, c.longitude, radius).size() == got.size());
+            if (o.tolerance == 0.0) {
+                CHECK(sameDistances(got, bruteRadius(stored, c.latitude, c.longitude, radius, o)));
+            } else {
+                // en el borde del radio se admite cualquier decisión dentro de la tolerancia
+                CHECK(got.size() >= bruteRadius(stored, c.latitude, c.longitude, radius - o.tolerance, o).size());
+                CHECK(got.size() <= bruteRadius(stored, c.latitude, c.longitude, radius + o.tolerance, o).size());
+                for (const double m : got) CHECK(m <= radius + o.tolerance);
+            }
+        }
+    }
+
+    // Con el perfilado encendido los resultados no cambian y se cuentan las consultas
+    index.profiler().setEnabled(true);
+    const auto& w = q.windows.front();
+    CHECK(index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon).size() == bruteRange(stored, w));
+    CHECK(index.profiler().stats(QueryKind::Range).queries == 1);
+    CHECK(index.profiler().last().pointsReturned == bruteRange(stored, w));
+    CHECK(index.profiler().last().nodesVisited() > 0);
+    index.profiler().setEnabled(false);
+
+    std::cout << name << ": " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Agregados con pesos: count y suma en cada ventana contra la fuerza bruta.
+static void testAggregate(const std::string& name, Index& index, const std::vector<Geoname>& pts,
+                          const std::vector<Geoname>& stored, const Queries& q) {
+    const int before = failures;
+    std::vector<double> weights(pts.size());
+    for (size_t i = 0; i < pts.size(); ++i) weights[i] = static_cast<double>(i % 97) + 0.25;
+    index.build(pts, weights);
+    // las sumas prefijas acumulan el error de redondeo del total
+    const double tolerance = 1e-12 * std::accumulate(weights.begin(), weights.end(), 0.0) * pts.size();
+
+    std::vector<Rect> windows(q.windows);
+    windows.emplace_back(-90, -180, 90, 180);
+    for (const auto& w : windows) {
+        size_t count = 0;
+        double sum = 0;
+        for (size_t i = 0; i < stored.size(); ++i) {
+            if (!w.contains(stored[i])) continue;
+            ++count;
+            sum += weights[i];
+        }
+        const Aggregate a = index.aggregateQuery(w.minLat, w.minLon, w.maxLat, w.maxLon);
+        CHECK(a.count == count);
+        CHECK(std::abs(a.sum - sum) <= tolerance);
+    }
+    // Sin pesos la suma es el número de puntos
+    index.build(pts);
+    const Aggregate all = index.aggregateQuery(-90, -180, 90, 180);
+    CHECK(all.count == pts.size() && all.sum == static_cast<double>(pts.size()));
+
+    std::cout << name << " agregados: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Rango y kNN filtrados por prefijo del nombre contra la fuerza bruta. Los
+// prefijos van de raros (recorrido directo de los que lo tienen) a comunes
+// (bajada por el índice con las firmas), con mayúsculas mezcladas.
+static void testNamePrefix(const std::string& name, Index& index, std::vector<Geoname> pts,
+                           const Queries& q, std::mt19937_64& rng) {
+    const int before = failures;
+    const std::vector<std::string> stems{"San ", "SANTA ", "santiago", "Port", "Zq", "Québec", "x"};
+    std::uniform_int_distribution<int> letter('a', 'z');
+    for (size_t i = 0; i < pts.size(); ++i) {
+        // ~1/2 con un prefijo común, 1/100 con "Zq", el resto letras al azar
+        std::string n = i % 2 ? stems[i % 4] : i % 100 == 4 ? "Zq" : "";
+        for (int c = 0; c < 4; ++c) n += static_cast<char>(letter(rng));
+        pts[i].name = n;
+    }
+    index.build(pts);
+
+    const Oracle o;
+    for (const std::string prefix : {"san", "SANT", "s", "zQ", "québ", "port9", "x"}) {
+        std::vector<Geoname> named;
+        for (const auto& g : pts)
+            if (hasNamePrefix(g.name, normalizeName(prefix))) named.push_back(g);
+        for (const auto& w : q.windows) {
+            std::vector<long> got, want;
+            for (const auto& g : index.rangeQueryWithPrefix(w.minLat, w.minLon, w.maxLat, w.maxLon, prefix))
+                got.push_back(g.geonameId);
+            for (const auto& g : named)
+                if (w.contains(g)) want.push_back(g.geonameId);
+            std::sort(got.begin(), got.end());
+            std::sort(want.begin(), want.end());
+            CHECK(got == want);
+        }
+        for (const auto& c : q.centers) {
+            for (const int k : {1, 10}) {
+                std::vector<double> got;
+                for (const auto& g : index.kNNWithPrefix(c, k, prefix)) {
+                    CHECK(hasNamePrefix(g.name, normalizeName(prefix)));
+                    got.push_back(o.dist(c.latitude, c.longitude, g.latitude, g.longitude));
+                }
+                CHECK(sameDistances(got, bruteKnn(named, o, c.latitude, c.longitude, k)));
+            }
+        }
+    }
+    // Prefijo vacío = consulta sin filtro
+    const auto& w = q.windows.front();
+    CHECK(index.rangeQueryWithPrefix(w.minLat, w.minLon, w.maxLat, w.maxLon, "").size() == bruteRange(pts, w));
+
+    std::cout << name << " prefijo de nombre: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Consultas de rango repartidas entre hilos (umbral bajo para que se repartan
+// casi todas): mismos puntos que la fuerza bruta, en varios trozos.
+template <typename Tree>
+static void testParallelScan(const std::string& name, Tree& index, const std::vector<Geoname>& pts,
+                             const Queries& q) {
+    const int before = failures;
+    index.build(pts);
+    index.parallelScan().configure(4, 1'000);
+
+    std::vector<Rect> windows(q.windows);
+    windows.emplace_back(-90, -180, 90, 180);
+    for (const auto& w : windows) {
+        std::vector<long> got, want;
+        for (const auto& g : index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon)) got.push_back(g.geonameId);
+        for (const auto& g : pts)
+            if (w.contains(g)) want.push_back(g.geonameId);
+        std::sort(got.begin(), got.end());
+        std::sort(want.begin(), want.end());
+        CHECK(got == want);
+        CHECK(index.rangeQueryChunks(w.minLat, w.minLon, w.maxLat, w.maxLon).size() == want.size());
+    }
+    CHECK(index.rangeQueryChunks(-90, -180, 90, 180).chunks.size() > 1);
+
+    // El perfil suma el de todas las tareas
+    index.profiler().setEnabled(true);
+    CHECK(index.rangeQuery(-90, -180, 90, 180).size() == pts.size());
+    CHECK(index.profiler().last().pointsTested == pts.size());
+    index.profiler().setEnabled(false);
+
+    index.parallelScan().configure(1, ParallelScan::DEFAULT_MIN_CANDIDATES);
+    CHECK(index.rangeQueryChunks(-90, -180, 90, 180).chunks.size() == 1);
+    std::cout << name << " rango en paralelo: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Planificador: el histograma cuenta bien las ventanas grandes, la ventana
+// mundial va al barrido y una ventana diminuta no, y el perfil dice qué plan
+// se siguió (testMemoryIndex ya compara los resultados con la fuerza bruta).
+static void testPlanner(PlannedIndex& index, const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    index.build(pts);
+
+    const auto world = index.plan(-90, -180, 90, 180);
+    CHECK(std::abs(world.estimate - static_cast<double>(pts.size())) < 1e-6 * pts.size());
+    CHECK(world.plan == QueryPlan::Scan);
+    const auto& c = pts.front();
+    const auto tiny = index.plan(c.latitude - 1e-4, c.longitude - 1e-4, c.latitude + 1e-4, c.longitude + 1e-4);
+    CHECK(tiny.plan != QueryPlan::Scan);
+
+    index.profiler().setEnabled(true);
+    for (const auto& w : q.windows) {
+        const RangePlan p = index.plan(w.minLat, w.minLon, w.maxLat, w.maxLon);
+        const size_t inside = bruteRange(pts, w);
+        // error del histograma acotado por lo que cabe en las cubetas del borde
+        CHECK(std::abs(p.estimate - static_cast<double>(inside)) <= 0.1 * pts.size());
+        CHECK(index.rangeQuery(w.minLat, w.minLon, w.maxLat, w.maxLon).size() == inside);
+        CHECK(index.profiler().last().plan == p.plan);
+        CHECK(index.profiler().last().estimatedPoints == static_cast<uint64_t>(std::llround(p.estimate)));
+    }
+    CHECK(index.rangeQuery(-90, -180, 90, 180).size() == pts.size());
+    CHECK(index.profiler().last().plan == QueryPlan::Scan && index.profiler().last().pointsTested == pts.size());
+    index.kNN(c, 5);
+    CHECK(index.profiler().last().plan == QueryPlan::RTree);
+    index.profiler().setEnabled(false);
+
+    uint64_t planned = 0;
+    for (const auto plan : {QueryPlan::Grid, QueryPlan::RTree, QueryPlan::Scan}) planned += index.planCount(plan);
+    CHECK(planned == q.windows.size() + 1);
+    std::cout << "planner: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Pirámide de grupos: cada nivel reparte todos los puntos, los grupos de una
+// ventana cubren sus puntos y con zoom alto salen los puntos exactos.
+static void testClusters(const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    ClusterOptions options;
+    options.maxZoom = 10;
+    options.rawZoom = 12;
+    options.rawLimit = 500;
+    options.maxClusters = 400;
+    ClusteredIndex clustered(std::make_shared<RTreeIndex>(16), options);
+    clustered.build(pts);
+
+    for (int z = 0; z <= options.maxZoom; ++z) {
+        const auto world = clustered.clusterQuery(-90, -180, 90, 180, z);
+        size_t total = 0;
+        for (const auto& c : world.clusters) total += c.count;
+        CHECK(!world.raw && total == pts.size());
+        CHECK(world.clusters.size() <= options.maxClusters);
+        CHECK(world.zoom <= z && (world.zoom == z || clustered.clusterCount(world.zoom + 1) > options.maxClusters));
+    }
+    for (const auto& w : q.windows) {
+        for (const int z : {3, 8, 14}) {
+            const auto r = clustered.clusterQuery(w.minLat, w.minLon, w.maxLat, w.maxLon, z);
+            const size_t inside = bruteRange(pts, w);
+            if (r.raw) {
+                CHECK(z >= options.rawZoom && r.points.size() == inside && inside <= options.rawLimit);
+                continue;
+            }
+            size_t covered = 0;
+            for (const auto& c : r.clusters) covered += c.count;
+            CHECK(covered >= inside);
+            CHECK(r.clusters.size() <= options.maxClusters);
+        }
+    }
+
+    // insert() deja la pirámide pendiente y la primera consulta la calcula igual que build()
+    ClusteredIndex lazy(std::make_shared<RTreeIndex>(16), options);
+    lazy.insert(std::vector<Geoname>(pts.begin(), pts.begin() + pts.size() / 2));
+    lazy.insert(pts);
+    CHECK(lazy.dirty());
+    for (const int z : {0, 5, options.maxZoom}) {
+        const auto a = lazy.clusterQuery(-90, -180, 90, 180, z);
+        const auto b = clustered.clusterQuery(-90, -180, 90, 180, z);
+        CHECK(!lazy.dirty() && a.zoom == b.zoom && a.clusters.size() == b.clusters.size());
+        for (size_t i = 0; i < std::min(a.clusters.size(), b.clusters.size()); ++i)
+            CHECK(a.clusters[i].count == b.clusters[i].count);
+    }
+    std::cout << "clusters: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Pirámide de teselas: cada tesela guarda cuántos puntos caen en ella y como
+// mucho featureCap, dentro de sus límites; las vacías no están en el fichero.
+static void testTiles(Index& index, const std::vector<Geoname>& pts, std::mt19937_64& rng) {
+    const int before = failures;
+    const std::string path = (std::filesystem::temp_directory_path() / "spatialcpp_test_tiles.sptiles").string();
+    TileOptions options;
+    options.maxZoom = 7;
+    options.featureCap = 300;
+    options.threads = 4;
+    const TileStats stats = writeTileArchive(index, path, options);
+    {
+        const TileArchive archive(path);
+        CHECK(archive.tileCount() == stats.tiles && archive.maxZoom() == options.maxZoom);
+        CHECK(std::filesystem::file_size(path) == stats.bytes);
+
+        size_t total = 0;
+        const size_t kept = archive.points(0, 0, 0).size();
+        CHECK(kept <= options.featureCap && kept > options.featureCap / 2);
+        decodeTile(archive.tile(0, 0, 0), 0, 0, 0, archive.extent(), &total);
+        CHECK(total == pts.size());
+
+        std::uniform_int_distribution<size_t> pick(0, pts.size() - 1);
+        for (int z = 1; z <= options.maxZoom; ++z) {
+            for (int s = 0; s < 20; ++s) {
+                const Geoname& g = pts[pick(rng)];
+                const uint64_t n = uint64_t(1) << z;
+                const uint32_t x = mercatorCell(mercatorX(g.longitude), n), y = mercatorCell(mercatorY(g.latitude), n);
+                const Rect w = tileBounds(z, x, y);
+                const auto points = decodeTile(archive.tile(z, x, y), z, x, y, archive.extent(), &total);
+                CHECK(total == bruteRange(pts, w));
+                CHECK(points.size() == std::min(total, options.featureCap) ||
+                      (total > options.featureCap && points.size() <= options.featureCap));
+                const double slack = 360.0 / n / archive.extent();
+                for (const auto& p : points) {
+                    CHECK(p.longitude >= w.minLon - slack && p.longitude <= w.maxLon + slack);
+                    CHECK(std::abs(p.latitude) > MERCATOR_MAX_LAT - 1 ||
+                          (p.latitude >= w.minLat - slack && p.latitude <= w.maxLat + slack));
+                }
+            }
+        }
+        CHECK(archive.tile(options.maxZoom + 1, 0, 0).empty());
+    }
+    std::filesystem::remove(path);
+    std::cout << "teselas: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// --- Índice particionado ---
+
+// Join por distancia contra la fuerza bruta: mismos pares (externo, interno).
+static void testDistanceJoin(PartitionedIndex& index, const std::vector<Geoname>& pts,
+                             const std::vector<Geoname>& outer, const double meters) {
+    const int before = failures;
+    auto key = [](const Geoname& a, const Geoname& b) {
+        return std::make_tuple(a.latitude, a.longitude, b.latitude, b.longitude);
+    };
+    std::vector<decltype(key(Geoname(), Geoname()))> got, want;
+    for (const auto& [a, b] : index.distanceJoin(outer, meters)) got.push_back(key(a, b));
+    for (const auto& a : outer)
+        for (const auto& b : pts)
+            if (haversine(a.latitude, a.longitude, b.latitude, b.longitude) <= meters) want.push_back(key(a, b));
+    std::sort(got.begin(), got.end());
+    std::sort(want.begin(), want.end());
+    CHECK(got == want);
+    CHECK(index.partitionCount() > 1);
+    std::cout << "partitioned join: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// --- Índice en disco ---
+
+static void testDiskIndex(const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_indexes").string();
+    std::filesystem::remove_all(dir);
+
+    auto check = [&](DiskRTreeIndex& index) {
+        for (const auto& w : q.windows) {
+            const Rectangle window(w.minLat, w.minLon, w.maxLat, w.maxLon);
+            CHECK(index.rangeQuery2D(window).size() == bruteRange(pts, w));
+            CHECK(index.countQuery2D(window) == bruteRange(pts, w));
+        }
+        CHECK(index.countQuery2D(Rectangle(-90, -180, 90, 180)) == pts.size());
+        for (const auto& c : q.centers) {
+            const Point2D p(c.latitude, c.longitude);
+            std::vector<double> got;
+            for (const auto& r : index.knnQuery2DGeo(p, 10)) got.push_back(haversine(p.x, p.y, r.x, r.y));
+            CHECK(sameDistances(got, bruteKnn(pts, Oracle(), p.x, p.y, 10)));
+            got.clear();
+            for (const auto& [m, r] : index.radiusQueryWithDistances(p, 150'000.0)) got.push_back(m);
+            CHECK(sameDistances(got, bruteRadius(pts, p.x, p.y, 150'000.0)));
+        }
+    };
+
+    {
+        DiskRTreeIndex index(dir, 64);
+        for (const auto& g : pts) index.insert2D(Point2D(g.latitude, g.longitude));
+        check(index);
+        index.flush();
+    }
+    {
+        // Reabierto y con las cachés vacías antes de cada consulta
+        DiskRTreeIndex index(dir, 64);
+        check(index);
+        index.dropCaches();
+        check(index);
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "disk: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Cursor de rangeQuery2DPage (20 bits de versión, 6 de hijo por nivel y 8 de
+// posición en la página): las páginas encadenadas juntan exactamente
+// rangeQuery2D, sin repetidos ni huecos. Con la raíz como única hoja
+// (DataPage::MAX_ENTRIES puntos), tras el insert que la parte y con el árbol
+// completo. Un cursor de antes de una inserción se rechaza; con pinVersion()
+// las páginas siguen viendo la versión fijada.
+static void testDiskPaging(const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_paging").string();
+    std::filesystem::remove_all(dir);
+
+    using Key = std::pair<double, double>;
+    auto sorted = [](const std::vector<Point2D>& found) {
+        std::vector<Key> out;
+        for (const auto& p : found) out.emplace_back(p.x, p.y);
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<Rectangle> windows{Rectangle(-90, -180, 90, 180)};
+    for (const auto& w : q.windows) windows.emplace_back(w.minLat, w.minLon, w.maxLat, w.maxLon);
+
+    // Devuelve el mayor cursor visto sin la marca de versión, para saber por
+    // qué niveles ha pasado
+    const uint64_t pathMask = (uint64_t(1) << 44) - 1;
+    auto check = [&](DiskRTreeIndex& index) {
+        uint64_t maxCursor = 0;
+        for (const auto& window : windows) {
+            const auto full = sorted(index.rangeQuery2D(window));
+            for (const size_t limit : {1, 7, 100}) {
+                QueryOptions opts;
+                opts.limit = limit;
+                std::vector<Point2D> paged;
+                for (size_t guard = 0; guard <= full.size(); ++guard) {
+                    const auto page = index.rangeQuery2DPage(window, opts);
+                    CHECK(page.results.size() <= limit);
+                    paged.insert(paged.end(), page.results.begin(), page.results.end());
+                    if (page.progress.done()) break;
+                    CHECK(page.progress.status == QueryStatus::LimitReached && page.results.size() == limit);
+                    maxCursor = std::max(maxCursor, page.progress.cursor & pathMask);
+                    opts.cursor = page.progress.cursor;
+                }
+                CHECK(sorted(paged) == full);
+            }
+        }
+        return maxCursor;
+    };
+
+    {
+        DiskRTreeIndex index(dir, 64);
+        size_t inserted = 0;
+        for (; inserted < DataPage::MAX_ENTRIES; ++inserted)
+            index.insert2D(Point2D(pts[inserted].latitude, pts[inserted].longitude));
+        // Raíz hoja: el cursor es solo la posición en la página
+        CHECK(check(index) < (uint64_t(1) << 8));
+        index.insert2D(Point2D(pts[inserted].latitude, pts[inserted].longitude));
+        ++inserted;
+        // Raíz partida: hay cursores en el segundo hijo de la raíz
+        CHECK(check(index) >= (uint64_t(1) << 38));
+        for (; inserted < pts.size(); ++inserted)
+            index.insert2D(Point2D(pts[inserted].latitude, pts[inserted].longitude));
+        check(index);
+        index.dropCaches();
+        check(index);
+
+        // Cursor tomado antes de una inserción
+        const Rectangle world(-90, -180, 90, 180);
+        QueryOptions opts;
+        opts.limit = 10;
+        const auto first = index.rangeQuery2DPage(world, opts);
+        CHECK(!first.progress.done());
+        index.insert2D(Point2D(0.5, 0.5));
+        opts.cursor = first.progress.cursor;
+        bool stale = false;
+        try {
+            index.rangeQuery2DPage(world, opts);
+        } catch (const std::runtime_error&) {
+            stale = true;
+        }
+        CHECK(stale);
+
+        // Versión fijada: las inserciones entre páginas no se ven ni rompen el cursor
+        const auto expected = sorted(index.rangeQuery2D(world));
+        {
+            auto version = index.pinVersion();
+            std::vector<Point2D> paged;
+            QueryOptions pinnedOpts;
+            pinnedOpts.limit = 500;
+            for (size_t guard = 0; guard <= expected.size(); ++guard) {
+                const auto page = index.rangeQuery2DPage(version, world, pinnedOpts);
+                paged.insert(paged.end(), page.results.begin(), page.results.end());
+                if (page.progress.done()) break;
+                pinnedOpts.cursor = page.progress.cursor;
+                for (int k = 0; k < 50; ++k) index.insert2D(Point2D(-k * 0.01, 1.0 + k * 0.01));
+            }
+            CHECK(sorted(paged) == expected);
+        }
+        CHECK(index.rangeQuery2D(world).size() > expected.size());
+    }
+
+    std::filesystem::remove_all(dir);
+    std::cout << "disk páginas: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Puntos 2D y 3D en el mismo índice (uno de cada dos es 3D, con z en
+// [-1000, 1000]): rangeQuery3D y knnQuery3D solo ven los 3D y coinciden con la
+// fuerza bruta, también reabierto y con las cachés vacías.
+static void testDisk3D(const std::vector<Geoname>& pts, const Queries& q, std::mt19937_64& rng) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_3d").string();
+    std::filesystem::remove_all(dir);
+
+    std::uniform_real_distribution<double> height(-1000.0, 1000.0);
+    std::vector<Geoname> flat;
+    std::vector<Point3D> solid;
+    for (size_t i = 0; i < pts.size(); ++i) {
+        if (i % 2) {
+            solid.emplace_back(pts[i].latitude, pts[i].longitude, height(rng));
+        } else {
+            flat.push_back(pts[i]);
+        }
+    }
+    std::vector<Box3D> boxes;
+    for (const auto& w : q.windows) {
+        const double z1 = height(rng), z2 = height(rng);
+        boxes.emplace_back(w.minLat, w.minLon, std::min(z1, z2), w.maxLat, w.maxLon, std::max(z1, z2));
+    }
+    boxes.emplace_back(-90, -180, -1000, 90, 180, 1000);
+    std::vector<Point3D> centers;
+    for (const auto& c : q.centers) centers.emplace_back(c.latitude, c.longitude, height(rng));
+
+    auto check = [&](DiskRTreeIndex& index) {
+        for (const auto& box : boxes) {
+            const auto got = index.rangeQuery3D(box);
+            const size_t expected = static_cast<size_t>(
+                std::count_if(solid.begin(), solid.end(), [&](const Point3D& p) { return box.contains(p); }));
+            CHECK(got.size() == expected);
+            CHECK(std::all_of(got.begin(), got.end(), [&](const Point3D& p) { return box.contains(p); }));
+        }
+        for (const auto& w : q.windows) {
+            const Rectangle window(w.minLat, w.minLon, w.maxLat, w.maxLon);
+            const size_t expected = static_cast<size_t>(std::count_if(
+                solid.begin(), solid.end(), [&](const Point3D& p) { return window.contains(Point2D(p.x, p.y)); }));
+            CHECK(index.rangeQuery3D(window).size() == expected);
+            CHECK(index.rangeQuery2D(window).size() == bruteRange(flat, w));
+        }
+        for (const auto& p : centers) {
+            for (const int k : {1, 10, 50}) {
+                std::vector<double> got, expected;
+                for (const auto& r : index.knnQuery3D(p, k)) got.push_back(distance3D(p, r));
+                for (const auto& r : solid) expected.push_back(distance3D(p, r));
+                std::sort(got.begin(), got.end());
+                std::sort(expected.begin(), expected.end());
+                expected.resize(std::min<size_t>(k, expected.size()));
+                CHECK(sameDistances(got, expected));
+            }
+        }
+    };
+
+    {
+        DiskRTreeIndex index(dir, 64);
+        for (size_t i = 0; i < std::max(flat.size(), solid.size()); ++i) {
+            if (i < flat.size()) index.insert2D(Point2D(flat[i].latitude, flat[i].longitude));
+            if (i < solid.size()) index.insert3D(solid[i]);
+        }
+        check(index);
+        index.flush();
+    }
+    {
+        DiskRTreeIndex index(dir, 64);
+        check(index);
+        index.dropCaches();
+        check(index);
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "disk 3D: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Intersección exacta polígono-ventana (bordes incluidos) sin franjas: algún
+// vértice dentro de la ventana, alguna arista que toca un lado, o la ventana
+// dentro del polígono.
+static bool bruteIntersects(const Polygon& poly, const Rectangle& r) {
+    auto orient = [](const Point2D& a, const Point2D& b, const Point2D& c) {
+        const double v = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        return (v > 0) - (v < 0);
+    };
+    auto within = [](const Point2D& a, const Point2D& b, const Point2D& c) {
+        return std::min(a.x, b.x) <= c.x && c.x <= std::max(a.x, b.x) &&
+               std::min(a.y, b.y) <= c.y && c.y <= std::max(a.y, b.y);
+    };
+    auto touch = [&](const Point2D& a, const Point2D& b, const Point2D& c, const Point2D& d) {
+        const int o1 = orient(a, b, c), o2 = orient(a, b, d), o3 = orient(c, d, a), o4 = orient(c, d, b);
+        if (o1 != o2 && o3 != o4) return true;
+        return (o1 == 0 && within(a, b, c)) || (o2 == 0 && within(a, b, d)) ||
+               (o3 == 0 && within(c, d, a)) || (o4 == 0 && within(c, d, b));
+    };
+    const Point2D corners[4] = {{r.x1, r.y1}, {r.x2, r.y1}, {r.x2, r.y2}, {r.x1, r.y2}};
+    const auto& v = poly.vertices;
+    for (size_t i = 0, j = v.size() - 1; i < v.size(); j = i++) {
+        if (r.contains(v[i])) return true;
+        for (int s = 0; s < 4; ++s) {
+            if (touch(v[j], v[i], corners[s], corners[(s + 1) % 4])) return true;
+        }
+    }
+    return poly.contains(corners[0]);
+}
+
+// Polígonos cóncavos de al menos 32 vértices: peines de coordenadas exactas,
+// para probar puntos y ventanas justo sobre aristas y vértices, y estrellas.
+// PreparedPolygon contra Polygon::contains y bruteIntersects, y su memoria con
+// un peine y una espiral de miles de vértices; stabQuery y rangeQueryPolygon
+// del índice en disco contra la fuerza bruta sobre todos los polígonos.
+static void testDiskPolygons(std::mt19937_64& rng) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_polygons").string();
+    std::filesystem::remove_all(dir);
+
+    std::vector<Polygon> polys;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int i = 0; i < 30; ++i) {
+        // Peine de 10 dientes: base [0, 20] x [0, 1] y dientes [2t, 2t + 1] x [1, 3]
+        const double s = i % 3 == 0 ? 0.5 : i % 3 == 1 ? 1.0 : 2.0;
+        const double ox = -85 + 3 * i, oy = std::floor(-170 + 330 * unit(rng));
+        std::vector<Point2D> v{{ox, oy}, {ox + 20 * s, oy}, {ox + 20 * s, oy + s}};
+        for (int t = 9; t >= 0; --t) {
+            v.emplace_back(ox + (2 * t + 1) * s, oy + s);
+            v.emplace_back(ox + (2 * t + 1) * s, oy + 3 * s);
+            v.emplace_back(ox + 2 * t * s, oy + 3 * s);
+            if (t > 0) v.emplace_back(ox + 2 * t * s, oy + s);
+        }
+        polys.emplace_back(v);
+    }
+    for (int i = 0; i < 30; ++i) {
+        // Estrella: radios alternos r y r / 3
+        const size_t n = 32 + 16 * (i % 4);
+        const double cx = -80 + 160 * unit(rng), cy = -170 + 340 * unit(rng), r = 0.5 + 4.5 * unit(rng);
+        std::vector<Point2D> v;
+        for (size_t k = 0; k < n; ++k) {
+            const double a = 2 * M_PI * k / n, rk = k % 2 ? r / 3 : r;
+            v.emplace_back(cx + rk * std::cos(a), cy + rk * std::sin(a));
+        }
+        polys.emplace_back(v);
+    }
+
+    // Sondas de cada polígono: vértices, puntos medios de las aristas, una
+    // rejilla de paso s / 2 sobre los peines y puntos al azar en su caja
+    std::vector<Point2D> probes;
+    std::vector<Rectangle> windows;
+    for (size_t i = 0; i < polys.size(); ++i) {
+        const auto& v = polys[i].vertices;
+        const Rectangle box = polys[i].getBoundingBox();
+        for (size_t a = 0, b = v.size() - 1; a < v.size(); b = a++) {
+            probes.push_back(v[a]);
+            probes.emplace_back((v[a].x + v[b].x) / 2, (v[a].y + v[b].y) / 2);
+        }
+        if (i < 30) {
+            const double step = (box.y2 - box.y1) / 6;
+            for (double x = box.x1 - step; x <= box.x2 + step; x += step) {
+                for (double y = box.y1 - step; y <= box.y2 + step; y += step) probes.emplace_back(x, y);
+            }
+            // Ventanas de la rejilla: degeneradas, que solo tocan un borde y que
+            // caen entre dos dientes
+            for (int k = 0; k < 12; ++k) {
+                const double x = box.x1 + step * std::floor(unit(rng) * 44), y = box.y1 + step * std::floor(unit(rng) * 8);
+                windows.emplace_back(x, y, x, y);
+                windows.emplace_back(x, y, x + step * (1 + k % 3), y + step * (1 + k % 2));
+            }
+        }
+        for (int k = 0; k < 40; ++k) {
+            probes.emplace_back(box.x1 + (box.x2 - box.x1) * unit(rng), box.y1 + (box.y2 - box.y1) * unit(rng));
+        }
+        for (int k = 0; k < 4; ++k) {
+            const double x = box.x1 + (box.x2 - box.x1) * unit(rng), y = box.y1 + (box.y2 - box.y1) * unit(rng);
+            const double w = (box.x2 - box.x1) * unit(rng) / 4, h = (box.y2 - box.y1) * unit(rng) / 4;
+            windows.emplace_back(x, y, x + w, y + h);
+        }
+    }
+    windows.emplace_back(-90, -180, 90, 180);
+
+    for (const auto& poly : polys) {
+        const PreparedPolygon prepared(poly);
+        const Rectangle box = poly.getBoundingBox();
+        for (const auto& p : probes) {
+            if (box.contains(p)) CHECK(prepared.contains(p) == poly.contains(p));
+        }
+        for (const auto& w : windows) {
+            if (box.intersects(w)) CHECK(prepared.intersects(w) == bruteIntersects(poly, w));
+        }
+    }
+
+    // Peine de 2000 dientes altos y espiral de 20 vueltas: casi todas las
+    // aristas cruzan casi todo el rango de y
+    std::vector<Polygon> large;
+    {
+        std::vector<Point2D> v{{0, 0}, {4000, 0}, {4000, 1}};
+        for (int t = 1999; t >= 0; --t) {
+            v.emplace_back(2 * t + 1, 1);
+            v.emplace_back(2 * t + 1, 1000);
+            v.emplace_back(2 * t, 1000);
+            if (t > 0) v.emplace_back(2 * t, 1);
+        }
+        large.emplace_back(v);
+        v.clear();
+        const int steps = 4000;
+        for (int k = 0; k <= steps; ++k) {
+            const double a = 40 * M_PI * k / steps, r = 1 + a / 4;
+            v.emplace_back(r * std::cos(a), r * std::sin(a));
+        }
+        for (int k = steps; k >= 0; --k) {
+            const double a = 40 * M_PI * k / steps, r = 1 + a / 4 - 0.5;
+            v.emplace_back(r * std::cos(a), r * std::sin(a));
+        }
+        large.emplace_back(v);
+    }
+    for (const auto& poly : large) {
+        const PreparedPolygon prepared(poly);
+        CHECK(prepared.getMemorySize() <= sizeof(PreparedPolygon) + 64 * poly.vertices.size());
+        const Rectangle box = poly.getBoundingBox();
+        for (int k = 0; k < 2000; ++k) {
+            const Point2D p(box.x1 + (box.x2 - box.x1) * unit(rng), box.y1 + (box.y2 - box.y1) * unit(rng));
+            CHECK(prepared.contains(p) == poly.contains(p));
+        }
+        for (int k = 0; k < 200; ++k) {
+            const double x = box.x1 + (box.x2 - box.x1) * unit(rng), y = box.y1 + (box.y2 - box.y1) * unit(rng);
+            const double w = (box.x2 - box.x1) * unit(rng) / 50, h = (box.y2 - box.y1) * unit(rng) / 50;
+            const Rectangle window(x, y, x + w, y + h);
+            CHECK(prepared.intersects(window) == bruteIntersects(poly, window));
+        }
+    }
+
+    // Un polígono se reconoce por su número de vértices y su primer vértice
+    using Key = std::tuple<size_t, double, double>;
+    auto keys = [](const std::vector<Polygon>& found) {
+        std::vector<Key> out;
+        for (const auto& p : found) out.emplace_back(p.vertices.size(), p.vertices[0].x, p.vertices[0].y);
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    auto check = [&](DiskRTreeIndex& index) {
+        for (size_t i = 0; i < probes.size(); i += 7) {
+            std::vector<Polygon> expected;
+            for (const auto& poly : polys) {
+                if (poly.contains(probes[i])) expected.push_back(poly);
+            }
+            CHECK(keys(index.stabQuery(probes[i])) == keys(expected));
+        }
+        for (const auto& w : windows) {
+            std::vector<Polygon> expected;
+            for (const auto& poly : polys) {
+                if (poly.getBoundingBox().intersects(w) && bruteIntersects(poly, w)) expected.push_back(poly);
+            }
+            CHECK(keys(index.rangeQueryPolygon(w)) == keys(expected));
+        }
+    };
+    {
+        DiskRTreeIndex index(dir, 64);
+        for (const auto& poly : polys) index.insertPolygon(poly);
+        check(index);
+        index.flush();
+    }
+    {
+        DiskRTreeIndex index(dir, 64);
+        check(index);
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "disk polígonos: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// Borrados, movimientos y compactación: se compara con la lista de puntos vivos.
+static void testDiskUpdates(const std::vector<Geoname>& pts, const Queries& q, std::mt19937_64& rng) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_updates").string();
+    std::filesystem::remove_all(dir);
+
+    auto check = [&](DiskRTreeIndex& index, const std::vector<Geoname>& live) {
+        for (const auto& w : q.windows) {
+            const Rectangle window(w.minLat, w.minLon, w.maxLat, w.maxLon);
+            CHECK(index.rangeQuery2D(window).size() == bruteRange(live, w));
+            CHECK(index.countQuery2D(window) == bruteRange(live, w));
+        }
+        for (const auto& c : q.centers) {
+            const Point2D p(c.latitude, c.longitude);
+            std::vector<double> got;
+            for (const auto& r : index.knnQuery2DGeo(p, 10)) got.push_back(haversine(p.x, p.y, r.x, r.y));
+            CHECK(sameDistances(got, bruteKnn(live, Oracle(), p.x, p.y, 10)));
+        }
+        CHECK(index.idCount() == live.size());
+        for (size_t i = 0; i < live.size(); i += 53) {
+            const auto p = index.getById(live[i].geonameId);
+            CHECK(p && p->x == live[i].latitude && p->y == live[i].longitude);
+        }
+    };
+
+    std::vector<Geoname> live(pts);
+    {
+        DiskRTreeIndex index(dir, 64);
+        for (size_t i = 0; i < pts.size(); ++i) index.insert2D(Point2D(pts[i].latitude, pts[i].longitude), i);
+
+        // Un tercio fuera (la mitad por punto y la mitad por id) y otro tercio
+        // movido. Por punto solo los que no comparten coordenadas con otro.
+        std::map<std::pair<double, double>, int> copies;
+        for (const auto& g : pts) ++copies[{g.latitude, g.longitude}];
+        auto unique = [&](const Geoname& g) { return copies[{g.latitude, g.longitude}] == 1; };
+        std::vector<size_t> order(pts.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        const size_t third = pts.size() / 3;
+        std::vector<bool> removed(pts.size(), false);
+        for (size_t r = 0; r < third; ++r) {
+            const size_t i = order[r];
+            const bool ok = r % 2 || !unique(pts[i]) ? index.removeById(i)
+                                                     : index.remove2D(Point2D(pts[i].latitude, pts[i].longitude));
+            CHECK(ok);
+            removed[i] = true;
+        }
+        CHECK(!index.removeById(order[0]));
+        CHECK(!index.getById(order[0]));
+        CHECK(!index.update(order[0], Point2D(0, 0)));
+        bool threw = false;
+        try {
+            index.insert2D(Point2D(0, 0), order[third]);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        CHECK(threw);
+        std::uniform_real_distribution<double> shift(-2.0, 2.0);
+        for (size_t r = third; r < 2 * third; ++r) {
+            Geoname& g = live[order[r]];
+            const Point2D from(g.latitude, g.longitude);
+            const bool byId = r % 2 || !unique(g);
+            g.latitude = std::clamp(g.latitude + shift(rng), -90.0, 90.0);
+            g.longitude = std::clamp(g.longitude + shift(rng), -180.0, 180.0);
+            CHECK(byId ? index.update(order[r], Point2D(g.latitude, g.longitude))
+                        : index.update(from, Point2D(g.latitude, g.longitude)));
+        }
+        std::vector<Geoname> kept;
+        for (size_t i = 0; i < live.size(); ++i) {
+            if (!removed[i]) kept.push_back(live[i]);
+        }
+        live.swap(kept);
+        check(index, live);
+        CHECK(index.rangeQuery2D(Rectangle(-90, -180, 90, 180)).size() == live.size());
+
+        // Compactación en los dos órdenes: menos bytes y las mismas respuestas
+        size_t reported = 0;
+        const auto stats = index.compact(DiskRTreeIndex::CompactOrder::STR,
+                                         [&](size_t done, size_t) { reported = done; });
+        CHECK(reported == stats.pagesBefore);
+        CHECK(stats.bytesAfter < stats.bytesBefore);
+        CHECK(stats.pagesAfter <= stats.pagesBefore);
+        check(index, live);
+        index.compact(DiskRTreeIndex::CompactOrder::Hilbert);
+        index.dropCaches();
+        check(index, live);
+
+        // Si progress lanza, la compactación se deshace y la siguiente funciona
+        bool cancelled = false;
+        try {
+            index.compact(DiskRTreeIndex::CompactOrder::STR, [](size_t done, size_t) {
+                if (done == 3) throw std::runtime_error("cancelada");
+            });
+        } catch (const std::runtime_error&) {
+            cancelled = true;
+        }
+        CHECK(cancelled);
+        CHECK(!std::filesystem::exists(dir + "/data.bin.compact"));
+        check(index, live);
+        index.compact(DiskRTreeIndex::CompactOrder::STR);
+        index.dropCaches();
+        check(index, live);
+    }
+    {
+        // Reabierto: los ids sobreviven y se puede seguir borrando
+        DiskRTreeIndex index(dir, 64);
+        check(index, live);
+        CHECK(index.removeById(live.front().geonameId));
+        CHECK(index.rangeQuery2D(Rectangle(-90, -180, 90, 180)).size() == live.size() - 1);
+
+        // Vaciar del todo (hojas vacías, nodos por debajo del mínimo y la raíz
+        // bajando de nivel) y volver a llenar
+        for (size_t i = 1; i < live.size(); ++i) {
+            CHECK(index.remove2D(Point2D(live[i].latitude, live[i].longitude)));
+            if (i % 500 == 0) check(index, std::vector<Geoname>(live.begin() + i + 1, live.end()));
+        }
+        CHECK(index.rangeQuery2D(Rectangle(-90, -180, 90, 180)).empty());
+        CHECK(index.knnQuery2DGeo(Point2D(0, 0), 5).empty());
+        for (const auto& g : live) index.insert2D(Point2D(g.latitude, g.longitude), g.geonameId);
+        check(index, live);
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "disk borrados/compactación: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+// --- Capa LSM ---
+
+static void testLsmIndex(const std::vector<Geoname>& pts, const Queries& q) {
+    const int before = failures;
+    const std::string dir = (std::filesystem::temp_directory_path() / "spatialcpp_test_lsm").string();
+    std::filesystem::remove_all(dir);
+
+    // Con `inserted` puntos dentro (memtable, runs y fusiones en curso)
+    auto check = [&](LsmRTreeIndex& index, const size_t inserted) {
+        const std::vector<Geoname> in(pts.begin(), pts.begin() + inserted);
+        CHECK(index.size() == inserted);
+        for (const auto& w : q.windows) {
+            const Rectangle window(w.minLat, w.minLon, w.maxLat, w.maxLon);
+            CHECK(index.rangeQuery2D(window).size() == bruteRange(in, w));
+        }
+        for (const auto& c : q.centers) {
+            const Point2D p(c.latitude, c.longitude);
+            std::vector<double> got;
+            for (const auto& r : index.knnQuery2DGeo(p, 10)) got.push_back(haversine(p.x, p.y, r.x, r.y));
+            CHECK(sameDistances(got, bruteKnn(in, Oracle(), p.x, p.y, 10)));
+            got.clear();
+            for (const auto& [m, r] : index.radiusQueryWithDistances(p, 150'000.0)) got.push_back(m);
+            CHECK(sameDistances(got, bruteRadius(in, p.x, p.y, 150'000.0)));
+        }
+    };
+
+    LsmOptions options;
+    options.memtableCapacity = 400;
+    options.mergeFactor = 3;
+    {
+        LsmRTreeIndex index(dir, options);
+        for (size_t i = 0; i < pts.size(); ++i) {
+            index.insert2D(Point2D(pts[i].latitude, pts[i].longitude));
+            if (i + 1 == pts.size() / 2) check(index, i + 1);
+        }
+        check(index, pts.size());
+    }
+    {
+        LsmRTreeIndex index(dir, options);
+        check(index, pts.size());
+        index.compact();
+        CHECK(index.runCount() == 1);
+        check(index, pts.size());
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "lsm: " << (failures == before ? "ok" : "FALLA") << "\n";
+}
+
+int main() {
+    for (const std::string dataset : {"uniform", "clustered", "geonames"}) {
+        std::mt19937_64 rng(11);
+        const auto pts = makeDataset(dataset, 20'000, rng);
+        const auto q = makeQueries(pts, rng);
+        std::cout << "== " << dataset << "\n";
+        testHaversineBatch(pts, q);
+
+        RTreeIndex str(16, RTreeIndex::BuildMode::STR);
+        testMemoryIndex("rtree STR", str, pts, pts, q);
+        RTreeIndex hilbert(16, RTreeIndex::BuildMode::Hilbert);
+        testMemoryIndex("rtree Hilbert", hilbert, pts, pts, q);
+        GridIndex grid(32, 32);
+        testMemoryIndex("grid", grid, pts, pts, q);
+
+        // Otras configuraciones de las plantillas: grado fijo (con bloques de
+        // hijos rellenos si el grado es menor), float y métrica plana
+        BasicRTreeIndex<double, 16> fixed16(16, RTreeIndex::BuildMode::STR);
+        testMemoryIndex("rtree<double, 16> STR", fixed16, pts, pts, q);
+        BasicRTreeIndex<double, 32> padded(12, RTreeIndex::BuildMode::Hilbert);
+        testMemoryIndex("rtree<double, 32> grado 12 Hilbert", padded, pts, pts, q);
+
+        Oracle meters;
+        meters.tolerance = 5.0;
+        const auto stored = roundedTo<float>(pts);
+        BasicRTreeIndex<float, 16> f16str(16, RTreeIndex::BuildMode::STR);
+        testMemoryIndex("rtree<float, 16> STR", f16str, pts, stored, q, meters);
+        BasicRTreeIndex<float, 32> f32hilbert(32, RTreeIndex::BuildMode::Hilbert);
+        testMemoryIndex("rtree<float, 32> Hilbert", f32hilbert, pts, stored, q, meters);
+        BasicGridIndex<float> gridF(32, 32);
+        testMemoryIndex("grid<float>", gridF, pts, stored, q, meters);
+        CHECK(f16str.memoryUsage() < str.memoryUsage());
+        CHECK(gridF.memoryUsage() < grid.memoryUsage());
+
+        BasicRTreeIndex<double, 0, PlanarMetric> planar(16, RTreeIndex::BuildMode::STR);
+        testMemoryIndex("rtree planar", planar, pts, pts, q, planarOracle(0.0));
+        BasicGridIndex<float, PlanarMetric> gridPlanar(32, 32);
+        testMemoryIndex("grid<float> planar", gridPlanar, pts, stored, q, planarOracle(1e-4));
+
+        // Particiones con índices locales (en paralelo con 4 hilos)
+        auto localRTree = [] { return std::make_unique<RTreeIndex>(16, RTreeIndex::BuildMode::STR); };
+        for (const auto scheme : {PartitionScheme::Grid, PartitionScheme::STR, PartitionScheme::KdTree}) {
+            PartitionedIndex parts(localRTree, scheme, 12, 4);
+            testMemoryIndex(std::string("partitioned ") + (scheme == PartitionScheme::Grid ? "grid"
+                            : scheme == PartitionScheme::STR ? "STR" : "kd") + " / rtree", parts, pts, pts, q);
+        }
+        PartitionedIndex partsGrid([] { return std::make_unique<GridIndex>(16, 16); }, PartitionScheme::KdTree, 8, 4);
+        testMemoryIndex("partitioned kd / grid", partsGrid, pts, pts, q);
+        PlannedIndex planned;
+        testMemoryIndex("planned", planned, pts, pts, q);
+        testPlanner(planned, pts, q);
+
+        testAggregate("rtree Hilbert", hilbert, pts, pts, q);
+        testAggregate("rtree<float, 16> STR", f16str, pts, stored, q);
+        testAggregate("grid<float>", gridF, pts, stored, q);
+        testAggregate("partitioned kd / grid", partsGrid, pts, pts, q);
+        testNamePrefix("rtree STR", str, pts, q, rng);
+        testNamePrefix("rtree Hilbert", hilbert, pts, q, rng);
+        testNamePrefix("grid", grid, pts, q, rng);
+        testNamePrefix("partitioned kd / grid", partsGrid, pts, q, rng);
+        testParallelScan("rtree STR", str, pts, q);
+        testParallelScan("rtree Hilbert", hilbert, pts, q);
+        testParallelScan("grid", grid, pts, q);
+        testClusters(pts, q);
+        testTiles(grid, pts, rng);
+        testDistanceJoin(partsGrid, pts, std::vector<Geoname>(pts.begin(), pts.begin() + 500), 20'000.0);
+
+        // El índice en disco inserta de uno en uno: basta con un subconjunto
+        const std::vector<Geoname> sub(pts.begin(), pts.begin() + 5'000);
+        testDiskIndex(sub, makeQueries(sub, rng, 30));
+        testDisk3D(sub, makeQueries(sub, rng, 30), rng);
+        testDiskPaging(sub, makeQueries(sub, rng, 30));
+        testDiskPolygons(rng);
+        testDiskUpdates(sub, makeQueries(sub, rng, 30), rng);
+        testLsmIndex(sub, makeQueries(sub, rng, 30));
+    }
+    if (failures) std::cerr << failures << " comprobaciones fallidas\n";
+    return failures ? 1 : 0;
+}